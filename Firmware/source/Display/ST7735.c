@@ -1,14 +1,30 @@
 #include "ST7735.h"
+#include "hardware.h"
+#include "main.h"
 
 uint8_t display_x = 0;
 uint8_t display_y = 0;
 
+//Pixels are sent in RGB444 format (COLMOD 0x03), two pixels in three bytes.
+//Table is indexed by two color indexes, see DISPLAY_PAIR_IDX.
 //Better in RAM
-uint16_t color_convert_table[COLOR_ENUM_SIZE];
+uint32_t color_pair_table[COLOR_ENUM_SIZE * COLOR_ENUM_SIZE];
+
+//Display is shifted left by this number of pixels, see "display_set_scroll"
+//Framebuffer is a copy of LCD RAM: display column "x" is stored in
+//framebuffer column (x + display_scroll_offset) % DISP_WIDTH
+uint16_t display_scroll_offset = 0;
+
+//Offset that is set in LCD, differs from "display_scroll_offset" after 
+//"display_reset_scroll" until the framebuffer is sent
+uint16_t display_lcd_scroll_offset = 0;
 
 void display_spi_init(void);
 void LCD_SetCursor(uint16_t Xstart, uint16_t Ystart, uint16_t Xend, uint16_t  Yend);
 void display_init_conv_table(void);
+void display_send_pixel_pair(uint32_t pair);
+void display_send_last_pixel(uint8_t color);
+void display_sync_scroll(void);
 
 //***************************************************************************
 
@@ -124,13 +140,33 @@ void display_set_contrast_value(unsigned char value)
 
 void display_init_conv_table(void)
 {
-  color_convert_table[COLOR_BLACK] = 0x0000;
-  color_convert_table[COLOR_WHITE] = 0xFFFF;
-  color_convert_table[COLOR_RED] = 0xF800;
-  color_convert_table[COLOR_GREEN] = 0x07E0;
-  color_convert_table[COLOR_BLUE] = 0x001F;
-  color_convert_table[COLOR_YELLOW] = 0xFFE0;
-  color_convert_table[COLOR_GRAY] = 0X8430;
+  uint16_t color12[COLOR_ENUM_SIZE];
+  
+  color12[COLOR_BLACK] = 0x000;
+  color12[COLOR_WHITE] = 0xFFF;
+  color12[COLOR_RED] = 0xF00;
+  color12[COLOR_GREEN] = 0x0F0;
+  color12[COLOR_BLUE] = 0x00F;
+  color12[COLOR_YELLOW] = 0xFF0;
+  color12[COLOR_GRAY] = 0x888;
+  color12[COLOR_GRADE_1] = 0x006;
+  color12[COLOR_GRADE_2] = 0x00C;
+  color12[COLOR_GRADE_3] = 0x06F;
+  color12[COLOR_GRADE_4] = 0x0FF;
+  color12[COLOR_GRADE_5] = 0x0F4;
+  color12[COLOR_GRADE_6] = 0xFF0;
+  color12[COLOR_GRADE_7] = 0xF80;
+  color12[COLOR_GRADE_8] = 0xFFF;
+  
+  //First pixel is placed to the upper 12 bits of 24-bit pair
+  for (uint8_t first = 0; first < COLOR_ENUM_SIZE; first++)
+  {
+    for (uint8_t second = 0; second < COLOR_ENUM_SIZE; second++)
+    {
+      color_pair_table[DISPLAY_PAIR_IDX(first, second)] = 
+        ((uint32_t)color12[first] << 12) | color12[second];
+    }
+  }
 }
 
 // Initialize display
@@ -231,12 +267,23 @@ void display_init(void)
   display_write_data8(0x0E);
   display_write_data8(0x10);
 
-  display_write_cmd(0x3A); 
-  display_write_data8(0x05);
+  display_write_cmd(0x3A);//COLMOD
+  display_write_data8(0x03);//12 bit/pixel
 
   display_write_cmd(0x36);
   display_write_data8(0xA8);//
 
+  //Vertical scroll area is made of all visible RAM rows.
+  //Panel is rotated by MADCTL (MV), so RAM rows are display columns.
+  display_write_cmd(0x33);//VSCRDEF
+  display_write_data8(0x00);
+  display_write_data8(DISPLAY_SCROLL_TOP_ROWS);
+  display_write_data8(0x00);
+  display_write_data8(DISP_WIDTH);
+  display_write_data8(0x00);
+  display_write_data8(DISPLAY_SCROLL_BOTTOM_ROWS);
+  display_set_scroll(0);
+
   display_write_cmd(0x29); 
 
   display_delay(100000);
@@ -274,37 +321,150 @@ void LCD_SetCursor(uint16_t Xstart, uint16_t Ystart, uint16_t Xend, uint16_t  Ye
 }
 
 //Send data from framebuffer to LCD
+//Framebuffer is a copy of LCD RAM, so current scroll is kept
 void display_send_full_framebuffer(uint8_t* data)
+{
+  uint32_t start_ticks = hardware_dwt_get();
+  display_sync_scroll();
+  LCD_SetCursor(0, 0, DISP_WIDTH - 1, DISP_HEIGHT - 1);
+  display_send_pixels(data, DISP_WIDTH * DISP_HEIGHT);
+  hardware_profile_store(HARDWARE_PROFILE_SEND_FRAMEBUFFER, start_ticks);
+}
+
+//Send rectangle of the display, x - display column
+//LCD RAM and framebuffer column is shifted by current scroll, 
+//rectangle can be split at the end of the ring
+void display_send_framebuffer_rect(
+  uint8_t* data, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+  display_sync_scroll();
+  uint16_t ram_x = (x + display_scroll_offset) % DISP_WIDTH;
+  uint16_t part_width = width;
+  if ((ram_x + width) > DISP_WIDTH)
+    part_width = DISP_WIDTH - ram_x;
+
+  LCD_SetCursor(ram_x, y, ram_x + part_width - 1, y + height - 1);
+  display_send_rect_pixels(&data[y * DISP_WIDTH + ram_x], part_width, height);
+  if (part_width < width)
+  {
+    LCD_SetCursor(0, y, width - part_width - 1, y + height - 1);
+    display_send_rect_pixels(&data[y * DISP_WIDTH], width - part_width, height);
+  }
+}
+
+//Shift displayed image left by "offset" pixels, LCD RAM is not changed.
+//Column "x" of the display is showing LCD RAM column (x + offset).
+//MADCTL MY flag mirrors RAM rows, so scroll start row is counted back.
+void display_set_scroll(uint16_t offset)
+{
+  display_scroll_offset = offset % DISP_WIDTH;
+  uint16_t start_row = DISPLAY_SCROLL_TOP_ROWS + 
+    (DISP_WIDTH - display_scroll_offset) % DISP_WIDTH;
+
+  display_write_cmd(0x37);//VSCRSADD
+  display_write_data8(start_row >> 8);
+  display_write_data8(start_row);
+  display_lcd_scroll_offset = display_scroll_offset;
+}
+
+uint16_t display_get_scroll(void)
+{
+  return display_scroll_offset;
+}
+
+//Framebuffer is cleared - next image is drawn without shift,
+//LCD scroll is changed when framebuffer is sent
+void display_reset_scroll(void)
+{
+  display_scroll_offset = 0;
+}
+
+void display_sync_scroll(void)
+{
+  if (display_lcd_scroll_offset != display_scroll_offset)
+    display_set_scroll(display_scroll_offset);
+}
+
+//Send two RGB444 pixels - three bytes
+//SPI registers are accessed directly - SPL functions are located in Flash
+CCM_RAM_FUNC void display_send_pixel_pair(uint32_t pair)
+{
+  __IO uint8_t* spi_dr = (__IO uint8_t*)&DISPLAY_SPI_NAME->DR;
+  
+  while ((DISPLAY_SPI_NAME->SR & SPI_I2S_FLAG_TXE) == 0) {}
+  *spi_dr = (uint8_t)(pair >> 16);
+  while ((DISPLAY_SPI_NAME->SR & SPI_I2S_FLAG_TXE) == 0) {}
+  *spi_dr = (uint8_t)(pair >> 8);
+  while ((DISPLAY_SPI_NAME->SR & SPI_I2S_FLAG_TXE) == 0) {}
+  *spi_dr = (uint8_t)pair;
+}
+
+//Send last pixel of the odd count - two bytes, 4 padding bits are not 
+//making a complete pixel, so they are dropped by the display
+CCM_RAM_FUNC void display_send_last_pixel(uint8_t color)
+{
+  __IO uint8_t* spi_dr = (__IO uint8_t*)&DISPLAY_SPI_NAME->DR;
+  uint32_t pair = color_pair_table[DISPLAY_PAIR_IDX(color, COLOR_BLACK)];
+  
+  while ((DISPLAY_SPI_NAME->SR & SPI_I2S_FLAG_TXE) == 0) {}
+  *spi_dr = (uint8_t)(pair >> 16);
+  while ((DISPLAY_SPI_NAME->SR & SPI_I2S_FLAG_TXE) == 0) {}
+  *spi_dr = (uint8_t)(pair >> 8);
+}
+
+//Send "count" pixels to the LCD RAM
+CCM_RAM_FUNC void display_send_pixels(uint8_t* data, uint16_t count)
 {
   uint8_t* tmp_ptr = data;
   
-  LCD_SetCursor(0, 0, DISP_WIDTH - 1, DISP_HEIGHT - 1);
-  for(uint16_t y = 0; y < DISP_HEIGHT; y++)
+  DISPLAY_CS_N_GPIO->BRR = DISPLAY_CS_N_PIN;//CS low
+  DISPLAY_DC_N_GPIO->BSRR = DISPLAY_DC_N_PIN;//DC high - data
+  
+  for (uint16_t i = 0; i < (count / 2); i++)
+  {
+    display_send_pixel_pair(color_pair_table[DISPLAY_PAIR_IDX(tmp_ptr[0], tmp_ptr[1])]);
+    tmp_ptr += 2;
+  }
+  if (count & 1)
+    display_send_last_pixel(*tmp_ptr);
+  
+  while (DISPLAY_SPI_NAME->SR & SPI_I2S_FLAG_BSY) {}
+  DISPLAY_CS_N_GPIO->BSRR = DISPLAY_CS_N_PIN;//CS high
+}
+
+//Send "width" x "height" pixels, "data" lines are DISP_WIDTH pixels long
+//Pixel pairs are continued across the lines, as display RAM is written
+CCM_RAM_FUNC void display_send_rect_pixels(uint8_t* data, uint16_t width, uint16_t height)
+{
+  uint8_t first_color = 0;
+  uint8_t first_flag = 0;//first pixel of the pair is waiting
+  
+  DISPLAY_CS_N_GPIO->BRR = DISPLAY_CS_N_PIN;//CS low
+  DISPLAY_DC_N_GPIO->BSRR = DISPLAY_DC_N_PIN;//DC high - data
+  
+  for (uint16_t y = 0; y < height; y++)
   {
-    DISP_CSN_SET_LOW;
-    DISP_DC_SET_HIGH;
-    
-    for(uint16_t x = 0; x < DISP_WIDTH; x++)
+    uint8_t* tmp_ptr = &data[y * DISP_WIDTH];
+    for (uint16_t x = 0; x < width; x++)
     {
-      uint16_t color16 = color_convert_table[*tmp_ptr];
-      uint8_t tmp = (color16 >> 8) & 0xff;
-      
-      while(SPI_I2S_GetFlagStatus(DISPLAY_SPI_NAME, SPI_I2S_FLAG_TXE) == RESET) {}
-      SPI_SendData8(DISPLAY_SPI_NAME, tmp);
-      while(SPI_I2S_GetFlagStatus(DISPLAY_SPI_NAME, SPI_I2S_FLAG_TXE) == RESET) {}
-      SPI_SendData8(DISPLAY_SPI_NAME, (color16 & 0xFF));
-      /*
-      SPI_SendData8(DISPLAY_SPI_NAME, tmp);
-      while(SPI_I2S_GetFlagStatus(DISPLAY_SPI_NAME, SPI_I2S_FLAG_BSY) == SET) {}
-      SPI_SendData8(DISPLAY_SPI_NAME, (color16 & 0xFF));
-      while(SPI_I2S_GetFlagStatus(DISPLAY_SPI_NAME, SPI_I2S_FLAG_BSY) == SET) {}
-      */
+      if (first_flag == 0)
+      {
+        first_color = *tmp_ptr;
+        first_flag = 1;
+      }
+      else
+      {
+        display_send_pixel_pair(color_pair_table[DISPLAY_PAIR_IDX(first_color, *tmp_ptr)]);
+        first_flag = 0;
+      }
       tmp_ptr++;
     }
-    while(SPI_I2S_GetFlagStatus(DISPLAY_SPI_NAME, SPI_I2S_FLAG_BSY) == SET) {}
-    DISP_CSN_SET_HIGH;
-    //tmp_ptr += LCD_WIDTH;
   }
+  if (first_flag)
+    display_send_last_pixel(first_color);
+  
+  while (DISPLAY_SPI_NAME->SR & SPI_I2S_FLAG_BSY) {}
+  DISPLAY_CS_N_GPIO->BSRR = DISPLAY_CS_N_PIN;//CS high
 }
 
 //Init SPI for display communication
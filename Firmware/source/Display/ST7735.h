@@ -19,7 +19,16 @@ typedef enum
   COLOR_BLUE = 4,
   COLOR_YELLOW = 5,
   COLOR_GRAY = 6,
-  COLOR_ENUM_SIZE
+  //Intensity graded colours of the persistence display, dim to bright
+  COLOR_GRADE_1,
+  COLOR_GRADE_2,
+  COLOR_GRADE_3,
+  COLOR_GRADE_4,
+  COLOR_GRADE_5,
+  COLOR_GRADE_6,
+  COLOR_GRADE_7,
+  COLOR_GRADE_8,
+  COLOR_ENUM_SIZE//must be <= 16, see "display_layers_store_background"
 } color_enum_t;
 
 //#define INVERT_MODE				1 // Rotate display
@@ -36,6 +45,13 @@ typedef enum
 #define DISP_WIDTH                      160
 #define DISP_HEIGHT                     80
 
+//Index in the pixel pair table
+#define DISPLAY_PAIR_IDX(first, second) ((first) * COLOR_ENUM_SIZE + (second))
+
+//LCD RAM rows around visible part, RAM has 162 rows
+#define DISPLAY_SCROLL_TOP_ROWS         1
+#define DISPLAY_SCROLL_BOTTOM_ROWS      1
+
 
 void display_init_pins(void);
 
@@ -61,5 +77,12 @@ void display_putch_inv(unsigned char c);
 void display_puts(char *s);
 void display_puts_inv(char *s);
 void display_send_full_framebuffer(uint8_t* data);
+void display_send_pixels(uint8_t* data, uint16_t count);
+void display_send_rect_pixels(uint8_t* data, uint16_t width, uint16_t height);
+void display_send_framebuffer_rect(
+  uint8_t* data, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+void display_set_scroll(uint16_t offset);
+uint16_t display_get_scroll(void);
+void display_reset_scroll(void);
 
 #endif
@@ -2,6 +2,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "display_functions.h"
+#include "main.h"
 
 /* Private variables ---------------------------------------------------------*/
 uint16_t display_cursor_text_x = 0;
@@ -13,6 +14,7 @@ uint8_t display_framebuffer[DISPLAY_WIDTH*DISPLAY_HEIGHT];
 volatile uint32_t display_update_time = 0;
 
 extern volatile uint32_t ms_tick;
+extern uint16_t display_scroll_offset;
 
 /* Private function prototypes -----------------------------------------------*/
 void display_draw_char_size8(uint8_t chr, uint16_t x_start, uint16_t y_start, uint8_t flags, uint8_t color);
@@ -24,12 +26,16 @@ void draw_char_line33(uint16_t line_data, uint16_t x_start, uint16_t y_pos, uint
 
 /* Private functions ---------------------------------------------------------*/
 
-void display_set_pixel_color(uint16_t x, uint16_t y, uint8_t color)
+CCM_RAM_FUNC void display_set_pixel_color(uint16_t x, uint16_t y, uint8_t color)
 {
   uint16_t loc_x = x + LCD_LEFT_OFFSET;
-  if (loc_x > LCD_RIGHT_OFFSET)
+  if ((loc_x > LCD_RIGHT_OFFSET) || (y >= DISPLAY_HEIGHT))
     return;
   
+  //Framebuffer is a ring of columns, see "display_scroll_left"
+  loc_x += display_scroll_offset;
+  if (loc_x >= DISPLAY_WIDTH)
+    loc_x -= DISPLAY_WIDTH;
   uint32_t word_pos = y * DISPLAY_WIDTH + loc_x;
   display_framebuffer[word_pos] = color;
 }
@@ -37,6 +43,7 @@ void display_set_pixel_color(uint16_t x, uint16_t y, uint8_t color)
 void display_clear_framebuffer(void)
 {
   memset(display_framebuffer, 0, sizeof(display_framebuffer));
+  display_reset_scroll();
   display_cursor_text_x = 0;
   display_cursor_text_y = 0;
 }
@@ -44,6 +51,7 @@ void display_clear_framebuffer(void)
 void display_full_clear(void)
 {
   memset(display_framebuffer, 0, sizeof(display_framebuffer));
+  display_reset_scroll();
   display_clear();
   display_cursor_text_x = 0;
   display_cursor_text_y = 0;
@@ -62,6 +70,35 @@ void display_update(void)
   display_update_time = ms_tick - start_time;
 }
 
+//Send only part of the framebuffer
+void display_update_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+  display_send_framebuffer_rect(display_framebuffer, x, y, width, height);
+}
+
+//Move displayed image left, freed columns at the right are black
+//Framebuffer is not moved: like LCD RAM, it is a ring of columns shifted 
+//by the scroll offset, so only the freed columns are cleared.
+//Freed columns must be drawn and sent by "display_update_rect"
+void display_scroll_left(uint16_t pixels)
+{
+  if (pixels >= DISPLAY_WIDTH)
+    return;
+  
+  //Columns that are moved out at the left are shown at the right
+  uint16_t offset = display_get_scroll();
+  uint16_t part_width = pixels;
+  if ((offset + pixels) > DISPLAY_WIDTH)
+    part_width = DISPLAY_WIDTH - offset;
+  for (uint16_t y = 0; y < DISPLAY_HEIGHT; y++)
+  {
+    uint8_t* line = &display_framebuffer[y * DISPLAY_WIDTH];
+    memset(&line[offset], COLOR_BLACK, part_width);
+    memset(line, COLOR_BLACK, pixels - part_width);
+  }
+  display_set_scroll(offset + pixels);
+}
+
 //x, y - in pixel
 //return string width
 //String end is 0x00 char
@@ -330,14 +367,14 @@ void draw_caption_bar(uint8_t height, uint8_t color)
 }
 
 //Horizontal line
-void display_draw_line(uint16_t y, uint8_t color)
+CCM_RAM_FUNC void display_draw_line(uint16_t y, uint8_t color)
 {
   uint16_t x_pos;
   for (x_pos = 0; x_pos <= LCD_RIGHT_OFFSET; x_pos++)
     display_set_pixel_color(x_pos, y, color);
 }
 
-void display_draw_vertical_line(uint16_t x, uint16_t y1, uint16_t y2, uint8_t color)
+CCM_RAM_FUNC void display_draw_vertical_line(uint16_t x, uint16_t y1, uint16_t y2, uint8_t color)
 {
   //y1 must be less than y2
   if (y1 > y2)
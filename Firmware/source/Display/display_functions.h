@@ -33,6 +33,8 @@
 void display_full_clear(void);
 void display_clear_framebuffer(void);
 void display_update(void);
+void display_update_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+void display_scroll_left(uint16_t pixels);
 void display_set_pixel_color(uint16_t x, uint16_t y, uint8_t color);
 
 void display_draw_char(uint8_t chr, uint16_t x, uint16_t y, uint8_t font_size, uint8_t flags, uint8_t color);
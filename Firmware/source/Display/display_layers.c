@@ -0,0 +1,122 @@
+//Two-layer compositor over the framebuffer.
+//Static layer (titles, outlines, markers) is drawn to the framebuffer once
+//after mode change and stored in a packed cache.
+//Dynamic layer is redrawn in its rectangles only: rectangle is restored
+//from the cache, dynamic items are drawn over it and only dirty rectangles
+//are sent to the display.
+//Framebuffer is accessed without scroll offset - it is reset by
+//"display_clear_framebuffer" and modes with layers don't scroll.
+
+/* Includes ------------------------------------------------------------------*/
+#include "display_layers.h"
+#include "main.h"
+
+/* Private define ------------------------------------------------------------*/
+//Background pixel is 4 bits - color_enum_t index
+#define DISPLAY_LAYERS_PIXEL_BITS       4
+#define DISPLAY_LAYERS_PIXEL_MASK       0x0F
+
+/* Private variables ---------------------------------------------------------*/
+extern uint8_t display_framebuffer[DISPLAY_WIDTH*DISPLAY_HEIGHT];
+
+//Two pixels per byte, even pixel is in low nibble
+uint8_t display_layers_background[DISPLAY_WIDTH * DISPLAY_HEIGHT / 2];
+uint8_t display_layers_background_flag = 0;
+
+display_rect_t display_layers_dirty[DISPLAY_LAYERS_MAX_DIRTY];
+uint8_t display_layers_dirty_cnt = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+
+/* Private functions ---------------------------------------------------------*/
+
+// Start drawing of the static layer
+void display_layers_begin_background(void)
+{
+  display_clear_framebuffer();
+  display_layers_dirty_cnt = 0;
+}
+
+// Current framebuffer becomes the static layer
+void display_layers_store_background(void)
+{
+  for (uint16_t i = 0; i < sizeof(display_layers_background); i++)
+  {
+    display_layers_background[i] =
+      (display_framebuffer[i * 2] & DISPLAY_LAYERS_PIXEL_MASK) |
+      (display_framebuffer[i * 2 + 1] << DISPLAY_LAYERS_PIXEL_BITS);
+  }
+  display_layers_background_flag = 1;
+}
+
+// Static layer must be drawn again - mode or autoscale is changed
+void display_layers_invalidate(void)
+{
+  display_layers_background_flag = 0;
+  display_layers_dirty_cnt = 0;
+}
+
+uint8_t display_layers_background_valid(void)
+{
+  return display_layers_background_flag;
+}
+
+// Copy static layer to the framebuffer rectangle, rectangle becomes dirty
+void display_layers_restore_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+  if (((x + width) > DISPLAY_WIDTH) || ((y + height) > DISPLAY_HEIGHT))
+    return;
+
+  for (uint16_t line = y; line < (y + height); line++)
+  {
+    uint32_t pos = (uint32_t)line * DISPLAY_WIDTH + x;
+    for (uint16_t i = 0; i < width; i++, pos++)
+    {
+      uint8_t packed = display_layers_background[pos >> 1];
+      if (pos & 1)
+        packed >>= DISPLAY_LAYERS_PIXEL_BITS;
+      display_framebuffer[pos] = packed & DISPLAY_LAYERS_PIXEL_MASK;
+    }
+  }
+  display_layers_mark_dirty(x, y, width, height);
+}
+
+// Rectangle will be sent by "display_layers_flush"
+// If there is no free place, rectangle is merged with the last one
+void display_layers_mark_dirty(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+  if (display_layers_dirty_cnt < DISPLAY_LAYERS_MAX_DIRTY)
+  {
+    display_rect_t* rect = &display_layers_dirty[display_layers_dirty_cnt++];
+    rect->x = x;
+    rect->y = y;
+    rect->width = width;
+    rect->height = height;
+    return;
+  }
+
+  display_rect_t* rect = &display_layers_dirty[DISPLAY_LAYERS_MAX_DIRTY - 1];
+  uint16_t x_end = rect->x + rect->width;
+  uint16_t y_end = rect->y + rect->height;
+  if ((x + width) > x_end)
+    x_end = x + width;
+  if ((y + height) > y_end)
+    y_end = y + height;
+  if (x < rect->x)
+    rect->x = x;
+  if (y < rect->y)
+    rect->y = y;
+  rect->width = x_end - rect->x;
+  rect->height = y_end - rect->y;
+}
+
+// Send dirty rectangles to the display
+void display_layers_flush(void)
+{
+  for (uint8_t i = 0; i < display_layers_dirty_cnt; i++)
+  {
+    display_rect_t* rect = &display_layers_dirty[i];
+    display_update_rect(rect->x, rect->y, rect->width, rect->height);
+  }
+  display_layers_dirty_cnt = 0;
+}
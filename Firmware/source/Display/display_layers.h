@@ -0,0 +1,27 @@
+#ifndef __DISPLAY_LAYERS_H
+#define __DISPLAY_LAYERS_H
+
+#include "stdint.h"
+#include "display_functions.h"
+
+// Maximum number of separately sent dirty rectangles
+#define DISPLAY_LAYERS_MAX_DIRTY        4
+
+typedef struct
+{
+  uint16_t x;
+  uint16_t y;
+  uint16_t width;
+  uint16_t height;
+} display_rect_t;
+
+void display_layers_begin_background(void);
+void display_layers_store_background(void);
+void display_layers_invalidate(void);
+uint8_t display_layers_background_valid(void);
+
+void display_layers_restore_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+void display_layers_mark_dirty(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+void display_layers_flush(void);
+
+#endif
@@ -0,0 +1,403 @@
+//Acquisition engine - single owner of ADC1/ADC2 + DMA
+//Modes are queuing capture jobs, engine runs them back-to-back using two
+//buffers: DMA is writing one buffer while main loop processes the other.
+//Processing results are passed to renderer through single-producer /
+//single-consumer mailbox, so ADC is never waiting for display update.
+
+/* Includes ------------------------------------------------------------------*/
+#include "acquisition.h"
+#include "adc_controlling.h"
+#include "generator_timer.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "string.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  ACQ_BUFFER_FREE = 0,
+  ACQ_BUFFER_CAPTURE,//DMA is writing it
+  ACQ_BUFFER_READY,//waiting for processing
+} acq_buffer_state_t;
+
+typedef struct
+{
+  volatile uint16_t* data;
+  const acq_job_t* job;
+  float sample_rate;//achieved rate of the capture, Hz
+  uint8_t opamp_gain;//OPAMP gain index of the capture
+  volatile acq_buffer_state_t state;
+  volatile uint8_t half_ready;//first half is captured
+  uint8_t half_processed;//first half is offset-corrected and passed to "partial_cb"
+  uint8_t result_done;//"partial_cb" has published result
+} acq_buffer_t;
+
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+acq_buffer_t acq_buffers[ACQ_BUFFERS_CNT];
+
+// Size of each buffer in points, 0 - no buffers in this mode
+uint16_t acq_buffer_points = 0;
+
+// Buffer that would be used for next capture
+uint8_t acq_capture_idx = 0;
+
+// Buffer that would be processed next
+uint8_t acq_process_idx = 0;
+
+// 1 - DMA is running
+volatile uint8_t acq_capture_running = 0;
+
+// Achieved sample rate of the buffer passed to the callback, Hz
+float acq_cb_sample_rate = 0.0f;
+
+// Jobs waiting for ADC, accessed from DMA interrupt
+const acq_job_t* acq_queue[ACQ_QUEUE_SIZE];
+volatile uint8_t acq_queue_cnt = 0;
+
+// Mailbox: "head" is written only by producer, "tail" only by consumer
+acq_result_t acq_mailbox[ACQ_MAILBOX_SIZE];
+volatile uint8_t acq_mailbox_head = 0;
+volatile uint8_t acq_mailbox_tail = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+void acquisition_partial_handler(void);
+void acquisition_start_next(void);
+const acq_job_t* acquisition_queue_pop(void);
+uint8_t acquisition_queue_push(const acq_job_t* job);
+
+/* Private functions ---------------------------------------------------------*/
+
+// Stop capture, drop all jobs and results. Buffers are released too.
+// Must be called before "mode_arena_reset".
+void acquisition_reset(void)
+{
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  capture_dma_stop();
+  acq_capture_running = 0;
+  acq_queue_cnt = 0;
+  LEAVE_CRITICAL(int_state);
+
+  for (uint8_t i = 0; i < ACQ_BUFFERS_CNT; i++)
+  {
+    acq_buffers[i].data = NULL;
+    acq_buffers[i].job = NULL;
+    acq_buffers[i].state = ACQ_BUFFER_FREE;
+    acq_buffers[i].half_ready = 0;
+  }
+  acq_buffer_points = 0;
+  acq_capture_idx = 0;
+  acq_process_idx = 0;
+  acq_mailbox_head = 0;
+  acq_mailbox_tail = 0;
+}
+
+// Stop running capture and drop queued jobs, buffers are kept.
+// Used when trigger is not coming.
+void acquisition_abort(void)
+{
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  capture_dma_stop();
+  if (acq_buffers[acq_capture_idx].state == ACQ_BUFFER_CAPTURE)
+    acq_buffers[acq_capture_idx].state = ACQ_BUFFER_FREE;
+  acq_capture_running = 0;
+  acq_queue_cnt = 0;
+  LEAVE_CRITICAL(int_state);
+}
+
+// Stop running capture, its buffer is processed as if capture is done.
+// Used to get segments that were captured before trigger has stopped coming.
+void acquisition_finish(void)
+{
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  if (acq_capture_running)
+  {
+    capture_dma_stop();
+    acquisition_capture_done();
+  }
+  LEAVE_CRITICAL(int_state);
+}
+
+// Allocate capture buffers for the current mode from "mode_arena"
+// max_points - biggest "points" value of mode jobs
+void acquisition_allocate_buffers(uint16_t max_points)
+{
+  for (uint8_t i = 0; i < ACQ_BUFFERS_CNT; i++)
+  {
+    acq_buffers[i].data = (volatile uint16_t*)mode_arena_alloc(
+      (uint32_t)max_points * 2 * sizeof(uint16_t));
+  }
+  acq_buffer_points = max_points;
+}
+
+// Add job to the queue, capture is started if ADC is idle
+// Return 1 if job is added
+uint8_t acquisition_submit(const acq_job_t* job)
+{
+  if ((job->points > acq_buffer_points) || (job->points == 0))
+    return 0;
+
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  uint8_t result = acquisition_queue_push(job);
+  if (acq_capture_running == 0)
+    acquisition_start_next();
+  LEAVE_CRITICAL(int_state);
+  return result;
+}
+
+// Remove job from the queue. Capture that is already running is finished.
+void acquisition_cancel(const acq_job_t* job)
+{
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  uint8_t new_cnt = 0;
+  for (uint8_t i = 0; i < acq_queue_cnt; i++)
+  {
+    if (acq_queue[i] != job)
+    {
+      acq_queue[new_cnt] = acq_queue[i];
+      new_cnt++;
+    }
+  }
+  acq_queue_cnt = new_cnt;
+  LEAVE_CRITICAL(int_state);
+}
+
+// Process captured buffers - called from "data_processing_handler"
+void acquisition_handler(void)
+{
+  acq_buffer_t* buffer = &acq_buffers[acq_process_idx];
+
+  while (buffer->state == ACQ_BUFFER_READY)
+  {
+    const acq_job_t* job = buffer->job;
+    uint16_t* data = (uint16_t*)buffer->data;
+    uint16_t start = buffer->half_processed ? (job->points / 2) : 0;
+
+    if (buffer->result_done == 0)
+    {
+      data_processing_correct_raw_data(&data[start * 2], job->points - start,
+        data_processing_get_adc_offset(job->sample_rate));
+      data_processing_set_opamp_gain(buffer->opamp_gain);
+      data_processing_fuse_samples(&data[start * 2], job->points - start);
+      data_processing_auto_range();//gain for the next captures
+      acq_cb_sample_rate = buffer->sample_rate;
+      if (job->process_cb != NULL)
+        job->process_cb(data, job->points);
+    }
+
+    buffer->state = ACQ_BUFFER_FREE;
+    acq_process_idx = (acq_process_idx + 1) % ACQ_BUFFERS_CNT;
+    buffer = &acq_buffers[acq_process_idx];
+
+    // ADC could be waiting for free buffer
+    uint32_t int_state;
+    ENTER_CRITICAL(int_state);
+    if (acq_capture_running == 0)
+      acquisition_start_next();
+    LEAVE_CRITICAL(int_state);
+  }
+
+  acquisition_partial_handler();
+}
+
+// Return real sample rate of the buffer passed to the job callback, Hz
+// Can differ from "job->sample_rate" - see "adc_plan_sample_rate"
+float acquisition_get_sample_rate(void)
+{
+  return acq_cb_sample_rate;
+}
+
+// Return 1 if capture path is not using Flash during the next "time_us":
+// ADC is idle, or untriggered capture would not end earlier.
+// DMA interrupt is in CCM RAM, but next capture is started from Flash code,
+// so Flash erase must fit into the running capture.
+uint8_t acquisition_is_flash_free(uint32_t time_us)
+{
+  uint32_t int_state;
+  uint8_t result = 1;
+  
+  ENTER_CRITICAL(int_state);
+  if (acq_capture_running)
+  {
+    acq_buffer_t* buffer = &acq_buffers[acq_capture_idx];
+    const acq_job_t* job = buffer->job;
+    
+    //End of triggered capture is not known
+    if ((job->trigger != ACQ_TRIGGER_NONE) || (job->segments > 1))
+      result = 0;
+    else if (((float)adc_get_points_left() * 1e6f / buffer->sample_rate) < (float)time_us)
+      result = 0;
+  }
+  LEAVE_CRITICAL(int_state);
+  return result;
+}
+
+// Pass first half of the running capture to "partial_cb"
+// If the job is sure about result, capture is stopped and next job is started
+void acquisition_partial_handler(void)
+{
+  acq_buffer_t* buffer = &acq_buffers[acq_capture_idx];
+  const acq_job_t* job = buffer->job;
+
+  if ((buffer->state != ACQ_BUFFER_CAPTURE) || (buffer->half_ready == 0) || 
+      buffer->half_processed)
+    return;
+  if ((job == NULL) || (job->partial_cb == NULL))
+    return;
+
+  uint16_t* data = (uint16_t*)buffer->data;
+  uint16_t half_points = job->points / 2;
+
+  data_processing_correct_raw_data(data, half_points,
+    data_processing_get_adc_offset(job->sample_rate));
+  data_processing_set_opamp_gain(buffer->opamp_gain);
+  data_processing_fuse_samples(data, half_points);
+  buffer->half_processed = 1;
+  acq_cb_sample_rate = buffer->sample_rate;
+  if (job->partial_cb(data, half_points) == 0)
+    return;//full capture is needed
+
+  buffer->result_done = 1;
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  if (buffer->state == ACQ_BUFFER_CAPTURE)
+  {
+    //Buffer is reused for the next capture
+    capture_dma_stop();
+    buffer->state = ACQ_BUFFER_FREE;
+    acq_capture_running = 0;
+    acquisition_start_next();
+  }
+  //else - capture is already done, buffer is released by "acquisition_handler"
+  LEAVE_CRITICAL(int_state);
+}
+
+// Called from DMA interrupt when capture is finished
+CCM_RAM_FUNC void acquisition_capture_done(void)
+{
+  acq_capture_running = 0;
+  acq_buffers[acq_capture_idx].state = ACQ_BUFFER_READY;
+  acq_capture_idx = (acq_capture_idx + 1) % ACQ_BUFFERS_CNT;
+  acquisition_start_next();
+}
+
+// Called from DMA interrupt when first half of the buffer is captured
+CCM_RAM_FUNC void acquisition_capture_half_done(void)
+{
+  acq_buffers[acq_capture_idx].half_ready = 1;
+}
+
+// Start capture of the next job if there is free buffer
+// Must be called with interrupts disabled or from DMA interrupt
+CCM_RAM_FUNC void acquisition_start_next(void)
+{
+  acq_buffer_t* buffer = &acq_buffers[acq_capture_idx];
+  if ((buffer->state != ACQ_BUFFER_FREE) || (buffer->data == NULL))
+    return;
+
+  const acq_job_t* job = acquisition_queue_pop();
+  if (job == NULL)
+    return;
+
+  if (job->flags & ACQ_JOB_FLAG_CONTINUOUS)
+    acquisition_queue_push(job);//next capture is ready as soon as this one ends
+
+  if (adc_current_sample_rate != job->sample_rate)
+    adc_set_sample_rate(job->sample_rate);
+  adc_apply_opamp_gain();
+
+  buffer->job = job;
+  buffer->sample_rate = adc_achieved_sample_rate;
+  buffer->opamp_gain = adc_get_opamp_gain();
+  buffer->half_ready = 0;
+  buffer->half_processed = 0;
+  buffer->result_done = 0;
+  buffer->state = ACQ_BUFFER_CAPTURE;
+  acq_capture_running = 1;
+  adc_set_segments(job->points, job->segments);
+  adc_start_t start = ADC_START_NOW;
+  if (job->trigger == ACQ_TRIGGER_GENERATOR)
+    start = ADC_START_GENERATOR;
+  else if (job->trigger == ACQ_TRIGGER_COMPARATOR)
+    start = ADC_START_COMPARATOR;
+  else if (job->trigger == ACQ_TRIGGER_AWD)
+    start = ADC_START_AWD;
+  adc_capture_start(buffer->data, job->points, start);
+
+  if (job->trigger == ACQ_TRIGGER_GENERATOR)
+    generator_timer_start();//ADC_TIMER is started by generator TRGO
+}
+
+// Take job with highest priority, FIFO for same priority
+CCM_RAM_FUNC const acq_job_t* acquisition_queue_pop(void)
+{
+  if (acq_queue_cnt == 0)
+    return NULL;
+
+  uint8_t best_idx = 0;
+  for (uint8_t i = 1; i < acq_queue_cnt; i++)
+  {
+    if (acq_queue[i]->priority < acq_queue[best_idx]->priority)
+      best_idx = i;
+  }
+
+  const acq_job_t* job = acq_queue[best_idx];
+  for (uint8_t i = best_idx; i < (acq_queue_cnt - 1); i++)
+    acq_queue[i] = acq_queue[i + 1];
+  acq_queue_cnt--;
+  return job;
+}
+
+CCM_RAM_FUNC uint8_t acquisition_queue_push(const acq_job_t* job)
+{
+  if (acq_queue_cnt >= ACQ_QUEUE_SIZE)
+    return 0;
+  acq_queue[acq_queue_cnt] = job;
+  acq_queue_cnt++;
+  return 1;
+}
+
+//*****************************************************************************
+
+// Producer side. Return 0 if mailbox is full - result is dropped.
+uint8_t acquisition_mailbox_post(const acq_result_t* result)
+{
+  uint8_t head = acq_mailbox_head;
+  uint8_t next_head = (head + 1) % ACQ_MAILBOX_SIZE;
+  if (next_head == acq_mailbox_tail)
+    return 0;
+
+  acq_mailbox[head] = *result;
+  __DMB();//data must be written before head is moved
+  acq_mailbox_head = next_head;
+  return 1;
+}
+
+// Consumer side. Return 1 if result is read.
+uint8_t acquisition_mailbox_get(acq_result_t* result)
+{
+  uint8_t tail = acq_mailbox_tail;
+  if (tail == acq_mailbox_head)
+    return 0;
+
+  *result = acq_mailbox[tail];
+  __DMB();
+  acq_mailbox_tail = (tail + 1) % ACQ_MAILBOX_SIZE;
+  return 1;
+}
+
+// Read all pending results, only the newest is returned
+// Return 1 if there was at least one result
+uint8_t acquisition_mailbox_get_last(acq_result_t* result)
+{
+  uint8_t got = 0;
+  while (acquisition_mailbox_get(result))
+    got = 1;
+  return got;
+}
@@ -0,0 +1,102 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ACQUISITION_H
+#define __ACQUISITION_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f30x.h"
+#include "data_processing.h"
+
+/* Exported types ------------------------------------------------------------*/
+// Max number of jobs waiting for the ADC
+#define ACQ_QUEUE_SIZE                  (4)
+
+// Number of results that renderer can be late for
+#define ACQ_MAILBOX_SIZE                (4)
+
+// ADC is writing one buffer while the other one is processed
+#define ACQ_BUFFERS_CNT                 (2)
+
+// Smaller value - higher priority
+#define ACQ_PRIORITY_HIGH               (0)
+#define ACQ_PRIORITY_NORMAL             (1)
+#define ACQ_PRIORITY_LOW                (2)
+
+// Job is queued again when its capture is started
+#define ACQ_JOB_FLAG_CONTINUOUS         (1 << 0)
+
+typedef enum
+{
+  ACQ_TRIGGER_NONE = 0,//capture starts immediately
+  ACQ_TRIGGER_GENERATOR,//"generator timer" is restarted and starts ADC timer
+  ACQ_TRIGGER_COMPARATOR,//comparator edge starts ADC_ETS_TIMER - edge may never come
+  ACQ_TRIGGER_AWD,//ADC1 analog watchdog starts DMA - crossing may never come
+} acq_trigger_t;
+
+typedef enum
+{
+  ACQ_JOB_LOGIC_PROBE = 0,
+  ACQ_JOB_VOLTMETER,
+  ACQ_JOB_SLOW_SCOPE,
+  ACQ_JOB_FREQ_CALIBRATION,
+  ACQ_JOB_ADC_CALIBRATION,
+  ACQ_JOB_SPECTRUM,
+  ACQ_JOB_ETS_LEVEL,
+  ACQ_JOB_ETS,
+  ACQ_JOB_SEGMENTED,
+  ACQ_JOB_AVERAGE_LEVEL,
+  ACQ_JOB_AVERAGE,
+  ACQ_JOB_PERSISTENCE_LEVEL,
+  ACQ_JOB_PERSISTENCE,
+  ACQ_JOB_HISTOGRAM,
+} acq_job_id_t;
+
+// Called from main loop, buffer is already offset-corrected and fused:
+// ADC1 results are kept, ADC2 results are replaced by fused samples
+// buffer - ADC1/fused pairs, points - number of pairs
+typedef void (*acq_process_cb_t)(uint16_t* buffer, uint16_t points);
+
+// Called from main loop when first half of the buffer is captured
+// Return 1 if result is already known - rest of the capture is dropped
+typedef uint8_t (*acq_partial_cb_t)(uint16_t* buffer, uint16_t points);
+
+typedef struct
+{
+  acq_job_id_t id;
+  uint32_t sample_rate;//requested rate, Hz
+  uint16_t points;//number of captured points
+  acq_trigger_t trigger;
+  uint8_t priority;
+  uint8_t flags;
+  acq_process_cb_t process_cb;
+  acq_partial_cb_t partial_cb;//can be NULL
+  uint8_t segments;//0 - single capture, else "points" are split into segments
+} acq_job_t;
+
+// Data passed from processing to renderer
+typedef struct
+{
+  acq_job_id_t job_id;
+  signal_state_t signal_state;
+  float voltage;
+  adc_processed_data_t data;
+  adc_ac_data_t ac;
+} acq_result_t;
+
+/* Exported functions ------------------------------------------------------- */
+void acquisition_reset(void);
+void acquisition_abort(void);
+void acquisition_finish(void);
+void acquisition_allocate_buffers(uint16_t max_points);
+uint8_t acquisition_submit(const acq_job_t* job);
+void acquisition_cancel(const acq_job_t* job);
+void acquisition_handler(void);
+void acquisition_capture_done(void);
+void acquisition_capture_half_done(void);
+float acquisition_get_sample_rate(void);
+uint8_t acquisition_is_flash_free(uint32_t time_us);
+
+uint8_t acquisition_mailbox_post(const acq_result_t* result);
+uint8_t acquisition_mailbox_get(acq_result_t* result);
+uint8_t acquisition_mailbox_get_last(acq_result_t* result);
+
+#endif
@@ -1,13 +1,23 @@
 //DMA is working in Normal mode, not Circular
 //Two ADC are mesuring same signal simultaneously, 
 //but ADC2 is connected to integrated OPAMP
+//Segmented capture: buffer is split into segments, each segment is started
+//by comparator edge or by ADC1 analog watchdog. Next segment is armed by 
+//DMA interrupt.
+//Analog watchdog trigger: ADC is converting all the time, DMA is enabled by 
+//watchdog interrupt. AWD2 waits for the signal below the level, then AWD1 
+//waits for the rising crossing. Thresholds can be written only when ADC is 
+//stopped, so interrupts are switched instead of thresholds.
 
 /* Includes ------------------------------------------------------------------*/
 #include "config.h"
 
 #include "stm32f30x.h"
 #include "adc_controlling.h"
+#include "acquisition.h"
 #include "hardware.h"
+#include "main.h"
+#include "string.h"
 
 #include "stm32f30x_gpio.h"
 #include "stm32f30x_rcc.h"
@@ -15,24 +25,78 @@
 #include "stm32f30x_adc.h"
 #include "stm32f30x_dma.h"
 #include "stm32f30x_misc.h"
+#include "stm32f30x_opamp.h"
 
-// Buffer to store data from two main ADC's
-// Even elements - ADC1, odd - ADC2
-volatile uint16_t adc_raw_buffer0[ADC_BUFFER_SIZE];
+/* Private define ------------------------------------------------------------*/
+// Timer counters are 16-bit
+#define ADC_TIMER_MAX_COUNT             (0x10000UL)
 
-// Pointer to ADC buffer that is written now
-volatile uint16_t* data_write_adc_ptr = adc_raw_buffer0;
+// Conversion time without sampling, half-cycles of ADC clock
+#define ADC_CONVERSION_HALF_CYCLES      (25)
 
-volatile cap_status_type adc_capture_status = NO_CAPTURE;
+// Sampling must end earlier than next trigger, half-cycles
+#define ADC_TRIGGER_MARGIN_HALF_CYCLES  (4)
 
-//Hz
+// Auto-timebase: rate is changed by this factor when signal period is unknown
+#define ADC_AUTO_TIMEBASE_STEP          (10)
+
+// Auto-timebase: less points per signal period - undersampled signal
+#define ADC_AUTO_MIN_POINTS_PER_PERIOD  (8)
+
+/* Private variables ---------------------------------------------------------*/
+//Hz, requested by "adc_set_sample_rate"
 uint32_t adc_current_sample_rate = 0;
 
+//Hz, real rate, differs from requested because of timer resolution
+float adc_achieved_sample_rate = 0.0f;
+
+// 1 - ADC is triggered by ADC_ETS_TIMER
+volatile uint8_t adc_ets_trigger = 0;
+
+// 1 - DMA is started by analog watchdog interrupt
+volatile uint8_t adc_awd_trigger = 0;
+
+// Analog watchdog trigger level, ADC1 points
+uint16_t adc_awd_level = MAIN_ADC_HALF_VALUE;
+
+// First sample delay after comparator edge, ADC_ETS_TIMER ticks
+uint16_t adc_ets_delay = 0;
+
+// Segmented capture, "adc_segments_cnt" < 2 - single block is captured
+uint8_t adc_segments_cnt = 0;
+uint16_t adc_segment_points = 0;
+volatile uint16_t* adc_segment_buffer = NULL;
+volatile uint8_t adc_segments_done = 0;
+
+// DWT value at the end of each segment
+uint32_t adc_segment_times[ADC_MAX_SEGMENTS];
+
+// OPAMP PGA gains of auto-ranging, from the smallest one
+const uint32_t adc_opamp_gains[ADC_OPAMP_GAINS_CNT] =
+  {OPAMP_OPAMP_PGAGain_2, OPAMP_OPAMP_PGAGain_4, 
+   OPAMP_OPAMP_PGAGain_8, OPAMP_OPAMP_PGAGain_16};
+
+// Index of the gain set to OPAMP and the gain for the next capture
+uint8_t adc_opamp_gain_idx = ADC_OPAMP_GAIN_IDX;
+volatile uint8_t adc_opamp_gain_request = ADC_OPAMP_GAIN_IDX;
+
+// Duration of each ADC_SampleTime_x, half-cycles of ADC clock
+const uint16_t adc_sample_time_half_cycles[ADC_SAMPLE_TIMES_CNT] =
+  {3, 5, 9, 15, 39, 123, 363, 1203};
+
 /* Private function prototypes -----------------------------------------------*/
 void adc_dma_init(void);
 void adc_trigger_timer_init(void);
 void adc_init(void);
 void DMA1_Channel1_IRQHandler(void);
+void ADC1_2_IRQHandler(void);
+uint32_t adc_round_rate_125(uint32_t rate);
+void adc_stop_conversion(void);
+void adc_select_trigger(uint8_t ets_trigger);
+void adc_arm_ets_timer(void);
+void adc_set_awd_thresholds(void);
+void adc_arm_awd(void);
+void adc_next_segment(void);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -44,63 +108,443 @@ void adc_init_all(void)
 }
 
 //ADC DMA interrupts
-void DMA1_Channel1_IRQHandler(void)
+//Registers are accessed directly - SPL functions are located in Flash
+CCM_RAM_FUNC void DMA1_Channel1_IRQHandler(void)
 {
-  ADC_TIMER->CR1 &= (uint16_t)~TIM_CR1_CEN;//stop timer
+  uint32_t start_ticks = hardware_dwt_get();
 
-  if(DMA_GetITStatus(DMA1_IT_TC1))
+  if (DMA1->ISR & DMA1_IT_HT1)
   {
-    DMA_ClearITPendingBit(DMA1_IT_TC1);
-    DMA_Cmd(DMA1_Channel1, DISABLE);
+    DMA1->IFCR = DMA1_IT_HT1;
+    acquisition_capture_half_done();//can be processed while capture is running
+  }
 
-    adc_capture_status = CAPTURE_DONE;
+  if (DMA1->ISR & DMA1_IT_TC1)
+  {
+    if (adc_awd_trigger == 0)
+      ADC_TIMER->CR1 &= (uint16_t)~TIM_CR1_CEN;//stop timer
+    if (adc_ets_trigger)
+    {
+      ADC_ETS_TIMER->SMCR &= (uint16_t)~TIM_SMCR_SMS;//no new comparator starts
+      ADC_ETS_TIMER->CR1 &= (uint16_t)~TIM_CR1_CEN;
+    }
+    DMA1->IFCR = DMA1_IT_TC1;
+    DMA1_Channel1->CCR &= ~DMA_CCR_EN;
+
+    if (adc_segments_cnt > 1)
+    {
+      adc_segment_times[adc_segments_done] = start_ticks;
+      adc_segments_done++;
+      if (adc_segments_done < adc_segments_cnt)
+      {
+        adc_next_segment();//dead time is interrupt latency only
+        hardware_profile_store(HARDWARE_PROFILE_ADC_DMA_IRQ, start_ticks);
+        return;
+      }
+    }
+
+    ADC_TIMER->CR1 &= (uint16_t)~TIM_CR1_CEN;//watchdog trigger keeps it running
+    acquisition_capture_done();//next capture can be started here
   }
+  hardware_profile_store(HARDWARE_PROFILE_ADC_DMA_IRQ, start_ticks);
 }
 
+// ADC1 analog watchdog interrupts - start of the segment
+// First samples after the crossing are lost - interrupt latency
+CCM_RAM_FUNC void ADC1_2_IRQHandler(void)
+{
+  uint32_t flags = ADC1->ISR & ADC1->IER;
+
+  if (flags & ADC_ISR_AWD2)
+  {
+    //Signal is below the level - wait for the crossing
+    ADC1->IER &= ~ADC_IER_AWD2;
+    ADC1->ISR = ADC_ISR_AWD1 | ADC_ISR_AWD2;//cleared by writing 1
+    ADC1->IER |= ADC_IER_AWD1;
+  }
+  else if (flags & ADC_ISR_AWD1)
+  {
+    ADC1->IER &= ~ADC_IER_AWD1;
+    ADC1->ISR = ADC_ISR_AWD1;
+    
+    //DMA requests of one shot mode are enabled again by ADSTART
+    ADC1->ISR = ADC_FLAG_EOC | ADC_FLAG_OVR;
+    ADC2->ISR = ADC_FLAG_EOC | ADC_FLAG_OVR;
+    DMA1_Channel1->CCR |= DMA_CCR_EN;
+    ADC2->CR |= ADC_CR_ADSTART;
+    ADC1->CR |= ADC_CR_ADSTART;
+  }
+}
 
 // Configure DMA and start timer
-void adc_capture_start(void)
+// buffer - even elements - ADC1, odd - ADC2
+// points - number of captured points
+// start - ADC_START_GENERATOR: timer would be started by "generator_timer_start"
+void adc_capture_start(
+  volatile uint16_t* buffer, uint16_t points, adc_start_t start)
 {
+  adc_select_trigger(start == ADC_START_COMPARATOR);
+  adc_awd_trigger = (start == ADC_START_AWD);
+  if (adc_awd_trigger)
+    adc_set_awd_thresholds();
+
+  adc_segment_buffer = buffer;
+  adc_segments_done = 0;
+  if (adc_segments_cnt > 1)
+    points = adc_segment_points;
+
   DMA_Cmd(DMA1_Channel1, DISABLE);
-  DMA_ClearITPendingBit(DMA1_IT_TC1);
-  DMA1_Channel1->CNDTR = ADC_BUFFER_SIZE / 2;//two adc give one 32-bit "sample"
-  DMA1_Channel1->CMAR = (uint32_t)data_write_adc_ptr;
+  DMA_ClearITPendingBit(DMA1_IT_TC1 | DMA1_IT_HT1);
+  DMA1_Channel1->CNDTR = points;//two adc give one 32-bit "sample"
+  DMA1_Channel1->CMAR = (uint32_t)buffer;
   //DMA_ITConfig(DMA1_Channel1, DMA_IT_TC, ENABLE);
   ADC_ClearFlag(ADC1, ADC_FLAG_EOC|ADC_FLAG_OVR);
   ADC_ClearFlag(ADC2, ADC_FLAG_EOC|ADC_FLAG_OVR);
-  DMA_Cmd(DMA1_Channel1, ENABLE);
+  if (adc_awd_trigger == 0)
+    DMA_Cmd(DMA1_Channel1, ENABLE);//else enabled by watchdog interrupt
   
   ADC_StartConversion(ADC2);//??
   ADC_StartConversion(ADC1);
   
-  adc_start_trigger_timer();
+  if (start == ADC_START_COMPARATOR)
+    adc_arm_ets_timer();
+  else if (start == ADC_START_GENERATOR)
+    adc_arm_trigger_timer();
+  else
+  {
+    if (start == ADC_START_AWD)
+      adc_arm_awd();
+    adc_start_trigger_timer();
+  }
 }
 
 void capture_dma_stop(void)
 {
   TIM_Cmd(ADC_TIMER, DISABLE);
+  if (adc_ets_trigger)
+  {
+    ADC_ETS_TIMER->SMCR &= (uint16_t)~TIM_SMCR_SMS;
+    ADC_ETS_TIMER->CR1 &= (uint16_t)~TIM_CR1_CEN;
+  }
+  ADC1->IER &= ~(ADC_IER_AWD1 | ADC_IER_AWD2);
   DMA_Cmd(DMA1_Channel1, DISABLE);
-  DMA_ClearITPendingBit(DMA1_IT_TC1);
+  DMA_ClearITPendingBit(DMA1_IT_TC1 | DMA1_IT_HT1);
 }
 
 // Start timer that triggers ADC
 void adc_start_trigger_timer(void)
 {
   TIM_SetCounter(ADC_TIMER, 0);
-  adc_capture_status = CAPTURE_IN_PROCESS; 
+  ADC_TIMER->SMCR &= ~TIM_SMCR_SMS;//free running
   TIM_Cmd(ADC_TIMER, ENABLE);
 }
 
-//Set trigger timer frequency - Hz
-void adc_set_sample_rate(uint32_t frequency)
+// Timer is started by GENERATOR_TIMER TRGO (slave trigger mode)
+// So phase of every ADC sample relative to test signal is fixed
+void adc_arm_trigger_timer(void)
+{
+  TIM_Cmd(ADC_TIMER, DISABLE);
+  TIM_SetCounter(ADC_TIMER, 0);
+  TIM_SelectSlaveMode(ADC_TIMER, TIM_SlaveMode_Trigger);
+}
+
+// Equivalent-time sampling: ADC_ETS_TIMER is started by comparator rising edge,
+// so first sample is taken "adc_ets_delay + 1" ticks after the edge.
+// Sample period is copied from ADC_TIMER, its prescaler must be 0.
+CCM_RAM_FUNC void adc_arm_ets_timer(void)
+{
+  ADC_ETS_TIMER->SMCR &= (uint16_t)~TIM_SMCR_SMS;
+  ADC_ETS_TIMER->CR1 &= (uint16_t)~TIM_CR1_CEN;
+  ADC_ETS_TIMER->ARR = ADC_TIMER->ARR;
+  ADC_ETS_TIMER->CNT = ADC_TIMER->ARR - adc_ets_delay;
+  ADC_ETS_TIMER->SR = 0;
+  ADC_ETS_TIMER->SMCR |= TIM_SlaveMode_Trigger;
+}
+
+// delay - ADC_ETS_TIMER ticks, must be less than sample period
+void adc_set_ets_delay(uint16_t delay)
+{
+  adc_ets_delay = delay;
+}
+
+// Level of ADC_START_AWD trigger, used by next "adc_capture_start"
+// level - ADC1 points, rising crossing starts the segment
+void adc_set_awd_level(uint16_t level)
+{
+  if (level < 1)
+    level = 1;
+  adc_awd_level = level;
+}
+
+// AWD1: out of window when sample >= level
+// AWD2: 8 MSB are compared, out of window when sample is below the level
+// by more than one AWD2 step - this is hysteresis of the trigger
+void adc_set_awd_thresholds(void)
+{
+  uint32_t low_level = adc_awd_level >> 4;
+  if (low_level > 0)
+    low_level--;
+
+  //TR1 and TR2 can be changed only when conversions are stopped
+  adc_stop_conversion();
+  ADC1->TR1 = (uint32_t)(adc_awd_level - 1) << 16;
+  ADC1->TR2 = (0xFFUL << 16) | low_level;
+}
+
+// Wait for signal below the level, then for the rising crossing
+CCM_RAM_FUNC void adc_arm_awd(void)
+{
+  ADC1->IER &= ~ADC_IER_AWD1;
+  ADC1->ISR = ADC_ISR_AWD1 | ADC_ISR_AWD2;//cleared by writing 1
+  ADC1->IER |= ADC_IER_AWD2;
+}
+
+// Gain is changed before the next capture, running capture is not affected
+// gain_idx - index in "adc_opamp_gains"
+void adc_request_opamp_gain(uint8_t gain_idx)
+{
+  if (gain_idx < ADC_OPAMP_GAINS_CNT)
+    adc_opamp_gain_request = gain_idx;
+}
+
+// Called before capture start, ADC must be stopped
+// OPAMP output is settled before return if gain is changed
+void adc_apply_opamp_gain(void)
+{
+  uint8_t gain_idx = adc_opamp_gain_request;
+  if (gain_idx == adc_opamp_gain_idx)
+    return;
+
+  OPAMP_PGAConfig(ADC_OPAMP_NAME, adc_opamp_gains[gain_idx], OPAMP_PGAConnect_No);
+  adc_opamp_gain_idx = gain_idx;
+  dwt_delay_us(ADC_OPAMP_SETTLING_US);
+}
+
+// Index of the gain currently set to OPAMP
+uint8_t adc_get_opamp_gain(void)
+{
+  return adc_opamp_gain_idx;
+}
+
+// Number of points that DMA has not written yet (current segment)
+uint16_t adc_get_points_left(void)
 {
-  uint32_t period = SystemCoreClock / frequency;
-  if (period > 0xFFFF)
+  return (uint16_t)DMA1_Channel1->CNDTR;
+}
+
+// Used by next "adc_capture_start", capture must be stopped
+// points - whole buffer, it is split into "segments_cnt" equal segments
+// segments_cnt < 2 - single capture
+// Segmented capture must be started by ADC_START_COMPARATOR or ADC_START_AWD
+void adc_set_segments(uint16_t points, uint8_t segments_cnt)
+{
+  if (segments_cnt > ADC_MAX_SEGMENTS)
+    segments_cnt = ADC_MAX_SEGMENTS;
+  adc_segments_cnt = segments_cnt;
+  if (segments_cnt > 1)
+    adc_segment_points = points / segments_cnt;
+}
+
+// Number of segments of the last segmented capture
+uint8_t adc_get_segments_done(void)
+{
+  return adc_segments_done;
+}
+
+// Return DWT value at the end of the segment "idx"
+// Segment duration is fixed, so difference of two values is time between triggers
+uint32_t adc_get_segment_time(uint8_t idx)
+{
+  return adc_segment_times[idx];
+}
+
+// Called from DMA interrupt - capture next segment at next comparator edge
+// or next watchdog trigger
+// Registers are accessed directly - SPL functions are located in Flash
+CCM_RAM_FUNC void adc_next_segment(void)
+{
+  DMA1_Channel1->CMAR = (uint32_t)&adc_segment_buffer[
+    (uint32_t)adc_segments_done * adc_segment_points * 2];
+  DMA1_Channel1->CNDTR = adc_segment_points;
+  if (adc_awd_trigger)
+  {
+    adc_arm_awd();//ADC and its timer are still running
+    return;
+  }
+  ADC1->ISR = ADC_FLAG_EOC | ADC_FLAG_OVR;//cleared by writing 1
+  ADC2->ISR = ADC_FLAG_EOC | ADC_FLAG_OVR;
+  DMA1_Channel1->CCR |= DMA_CCR_EN;
+
+  //DMA requests of one shot mode are enabled again by ADSTART
+  ADC2->CR |= ADC_CR_ADSTART;
+  ADC1->CR |= ADC_CR_ADSTART;
+  adc_arm_ets_timer();
+}
+
+// Must be called when equivalent-time sampling mode is entered
+// Comparator output must be connected to ADC_ETS_TIMER IC2
+void adc_ets_timer_init(void)
+{
+  TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+  TIM_ICInitTypeDef TIM_ICInitStructure;
+
+  ADC_ETS_TIMER_CLK_INIT_F(ADC_ETS_TIMER_CLK, ENABLE);
+  TIM_DeInit(ADC_ETS_TIMER);
+
+  //UG made here is ignored - ADC is not triggered by this timer yet
+  TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+  TIM_TimeBaseStructure.TIM_Prescaler = 0;//delay resolution is one HCLK tick
+  TIM_TimeBaseStructure.TIM_Period = ADC_TIMER_PERIOD;
+  TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+  TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+  TIM_TimeBaseInit(ADC_ETS_TIMER, &TIM_TimeBaseStructure);
+
+  TIM_ICStructInit(&TIM_ICInitStructure);
+  TIM_ICInitStructure.TIM_Channel = TIM_Channel_2;
+  TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_Rising;
+  TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+  TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+  TIM_ICInitStructure.TIM_ICFilter = 0;
+  TIM_ICInit(ADC_ETS_TIMER, &TIM_ICInitStructure);
+
+  TIM_SelectOutputTrigger(ADC_ETS_TIMER, TIM_TRGOSource_Update);
+  //Slave mode is enabled only by "adc_arm_ets_timer"
+  TIM_SelectInputTrigger(ADC_ETS_TIMER, TIM_TS_TI2FP2);
+}
+
+// Switch ADC trigger between ADC_TIMER and ADC_ETS_TIMER
+void adc_select_trigger(uint8_t ets_trigger)
+{
+  if (adc_ets_trigger == ets_trigger)
+    return;
+
+  uint32_t source = ADC_TRIGGER_SOURCE;
+  if (ets_trigger)
+    source = ADC_ETS_TRIGGER_SOURCE;
+
+  //EXTSEL can be changed only when conversions are stopped
+  adc_stop_conversion();
+  ADC1->CFGR = (ADC1->CFGR & ~ADC_CFGR_EXTSEL) | source;
+  ADC2->CFGR = (ADC2->CFGR & ~ADC_CFGR_EXTSEL) | source;
+  adc_ets_trigger = ets_trigger;
+}
+
+void adc_stop_conversion(void)
+{
+  ADC_StopConversion(ADC1);
+  ADC_StopConversion(ADC2);
+  while ((ADC1->CR & ADC_CR_ADSTP) || (ADC2->CR & ADC_CR_ADSTP)) {};
+}
+
+// Find timer settings and ADC sampling time for given sample rate - Hz
+// Rate is limited to ADC_MIN_SAMPLE_RATE - ADC_MAX_SAMPLE_RATE
+adc_rate_plan_t adc_plan_sample_rate(uint32_t frequency)
+{
+  adc_rate_plan_t plan;
+
+  if (frequency < ADC_MIN_SAMPLE_RATE)
+    frequency = ADC_MIN_SAMPLE_RATE;
+
+  uint32_t ticks = (SystemCoreClock + frequency / 2) / frequency;
+  if (ticks < ADC_MIN_PERIOD_TICKS)
+    ticks = ADC_MIN_PERIOD_TICKS;
+
+  //Smallest prescaler gives best rate resolution
+  uint32_t divider = (ticks - 1) / ADC_TIMER_MAX_COUNT + 1;
+  uint32_t period = (ticks + divider / 2) / divider;
+  ticks = period * divider;
+
+  plan.prescaler = (uint16_t)(divider - 1);
+  plan.period = (uint16_t)(period - 1);
+  plan.rate = (float)SystemCoreClock / (float)ticks;
+
+  //Longest sampling time - smallest error from the source impedance
+  plan.sample_time = ADC_SampleTime_1Cycles5;
+  for (uint8_t i = 1; i < ADC_SAMPLE_TIMES_CNT; i++)
   {
-    while(1) {};//unexpected error
+    uint32_t conversion = adc_sample_time_half_cycles[i] + 
+      ADC_CONVERSION_HALF_CYCLES + ADC_TRIGGER_MARGIN_HALF_CYCLES;
+    if (conversion <= (ticks * 2))
+      plan.sample_time = i;
   }
+  return plan;
+}
+
+// Fastest sample rate that uses "sample_time" (ADC_SampleTime_x), Hz
+// "adc_plan_sample_rate" gives this sampling time for the returned rate
+uint32_t adc_get_sample_time_rate(uint8_t sample_time)
+{
+  uint32_t half_cycles = adc_sample_time_half_cycles[sample_time] + 
+    ADC_CONVERSION_HALF_CYCLES + ADC_TRIGGER_MARGIN_HALF_CYCLES;
+  uint32_t ticks = (half_cycles + 1) / 2;
+  if (ticks < ADC_MIN_PERIOD_TICKS)
+    ticks = ADC_MIN_PERIOD_TICKS;
+  return SystemCoreClock / ticks;
+}
+
+// Set trigger timer frequency - Hz
+// Capture must be stopped. Return achieved rate - Hz
+float adc_set_sample_rate(uint32_t frequency)
+{
+  adc_rate_plan_t plan = adc_plan_sample_rate(frequency);
+
+  //SMPR can be changed only when conversions are stopped
+  //Stopped ADC also ignores TRGO made by UG below
+  adc_stop_conversion();
+
+  ADC_RegularChannelConfig(ADC1, ADC_MAIN_IN_CHANNEL, 1, plan.sample_time);
+  ADC_RegularChannelConfig(ADC2, ADC_OPAMP_IN_CHANNEL, 1, plan.sample_time);
+
+  //PSC and ARR are preloaded - load them now
+  ADC_TIMER->PSC = plan.prescaler;
+  ADC_TIMER->ARR = plan.period;
+  ADC_TIMER->EGR = TIM_EGR_UG;
+  ADC_TIMER->SR = (uint16_t)~TIM_SR_UIF;
+
   adc_current_sample_rate = frequency;
-  TIM_SetAutoreload(ADC_TIMER, (period - 1));
+  adc_achieved_sample_rate = plan.rate;
+  return plan.rate;
+}
+
+// Auto-timebase: choose sample rate so "target_periods" signal periods 
+// fit into "points" samples
+// rate - sample rate of the probe capture, Hz
+// periods - number of signal periods found in the probe capture
+// Return new sample rate, rounded to 1-2-5 series
+uint32_t adc_auto_timebase(
+  uint32_t rate, uint16_t points, uint16_t periods, uint16_t target_periods)
+{
+  uint64_t new_rate;
+
+  if (periods == 0)
+    new_rate = rate / ADC_AUTO_TIMEBASE_STEP;//period is longer than capture
+  else if (periods > (points / ADC_AUTO_MIN_POINTS_PER_PERIOD))
+    new_rate = (uint64_t)rate * ADC_AUTO_TIMEBASE_STEP;//count is not reliable
+  else if (((periods * 2) >= target_periods) && (periods <= (target_periods * 2)))
+    return rate;//close enough - keep timebase stable
+  else
+    new_rate = (uint64_t)rate * target_periods / periods;
+
+  if (new_rate < ADC_MIN_SAMPLE_RATE)
+    new_rate = ADC_MIN_SAMPLE_RATE;
+  if (new_rate > ADC_MAX_SAMPLE_RATE)
+    new_rate = ADC_MAX_SAMPLE_RATE;
+  return adc_round_rate_125((uint32_t)new_rate);
+}
+
+// Round rate down to 1-2-5 series
+uint32_t adc_round_rate_125(uint32_t rate)
+{
+  uint32_t decade = 1;
+  while ((decade * 10) <= rate)
+    decade*= 10;
+
+  uint32_t mantissa = rate / decade;
+  if (mantissa >= 5)
+    return decade * 5;
+  else if (mantissa >= 2)
+    return decade * 2;
+  return decade;
 }
 
 
@@ -125,6 +569,9 @@ void adc_trigger_timer_init(void)
   //TRGO from timer Source
   TIM_SelectOutputTrigger(ADC_TIMER, TIM_TRGOSource_Update);
   TIM_ARRPreloadConfig(ADC_TIMER, ENABLE);
+  
+  //Slave mode is enabled only by "adc_arm_trigger_timer"
+  TIM_SelectInputTrigger(ADC_TIMER, ADC_TIMER_GENERATOR_ITR);
 }
 
 //ADC1 & ADC2
@@ -133,6 +580,7 @@ void adc_init(void)
   ADC_InitTypeDef ADC_InitStructure;
   ADC_CommonInitTypeDef ADC_CommonInitStructure;
   GPIO_InitTypeDef GPIO_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
 
   RCC_ADCCLKConfig(RCC_ADC12PLLCLK_Div1);
   RCC_AHBPeriphClockCmd(RCC_AHBPeriph_ADC12, ENABLE);
@@ -193,6 +641,16 @@ void adc_init(void)
   ADC_DMAConfig(ADC1, ADC_DMAMode_OneShot);
   ADC_DMACmd(ADC1, ENABLE);
 
+  //Analog watchdog trigger, interrupts are enabled only by "adc_arm_awd"
+  ADC_AnalogWatchdog1SingleChannelConfig(ADC1, ADC_MAIN_IN_CHANNEL);
+  ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_SingleRegEnable);
+  ADC_AnalogWatchdog2SingleChannelConfig(ADC1, ADC_MAIN_IN_CHANNEL);
+  NVIC_InitStructure.NVIC_IRQChannel = ADC1_2_IRQn;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;//same as ADC DMA
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+
   ADC_Cmd(ADC1, ENABLE);
   ADC_Cmd(ADC2, ENABLE);
 
@@ -214,7 +672,7 @@ void adc_dma_init(void)
   DMA_DeInit(DMA1_Channel1);//master
   DMA_StructInit(&DMA_InitStructure);
   DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&ADC1_2->CDR;
-  DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)&adc_raw_buffer0[0];
+  DMA_InitStructure.DMA_MemoryBaseAddr = 0;//buffer is set by "adc_capture_start"
   DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
   DMA_InitStructure.DMA_BufferSize = ADC_BUFFER_SIZE / 2;
   DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
@@ -227,8 +685,6 @@ void adc_dma_init(void)
   DMA_Init(DMA1_Channel1, &DMA_InitStructure);
   
   DMA_ClearITPendingBit(DMA1_IT_TC1);
-
-  DMA_Cmd(DMA1_Channel1, ENABLE);
   
   NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel1_IRQn;
   NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;//highest
@@ -236,5 +692,5 @@ void adc_dma_init(void)
   NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
   NVIC_Init(&NVIC_InitStructure);
 
-  DMA_ITConfig(DMA1_Channel1, DMA_IT_TC, ENABLE);
+  DMA_ITConfig(DMA1_Channel1, DMA_IT_TC | DMA_IT_HT, ENABLE);
 }
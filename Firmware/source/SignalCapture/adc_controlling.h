@@ -11,23 +11,62 @@
 //Size in uint16_t elements
 #define ADC_BUFFER_SIZE (uint16_t)(MAIN_ADC_CAPTURED_POINTS * 2)
 
+// Sample rate limits, Hz
+#define ADC_MIN_SAMPLE_RATE             (1)
+
+// ADC clock is HCLK, conversion takes sampling time + 12.5 cycles
+// Shortest sample period: 1.5 + 12.5 cycles + margin
+#define ADC_MIN_PERIOD_TICKS            (16)
+#define ADC_MAX_SAMPLE_RATE             (SystemCoreClock / ADC_MIN_PERIOD_TICKS)
+
+// Max number of segments of segmented capture
+#define ADC_MAX_SEGMENTS                (32)
+
+// Event that starts ADC trigger timer
 typedef enum
 {
-  NO_CAPTURE = 0,
-  CAPTURE_IN_PROCESS,
-  CAPTURE_DONE
-} cap_status_type;//image capture status
+  ADC_START_NOW = 0,
+  ADC_START_GENERATOR,//GENERATOR_TIMER TRGO
+  ADC_START_COMPARATOR,//COMP4 edge, ADC_ETS_TIMER is used
+  ADC_START_AWD,//rising crossing of ADC1 analog watchdog level, see "adc_set_awd_level"
+} adc_start_t;
+
+// Settings found by "adc_plan_sample_rate"
+typedef struct
+{
+  uint16_t prescaler;//ADC_TIMER PSC value
+  uint16_t period;//ADC_TIMER ARR value
+  uint8_t sample_time;//ADC_SampleTime_x
+  float rate;//achieved sample rate, Hz
+} adc_rate_plan_t;
 
 extern uint32_t adc_current_sample_rate;
+extern float adc_achieved_sample_rate;
 
 void adc_init_all(void);
 
-void adc_capture_start(void);
+void adc_capture_start(
+  volatile uint16_t* buffer, uint16_t points, adc_start_t start);
 void capture_dma_stop(void);
 
 void adc_start_trigger_timer(void);
+void adc_arm_trigger_timer(void);
+void adc_ets_timer_init(void);
+void adc_set_ets_delay(uint16_t delay);
+void adc_set_awd_level(uint16_t level);
+void adc_request_opamp_gain(uint8_t gain_idx);
+void adc_apply_opamp_gain(void);
+uint8_t adc_get_opamp_gain(void);
+uint16_t adc_get_points_left(void);
+void adc_set_segments(uint16_t points, uint8_t segments_cnt);
+uint8_t adc_get_segments_done(void);
+uint32_t adc_get_segment_time(uint8_t idx);
 void init_capture_gpio(void);
-void adc_set_sample_rate(uint32_t frequency);
+adc_rate_plan_t adc_plan_sample_rate(uint32_t frequency);
+uint32_t adc_get_sample_time_rate(uint8_t sample_time);
+float adc_set_sample_rate(uint32_t frequency);
+uint32_t adc_auto_timebase(
+  uint32_t rate, uint16_t points, uint16_t periods, uint16_t target_periods);
 
 
 void set_adc_buf(void);
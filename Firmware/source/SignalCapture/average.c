@@ -0,0 +1,396 @@
+//Averaging mode - for small repetitive signals
+//Captures are started by comparator rising edge, so they are aligned with
+//one HCLK tick jitter. Fused points of N captures are summed into 32-bit
+//accumulators, noise of the average is sqrt(N) times smaller.
+//First half of the capture is accumulated while second half is captured.
+
+/* Includes ------------------------------------------------------------------*/
+#include "config.h"
+#include "mode_controlling.h"
+#include "data_processing.h"
+#include "acquisition.h"
+#include "adc_controlling.h"
+#include "comparator_handling.h"
+#include "display_functions.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "stdio.h"
+#include "string.h"
+
+#include "average.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  AVG_STATUS_RUNNING = 0,
+  AVG_STATUS_NO_SIGNAL,
+  AVG_STATUS_NO_TRIGGER,
+} avg_status_t;
+
+/* Private define ------------------------------------------------------------*/
+//Two points per display column
+#define AVG_POINTS                      (320)
+
+//Capture used to find comparator threshold
+#define AVG_LEVEL_POINTS                (256)
+
+#define AVG_COUNTS_CNT                  (4)
+#define AVG_RATES_CNT                   (5)
+
+//Smaller signal can't be used for trigger
+#define AVG_MIN_SWING_V                 (0.05f)
+
+//Averaging is restarted if trigger is not coming
+#define AVG_TRIGGER_TIMEOUT_MS          (200)
+
+//Header is part with text
+#define AVG_HEADER_HEIGHT               (9)
+
+//One text line is placed below waveform
+#define AVG_Y_END                       (DISPLAY_HEIGHT - 13)
+
+#define AVG_ACTIVE_HEIGHT               (AVG_Y_END - AVG_HEADER_HEIGHT - 1)
+
+#define AVG_COLUMNS_CNT                 (DISP_WIDTH)
+
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+//Max fused value * max count must fit into 32 bits
+const uint16_t avg_counts[AVG_COUNTS_CNT] = {4, 16, 64, 256};
+uint8_t avg_count_idx = 2;
+
+//ADC_ETS_TIMER is used, ADC timer prescaler must be 0 at these rates
+const uint32_t avg_rates[AVG_RATES_CNT] = {2000000, 1000000, 200000, 50000, 10000};
+uint8_t avg_rate_idx = 1;
+
+//Allocated from "mode_arena"
+uint32_t* avg_accumulator = NULL;
+uint16_t* avg_result = NULL;//last average, fused points
+
+uint16_t avg_captures = 0;//captures in "avg_accumulator"
+uint8_t avg_half_done = 0;//first half of the capture is accumulated
+uint8_t avg_result_valid = 0;
+
+//Triggered captures are running
+uint8_t avg_running = 0;
+uint32_t avg_capture_time = 0;//ms_tick value
+
+avg_status_t avg_status = AVG_STATUS_RUNNING;
+
+//Range of "avg_result", fused points
+uint16_t avg_min_value = 0;
+uint16_t avg_max_value = 0;
+
+//Set when waveform must be redrawn
+uint8_t avg_redraw = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+void avg_level_job_cb(uint16_t* adc_buffer, uint16_t points);
+uint8_t avg_capture_job_partial_cb(uint16_t* adc_buffer, uint16_t points);
+void avg_capture_job_cb(uint16_t* adc_buffer, uint16_t points);
+void avg_accumulate(const uint16_t* adc_buffer, uint16_t start, uint16_t end);
+void avg_update_result(void);
+void avg_restart(void);
+void avg_post_result(acq_job_id_t job_id);
+void avg_draw_header(void);
+void avg_draw_waveform(void);
+void avg_draw_stats(void);
+uint16_t avg_get_y(uint16_t value);
+void avg_clear_active_zone(void);
+
+//"sample_rate" is changed by upper button hold
+acq_job_t avg_level_job =
+{
+  ACQ_JOB_AVERAGE_LEVEL, 0, AVG_LEVEL_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, 0, avg_level_job_cb, NULL
+};
+
+acq_job_t avg_capture_job =
+{
+  ACQ_JOB_AVERAGE, 0, AVG_POINTS,
+  ACQ_TRIGGER_COMPARATOR, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  avg_capture_job_cb, avg_capture_job_partial_cb
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+// This function must be called when "main_menu_mode" is changed
+// Must be called after "glitch_catcher_main_mode_changed" - same timer is used
+void average_main_mode_changed(void)
+{
+  avg_accumulator = NULL;
+  avg_result = NULL;
+  avg_running = 0;
+  if (main_menu_mode != MENU_MODE_AVERAGE)
+    return;
+
+  avg_accumulator = (uint32_t*)mode_arena_alloc(AVG_POINTS * sizeof(uint32_t));
+  avg_result = (uint16_t*)mode_arena_alloc(AVG_POINTS * sizeof(uint16_t));
+
+  comparator_init(USE_GLITCH_CAPTURE_COMP);
+  adc_ets_timer_init();
+  adc_set_ets_delay(0);
+
+  avg_result_valid = 0;
+  avg_restart();
+}
+
+// Clear accumulators and find trigger level again
+void avg_restart(void)
+{
+  acquisition_abort();
+  avg_running = 0;
+  avg_captures = 0;
+  avg_half_done = 0;
+  memset(avg_accumulator, 0, AVG_POINTS * sizeof(uint32_t));
+
+  avg_level_job.sample_rate = avg_rates[avg_rate_idx];
+  avg_capture_job.sample_rate = avg_rates[avg_rate_idx];
+  acquisition_submit(&avg_level_job);
+}
+
+// Called from "data_processing_handler"
+// Drop captures if trigger is not coming
+void average_processing_handler(void)
+{
+  if ((avg_running == 0) ||
+      ((ms_tick - avg_capture_time) < AVG_TRIGGER_TIMEOUT_MS))
+    return;
+
+  avg_status = AVG_STATUS_NO_TRIGGER;
+  avg_post_result(ACQ_JOB_AVERAGE);
+  avg_restart();
+}
+
+// Change number of averaged captures
+void average_upper_button_pressed(void)
+{
+  avg_count_idx++;
+  if (avg_count_idx >= AVG_COUNTS_CNT)
+    avg_count_idx = 0;
+  avg_result_valid = 0;
+  avg_redraw = 1;
+  avg_restart();
+}
+
+// Change sample rate
+void average_upper_button_hold(void)
+{
+  avg_rate_idx++;
+  if (avg_rate_idx >= AVG_RATES_CNT)
+    avg_rate_idx = 0;
+  avg_result_valid = 0;
+  avg_redraw = 1;
+  avg_restart();
+}
+
+//Called by acquisition engine - set comparator threshold to the signal middle
+void avg_level_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  adc_processed_data_t data = data_processing_extended(adc_buffer, points);
+
+  if ((data.max_voltage - data.min_voltage) < AVG_MIN_SWING_V)
+  {
+    avg_status = AVG_STATUS_NO_SIGNAL;
+    avg_post_result(ACQ_JOB_AVERAGE_LEVEL);
+    acquisition_submit(&avg_level_job);
+    return;
+  }
+
+  comparator_set_threshold((data.max_voltage + data.min_voltage) / 2.0f);
+  avg_status = AVG_STATUS_RUNNING;
+  avg_capture_time = ms_tick;
+  avg_running = 1;
+  acquisition_submit(&avg_capture_job);
+}
+
+//Called by acquisition engine while second half is captured
+uint8_t avg_capture_job_partial_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  if (avg_running == 0)
+    return 1;//capture was aborted
+
+  avg_accumulate(adc_buffer, 0, points);
+  avg_half_done = 1;
+  return 0;//full capture is needed
+}
+
+//Called by acquisition engine - rest of the capture is accumulated
+void avg_capture_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  if (avg_running == 0)
+    return;//capture was aborted
+
+  //First half is not accumulated if main loop was late for it
+  avg_accumulate(adc_buffer, avg_half_done ? (points / 2) : 0, points);
+  avg_half_done = 0;
+  avg_captures++;
+  avg_capture_time = ms_tick;
+
+  if ((avg_result_valid == 0) || (avg_captures >= avg_counts[avg_count_idx]))
+    avg_update_result();//first average is shown while it is collected
+
+  if (avg_captures >= avg_counts[avg_count_idx])
+  {
+    avg_captures = 0;
+    memset(avg_accumulator, 0, AVG_POINTS * sizeof(uint32_t));
+    avg_result_valid = 1;
+  }
+  avg_post_result(ACQ_JOB_AVERAGE);
+}
+
+// Add fused points "start" - "end" to accumulators
+CCM_RAM_FUNC void avg_accumulate(const uint16_t* adc_buffer, uint16_t start, uint16_t end)
+{
+  for (uint16_t i = start; i < end; i++)
+    avg_accumulator[i] += adc_buffer[i * 2 + 1];
+}
+
+void avg_update_result(void)
+{
+  uint16_t min_value = 0xFFFF;
+  uint16_t max_value = 0;
+  uint32_t half_count = avg_captures / 2;
+
+  for (uint16_t i = 0; i < AVG_POINTS; i++)
+  {
+    uint16_t value = (uint16_t)((avg_accumulator[i] + half_count) / avg_captures);
+    avg_result[i] = value;
+    if (value < min_value)
+      min_value = value;
+    if (value > max_value)
+      max_value = value;
+  }
+  avg_min_value = min_value;
+  avg_max_value = max_value;
+  avg_redraw = 1;
+}
+
+void avg_post_result(acq_job_id_t job_id)
+{
+  acq_result_t result;
+  result.job_id = job_id;
+  acquisition_mailbox_post(&result);
+}
+
+//*****************************************************************************
+
+void average_draw_menu(menu_draw_type_t draw_type)
+{
+  if (draw_type == MENU_MODE_FULL_REDRAW)
+  {
+    display_clear_framebuffer();
+    display_draw_string("AVERAGE", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_update();
+    avg_redraw = 1;
+  }
+  else
+  {
+    acq_result_t result;
+
+    //Redraw only when capture is done
+    if (acquisition_mailbox_get_last(&result) || avg_redraw)
+    {
+      avg_draw_header();
+      if (avg_redraw)
+      {
+        avg_redraw = 0;
+        avg_clear_active_zone();
+        if (avg_captures || avg_result_valid)
+        {
+          avg_draw_waveform();
+          avg_draw_stats();
+        }
+      }
+      display_update();
+    }
+  }//PARTIAL_REDRAW
+}
+
+void avg_draw_header(void)
+{
+  char tmp_str[32];
+  uint32_t rate = avg_rates[avg_rate_idx];
+
+  if (rate >= 1000000)
+    sprintf(tmp_str, "AVG %-3u %luM  ", avg_counts[avg_count_idx], rate / 1000000);
+  else
+    sprintf(tmp_str, "AVG %-3u %luk", avg_counts[avg_count_idx], rate / 1000);
+  display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+
+  switch (avg_status)
+  {
+    case AVG_STATUS_NO_SIGNAL:
+      display_draw_string(" NO SIG", 118, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    case AVG_STATUS_NO_TRIGGER:
+      display_draw_string("NO TRIG", 118, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    default:
+      sprintf(tmp_str, "%u/%u", avg_captures, avg_counts[avg_count_idx]);
+      menu_shift_string_right(tmp_str, 7);
+      display_draw_string(tmp_str, 118, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+    break;
+  }
+}
+
+// Each column is a line from min to max of its points,
+// last point of the previous column is included - trace is continuous
+void avg_draw_waveform(void)
+{
+  uint16_t start = 0;
+
+  for (uint16_t x = 0; x < AVG_COLUMNS_CNT; x++)
+  {
+    uint16_t end = (uint32_t)(x + 1) * AVG_POINTS / AVG_COLUMNS_CNT;
+
+    uint16_t min_value = avg_result[start];
+    uint16_t max_value = avg_result[start];
+    uint16_t i = (start > 0) ? (start - 1) : 0;
+    for (; i < end; i++)
+    {
+      if (avg_result[i] < min_value)
+        min_value = avg_result[i];
+      if (avg_result[i] > max_value)
+        max_value = avg_result[i];
+    }
+    display_draw_vertical_line(x, avg_get_y(max_value), avg_get_y(min_value), COLOR_WHITE);
+    start = end;
+  }
+  display_draw_line(AVG_Y_END, COLOR_BLUE);
+}
+
+// Range of the averaged waveform
+void avg_draw_stats(void)
+{
+  char tmp_str[32];
+
+  float min_voltage = data_processing_fused_to_voltage(avg_min_value);
+  float max_voltage = data_processing_fused_to_voltage(avg_max_value);
+  sprintf(tmp_str, "MIN%5.3f MAX%5.3f", min_voltage, max_voltage);
+  display_draw_string(tmp_str, 0, AVG_Y_END + 3, FONT_SIZE_8, 0, COLOR_GREEN);
+}
+
+//Convert fused value to y position (counted from upper line)
+uint16_t avg_get_y(uint16_t value)
+{
+  uint16_t swing = avg_max_value - avg_min_value;
+  if (swing == 0)
+    return AVG_Y_END - 1;
+
+  uint16_t pix_cnt =
+    (uint16_t)((uint32_t)(value - avg_min_value) * AVG_ACTIVE_HEIGHT / swing);
+  if (pix_cnt > AVG_ACTIVE_HEIGHT)
+    pix_cnt = AVG_ACTIVE_HEIGHT;
+  return (AVG_Y_END - 1 - pix_cnt);
+}
+
+void avg_clear_active_zone(void)
+{
+  uint8_t y;
+  for (y = AVG_HEADER_HEIGHT; y < DISPLAY_HEIGHT; y++)
+    display_draw_line(y, COLOR_BLACK);
+}
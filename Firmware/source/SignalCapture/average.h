@@ -0,0 +1,16 @@
+#ifndef __AVERAGE_H
+#define __AVERAGE_H
+
+#include "mode_controlling.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+void average_main_mode_changed(void);
+void average_processing_handler(void);
+
+void average_draw_menu(menu_draw_type_t draw_type);
+void average_upper_button_pressed(void);
+void average_upper_button_hold(void);
+
+#endif
+
@@ -1,5 +1,6 @@
 //Comparator is used for measuring frequency (see "freq_measurement.c")
 //Also is used for baudrate measurement - calculating time between interrupts
+//In logic probe mode output is latched by "glitch catcher" timer
 
 /* Includes ------------------------------------------------------------------*/
 #include "comparator_handling.h"
@@ -7,6 +8,7 @@
 #include "data_processing.h"
 #include "freq_measurement.h"
 #include "hardware.h"
+#include "mode_arena.h"
 #include "main.h"
 #include "string.h"
 
@@ -18,6 +20,7 @@
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 extern float data_processing_main_div;
+extern menu_mode_t main_menu_mode;
 
 // Comparator threshold voltage, V
 float comparator_threshold_v = FREQ_TRIGGER_DEFAULT_V;
@@ -27,7 +30,8 @@ float comparator_min_voltage = 500.0f;
 float comparator_max_voltage = 0.0f;
 
 volatile uint16_t comparator_irq_counter = 0;//Interrupts counter
-volatile uint32_t comparator_irq_dwt_buff[COMP_INTERRUPTS_DWT_BUF_SIZE];
+// Allocated from "mode_arena" in frequency meter mode
+volatile uint32_t* comparator_irq_dwt_buff = NULL;
 volatile uint8_t comparator_irq_dwt_buff_full = 0;
 
 /* Private function prototypes -----------------------------------------------*/
@@ -36,11 +40,15 @@ void COMP_MAIN_EXTI_IRQ_HANDLER(void);
 /* Private functions ---------------------------------------------------------*/
 
 //Comparator -> EXTI interrupt
-void COMP_MAIN_EXTI_IRQ_HANDLER(void)
+CCM_RAM_FUNC void COMP_MAIN_EXTI_IRQ_HANDLER(void)
 {
-  EXTI_ClearITPendingBit(COMP_MAIN_IRQ_EXTI_LINE);
+  EXTI->PR = (1 << COMP_MAIN_IRQ_EXTI_LINE);//clear pending bit
   
-  if (comparator_irq_counter < COMP_INTERRUPTS_DWT_BUF_SIZE)
+  if (comparator_irq_dwt_buff == NULL)
+  {
+    COMP_Cmd(COMP_MAIN_NAME, DISABLE);
+  }
+  else if (comparator_irq_counter < COMP_INTERRUPTS_DWT_BUF_SIZE)
   {
     comparator_irq_dwt_buff[comparator_irq_counter] = hardware_dwt_get();
     comparator_irq_counter++;
@@ -52,6 +60,24 @@ void COMP_MAIN_EXTI_IRQ_HANDLER(void)
   }
 }
 
+// This function must be called when "main_menu_mode" is changed
+// Buffers of previous mode are already released here
+void comparator_main_mode_changed(void)
+{
+  EXTI_ClearITPendingBit(COMP_MAIN_IRQ_EXTI_LINE);
+  NVIC_DisableIRQ(COMP_MAIN_IRQ);
+  
+  if (main_menu_mode == MENU_MODE_FREQUENCY_METER)
+  {
+    comparator_irq_dwt_buff = (volatile uint32_t*)mode_arena_alloc(
+      COMP_INTERRUPTS_DWT_BUF_SIZE * sizeof(uint32_t));
+  }
+  else
+  {
+    comparator_irq_dwt_buff = NULL;
+  }
+}
+
 //DAC is used as NEG IN for comparator
 void dac_init(void)
 {
@@ -98,9 +124,15 @@ void comparator_init(uint8_t interrupt_mode)
   COMP_InitStructure.COMP_InvertingInput = COMP_InvertingInput_DAC1OUT1;
   COMP_InitStructure.COMP_NonInvertingInput = COMP_NonInvertingInput_IO1;
   COMP_InitStructure.COMP_Output = COMP_Output_None;
+  COMP_InitStructure.COMP_Hysteresis = COMP_Hysteresis_No;
+  if (interrupt_mode == USE_GLITCH_CAPTURE_COMP)
+  {
+    COMP_InitStructure.COMP_Output = GLITCH_COMP_OUTPUT;
+    //Slow edges must not be counted as glitches
+    COMP_InitStructure.COMP_Hysteresis = COMP_Hysteresis_Low;
+  }
     
   COMP_InitStructure.COMP_Mode = COMP_Mode_HighSpeed;
-  COMP_InitStructure.COMP_Hysteresis = COMP_Hysteresis_No;
   COMP_InitStructure.COMP_OutputPol = COMP_OutputPol_NonInverted;
   COMP_Init(COMP_MAIN_NAME, &COMP_InitStructure);
   
@@ -134,6 +166,12 @@ void comparator_init(uint8_t interrupt_mode)
     GPIO_Init(COMP_OUT_GPIO, &GPIO_InitStructure);
     GPIO_PinAFConfig(COMP_OUT_GPIO, COMP_OUT_AF_SRC, COMP_OUT_AFIO);
   }
+  else if (interrupt_mode == USE_GLITCH_CAPTURE_COMP) //logic probe
+  {
+    EXTI_InitStructure.EXTI_Line = COMP_MAIN_IRQ_EXTI_LINE;
+    EXTI_InitStructure.EXTI_LineCmd = DISABLE;
+    EXTI_Init(&EXTI_InitStructure);
+  }
   else //called at startup init
   {
     NVIC_InitTypeDef NVIC_InitStructure;
@@ -9,6 +9,7 @@
 /* Exported types ------------------------------------------------------------*/
 #define USE_INTERUPT_MODE               (1)
 #define USE_NO_EVENTS_COMP              (2)
+#define USE_GLITCH_CAPTURE_COMP         (3)
 
 #define COMP_INTERRUPTS_DWT_BUF_SIZE    (128)
 
@@ -28,6 +29,7 @@ void comparator_switch_to_filter(void);
 void comparator_processing_handler(void);
 void comparator_set_threshold(float voltage);
 void comparator_start_wait_interrupt(void);
+void comparator_main_mode_changed(void);
 void comparator_init(uint8_t interrupt_mode);
 
 #endif /* __COMPARATOR_HANDLING_H */
@@ -3,16 +3,32 @@
 /* Includes ------------------------------------------------------------------*/
 #include "data_processing.h"
 #include "adc_controlling.h"
+#include "acquisition.h"
 #include "generator_timer.h"
 #include "comparator_handling.h"
 #include "mode_controlling.h"
 #include "freq_measurement.h"
+#include "glitch_catcher.h"
 #include "slow_scope.h"
+#include "spectrum.h"
+#include "ets.h"
+#include "logic_analyzer.h"
+#include "segmented.h"
+#include "average.h"
+#include "persistence.h"
+#include "histogram.h"
+#include "fft.h"
 #include "menu_selector.h"
 #include "nvram.h"
+#include "mode_arena.h"
+#include "display_layers.h"
+#include "hardware.h"
 #include "main.h"
 
 #include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "math.h"
 
 /* Private typedef -----------------------------------------------------------*/
 
@@ -22,8 +38,15 @@
 // Half of "DATA_PROC_LOGIC_PROBE_SAMPLE_PERIOD" - time of SAME logic level
 #define DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD    (DATA_PROC_LOGIC_PROBE_SAMPLE_PERIOD / 2)
 
-//Number of HPERIODS in all captured data
-#define DATA_PROC_LOGIC_PROBE_HPERIODS_NUM      (MAIN_ADC_CAPTURED_POINTS / DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD)
+//Number of "GENERATOR_TIMER" periods in one capture
+#define DATA_PROC_LOGIC_PROBE_PERIODS_NUM       (4)
+
+#define DATA_PROC_LOGIC_PROBE_CAPTURED_POINTS   \
+  (DATA_PROC_LOGIC_PROBE_SAMPLE_PERIOD * DATA_PROC_LOGIC_PROBE_PERIODS_NUM)
+
+//Phase of the last analysed point in HPERIOD, points at the end are skipped
+#define DATA_PROC_LOGIC_PROBE_HALF_LAST         \
+  (DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD - DATA_PROC_LOGIC_PROBE_START_OFFSET - 1)
 
 //in ADC1 points
 #define DATA_PROC_LOGIC_PROBE_BIG_DIFF_THRESHOLD 15
@@ -32,80 +55,244 @@
 #define DATA_PROC_LOGIC_PROBE_LOW_DIFF_THRESHOLD 10
 
 //in ADC1 points
+//Default thresholds, can be changed by "data_processing_set_logic_thresholds"
 #define DATA_PROC_LOGIC_PROBE_HIGH_STATE_THRESHOLD 260 //~2V
 #define DATA_PROC_LOGIC_PROBE_LOW_STATE_THRESHOLD  130 //~1V
+#define DATA_PROC_LOGIC_PROBE_HIGH_STATE_V         2.0f //V
+#define DATA_PROC_LOGIC_PROBE_LOW_STATE_V          1.0f //V
 
 //If peak-peak voltage is bigger than this voltage that mean that it is pulsed voltage
 #define DATA_PROC_LOGIC_PROBE_PEAK_THRESHOLD       0.5f //V
 
-#define DATA_PROC_LOGIC_PROBE_ANALYSE_LENGTH    \
- (DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD - DATA_PROC_LOGIC_PROBE_START_OFFSET * 2) //start and end
+//Minimum number of agreeing generator periods to publish state before
+//the end of capture
+#define DATA_PROC_LOGIC_PROBE_MIN_PERIODS          (2)
    
 //****************************************
 
 // If voltage is higher this threshold, ADC1 result is used, [V]
 #define DATA_PROC_FINE_VOLTAGE_THRESHOLD        2.8f
-
-// If (max-min) voltage less than this value, so it is stable
-#define DATA_PROC_STABLE_ANALYSE_THRESHOLD      0.15f //V
    
 // Min voltage for adc calibration
 #define DATA_PROC_MIN_ADC_CALIB_VOLTAGE         3.0f //V
 
 #define DATA_PROC_MIN_ADC_CALIB_FIFO_SIZE       10
 
+// Zero calibration: max ADC1 average at grounded input, [ADC1 points]
+#define DATA_PROC_ZERO_CALIB_MAX_OFFSET         50
+// Zero calibration: max ADC1 peak-peak noise at grounded input, [ADC1 points]
+#define DATA_PROC_ZERO_CALIB_MAX_NOISE          20
+// Zero calibration: points captured for each sampling time
+#define DATA_PROC_ZERO_CALIB_POINTS             256
+// Zero calibration: old offsets are kept if the input is not grounded during this time, ms
+#define DATA_PROC_ZERO_CALIB_TIMEOUT            5000
+
+// Fused samples: only ADC2 is used below this ADC2 value, [ADC2 points]
+// Between this value and DATA_PROC_FUSE_BLEND_END ADC1 and ADC2 are blended
+// 2.4V and 2.8V at gain 8 - same part of ADC2 range is used at every gain
+#define DATA_PROC_FUSE_BLEND_START              2350
+#define DATA_PROC_FUSE_BLEND_END                2740
+
+// Auto-ranging: gain is kept while capture peak is below this value, [ADC2 points]
+#define DATA_PROC_RANGE_KEEP_POINTS             DATA_PROC_FUSE_BLEND_START
+
+// Auto-ranging: bigger gain is selected if capture peak is below this value
+// at that gain, [ADC2 points]
+#define DATA_PROC_RANGE_UP_POINTS               (DATA_PROC_FUSE_BLEND_START * 3 / 4)
+
+// ADC1 point size in fused points. Full ADC1 range fits into 16 bits:
+// 4095 * 16 = 65520. Fused point is a bit bigger than ADC2 point at gain 16,
+// because real PGA gain is a bit bigger than nominal.
+#define DATA_PROC_FUSE_ADC1_GAIN                16
+
+// PGA calibration: smaller voltages are not measured precisely by ADC1, [V]
+#define DATA_PROC_PGA_CALIB_MIN_VOLTAGE         0.5f
+
+// Fraction bits of ADC1->fused gain
+#define DATA_PROC_FUSE_GAIN_BITS                8
+
+// Fraction bits of blend weight
+#define DATA_PROC_FUSE_WEIGHT_BITS              8
+
+
+// Running statistics of logic probe synchronous detection
+typedef struct
+{
+  int32_t correlation;//sum of finished generator periods
+  uint32_t summ;
+  uint16_t used_cnt;//number of added samples
+  int32_t period_correlation;//current generator period
+  uint32_t period_summ;
+  uint16_t period_used_cnt;
+  uint16_t half_min;
+  uint16_t half_max;
+  uint8_t pulsed;
+  uint8_t periods_cnt;//number of finished generator periods
+  uint8_t periods_agree_cnt;//periods with the same state as the first one
+  uint8_t period_states;//bit "1 << state" is set by each finished period
+  signal_state_t first_period_state;
+} logic_probe_stats_t;
+
+// Coefficients of "data_processing_fuse_kernel"
+typedef struct
+{
+  uint32_t gain;//ADC1 point size, DATA_PROC_FUSE_GAIN_BITS fraction
+  uint32_t fine_gain;//ADC2 point size, DATA_PROC_FUSE_GAIN_BITS fraction
+  uint32_t blend_start;//ADC2 points
+  uint32_t blend_end;//ADC2 points
+  uint32_t blend_recip;//(1 << (16 + DATA_PROC_FUSE_WEIGHT_BITS)) / blend size
+} data_processing_fuse_coef_t;
+
+// Integer sums of "data_processing_ac_measure", in fused points
+typedef struct
+{
+  uint32_t summ;
+  uint64_t summ_sq;
+  uint32_t min_value;
+  uint32_t max_value;
+} data_processing_ac_summ_t;
 
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-data_processing_state_t data_processing_state = PROCESSING_IDLE;
+// Statistics of the current logic probe capture
+logic_probe_stats_t logic_probe_stats;
 
-// Odd items - high state of "generator timer", even - low state
-uint16_t logic_probe_results[DATA_PROC_LOGIC_PROBE_HPERIODS_NUM];
+// Number of points of the current capture added to "logic_probe_stats"
+uint16_t logic_probe_stats_points = 0;
 
 // Last input state, detected by logic probe
 signal_state_t logic_probe_signal_state;
 
+// Logic probe input thresholds, in ADC1 points
+uint16_t logic_probe_high_threshold = DATA_PROC_LOGIC_PROBE_HIGH_STATE_THRESHOLD;
+uint16_t logic_probe_low_threshold = DATA_PROC_LOGIC_PROBE_LOW_STATE_THRESHOLD;
+
+// Same thresholds, in V
+float logic_probe_high_threshold_v = DATA_PROC_LOGIC_PROBE_HIGH_STATE_V;
+float logic_probe_low_threshold_v = DATA_PROC_LOGIC_PROBE_LOW_STATE_V;
+
 // Input division coefficient
 float data_processing_main_div = ADC_MAIN_DIVIDER;
 
 // Converting imput voltage to ADC2 voltage (divided and amplified)
+// Gain of the capture that is processed now
 float data_processing_amp_div = ADC_MAIN_AMP_DIVIDER;
 
+// Same for every auto-ranging gain, see "data_processing_update_amp_div"
+float data_processing_amp_divs[ADC_OPAMP_GAINS_CNT];
+
+// Fused point is ADC1 point / DATA_PROC_FUSE_ADC1_GAIN,
+// so fused samples of all gains have the same scale
+float data_processing_fused_div = ADC_MAIN_DIVIDER / DATA_PROC_FUSE_ADC1_GAIN;
+
+// ADC2 point size of every gain in fused points, DATA_PROC_FUSE_GAIN_BITS fraction
+uint32_t data_processing_fine_gains[ADC_OPAMP_GAINS_CNT];
+
+// OPAMP gain index of the capture that is processed now
+uint8_t data_processing_opamp_gain = ADC_OPAMP_GAIN_IDX;
+
+// Peak of fused samples since the last "data_processing_auto_range"
+uint16_t data_processing_fused_max = 0;
+
+// PGA calibration: summ of measured/expected gain ratios
+float data_processing_pga_calib_summ[ADC_OPAMP_GAINS_CNT];
+uint8_t data_processing_pga_calib_cnt[ADC_OPAMP_GAINS_CNT];
+
 // Curent voltage
 float voltmeter_voltage = 0.0f;
 
+// Measured by "data_processing_ac_measure" in voltmeter and logic probe modes
+adc_ac_data_t data_processing_ac_data;
+
 //State of ADC calibration
-adc_calibration_state_t data_processing_adc_calib_state = ADC_CALIB_DISPLAY_MSG1;
+adc_calibration_state_t data_processing_adc_calib_state = ADC_CALIB_DISPLAY_ZERO_MSG;
 uint8_t data_processing_adc_calib_running = 0;
 uint32_t data_processing_adc_calib_timer = 0;
 uint16_t data_processing_adc_calib_fifo[DATA_PROC_MIN_ADC_CALIB_FIFO_SIZE];
 uint8_t data_processing_adc_calib_fifo_pos = 0;
 float data_processing_adc_calib_voltage = 0.0;//volts
 
+// Zero calibration: ADC1 offsets are measured with raw data correction disabled
+uint8_t data_processing_zero_calib_running = 0;
+uint8_t data_processing_zero_calib_idx = 0;//ADC_SampleTime_x being measured
+uint16_t data_processing_zero_calib_offsets[ADC_SAMPLE_TIMES_CNT];
+
 extern nvram_data_t nvram_data;
 extern menu_mode_t main_menu_mode;
-extern volatile cap_status_type adc_capture_status;
-extern volatile uint16_t adc_raw_buffer0[ADC_BUFFER_SIZE];
 
 /* Private function prototypes -----------------------------------------------*/
-void data_processing_logic_probe_handler(void);
-void data_processing_process_logic_probe_data(void);
+void data_processing_logic_probe_job_cb(uint16_t* adc_buffer, uint16_t points);
+uint8_t data_processing_logic_probe_partial_cb(uint16_t* adc_buffer, uint16_t points);
+void data_processing_logic_probe_post_result(void);
+void data_processing_process_logic_probe_data(uint16_t* adc_buffer, uint16_t points);
+uint8_t data_processing_logic_probe_early_result(uint16_t* adc_buffer, uint16_t points);
+void data_processing_logic_probe_set_state(
+  signal_state_t state, uint16_t* adc_buffer, uint16_t points);
+void data_processing_logic_probe_reset_stats(void);
+void data_processing_logic_probe_accumulate(
+  uint16_t* adc_buffer, uint16_t start, uint16_t end);
+void data_processing_logic_probe_end_period(logic_probe_stats_t* stats);
+signal_state_t data_processing_logic_probe_get_full_state(void);
+signal_state_t data_processing_logic_probe_get_state(
+  int32_t correlation, uint32_t summ, uint16_t used_cnt);
 uint16_t data_processing_calc_adc_average(uint16_t* adc_buffer, uint16_t length);
 
-void data_processing_voltmeter_handler(void);
-void data_processing_process_voltmeter_data(void);
-void data_processing_process_peak_voltmeter_data(void);
+void data_processing_voltmeter_job_cb(uint16_t* adc_buffer, uint16_t points);
+void data_processing_process_voltmeter_data(uint16_t* adc_buffer, uint16_t points);
+void data_processing_process_peak_voltmeter_data(uint16_t* adc_buffer, uint16_t points);
 
 uint16_t data_processing_calc_peak_peak(uint16_t* adc_buffer, uint16_t length);
 float data_processing_adc_to_voltage(uint16_t adc1, uint16_t adc2);
 uint16_t data_processing_calculate_edges(uint16_t* adc_buffer, uint16_t length, float threshold_v);
 void data_processing_adc_calibraion_mode(void);
-void data_processing_process_adc_calibration_data(void);
+void data_processing_adc_calibration_job_cb(uint16_t* adc_buffer, uint16_t points);
 uint8_t data_processing_process_adc_calibraion_fifo(void);
 void data_processing_adc_calibration_add_to_fifo(uint16_t new_value);
-uint16_t data_processing_calc_adc_maximum(uint16_t* adc_buffer, uint16_t length);
+void data_processing_zero_calib_start(void);
+void data_processing_zero_calib_submit(void);
+void data_processing_zero_calib_stop(void);
+void data_processing_zero_calib_job_cb(uint16_t* adc_buffer, uint16_t points);
+void data_processing_ac_accumulate(
+  uint16_t* adc_buffer, uint16_t length, data_processing_ac_summ_t* summ);
+uint32_t data_processing_isqrt64(uint64_t value);
+uint16_t data_processing_fuse_kernel(
+  uint32_t* pairs, uint16_t length, const data_processing_fuse_coef_t* coef);
+void data_processing_pga_calib_start(void);
+void data_processing_pga_calib_add(uint16_t* adc_buffer, uint16_t points, float adc1_voltage);
+void data_processing_pga_calib_finish(void);
+adc_processed_data_t data_processing_extended_internal(
+  uint16_t* adc_buffer, uint16_t length);
+
+// Capture jobs of this file
+const acq_job_t data_processing_logic_probe_job = 
+{
+  ACQ_JOB_LOGIC_PROBE, DATA_PROC_LOW_SAMPLE_RATE, DATA_PROC_LOGIC_PROBE_CAPTURED_POINTS,
+  ACQ_TRIGGER_GENERATOR, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  data_processing_logic_probe_job_cb, data_processing_logic_probe_partial_cb
+};
+
+const acq_job_t data_processing_voltmeter_job = 
+{
+  ACQ_JOB_VOLTMETER, DATA_PROC_LOW_SAMPLE_RATE, MAIN_ADC_CAPTURED_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  data_processing_voltmeter_job_cb, NULL
+};
 
+const acq_job_t data_processing_adc_calibration_job = 
+{
+  ACQ_JOB_ADC_CALIBRATION, DATA_PROC_LOW_SAMPLE_RATE, MAIN_ADC_CAPTURED_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  data_processing_adc_calibration_job_cb, NULL
+};
+
+// Rate is set for each sampling time by "data_processing_zero_calib_submit"
+acq_job_t data_processing_zero_calib_job = 
+{
+  ACQ_JOB_ADC_CALIBRATION, DATA_PROC_LOW_SAMPLE_RATE, DATA_PROC_ZERO_CALIB_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, 0,
+  data_processing_zero_calib_job_cb, NULL
+};
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -113,36 +300,183 @@ void data_processing_init(void)
 {
   //use calibration coefficient from nvram
   data_processing_main_div = ADC_MAIN_DIVIDER * nvram_data.div_a_coef;
+  data_processing_update_amp_div();
+}
+
+// Calculate dividers of all OPAMP gains
+// Must be called when "data_processing_main_div" or PGA calibration is changed
+void data_processing_update_amp_div(void)
+{
+  for (uint8_t i = 0; i < ADC_OPAMP_GAINS_CNT; i++)
+  {
+    //Gain 2 << i, real gain is a bit different
+    float gain = (float)(2 << i) / 8.0f * (ADC_MAIN_DIVIDER / ADC_MAIN_AMP_DIVIDER);
+    data_processing_amp_divs[i] = 
+      data_processing_main_div / (gain * nvram_data.pga_gain_coef[i]);
+  }
+  data_processing_fused_div = data_processing_main_div / DATA_PROC_FUSE_ADC1_GAIN;
+  
+  for (uint8_t i = 0; i < ADC_OPAMP_GAINS_CNT; i++)
+  {
+    data_processing_fine_gains[i] = (uint32_t)lrintf(data_processing_amp_divs[i] / 
+      data_processing_fused_div * (float)(1 << DATA_PROC_FUSE_GAIN_BITS));
+  }
+  data_processing_amp_div = data_processing_amp_divs[data_processing_opamp_gain];
+}
+
+// Set OPAMP gain of the capture that would be processed
+// gain_idx - value of "adc_get_opamp_gain" at the capture start
+void data_processing_set_opamp_gain(uint8_t gain_idx)
+{
+  data_processing_opamp_gain = gain_idx;
+  data_processing_amp_div = data_processing_amp_divs[gain_idx];
+}
+
+// Select OPAMP gain for the next captures by the peak of the processed capture.
+// Biggest gain that keeps the peak in ADC2-only part of its range is used.
+// Current gain is kept until the peak leaves this part - hysteresis.
+// Peak is taken from fused samples, so it is known even if ADC2 is saturated.
+void data_processing_auto_range(void)
+{
+  uint32_t peak = data_processing_fused_max;
+  data_processing_fused_max = 0;
+  if (data_processing_adc_calib_running)
+    return;//gains are switched by PGA calibration
+  
+  uint8_t gain_idx = 0;
+  for (uint8_t i = ADC_OPAMP_GAINS_CNT - 1; i > 0; i--)
+  {
+    uint32_t points = (peak << DATA_PROC_FUSE_GAIN_BITS) / data_processing_fine_gains[i];
+    uint32_t limit = (i > data_processing_opamp_gain) ? 
+      DATA_PROC_RANGE_UP_POINTS : DATA_PROC_RANGE_KEEP_POINTS;
+    if (points < limit)
+    {
+      gain_idx = i;
+      break;
+    }
+  }
+  adc_request_opamp_gain(gain_idx);
+}
+
+// Replace ADC2 results with fused ADC1/ADC2 16-bit samples, ADC1 results are kept.
+// Fused point is close to ADC2 point at the biggest gain: small signals 
+// have ADC2 resolution, ADC1 is used when ADC2 is close to saturation.
+// Must be called after "data_processing_correct_raw_data", once per buffer.
+// length - number of captured points
+void data_processing_fuse_samples(uint16_t* adc_buffer, uint16_t length)
+{
+  data_processing_fuse_coef_t coef;
+  
+  uint32_t start_ticks = hardware_dwt_get();
+  coef.gain = (uint32_t)lrintf(data_processing_main_div / data_processing_fused_div * 
+    (float)(1 << DATA_PROC_FUSE_GAIN_BITS));
+  coef.fine_gain = data_processing_fine_gains[data_processing_opamp_gain];
+  coef.blend_start = DATA_PROC_FUSE_BLEND_START;
+  coef.blend_end = DATA_PROC_FUSE_BLEND_END;
+  coef.blend_recip = (1UL << (16 + DATA_PROC_FUSE_WEIGHT_BITS)) / 
+    (coef.blend_end - coef.blend_start);
+  
+  //ADC1 - low halfword, ADC2 - high halfword
+  uint16_t max_value = data_processing_fuse_kernel((uint32_t*)adc_buffer, length, &coef);
+  if (max_value > data_processing_fused_max)
+    data_processing_fused_max = max_value;
+  hardware_profile_store(HARDWARE_PROFILE_FUSE_SAMPLES, start_ticks);
+}
+
+// Each ADC1/ADC2 pair is processed as one 32-bit word
+// Return max fused value
+CCM_RAM_FUNC uint16_t data_processing_fuse_kernel(
+  uint32_t* pairs, uint16_t length, const data_processing_fuse_coef_t* coef)
+{
+  uint32_t gain = coef->gain;
+  uint32_t fine_gain = coef->fine_gain;
+  uint32_t blend_start = coef->blend_start;
+  uint32_t blend_end = coef->blend_end;
+  uint32_t max_value = 0;
+  
+  for (uint16_t i = 0; i < length; i++)
+  {
+    uint32_t pair = pairs[i];
+    uint32_t fine = pair >> 16;
+    uint32_t fine_value = (fine * fine_gain) >> DATA_PROC_FUSE_GAIN_BITS;
+    uint32_t value;
+    
+    if (fine <= blend_start)
+    {
+      value = fine_value;
+    }
+    else
+    {
+      uint32_t coarse = ((pair & 0xFFFF) * gain) >> DATA_PROC_FUSE_GAIN_BITS;
+      if (fine >= blend_end)
+      {
+        value = coarse;
+      }
+      else
+      {
+        uint32_t weight = ((fine - blend_start) * coef->blend_recip) >> 16;
+        value = (fine_value * ((1 << DATA_PROC_FUSE_WEIGHT_BITS) - weight) + 
+          coarse * weight) >> DATA_PROC_FUSE_WEIGHT_BITS;
+      }
+    }
+    value = __USAT(value, 16);
+    if (value > max_value)
+      max_value = value;
+    pairs[i] = (pair & 0xFFFF) | (value << 16);
+  }
+  return (uint16_t)max_value;
+}
+
+// Convert fused sample to voltage, V
+float data_processing_fused_to_voltage(uint16_t value)
+{
+  return (float)value * (float)MCU_VREF * 
+    data_processing_fused_div / (float)MAIN_ADC_MAX_VALUE;
+}
+
+// Convert voltage (probe input) to fused points
+uint16_t data_processing_volt_to_fused(float voltage)
+{
+  if (voltage < 0.0f)
+    return 0;
+  
+  float tmp_val = voltage / data_processing_fused_div * 
+    (float)MAIN_ADC_MAX_VALUE / (float)MCU_VREF;
+  if (tmp_val > 65535.0f)
+    return 0xFFFF;
+  return (uint16_t)tmp_val;
 }
 
 // Remove sampling offset from ADC1 results
-void data_processing_correct_raw_data(uint16_t zero_offset)
+// length - number of captured points
+CCM_RAM_FUNC void data_processing_correct_raw_data(
+  uint16_t* adc_buffer, uint16_t length, uint16_t zero_offset)
 {
+  uint32_t start_ticks = hardware_dwt_get();
   float a_coef = (float)zero_offset / (float)(MAIN_ADC_HALF_VALUE - zero_offset);
   float b_coef = -a_coef * (float)MAIN_ADC_HALF_VALUE;
   
-  for (uint16_t i = 0; i < MAIN_ADC_CAPTURED_POINTS; i++)
+  for (uint16_t i = 0; i < length; i++)
   {
-    uint16_t raw_value = adc_raw_buffer0[i * 2];
+    uint16_t raw_value = adc_buffer[i * 2];
     float tmp_value = a_coef * raw_value + b_coef;//correction offset
     tmp_value = (float)raw_value + tmp_value;
     if (tmp_value < 0.0f)
       tmp_value = 0.0f;
-    adc_raw_buffer0[i * 2] = (uint16_t)tmp_value;
+    adc_buffer[i * 2] = (uint16_t)tmp_value;
   }
+  hardware_profile_store(HARDWARE_PROFILE_CORRECT_RAW_DATA, start_ticks);
 }
 
-//Return ADC1 zero offset in ADC points for current sample rate
-uint16_t data_processing_get_adc_offset(void)
+//Return ADC1 zero offset in ADC points for given sample rate
+//Offset depends on ADC sampling time, selected by "adc_plan_sample_rate"
+uint16_t data_processing_get_adc_offset(uint32_t sample_rate)
 {
-  if (adc_current_sample_rate == DATA_PROC_LOW_SAMPLE_RATE)
-    return 11;//todo
-  else if (adc_current_sample_rate == DATA_PROC_SAMPLE_RATE_200K)
-    return 7;//todo
-  else if (adc_current_sample_rate == DATA_PROC_SAMPLE_RATE_2M)
-    return 7;//todo
+  if (data_processing_zero_calib_running)
+    return 0;//raw ADC1 values are measured
   
-  return 0xFFFF;//error
+  adc_rate_plan_t plan = adc_plan_sample_rate(sample_rate);
+  return nvram_data.adc_zero_offsets[plan.sample_time];
 }
 
 
@@ -150,11 +484,26 @@ uint16_t data_processing_get_adc_offset(void)
 // Switch capture mode
 void data_processing_main_mode_changed(void)
 {
-  data_processing_state = PROCESSING_IDLE;
+  //Leave previous mode - DMA must not write to released buffers
+  acquisition_reset();
+  logic_analyzer_stop();
+  mode_arena_reset();
+  display_layers_invalidate();
+  logic_probe_stats_points = 0;
+  
+  //Enter new mode - allocate its buffers
+  if (main_menu_mode == MENU_MODE_SPECTRUM)
+    acquisition_allocate_buffers(FFT_SIZE);
+  else if (main_menu_mode == MENU_MODE_SEGMENTED)
+    acquisition_allocate_buffers(SEGMENTED_TOTAL_POINTS);
+  else if ((main_menu_mode != MENU_MODE_CHARGE) &&
+           (main_menu_mode != MENU_MODE_LOGIC_ANALYZER))
+    acquisition_allocate_buffers(MAIN_ADC_CAPTURED_POINTS);
+  
   if (main_menu_mode == MENU_MODE_LOGIC_PROBE)
   {
-    adc_set_sample_rate(DATA_PROC_LOW_SAMPLE_RATE);
     generator_timer_activate_gpio();
+    acquisition_submit(&data_processing_logic_probe_job);
   }
   else
   {
@@ -162,46 +511,61 @@ void data_processing_main_mode_changed(void)
   }
   
   if (main_menu_mode == MENU_MODE_VOLTMETER)
-  {
-    adc_set_sample_rate(DATA_PROC_LOW_SAMPLE_RATE);
-  }
-  else if (main_menu_mode == MENU_MODE_FREQUENCY_METER)// used for trigger calibration
-  {
-    adc_set_sample_rate(DATA_PROC_LOW_SAMPLE_RATE);
-  }
+    acquisition_submit(&data_processing_voltmeter_job);
   
   //addition processing for SLOW_SCOPE mode
   slow_scope_processing_main_mode_changed();
+  spectrum_main_mode_changed();
+  glitch_catcher_main_mode_changed();
+  ets_main_mode_changed();
+  segmented_main_mode_changed();
+  average_main_mode_changed();
+  persistence_main_mode_changed();
+  histogram_main_mode_changed();
   freq_measurement_main_mode_changed();
+  logic_analyzer_main_mode_changed();
+  comparator_main_mode_changed();
   data_processing_adc_calib_running = 0;//reset
+  data_processing_zero_calib_running = 0;
 }
 
 // Controlling data sampling and processing - called every 10 ms
 void data_processing_handler(void)
 {
+  //Captured buffers are processed by job callbacks
+  acquisition_handler();
+  
   switch (main_menu_mode)
   {
-    case MENU_MODE_LOGIC_PROBE:
-      data_processing_logic_probe_handler();
+    case MENU_MODE_FREQUENCY_METER:
+      //comparator_processing_handler();
+      freq_measurement_processing_handler();
     break;
     
-    case MENU_MODE_VOLTMETER:
-      data_processing_voltmeter_handler();
+    case MENU_MODE_ETS:
+      ets_processing_handler();
     break;
     
-    case MENU_MODE_FREQUENCY_METER:
-      //comparator_processing_handler();
-      freq_measurement_processing_handler();
-      data_processing_voltmeter_handler();//used for trigger calibration
+    case MENU_MODE_SEGMENTED:
+      segmented_processing_handler();
+    break;
+    
+    case MENU_MODE_AVERAGE:
+      average_processing_handler();
     break;
     
-    case MENU_MODE_SLOW_SCOPE:
-      slow_scope_processing_handler();
+    case MENU_MODE_PERSISTENCE:
+      persistence_processing_handler();
     break;
     
     case MENU_SELECTOR://some data handling must be done in selected menu subitem
       if (menu_selector_adc_calib_running())
         data_processing_adc_calibraion_mode();
+      else
+      {
+        acquisition_cancel(&data_processing_adc_calibration_job);
+        data_processing_zero_calib_stop();
+      }
     break;
 
     
@@ -209,157 +573,360 @@ void data_processing_handler(void)
   }
 }
 
-void data_processing_start_new_capture(void)
+//*****************************************************************************
+
+// Called by acquisition engine when first half of logic probe capture is ready
+// Return 1 if input state is already certain - result is published
+uint8_t data_processing_logic_probe_partial_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  uint32_t start_ticks = hardware_dwt_get();
+  data_processing_logic_probe_reset_stats();
+  data_processing_logic_probe_accumulate(adc_buffer, 0, points);
+  uint8_t certain = data_processing_logic_probe_early_result(adc_buffer, points);
+  hardware_profile_store(HARDWARE_PROFILE_LOGIC_PROBE_DATA, start_ticks);
+  
+  if (certain == 0)
+  {
+    logic_probe_stats_points = points;//rest is added by "job_cb"
+    return 0;
+  }
+  logic_probe_stats_points = 0;
+  data_processing_logic_probe_post_result();
+  return 1;
+}
+
+// Called by acquisition engine in "logic probe" mode - full capture is ready
+void data_processing_logic_probe_job_cb(uint16_t* adc_buffer, uint16_t points)
 {
-  data_processing_state = PROCESSING_IDLE;
+  data_processing_process_logic_probe_data(adc_buffer, points);
+  data_processing_logic_probe_post_result();
 }
 
-//*****************************************************************************
+void data_processing_logic_probe_post_result(void)
+{
+  acq_result_t result;
+  
+  result.job_id = ACQ_JOB_LOGIC_PROBE;
+  result.signal_state = logic_probe_signal_state;
+  result.voltage = voltmeter_voltage;
+  result.ac = data_processing_ac_data;
+  acquisition_mailbox_post(&result);
+}
+
+//Process data captured by ADC1
+void data_processing_process_logic_probe_data(uint16_t* adc_buffer, uint16_t points)
+{
+  uint32_t start_ticks = hardware_dwt_get();
+  if (logic_probe_stats_points == 0)
+    data_processing_logic_probe_reset_stats();
+  data_processing_logic_probe_accumulate(
+    adc_buffer, logic_probe_stats_points, points);
+  logic_probe_stats_points = 0;
+  
+  data_processing_logic_probe_set_state(
+    data_processing_logic_probe_get_full_state(), adc_buffer, points);
+  hardware_profile_store(HARDWARE_PROFILE_LOGIC_PROBE_DATA, start_ticks);
+}
+
+// State of the full capture
+// Periods of both halves are checked too - sum of the capture can look 
+// stable when input has changed its state during the capture
+signal_state_t data_processing_logic_probe_get_full_state(void)
+{
+  logic_probe_stats_t* stats = &logic_probe_stats;
+  const uint8_t low_high_mask = 
+    (1 << SIGNAL_TYPE_LOW_STATE) | (1 << SIGNAL_TYPE_HIGH_STATE);
+  const uint8_t stable_mask = low_high_mask | (1 << SIGNAL_TYPE_Z_STATE);
+  
+  if (stats->pulsed)
+    return SIGNAL_TYPE_PULSED_STATE;
+  
+  //Input was switched between low and high levels
+  if ((stats->period_states & low_high_mask) == low_high_mask)
+    return SIGNAL_TYPE_PULSED_STATE;
+  
+  //Input was connected or disconnected
+  uint8_t stable_states = stats->period_states & stable_mask;
+  if ((stable_states & (stable_states - 1)) != 0)
+    return SIGNAL_TYPE_UNKNOWN_STATE;
+  
+  return data_processing_logic_probe_get_state(
+    stats->correlation, stats->summ, stats->used_cnt);
+}
 
-// Data sampling and processing for "logic probe" mode
-void data_processing_logic_probe_handler(void)
+// Check if state can be published using part of the capture
+// Every generator period is classified separately, state is certain if 
+// all periods and their sum are giving the same result
+// Return 1 if state is certain
+uint8_t data_processing_logic_probe_early_result(uint16_t* adc_buffer, uint16_t points)
 {
-  if (data_processing_state == PROCESSING_IDLE)
+  logic_probe_stats_t* stats = &logic_probe_stats;
+  
+  if (stats->pulsed)
   {
-    generator_timer_start();
-    adc_capture_start();
-    data_processing_state = PROCESSING_CAPTURE_RUNNING;
+    data_processing_logic_probe_set_state(
+      SIGNAL_TYPE_PULSED_STATE, adc_buffer, points);
+    return 1;
   }
-  else if (data_processing_state == PROCESSING_CAPTURE_RUNNING)
+  
+  if ((stats->periods_cnt < DATA_PROC_LOGIC_PROBE_MIN_PERIODS) || 
+      (stats->periods_agree_cnt != stats->periods_cnt) || 
+      (stats->first_period_state == SIGNAL_TYPE_UNKNOWN_STATE))
+    return 0;//ambiguous
+  
+  signal_state_t state = data_processing_logic_probe_get_state(
+    stats->correlation, stats->summ, stats->used_cnt);
+  if (state != stats->first_period_state)
+    return 0;
+  
+  data_processing_logic_probe_set_state(state, adc_buffer, points);
+  return 1;
+}
+
+void data_processing_logic_probe_set_state(
+  signal_state_t state, uint16_t* adc_buffer, uint16_t points)
+{
+  logic_probe_signal_state = state;
+  if (state == SIGNAL_TYPE_PULSED_STATE)
+    data_processing_process_peak_voltmeter_data(adc_buffer, points);
+  else if (state == SIGNAL_TYPE_Z_STATE)
   {
-    if (adc_capture_status == CAPTURE_DONE)
-    {
-      data_processing_state = PROCESSING_DATA;
-      data_processing_correct_raw_data(data_processing_get_adc_offset());
-      data_processing_process_logic_probe_data();
-      data_processing_state = PROCESSING_DATA_DONE;
-    }
+    voltmeter_voltage = 0.0f;
+    memset(&data_processing_ac_data, 0, sizeof(data_processing_ac_data));
   }
+  else
+    data_processing_process_voltmeter_data(adc_buffer, points);
 }
 
-//Process data captured by ADC1
-void data_processing_process_logic_probe_data(void)
+void data_processing_logic_probe_reset_stats(void)
 {
-  uint8_t i;
+  memset(&logic_probe_stats, 0, sizeof(logic_probe_stats));
+  logic_probe_stats.half_min = MAIN_ADC_MAX_VALUE;
+}
+
+// Synchronous (lock-in) detection. ADC_TIMER is started by GENERATOR_TIMER
+// TRGO, so phase of each sample relative to the test signal is known.
+// Every sample is multiplied by reference: +1 - generator is high, -1 - low.
+// Floating input follows the generator - big positive correlation.
+// Input driven by external signal - correlation is near zero.
+// start, end - range of points added to "logic_probe_stats"
+CCM_RAM_FUNC void data_processing_logic_probe_accumulate(
+  uint16_t* adc_buffer, uint16_t start, uint16_t end)
+{
+  logic_probe_stats_t* stats = &logic_probe_stats;
+  uint16_t i;
   
   uint16_t peak_diff_threshold = 
     data_processing_volt_to_points(DATA_PROC_LOGIC_PROBE_PEAK_THRESHOLD);
-
-  for (i = 0; i < DATA_PROC_LOGIC_PROBE_HPERIODS_NUM; i++)
+  
+  for (i = start; i < end; i++)
   {
-    uint16_t start = (DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD * i + DATA_PROC_LOGIC_PROBE_START_OFFSET) * 2;//adc1
+    //Sample "i" is taken (i + 1) ADC_TIMER periods after generator start
+    uint16_t phase = (i + 1) % DATA_PROC_LOGIC_PROBE_SAMPLE_PERIOD;
+    uint16_t half_phase = phase % DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD;
     
-    logic_probe_results[i] = data_processing_calc_adc_average(
-      (uint16_t*)&adc_raw_buffer0[start], DATA_PROC_LOGIC_PROBE_ANALYSE_LENGTH);
+    //Input is settling after generator edge
+    if ((half_phase < DATA_PROC_LOGIC_PROBE_START_OFFSET) || 
+        (half_phase > DATA_PROC_LOGIC_PROBE_HALF_LAST))
+      continue;
     
-//printf(" %i \r\n",   logic_probe_results[i]);   //-------------------------------------------------------------------------------------------------------
+    uint16_t value = adc_buffer[i * 2];//adc1
+    if (phase < DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD)
+      stats->period_correlation+= value;//generator is high
+    else
+      stats->period_correlation-= value;
+    stats->period_summ+= value;
+    stats->period_used_cnt++;
     
     //Calculate pulsation of voltage during HALF of period
-    uint16_t peak_diff_result = data_processing_calc_peak_peak(
-      (uint16_t*)&adc_raw_buffer0[start], DATA_PROC_LOGIC_PROBE_ANALYSE_LENGTH);
+    if (value > stats->half_max)
+      stats->half_max = value;
+    if (value < stats->half_min)
+      stats->half_min = value;
     
-    if (peak_diff_result > peak_diff_threshold)
+    if (half_phase == DATA_PROC_LOGIC_PROBE_HALF_LAST)
     {
-      logic_probe_signal_state = SIGNAL_TYPE_PULSED_STATE;
-      data_processing_process_peak_voltmeter_data();
-      return;
+      if ((stats->half_max - stats->half_min) > peak_diff_threshold)
+      {
+        stats->pulsed = 1;
+        return;
+      }
+      stats->half_min = MAIN_ADC_MAX_VALUE;
+      stats->half_max = 0;
+      
+      if (phase >= DATA_PROC_LOGIC_PROBE_SAMPLE_HPERIOD)
+        data_processing_logic_probe_end_period(stats);
     }
   }
+}
+
+// Generator period is finished - classify it and add to the sum
+CCM_RAM_FUNC void data_processing_logic_probe_end_period(logic_probe_stats_t* stats)
+{
+  signal_state_t state = data_processing_logic_probe_get_state(
+    stats->period_correlation, stats->period_summ, stats->period_used_cnt);
   
-  int16_t diff_results[DATA_PROC_LOGIC_PROBE_HPERIODS_NUM / 2];
-  uint8_t big_diff_cnt = 0;
-  uint8_t low_diff_cnt = 0;
+  if (stats->periods_cnt == 0)
+    stats->first_period_state = state;
+  if (state == stats->first_period_state)
+    stats->periods_agree_cnt++;
+  stats->periods_cnt++;
+  stats->period_states |= (uint8_t)(1 << state);
   
-  for (i = 0; i < DATA_PROC_LOGIC_PROBE_HPERIODS_NUM; i+= 2)
-  {
-    diff_results[i/2] = logic_probe_results[i] - logic_probe_results[i + 1];
-    
-    //Big difference mean that input is floating
-    if (diff_results[i/2] > DATA_PROC_LOGIC_PROBE_BIG_DIFF_THRESHOLD)
-      big_diff_cnt++;
-    
-    //Small difference mean than input is stable
-    if (diff_results[i/2] < DATA_PROC_LOGIC_PROBE_LOW_DIFF_THRESHOLD)
-      low_diff_cnt++;
-  }
- // printf(" %i %i %i --- %i\r\n",  big_diff_cnt, low_diff_cnt, DATA_PROC_LOGIC_PROBE_HPERIODS_NUM/2,logic_probe_results[0] );   //-------------------------------------------------------------------------------------------------------
+  stats->correlation+= stats->period_correlation;
+  stats->summ+= stats->period_summ;
+  stats->used_cnt+= stats->period_used_cnt;
+  stats->period_correlation = 0;
+  stats->period_summ = 0;
+  stats->period_used_cnt = 0;
+}
 
+// Get input state from synchronous detection results
+// used_cnt - number of added samples
+CCM_RAM_FUNC signal_state_t data_processing_logic_probe_get_state(
+  int32_t correlation, uint32_t summ, uint16_t used_cnt)
+{
+  if (used_cnt == 0)
+    return SIGNAL_TYPE_UNKNOWN_STATE;
   
+  //"correlation / (used_cnt / 2)" is difference between average 
+  //voltages of generator high and low states, division is not needed
+  int32_t big_diff_threshold = 
+    (int32_t)DATA_PROC_LOGIC_PROBE_BIG_DIFF_THRESHOLD * used_cnt / 2;
+  int32_t low_diff_threshold = 
+    (int32_t)DATA_PROC_LOGIC_PROBE_LOW_DIFF_THRESHOLD * used_cnt / 2;
   
-  if (big_diff_cnt == (DATA_PROC_LOGIC_PROBE_HPERIODS_NUM / 2))
-  {  
-    logic_probe_signal_state = SIGNAL_TYPE_Z_STATE;
-    voltmeter_voltage = 0.0f;
-  }
-  else if (low_diff_cnt == (DATA_PROC_LOGIC_PROBE_HPERIODS_NUM / 2)) //satble input
-  {
-    //Signal is stable all the time - mean strong external signal
-    if (logic_probe_results[0] > DATA_PROC_LOGIC_PROBE_HIGH_STATE_THRESHOLD)
-    {
-      logic_probe_signal_state = SIGNAL_TYPE_HIGH_STATE;
-      data_processing_process_voltmeter_data();
-    }
-    else if (logic_probe_results[0] < DATA_PROC_LOGIC_PROBE_LOW_STATE_THRESHOLD)
-    {
-      logic_probe_signal_state = SIGNAL_TYPE_LOW_STATE;
-      data_processing_process_voltmeter_data();
-    }
-    else
-    {
-      logic_probe_signal_state = SIGNAL_TYPE_UNKNOWN_STATE;
-      data_processing_process_voltmeter_data();
-    }
-  }
-  else
-  {
-    logic_probe_signal_state = SIGNAL_TYPE_UNKNOWN_STATE;
-    data_processing_process_voltmeter_data();
-  }
+  //Big difference mean that input is floating
+  if (correlation > big_diff_threshold)
+    return SIGNAL_TYPE_Z_STATE;
+  
+  if (abs(correlation) >= low_diff_threshold)
+    return SIGNAL_TYPE_UNKNOWN_STATE;
+  
+  //Signal is stable all the time - mean strong external signal
+  uint16_t average = (uint16_t)(summ / used_cnt);
+  if (average > logic_probe_high_threshold)
+    return SIGNAL_TYPE_HIGH_STATE;
+  else if (average < logic_probe_low_threshold)
+    return SIGNAL_TYPE_LOW_STATE;
+  return SIGNAL_TYPE_UNKNOWN_STATE;
 }
 
 //*****************************************************************************
 
-// Data sampling and processing for "voltmeter" mode
-void data_processing_voltmeter_handler(void)
+// Called by acquisition engine in "voltmeter" mode
+void data_processing_voltmeter_job_cb(uint16_t* adc_buffer, uint16_t points)
 {
-  if (data_processing_state == PROCESSING_IDLE)
-  {
-    adc_capture_start();
-    data_processing_state = PROCESSING_CAPTURE_RUNNING;
-  }
-  else if (data_processing_state == PROCESSING_CAPTURE_RUNNING)
-  {
-    if (adc_capture_status == CAPTURE_DONE) //DMA transfer is done
-    {
-      data_processing_state = PROCESSING_DATA;
-      data_processing_correct_raw_data(data_processing_get_adc_offset());
-      data_processing_process_voltmeter_data();
-      data_processing_state = PROCESSING_DATA_DONE;
-    }
-  }
+  acq_result_t result;
+  
+  data_processing_process_voltmeter_data(adc_buffer, points);
+  result.job_id = ACQ_JOB_VOLTMETER;
+  result.signal_state = SIGNAL_TYPE_UNKNOWN_STATE;
+  result.voltage = voltmeter_voltage;
+  result.ac = data_processing_ac_data;
+  acquisition_mailbox_post(&result);
 }
 
 //Process data captured by ADC1 and ADC2
-void data_processing_process_voltmeter_data(void)
+void data_processing_process_voltmeter_data(uint16_t* adc_buffer, uint16_t points)
 {
-  uint16_t adc1_result = data_processing_calc_adc_average( //divider - coarse
-      (uint16_t*)&adc_raw_buffer0[6], (MAIN_ADC_CAPTURED_POINTS - 3));
-  uint16_t adc2_result = data_processing_calc_adc_average( //opamp - fine
-        (uint16_t*)&adc_raw_buffer0[7], (MAIN_ADC_CAPTURED_POINTS - 3));
-  
-  voltmeter_voltage = data_processing_adc_to_voltage(adc1_result, adc2_result);
+  data_processing_ac_data = data_processing_ac_measure(&adc_buffer[6], (points - 3));
+  voltmeter_voltage = data_processing_ac_data.mean;
 }
 
 //Process data captured by ADC1 and ADC2
 //Maximum value is used here
-void data_processing_process_peak_voltmeter_data(void)
+void data_processing_process_peak_voltmeter_data(uint16_t* adc_buffer, uint16_t points)
+{
+  data_processing_ac_data = data_processing_ac_measure(&adc_buffer[6], (points - 3));
+  voltmeter_voltage = data_processing_ac_data.max_voltage;
+}
+
+// Mean, RMS, Vpp and crest factor in one integer pass over fused samples
+// length - number of ADC1/fused pairs
+adc_ac_data_t data_processing_ac_measure(uint16_t* adc_buffer, uint16_t length)
+{
+  adc_ac_data_t result;
+  data_processing_ac_summ_t summ;
+  
+  memset(&result, 0, sizeof(result));
+  if (length == 0)
+    return result;
+  
+  uint32_t start_ticks = hardware_dwt_get();
+  data_processing_ac_accumulate(adc_buffer, length, &summ);
+  
+  uint64_t mean_square = summ.summ_sq / length;
+  //n*summ(x^2) - summ(x)^2 = n^2 * variance
+  uint64_t variance = 0;
+  uint64_t summ_square = (uint64_t)summ.summ * summ.summ;
+  if ((summ.summ_sq * length) > summ_square)
+    variance = (summ.summ_sq * length - summ_square) / ((uint64_t)length * length);
+  
+  float volts_per_point = data_processing_fused_to_voltage(1);
+  
+  result.mean = (float)summ.summ / (float)length * volts_per_point;
+  result.rms = (float)data_processing_isqrt64(mean_square) * volts_per_point;
+  result.ac_rms = (float)data_processing_isqrt64(variance) * volts_per_point;
+  result.min_voltage = (float)summ.min_value * volts_per_point;
+  result.max_voltage = (float)summ.max_value * volts_per_point;
+  result.vpp = result.max_voltage - result.min_voltage;
+  if (result.rms > 0.0f)
+    result.crest_factor = result.max_voltage / result.rms;
+  
+  hardware_profile_store(HARDWARE_PROFILE_AC_MEASURE, start_ticks);
+  return result;
+}
+
+CCM_RAM_FUNC void data_processing_ac_accumulate(
+  uint16_t* adc_buffer, uint16_t length, data_processing_ac_summ_t* summ)
+{
+  uint32_t summ_value = 0;
+  uint64_t summ_sq = 0;
+  uint32_t min_value = 0xFFFFFFFF;
+  uint32_t max_value = 0;
+  
+  for (uint16_t i = 0; i < (length * 2); i+= 2)
+  {
+    uint32_t value = adc_buffer[i + 1];//fused sample
+    
+    summ_value+= value;
+    summ_sq+= (uint64_t)value * value;
+    if (value < min_value)
+      min_value = value;
+    if (value > max_value)
+      max_value = value;
+  }
+  
+  summ->summ = summ_value;
+  summ->summ_sq = summ_sq;
+  summ->min_value = min_value;
+  summ->max_value = max_value;
+}
+
+// Integer square root, bit by bit
+CCM_RAM_FUNC uint32_t data_processing_isqrt64(uint64_t value)
 {
-  uint16_t adc1_result = data_processing_calc_adc_maximum( //divider - coarse
-      (uint16_t*)&adc_raw_buffer0[6], (MAIN_ADC_CAPTURED_POINTS - 3));
-  uint16_t adc2_result = data_processing_calc_adc_maximum( //opamp - fine
-        (uint16_t*)&adc_raw_buffer0[7], (MAIN_ADC_CAPTURED_POINTS - 3));
+  uint64_t result = 0;
+  uint64_t bit = (uint64_t)1 << 62;
   
-  voltmeter_voltage = data_processing_adc_to_voltage(adc1_result, adc2_result);
+  while (bit > value)
+    bit >>= 2;
+  
+  while (bit != 0)
+  {
+    if (value >= (result + bit))
+    {
+      value-= result + bit;
+      result = (result >> 1) + bit;
+    }
+    else
+    {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)result;
 }
 
 //*****************************************************************************
@@ -376,44 +943,60 @@ void data_processing_adc_calibraion_mode(void)
   
   switch (data_processing_adc_calib_state)
   {
+    case ADC_CALIB_DISPLAY_ZERO_MSG:
+      if (TIMER_ELAPSED(data_processing_adc_calib_timer))
+      {
+        data_processing_adc_calib_state = ADC_CALIB_MEASURE_ZERO;
+        START_TIMER(data_processing_adc_calib_timer, DATA_PROC_ZERO_CALIB_TIMEOUT);
+        data_processing_zero_calib_start();
+      }
+    break;
+    
+    case ADC_CALIB_MEASURE_ZERO: //done by "data_processing_zero_calib_job_cb"
+      if (TIMER_ELAPSED(data_processing_adc_calib_timer))
+      {
+        //input is not grounded - old offsets are kept
+        data_processing_zero_calib_stop();
+        data_processing_adc_calib_state = ADC_CALIB_DISPLAY_MSG1;
+        START_TIMER(data_processing_adc_calib_timer, 2000);
+      }
+    break;
+    
     case ADC_CALIB_DISPLAY_MSG1:
       if (TIMER_ELAPSED(data_processing_adc_calib_timer))
       {
         //time to start ADC capture
         data_processing_adc_calib_state = ADC_CALIB_MEASURE1;
-        adc_set_sample_rate(DATA_PROC_LOW_SAMPLE_RATE);
-        adc_capture_start();
+        data_processing_pga_calib_start();
+        acquisition_submit(&data_processing_adc_calibration_job);
       }
     break;
     
     case ADC_CALIB_MEASURE1: //measuring average ext voltage at ADC1
-      if (adc_capture_status == CAPTURE_DONE)
-      {
-        data_processing_correct_raw_data(data_processing_get_adc_offset());
-        data_processing_process_adc_calibration_data();
-        adc_capture_start();
-      }
-      break;
+      break;//done by "data_processing_adc_calibration_job_cb"
       
     case ADC_CALIB_DISPLAY_CALIB:
+      acquisition_cancel(&data_processing_adc_calibration_job);
       data_processing_process_adc_calibraion_fifo();//used for recalculating "data_processing_adc_calib_voltage"
       break;
   }
 }
 
-void data_processing_process_adc_calibration_data(void)
+// Called by acquisition engine while ADC calibration is running
+void data_processing_adc_calibration_job_cb(uint16_t* adc_buffer, uint16_t points)
 {
   if (data_processing_adc_calib_state == ADC_CALIB_MEASURE1)
   {
     uint16_t adc1_result = data_processing_calc_adc_average( //divider - coarse
-      (uint16_t*)&adc_raw_buffer0[6], (MAIN_ADC_CAPTURED_POINTS - 3));
+      &adc_buffer[6], (points - 3));
     
     //check if the captured signal is suitable
     float tmp_voltage = data_processing_adc_to_voltage(adc1_result, 0);
+    data_processing_pga_calib_add(adc_buffer, points, tmp_voltage);
     if (tmp_voltage > DATA_PROC_MIN_ADC_CALIB_VOLTAGE) //voltage is high enought
     {
       adc_processed_data_t tmp_result = data_processing_extended(
-        (uint16_t*)&adc_raw_buffer0[6], (MAIN_ADC_CAPTURED_POINTS - 3));
+        &adc_buffer[6], (points - 3));
       if (tmp_result.signal_type != ADC_SIGNAL_TYPE_STABLE)
       {
         tmp_voltage = 0.0f;
@@ -425,6 +1008,7 @@ void data_processing_process_adc_calibration_data(void)
       {
         //Get stable voltage value
         data_processing_adc_calib_state = ADC_CALIB_DISPLAY_CALIB;
+        data_processing_pga_calib_finish();
       }
     }
     else
@@ -434,6 +1018,129 @@ void data_processing_process_adc_calibration_data(void)
   }
 }
 
+// Zero calibration: ADC1 offset at grounded input is measured for each sampling time
+// Raw data correction is disabled by "data_processing_get_adc_offset" meanwhile
+void data_processing_zero_calib_start(void)
+{
+  data_processing_zero_calib_running = 1;
+  data_processing_zero_calib_idx = 0;
+  data_processing_zero_calib_submit();
+}
+
+void data_processing_zero_calib_submit(void)
+{
+  data_processing_zero_calib_job.sample_rate = 
+    adc_get_sample_time_rate(data_processing_zero_calib_idx);
+  acquisition_submit(&data_processing_zero_calib_job);
+}
+
+void data_processing_zero_calib_stop(void)
+{
+  acquisition_cancel(&data_processing_zero_calib_job);
+  data_processing_zero_calib_running = 0;
+}
+
+// Called by acquisition engine for each sampling time
+void data_processing_zero_calib_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  if ((data_processing_zero_calib_running == 0) || 
+      (data_processing_adc_calib_state != ADC_CALIB_MEASURE_ZERO))
+    return;
+  
+  uint16_t average = data_processing_calc_adc_average(&adc_buffer[6], (points - 3));
+  uint16_t noise = data_processing_calc_peak_peak(&adc_buffer[6], (points - 3));
+  if ((average > DATA_PROC_ZERO_CALIB_MAX_OFFSET) || 
+      (noise > DATA_PROC_ZERO_CALIB_MAX_NOISE))
+  {
+    //input is not grounded - start again
+    data_processing_zero_calib_idx = 0;
+    data_processing_zero_calib_submit();
+    return;
+  }
+  
+  data_processing_zero_calib_offsets[data_processing_zero_calib_idx] = average;
+  data_processing_zero_calib_idx++;
+  if (data_processing_zero_calib_idx < ADC_SAMPLE_TIMES_CNT)
+  {
+    data_processing_zero_calib_submit();
+    return;
+  }
+  
+  memcpy(nvram_data.adc_zero_offsets, data_processing_zero_calib_offsets, 
+    sizeof(nvram_data.adc_zero_offsets));
+  nvram_write_record(NVRAM_KEY_ADC_ZERO_OFFSETS, 
+    nvram_data.adc_zero_offsets, sizeof(nvram_data.adc_zero_offsets));
+  data_processing_zero_calib_running = 0;
+  data_processing_adc_calib_state = ADC_CALIB_DISPLAY_MSG1;
+  START_TIMER(data_processing_adc_calib_timer, 2000);
+}
+
+// PGA calibration: ADC2 voltage of stable captures is compared with ADC1 voltage
+// Each capture is made with the next gain, gains with saturated ADC2 are skipped
+void data_processing_pga_calib_start(void)
+{
+  for (uint8_t i = 0; i < ADC_OPAMP_GAINS_CNT; i++)
+  {
+    data_processing_pga_calib_summ[i] = 0.0f;
+    data_processing_pga_calib_cnt[i] = 0;
+  }
+}
+
+// adc1_voltage - average voltage of the capture, measured by ADC1
+void data_processing_pga_calib_add(uint16_t* adc_buffer, uint16_t points, float adc1_voltage)
+{
+  uint8_t gain_idx = data_processing_opamp_gain;
+  adc_request_opamp_gain((gain_idx + 1) % ADC_OPAMP_GAINS_CNT);
+  
+  if (adc1_voltage < DATA_PROC_PGA_CALIB_MIN_VOLTAGE)
+    return;
+  if (data_processing_pga_calib_cnt[gain_idx] == 0xFF)
+    return;
+  
+  adc_processed_data_t tmp_result = 
+    data_processing_extended(&adc_buffer[6], (points - 3));
+  if (tmp_result.signal_type != ADC_SIGNAL_TYPE_STABLE)
+    return;
+  
+  //Fused samples must be made from ADC2 only
+  uint32_t max_points = 
+    ((uint32_t)data_processing_volt_to_fused(tmp_result.max_voltage) << 
+    DATA_PROC_FUSE_GAIN_BITS) / data_processing_fine_gains[gain_idx];
+  if (max_points >= DATA_PROC_FUSE_BLEND_START)
+    return;
+  
+  uint16_t fused_result = data_processing_calc_adc_average(&adc_buffer[7], (points - 3));
+  data_processing_pga_calib_summ[gain_idx] += 
+    data_processing_fused_to_voltage(fused_result) / adc1_voltage;
+  data_processing_pga_calib_cnt[gain_idx]++;
+}
+
+// Gains without measurements get coefficient of the nearest smaller measured gain -
+// PGA resistor ratios are precise, gain error is mostly common for all gains
+void data_processing_pga_calib_finish(void)
+{
+  uint8_t measured_flag = 0;
+  float coef = 1.0f;
+  
+  for (uint8_t i = 0; i < ADC_OPAMP_GAINS_CNT; i++)
+  {
+    if (data_processing_pga_calib_cnt[i] != 0)
+    {
+      coef = nvram_data.pga_gain_coef[i] * 
+        data_processing_pga_calib_summ[i] / (float)data_processing_pga_calib_cnt[i];
+      measured_flag = 1;
+    }
+    if (measured_flag)
+      nvram_data.pga_gain_coef[i] = coef;
+  }
+  
+  if (measured_flag == 0)
+    return;
+  data_processing_update_amp_div();
+  nvram_write_record(NVRAM_KEY_PGA_GAIN_COEF, 
+    nvram_data.pga_gain_coef, sizeof(nvram_data.pga_gain_coef));
+}
+
 void data_processing_adc_calibration_add_to_fifo(uint16_t new_value)
 {
   data_processing_adc_calib_fifo[data_processing_adc_calib_fifo_pos] = new_value;
@@ -499,7 +1206,7 @@ float data_processing_adc_to_voltage(uint16_t adc1, uint16_t adc2)
 // Calculate average value from RAW adc data
 // length - number of analysed points
 // Return - raw voltage
-uint16_t data_processing_calc_adc_average(uint16_t* adc_buffer, uint16_t length)
+CCM_RAM_FUNC uint16_t data_processing_calc_adc_average(uint16_t* adc_buffer, uint16_t length)
 {
   uint16_t i;
   if (length == 0)
@@ -513,28 +1220,9 @@ uint16_t data_processing_calc_adc_average(uint16_t* adc_buffer, uint16_t length)
   return (uint16_t)(summ / length);
 }
 
-// Calculate maximum value from RAW adc data
-// length - number of analysed points
-// Return - raw voltage
-uint16_t data_processing_calc_adc_maximum(uint16_t* adc_buffer, uint16_t length)
-{
-  uint16_t i;
-  if (length == 0)
-    return 0;
-  
-  uint16_t max_value = 0;
-  for (i = 0; i < (length * 2); i+= 2)
-  {
-    // data from two ADC's alternates
-    if (adc_buffer[i] > max_value)
-      max_value = adc_buffer[i];
-  }
-  return (uint16_t)max_value;
-}
-
 // Calculate peak-peak value from RAW adc data
 // length - number of analysed points
-uint16_t data_processing_calc_peak_peak(uint16_t* adc_buffer, uint16_t length)
+CCM_RAM_FUNC uint16_t data_processing_calc_peak_peak(uint16_t* adc_buffer, uint16_t length)
 {
   uint16_t i;
   if (length == 0)
@@ -554,21 +1242,32 @@ uint16_t data_processing_calc_peak_peak(uint16_t* adc_buffer, uint16_t length)
 }
 
 //analyse signal - get min, max and edge statictics
+//Fused samples are used (see "data_processing_fuse_samples")
 //length - size in samples
 adc_processed_data_t data_processing_extended(uint16_t* adc_buffer, uint16_t length)
+{
+  uint32_t start_ticks = hardware_dwt_get();
+  adc_processed_data_t result = 
+    data_processing_extended_internal(adc_buffer, length);
+  hardware_profile_store(HARDWARE_PROFILE_EXTENDED_DATA, start_ticks);
+  return result;
+}
+
+CCM_RAM_FUNC adc_processed_data_t data_processing_extended_internal(
+  uint16_t* adc_buffer, uint16_t length)
 {
   uint16_t i;
   adc_processed_data_t result = {0.0f, 0.0f, ADC_SIGNAL_TYPE_STABLE};
   if (length == 0)
     return result;
   
-  uint16_t min = adc_buffer[0];
-  uint16_t max = adc_buffer[0];
-  uint16_t min_pos = 0;
-  uint16_t max_pos = 0;
+  uint16_t min = adc_buffer[1];
+  uint16_t max = adc_buffer[1];
+  uint16_t min_pos = 1;
+  uint16_t max_pos = 1;
   
-  //Get min and max aw values
-  for (i = 0; i < (length * 2); i+= 2)
+  //Get min and max fused values
+  for (i = 1; i < (length * 2); i+= 2)
   {
     if (adc_buffer[i] > max)
     {
@@ -582,14 +1281,9 @@ adc_processed_data_t data_processing_extended(uint16_t* adc_buffer, uint16_t len
     }
   }
   
-  result.max_voltage = data_processing_adc_to_voltage(
-    adc_buffer[max_pos], adc_buffer[max_pos + 1]);
-  
-  result.min_voltage = data_processing_adc_to_voltage(
-    adc_buffer[min_pos], adc_buffer[min_pos + 1]);
-  
-  result.end_voltage = data_processing_adc_to_voltage(
-    adc_buffer[length * 2 - 2], adc_buffer[length * 2 - 1]);
+  result.max_voltage = data_processing_fused_to_voltage(adc_buffer[max_pos]);
+  result.min_voltage = data_processing_fused_to_voltage(adc_buffer[min_pos]);
+  result.end_voltage = data_processing_fused_to_voltage(adc_buffer[length * 2 - 1]);
   
   float tmp_diff = result.max_voltage - result.min_voltage;
   if (tmp_diff < DATA_PROC_STABLE_ANALYSE_THRESHOLD)
@@ -609,17 +1303,17 @@ adc_processed_data_t data_processing_extended(uint16_t* adc_buffer, uint16_t len
 
 //Calculate number of signal edges
 //threshold_v - voltage in volts
-uint16_t data_processing_calculate_edges(
+CCM_RAM_FUNC uint16_t data_processing_calculate_edges(
   uint16_t* adc_buffer, uint16_t length, float threshold_v)
 {
   if (length == 0)
     return 0;
   
-  uint16_t raw_threshold = data_processing_volt_to_points(threshold_v);//adc1 raw value
+  uint16_t raw_threshold = data_processing_volt_to_fused(threshold_v);
   
   uint16_t i;
   uint16_t counter = 0;
-  for (i = 2; i < (length * 2); i+= 2)
+  for (i = 3; i < (length * 2); i+= 2)//fused samples
   {
     if ((adc_buffer[i - 2] >= raw_threshold) && (adc_buffer[i] < raw_threshold))
       counter++;
@@ -629,6 +1323,64 @@ uint16_t data_processing_calculate_edges(
   return counter;
 }
 
+//Edge-rate probe: return number of full signal periods in the capture
+//Rising edges are counted with hysteresis, so noise is not counted
+CCM_RAM_FUNC uint16_t data_processing_count_periods(uint16_t* adc_buffer, uint16_t length)
+{
+  uint16_t min_value = 0xFFFF;
+  uint16_t max_value = 0;
+  uint16_t i;
+  
+  for (i = 1; i < (length * 2); i+= 2)//fused samples
+  {
+    if (adc_buffer[i] < min_value)
+      min_value = adc_buffer[i];
+    if (adc_buffer[i] > max_value)
+      max_value = adc_buffer[i];
+  }
+  
+  if ((length == 0) || ((max_value - min_value) < 
+      data_processing_volt_to_fused(DATA_PROC_STABLE_ANALYSE_THRESHOLD)))
+    return 0;//stable signal
+  
+  uint16_t swing = max_value - min_value;
+  uint16_t low_threshold = min_value + swing / 3;
+  uint16_t high_threshold = max_value - swing / 3;
+  
+  uint8_t is_high = (adc_buffer[1] >= high_threshold);
+  uint16_t rising_cnt = 0;
+  for (i = 3; i < (length * 2); i+= 2)
+  {
+    if (is_high && (adc_buffer[i] < low_threshold))
+      is_high = 0;
+    else if ((is_high == 0) && (adc_buffer[i] >= high_threshold))
+    {
+      is_high = 1;
+      rising_cnt++;
+    }
+  }
+  
+  //Period is the distance between two rising edges
+  if (rising_cnt < 2)
+    return 0;
+  return rising_cnt - 1;
+}
+
+// Set logic probe input thresholds - VIL and VIH of the logic family
+void data_processing_set_logic_thresholds(float low_v, float high_v)
+{
+  logic_probe_low_threshold_v = low_v;
+  logic_probe_high_threshold_v = high_v;
+  logic_probe_low_threshold = data_processing_volt_to_points(low_v);
+  logic_probe_high_threshold = data_processing_volt_to_points(high_v);
+}
+
+void data_processing_get_logic_thresholds(float* low_v, float* high_v)
+{
+  *low_v = logic_probe_low_threshold_v;
+  *high_v = logic_probe_high_threshold_v;
+}
+
 //Convert voltage (probe input 0 - 30V) to ADC1 points
 uint16_t data_processing_volt_to_points(float voltage)
 {
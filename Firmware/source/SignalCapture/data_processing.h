@@ -17,17 +17,14 @@
 // Number of sampled points to skip
 #define DATA_PROC_LOGIC_PROBE_START_OFFSET      (4)
 
-typedef enum
-{
-  PROCESSING_IDLE = 0,
-  PROCESSING_CAPTURE_RUNNING,
-  PROCESSING_DATA,
-  PROCESSING_DATA_DONE
-} data_processing_state_t;
+// If (max-min) voltage less than this value, so it is stable
+#define DATA_PROC_STABLE_ANALYSE_THRESHOLD      0.15f //V
 
 typedef enum
 {
-  ADC_CALIB_DISPLAY_MSG1 = 0,
+  ADC_CALIB_DISPLAY_ZERO_MSG = 0,
+  ADC_CALIB_MEASURE_ZERO,//measure ADC1 zero offsets
+  ADC_CALIB_DISPLAY_MSG1,
   ADC_CALIB_MEASURE1,//measure ext voltage
   ADC_CALIB_DISPLAY_CALIB,
 } adc_calibration_state_t;
@@ -56,24 +53,43 @@ typedef struct
   adc_signal_state_t signal_type; 
 } adc_processed_data_t;
 
+// Result of "data_processing_ac_measure", all voltages are in volts
+typedef struct
+{
+  float mean;
+  float rms;//true RMS - DC + AC
+  float ac_rms;//RMS without DC
+  float min_voltage;
+  float max_voltage;
+  float vpp;
+  float crest_factor;//peak / RMS
+} adc_ac_data_t;
+
 
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
-extern data_processing_state_t data_processing_state;
-extern signal_state_t logic_probe_signal_state;
-extern float voltmeter_voltage;
-
 void data_processing_init(void);
 uint16_t data_processing_volt_to_points(float voltage);
 void data_processing_main_mode_changed(void);
 void data_processing_handler(void);
-void data_processing_start_new_capture(void);
 
-void data_processing_correct_raw_data(uint16_t zero_offset);
-uint16_t data_processing_get_adc_offset(void);
+void data_processing_correct_raw_data(
+  uint16_t* adc_buffer, uint16_t length, uint16_t zero_offset);
+uint16_t data_processing_get_adc_offset(uint32_t sample_rate);
+void data_processing_fuse_samples(uint16_t* adc_buffer, uint16_t length);
+float data_processing_fused_to_voltage(uint16_t value);
+uint16_t data_processing_volt_to_fused(float voltage);
+void data_processing_update_amp_div(void);
+void data_processing_set_opamp_gain(uint8_t gain_idx);
+void data_processing_auto_range(void);
+
+void data_processing_set_logic_thresholds(float low_v, float high_v);
+void data_processing_get_logic_thresholds(float* low_v, float* high_v);
 
 adc_processed_data_t data_processing_extended(uint16_t* adc_buffer, uint16_t length);
+adc_ac_data_t data_processing_ac_measure(uint16_t* adc_buffer, uint16_t length);
+uint16_t data_processing_count_periods(uint16_t* adc_buffer, uint16_t length);
 
 
 #endif /* __DATA_PROCESSING_H */
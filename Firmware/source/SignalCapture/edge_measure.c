@@ -0,0 +1,258 @@
+//Edge parameters of the captured waveform: rise/fall time, overshoot and
+//settling time. Integer kernel finds edges by 10/50/90% threshold crossings,
+//crossing positions are linearly interpolated between samples.
+
+/* Includes ------------------------------------------------------------------*/
+#include "edge_measure.h"
+#include "hardware.h"
+#include "main.h"
+#include "stdlib.h"
+#include "string.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  EDGE_MEASURE_LEVEL_UNKNOWN = 0,
+  EDGE_MEASURE_LEVEL_LOW,
+  EDGE_MEASURE_LEVEL_HIGH,
+} edge_measure_level_t;
+
+/* Private define ------------------------------------------------------------*/
+// Plateau level is averaged with 1/(2^N) coefficient
+#define EDGE_MEASURE_AVG_SHIFT                  3
+
+// Fraction bits of plateau level
+#define EDGE_MEASURE_LEVEL_BITS                 4
+
+// Settling band is swing / N (5%)
+#define EDGE_MEASURE_BAND_DIV                   20
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+uint32_t edge_measure_cross(uint16_t idx, int32_t prev, int32_t cur, int32_t threshold);
+uint32_t edge_measure_settled_pos(const uint16_t* samples, uint8_t stride,
+  uint16_t first, uint16_t end, int32_t settled, int32_t band);
+
+/* Private functions ---------------------------------------------------------*/
+
+// Rise/fall time, overshoot and settling time in one integer pass
+// Crossing points are linearly interpolated between samples
+// samples - fused samples, "stride" elements between them:
+// 2 for ADC1/fused pairs (pass &adc_buffer[1]), 1 for plain array
+// low, high - signal levels in fused points, thresholds are 10/50/90% of them
+// sample_rate - Hz
+adc_edge_data_t edge_measure_process(const uint16_t* samples, uint16_t length,
+  uint8_t stride, uint16_t low, uint16_t high, float sample_rate)
+{
+  adc_edge_data_t result;
+  edge_measure_levels_t levels;
+  edge_measure_summ_t summ;
+  
+  memset(&result, 0, sizeof(result));
+  if ((length < 2) || (high <= low) || (sample_rate <= 0.0f))
+    return result;
+  
+  uint32_t start_ticks = hardware_dwt_get();
+  int32_t swing = high - low;
+  levels.low = low + swing / 10;
+  levels.middle = low + swing / 2;
+  levels.high = high - swing / 10;
+  levels.band = swing / EDGE_MEASURE_BAND_DIV;
+  edge_measure_kernel(samples, length, stride, &levels, &summ);
+  
+  float sample_time = 1.0f / sample_rate / (float)(1 << EDGE_MEASURE_POS_BITS);
+  result.rising_cnt = summ.rise_cnt;
+  result.falling_cnt = summ.fall_cnt;
+  if (summ.rise_cnt > 0)
+    result.rise_time = (float)summ.rise_summ / (float)summ.rise_cnt * sample_time;
+  if (summ.fall_cnt > 0)
+    result.fall_time = (float)summ.fall_summ / (float)summ.fall_cnt * sample_time;
+  if (summ.plateau_cnt > 0)
+  {
+    result.overshoot = 100.0f * (float)summ.overshoot_summ / 
+      (float)summ.plateau_cnt / (float)swing;
+    result.settling_time = 
+      (float)summ.settle_summ / (float)summ.plateau_cnt * sample_time;
+  }
+  
+  hardware_profile_store(HARDWARE_PROFILE_EDGE_MEASURE, start_ticks);
+  return result;
+}
+
+// Plateau is the part between two edges. Its level is running average.
+// Excursion towards the other level (out of the band around the plateau level)
+// can be ringing or next edge, so plateau state is saved at its start and
+// used if next edge is confirmed. Sample before the excursion can be the
+// start of the edge too, so it is not included into the saved level. Settling time ends at the last sample
+// outside the band around the settled level - plateau level before the next edge.
+CCM_RAM_FUNC void edge_measure_kernel(const uint16_t* samples, uint16_t length, uint8_t stride,
+  const edge_measure_levels_t* levels, edge_measure_summ_t* summ)
+{
+  edge_measure_level_t level = EDGE_MEASURE_LEVEL_UNKNOWN;
+  uint8_t plateau_valid = 0;//plateau was started by edge
+  uint8_t start_valid = 0;//10% (90% for falling) crossing is found
+  uint8_t excursion = 0;//sample is out of the band towards the other level
+  uint32_t start_pos = 0;
+  uint32_t mid_pos = 0;//50% crossing of the edge that started plateau
+  uint32_t new_mid_pos = 0;
+  uint16_t plateau_start = 0;//index of the first plateau sample
+  int32_t plateau_level = 0;//EDGE_MEASURE_LEVEL_BITS fraction
+  int32_t prev_plateau_level = 0;//before the previous sample
+  int32_t peak = 0;//max of high plateau, min of low plateau
+  
+  //Saved at the start of the excursion
+  int32_t saved_level = 0;
+  uint16_t saved_idx = 0;
+  
+  memset(summ, 0, sizeof(edge_measure_summ_t));
+  
+  int32_t prev = samples[0];
+  if (prev <= levels->low)
+    level = EDGE_MEASURE_LEVEL_LOW;
+  else if (prev >= levels->high)
+    level = EDGE_MEASURE_LEVEL_HIGH;
+  
+  for (uint16_t i = 1; i < length; i++)
+  {
+    int32_t cur = samples[i * stride];
+    uint8_t edge_done = 0;
+    
+    if (level != EDGE_MEASURE_LEVEL_UNKNOWN)
+    {
+      int32_t deviation = cur - (plateau_level >> EDGE_MEASURE_LEVEL_BITS);
+      if (level == EDGE_MEASURE_LEVEL_HIGH)
+        deviation = -deviation;
+      if (deviation > levels->band)
+      {
+        if (excursion == 0)
+        {
+          saved_level = prev_plateau_level;
+          saved_idx = i - 1;
+        }
+        excursion = 1;
+      }
+      else
+      {
+        excursion = 0;
+      }
+    }
+    
+    if (cur > prev)
+    {
+      if ((prev < levels->low) && (cur >= levels->low))
+      {
+        start_pos = edge_measure_cross(i, prev, cur, levels->low);
+        start_valid = (level == EDGE_MEASURE_LEVEL_LOW);
+      }
+      if ((prev < levels->middle) && (cur >= levels->middle))
+        new_mid_pos = edge_measure_cross(i, prev, cur, levels->middle);
+      if ((prev < levels->high) && (cur >= levels->high) && 
+          (level != EDGE_MEASURE_LEVEL_HIGH))
+      {
+        if (start_valid)
+        {
+          summ->rise_summ+= edge_measure_cross(i, prev, cur, levels->high) - start_pos;
+          summ->rise_cnt++;
+        }
+        if (plateau_valid && start_valid)
+        {
+          int32_t settled = saved_level >> EDGE_MEASURE_LEVEL_BITS;
+          if (settled > peak)
+            summ->overshoot_summ+= settled - peak;
+          uint32_t settled_pos = edge_measure_settled_pos(
+            samples, stride, plateau_start, saved_idx, settled, levels->band);
+          if (settled_pos > mid_pos)
+            summ->settle_summ+= settled_pos - mid_pos;
+          summ->plateau_cnt++;
+        }
+        plateau_valid = start_valid;
+        level = EDGE_MEASURE_LEVEL_HIGH;
+        edge_done = 1;
+      }
+    }
+    else if (cur < prev)
+    {
+      if ((prev > levels->high) && (cur <= levels->high))
+      {
+        start_pos = edge_measure_cross(i, prev, cur, levels->high);
+        start_valid = (level == EDGE_MEASURE_LEVEL_HIGH);
+      }
+      if ((prev > levels->middle) && (cur <= levels->middle))
+        new_mid_pos = edge_measure_cross(i, prev, cur, levels->middle);
+      if ((prev > levels->low) && (cur <= levels->low) && 
+          (level != EDGE_MEASURE_LEVEL_LOW))
+      {
+        if (start_valid)
+        {
+          summ->fall_summ+= edge_measure_cross(i, prev, cur, levels->low) - start_pos;
+          summ->fall_cnt++;
+        }
+        if (plateau_valid && start_valid)
+        {
+          int32_t settled = saved_level >> EDGE_MEASURE_LEVEL_BITS;
+          if (peak > settled)
+            summ->overshoot_summ+= peak - settled;
+          uint32_t settled_pos = edge_measure_settled_pos(
+            samples, stride, plateau_start, saved_idx, settled, levels->band);
+          if (settled_pos > mid_pos)
+            summ->settle_summ+= settled_pos - mid_pos;
+          summ->plateau_cnt++;
+        }
+        plateau_valid = start_valid;
+        level = EDGE_MEASURE_LEVEL_LOW;
+        edge_done = 1;
+      }
+    }
+    
+    if (edge_done)
+    {
+      //New plateau
+      start_valid = 0;
+      excursion = 0;
+      mid_pos = new_mid_pos;
+      plateau_start = i;
+      plateau_level = cur << EDGE_MEASURE_LEVEL_BITS;
+      prev_plateau_level = plateau_level;
+      peak = cur;
+    }
+    else if (level != EDGE_MEASURE_LEVEL_UNKNOWN)
+    {
+      prev_plateau_level = plateau_level;
+      plateau_level+= 
+        ((cur << EDGE_MEASURE_LEVEL_BITS) - plateau_level) >> EDGE_MEASURE_AVG_SHIFT;
+      
+      if ((level == EDGE_MEASURE_LEVEL_HIGH) && (cur > peak))
+        peak = cur;
+      else if ((level == EDGE_MEASURE_LEVEL_LOW) && (cur < peak))
+        peak = cur;
+    }
+    prev = cur;
+  }
+}
+
+// Position of the last plateau sample outside the band around "settled" level
+// Plateau samples are "first" ... "end - 1", search is backward from the end
+// EDGE_MEASURE_POS_BITS fraction
+CCM_RAM_FUNC uint32_t edge_measure_settled_pos(const uint16_t* samples, uint8_t stride,
+  uint16_t first, uint16_t end, int32_t settled, int32_t band)
+{
+  uint16_t i = end;
+  while (i > first)
+  {
+    i--;
+    int32_t deviation = (int32_t)samples[i * stride] - settled;
+    if ((deviation > band) || (deviation < -band))
+      break;
+  }
+  return (uint32_t)i << EDGE_MEASURE_POS_BITS;
+}
+
+// Position of "threshold" crossing between samples "idx - 1" and "idx"
+// EDGE_MEASURE_POS_BITS fraction
+CCM_RAM_FUNC uint32_t edge_measure_cross(
+  uint16_t idx, int32_t prev, int32_t cur, int32_t threshold)
+{
+  uint32_t part = (uint32_t)abs(threshold - prev) << EDGE_MEASURE_POS_BITS;
+  return ((uint32_t)(idx - 1) << EDGE_MEASURE_POS_BITS) + part / (uint32_t)abs(cur - prev);
+}
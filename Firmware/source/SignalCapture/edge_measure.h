@@ -0,0 +1,52 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __EDGE_MEASURE_H
+#define __EDGE_MEASURE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f30x.h"
+#include "config.h"
+
+/* Exported types ------------------------------------------------------------*/
+// Fraction bits of interpolated crossing positions
+#define EDGE_MEASURE_POS_BITS                   8
+
+// Result of "edge_measure_process", averaged over all edges
+typedef struct
+{
+  uint16_t rising_cnt;
+  uint16_t falling_cnt;
+  float rise_time;//10%-90%, s
+  float fall_time;//90%-10%, s
+  float overshoot;//% of the swing, both edge directions
+  float settling_time;//from 50% crossing, s
+} adc_edge_data_t;
+
+// Thresholds of "edge_measure_kernel", in fused points
+typedef struct
+{
+  int32_t low;//10%
+  int32_t middle;//50%
+  int32_t high;//90%
+  int32_t band;//settling band half-width
+} edge_measure_levels_t;
+
+// Integer sums of "edge_measure_kernel"
+// Times are in samples with EDGE_MEASURE_POS_BITS fraction
+typedef struct
+{
+  uint32_t rise_summ;
+  uint16_t rise_cnt;
+  uint32_t fall_summ;
+  uint16_t fall_cnt;
+  uint32_t overshoot_summ;//fused points
+  uint32_t settle_summ;
+  uint16_t plateau_cnt;//plateaus with both edges in the capture
+} edge_measure_summ_t;
+
+/* Exported functions ------------------------------------------------------- */
+adc_edge_data_t edge_measure_process(const uint16_t* samples, uint16_t length,
+  uint8_t stride, uint16_t low, uint16_t high, float sample_rate);
+void edge_measure_kernel(const uint16_t* samples, uint16_t length, uint8_t stride,
+  const edge_measure_levels_t* levels, edge_measure_summ_t* summ);
+
+#endif /* __EDGE_MEASURE_H */
@@ -0,0 +1,426 @@
+//Equivalent-time sampling (ETS) mode - for repetitive signals only
+//Each capture is started by comparator rising edge and its first sample is
+//delayed by "phase" HCLK ticks. Captures of all phases of one ADC sample period
+//are interleaved, so waveform has one point per HCLK tick.
+//Last capture repeats phase 0 - if it differs from the first one,
+//signal is not repetitive. Edge parameters are measured on the whole waveform.
+
+/* Includes ------------------------------------------------------------------*/
+#include "config.h"
+#include "mode_controlling.h"
+#include "data_processing.h"
+#include "edge_measure.h"
+#include "acquisition.h"
+#include "adc_controlling.h"
+#include "comparator_handling.h"
+#include "display_functions.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "stdio.h"
+#include "string.h"
+
+#include "ets.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  ETS_STATUS_RUNNING = 0,
+  ETS_STATUS_NO_SIGNAL,
+  ETS_STATUS_NO_TRIGGER,
+  ETS_STATUS_NOT_REPETITIVE,
+} ets_status_t;
+
+/* Private define ------------------------------------------------------------*/
+//Real-time sample rate, ADC timer prescaler must be 0 at this rate
+#define ETS_SAMPLE_RATE                 DATA_PROC_SAMPLE_RATE_2M
+
+//Number of points in each capture
+#define ETS_CAPTURE_POINTS              (64)
+
+//Number of phases is ADC sample period in HCLK ticks
+#define ETS_MAX_PHASES                  (16)
+
+#define ETS_BUFFER_SIZE                 (ETS_CAPTURE_POINTS * ETS_MAX_PHASES)
+
+//Capture used to find comparator threshold
+#define ETS_LEVEL_POINTS                (256)
+
+//Smaller signal can't be used for trigger
+#define ETS_MIN_SWING_V                 (0.3f)
+
+//Comparator-triggered capture is dropped after this time
+#define ETS_TRIGGER_TIMEOUT_MS          (200)
+
+//Max average difference of two phase 0 captures, part of the signal swing
+#define ETS_MAX_MISMATCH                (0.1f)
+
+//Header is part with text
+#define ETS_HEADER_HEIGHT               (9)
+
+//part of the display is closed by device case
+#define ETS_Y_END                       (DISPLAY_HEIGHT - 3)
+
+#define ETS_ACTIVE_HEIGHT               (ETS_Y_END - ETS_HEADER_HEIGHT - 1)
+
+#define ETS_COLUMNS_CNT                 (DISP_WIDTH)
+
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+//Interleaved waveform, fused points, allocated from "mode_arena"
+uint16_t* ets_buffer = NULL;
+
+uint8_t ets_phases_cnt = ETS_MAX_PHASES;
+
+//Phase of the running capture, "ets_phases_cnt" - verification capture
+uint8_t ets_phase = 0;
+
+//Comparator-triggered capture is running
+uint8_t ets_waiting_trigger = 0;
+uint32_t ets_capture_time = 0;//ms_tick value
+
+ets_status_t ets_status = ETS_STATUS_RUNNING;
+uint8_t ets_progress = 0;//%
+
+//Hz, one point per phase
+float ets_equivalent_rate = 0.0f;
+
+//1 - whole buffer is displayed, 0 - one point per column
+uint8_t ets_zoom_full = 0;
+
+//Set when sweep is done - waveform must be redrawn
+uint8_t ets_new_sweep = 0;
+
+//Range of the last sweep, fused points
+uint16_t ets_min_value = 0;
+uint16_t ets_max_value = 0;
+
+adc_edge_data_t ets_edges;
+
+/* Private function prototypes -----------------------------------------------*/
+void ets_level_job_cb(uint16_t* adc_buffer, uint16_t points);
+void ets_capture_job_cb(uint16_t* adc_buffer, uint16_t points);
+void ets_start_capture(void);
+void ets_finish_sweep(uint16_t* adc_buffer, uint16_t points);
+void ets_post_result(acq_job_id_t job_id);
+void ets_draw_header(void);
+void ets_draw_grid(void);
+void ets_draw_waveform(void);
+void ets_draw_edges(void);
+uint16_t ets_get_y(uint16_t value);
+void ets_clear_active_zone(void);
+
+const acq_job_t ets_level_job =
+{
+  ACQ_JOB_ETS_LEVEL, ETS_SAMPLE_RATE, ETS_LEVEL_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, 0, ets_level_job_cb, NULL
+};
+
+const acq_job_t ets_capture_job =
+{
+  ACQ_JOB_ETS, ETS_SAMPLE_RATE, ETS_CAPTURE_POINTS,
+  ACQ_TRIGGER_COMPARATOR, ACQ_PRIORITY_NORMAL, 0, ets_capture_job_cb, NULL
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+// This function must be called when "main_menu_mode" is changed
+// Must be called after "glitch_catcher_main_mode_changed" - same timer is used
+void ets_main_mode_changed(void)
+{
+  ets_buffer = NULL;
+  ets_waiting_trigger = 0;
+  ets_new_sweep = 0;
+  if (main_menu_mode != MENU_MODE_ETS)
+    return;
+
+  adc_rate_plan_t plan = adc_plan_sample_rate(ETS_SAMPLE_RATE);
+  ets_phases_cnt = (uint8_t)(plan.period + 1);
+  if (ets_phases_cnt > ETS_MAX_PHASES)
+    ets_phases_cnt = ETS_MAX_PHASES;
+  ets_equivalent_rate = plan.rate * (float)ets_phases_cnt;
+
+  ets_buffer = (uint16_t*)mode_arena_alloc(ETS_BUFFER_SIZE * sizeof(uint16_t));
+  memset(ets_buffer, 0, ETS_BUFFER_SIZE * sizeof(uint16_t));
+
+  comparator_init(USE_GLITCH_CAPTURE_COMP);
+  adc_ets_timer_init();
+
+  ets_status = ETS_STATUS_RUNNING;
+  ets_progress = 0;
+  acquisition_submit(&ets_level_job);
+}
+
+// Called from "data_processing_handler"
+// Drop capture if trigger is not coming - signal can't be used for ETS
+void ets_processing_handler(void)
+{
+  if ((ets_waiting_trigger == 0) ||
+      ((ms_tick - ets_capture_time) < ETS_TRIGGER_TIMEOUT_MS))
+    return;
+
+  ets_waiting_trigger = 0;
+  acquisition_abort();
+  ets_status = ETS_STATUS_NO_TRIGGER;
+  ets_post_result(ACQ_JOB_ETS);
+  acquisition_submit(&ets_level_job);
+}
+
+// Toggle zoom
+void ets_upper_button_pressed(void)
+{
+  ets_zoom_full ^= 1;
+  ets_new_sweep = 1;
+}
+
+//Called by acquisition engine - set comparator threshold to the signal middle
+void ets_level_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  adc_processed_data_t data = data_processing_extended(adc_buffer, points);
+
+  if ((data.max_voltage - data.min_voltage) < ETS_MIN_SWING_V)
+  {
+    ets_status = ETS_STATUS_NO_SIGNAL;
+    ets_post_result(ACQ_JOB_ETS_LEVEL);
+    acquisition_submit(&ets_level_job);
+    return;
+  }
+
+  comparator_set_threshold((data.max_voltage + data.min_voltage) / 2.0f);
+  ets_phase = 0;
+  ets_start_capture();
+}
+
+void ets_start_capture(void)
+{
+  if (ets_phase < ets_phases_cnt)
+    adc_set_ets_delay(ets_phase);
+  else
+    adc_set_ets_delay(0);//verification
+
+  ets_capture_time = ms_tick;
+  ets_waiting_trigger = 1;
+  acquisition_submit(&ets_capture_job);
+}
+
+//Called by acquisition engine - place capture samples to their phase
+void ets_capture_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  if (ets_waiting_trigger == 0)
+    return;//capture was aborted
+  ets_waiting_trigger = 0;
+
+  if (ets_phase >= ets_phases_cnt)
+  {
+    ets_finish_sweep(adc_buffer, points);
+    acquisition_submit(&ets_level_job);//signal level could be changed
+    return;
+  }
+
+  for (uint16_t i = 0; i < points; i++)
+    ets_buffer[i * ets_phases_cnt + ets_phase] = adc_buffer[i * 2 + 1];
+
+  ets_phase++;
+  ets_progress = (uint8_t)((uint16_t)ets_phase * 100 / (ets_phases_cnt + 1));
+  ets_post_result(ACQ_JOB_ETS);
+  ets_start_capture();
+}
+
+// Compare verification capture with phase 0 and find waveform range
+void ets_finish_sweep(uint16_t* adc_buffer, uint16_t points)
+{
+  uint16_t buffer_size = points * ets_phases_cnt;
+  uint16_t min_value = 0xFFFF;
+  uint16_t max_value = 0;
+  for (uint16_t i = 0; i < buffer_size; i++)
+  {
+    if (ets_buffer[i] < min_value)
+      min_value = ets_buffer[i];
+    if (ets_buffer[i] > max_value)
+      max_value = ets_buffer[i];
+  }
+
+  uint32_t mismatch = 0;
+  for (uint16_t i = 0; i < points; i++)
+  {
+    int32_t diff = (int32_t)adc_buffer[i * 2 + 1] - (int32_t)ets_buffer[i * ets_phases_cnt];
+    mismatch+= (diff < 0) ? -diff : diff;
+  }
+
+  float swing = (float)(max_value - min_value);
+  if ((float)mismatch > (swing * ETS_MAX_MISMATCH * (float)points))
+    ets_status = ETS_STATUS_NOT_REPETITIVE;
+  else
+    ets_status = ETS_STATUS_RUNNING;
+
+  ets_min_value = min_value;
+  ets_max_value = max_value;
+  ets_edges = edge_measure_process(
+    ets_buffer, buffer_size, 1, min_value, max_value, ets_equivalent_rate);
+  ets_progress = 100;
+  ets_new_sweep = 1;
+  ets_post_result(ACQ_JOB_ETS);
+}
+
+void ets_post_result(acq_job_id_t job_id)
+{
+  acq_result_t result;
+  result.job_id = job_id;
+  acquisition_mailbox_post(&result);
+}
+
+//-----------------------------------------------------------------------------
+
+void ets_draw_menu(menu_draw_type_t draw_type)
+{
+  if (draw_type == MENU_MODE_FULL_REDRAW)
+  {
+    display_clear_framebuffer();
+    display_draw_string("ETS", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_update();
+  }
+  else
+  {
+    acq_result_t result;
+
+    //Redraw only when capture is done
+    if (acquisition_mailbox_get_last(&result))
+    {
+      ets_draw_header();
+      if (ets_new_sweep)
+      {
+        ets_new_sweep = 0;
+        ets_clear_active_zone();
+        ets_draw_grid();
+        ets_draw_waveform();
+        ets_draw_edges();
+      }
+      display_update();
+    }
+  }//PARTIAL_REDRAW
+}
+
+void ets_draw_header(void)
+{
+  char tmp_str[32];
+
+  sprintf(tmp_str, "ETS %luM ", (uint32_t)(ets_equivalent_rate / 1000000.0f));
+  display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+
+  //Displayed time window
+  uint16_t window_points = ETS_COLUMNS_CNT;
+  if (ets_zoom_full)
+    window_points = ETS_CAPTURE_POINTS * ets_phases_cnt;
+  uint32_t window_ns = (uint32_t)((float)window_points * 1e9f / ets_equivalent_rate);
+  if (window_ns < 1000)
+    sprintf(tmp_str, "%luns", window_ns);
+  else
+    sprintf(tmp_str, "%luus", window_ns / 1000);
+  menu_shift_string_right(tmp_str, 6);
+  display_draw_string(tmp_str, 54, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+
+  switch (ets_status)
+  {
+    case ETS_STATUS_NO_SIGNAL:
+      display_draw_string(" NO SIG", 112, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    case ETS_STATUS_NO_TRIGGER:
+      display_draw_string("NO TRIG", 112, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    case ETS_STATUS_NOT_REPETITIVE:
+      display_draw_string("NOT REP", 112, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    default:
+      sprintf(tmp_str, "   %3u%%", ets_progress);
+      display_draw_string(tmp_str, 112, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+    break;
+  }
+}
+
+// Dotted lines at 10% and 90% of the swing - rise time levels
+void ets_draw_grid(void)
+{
+  uint16_t swing = ets_max_value - ets_min_value;
+  uint16_t low_y = ets_get_y(ets_min_value + swing / 10);
+  uint16_t high_y = ets_get_y(ets_max_value - swing / 10);
+
+  for (uint16_t x = 0; x < ETS_COLUMNS_CNT; x+= 4)
+  {
+    display_set_pixel_color(x, low_y, COLOR_BLUE);
+    display_set_pixel_color(x, high_y, COLOR_BLUE);
+  }
+  display_draw_line(ETS_Y_END, COLOR_BLUE);
+}
+
+// Each column is a line from min to max of its points,
+// last point of the previous column is included - trace is continuous
+void ets_draw_waveform(void)
+{
+  uint16_t buffer_size = ETS_CAPTURE_POINTS * ets_phases_cnt;
+  uint16_t window_points = ets_zoom_full ? buffer_size : ETS_COLUMNS_CNT;
+  uint16_t start = 0;
+
+  for (uint16_t x = 0; x < ETS_COLUMNS_CNT; x++)
+  {
+    uint16_t end = (uint32_t)(x + 1) * window_points / ETS_COLUMNS_CNT;
+    if (end <= start)
+      end = start + 1;
+
+    uint16_t min_value = ets_buffer[start];
+    uint16_t max_value = ets_buffer[start];
+    uint16_t i = (start > 0) ? (start - 1) : 0;
+    for (; i < end; i++)
+    {
+      if (ets_buffer[i] < min_value)
+        min_value = ets_buffer[i];
+      if (ets_buffer[i] > max_value)
+        max_value = ets_buffer[i];
+    }
+    display_draw_vertical_line(x, ets_get_y(max_value), ets_get_y(min_value), COLOR_WHITE);
+    start = end;
+  }
+}
+
+// Rise/fall time, overshoot and settling time over the waveform
+void ets_draw_edges(void)
+{
+  char tmp_str[32];
+  char time_str[2][12];
+
+  if ((ets_edges.rising_cnt == 0) && (ets_edges.falling_cnt == 0))
+    return;
+
+  menu_print_time(time_str[0], ets_edges.rise_time);
+  menu_print_time(time_str[1], ets_edges.fall_time);
+  sprintf(tmp_str, "TR %s TF %s", time_str[0], time_str[1]);
+  display_draw_string(tmp_str, 0, ETS_HEADER_HEIGHT + 1, FONT_SIZE_8, 0, COLOR_GREEN);
+
+  menu_print_time(time_str[0], ets_edges.settling_time);
+  sprintf(tmp_str, "OS %lu%% TS %s", 
+    (uint32_t)(ets_edges.overshoot + 0.5f), time_str[0]);
+  display_draw_string(tmp_str, 0, ETS_HEADER_HEIGHT + 10, FONT_SIZE_8, 0, COLOR_GREEN);
+}
+
+//Convert fused value to y position (counted from upper line)
+uint16_t ets_get_y(uint16_t value)
+{
+  uint16_t swing = ets_max_value - ets_min_value;
+  if (swing == 0)
+    return ETS_Y_END - 1;
+
+  uint16_t pix_cnt =
+    (uint16_t)((uint32_t)(value - ets_min_value) * ETS_ACTIVE_HEIGHT / swing);
+  if (pix_cnt > ETS_ACTIVE_HEIGHT)
+    pix_cnt = ETS_ACTIVE_HEIGHT;
+  return (ETS_Y_END - 1 - pix_cnt);
+}
+
+void ets_clear_active_zone(void)
+{
+  uint8_t y;
+  for (y = ETS_HEADER_HEIGHT; y < DISPLAY_HEIGHT; y++)
+    display_draw_line(y, COLOR_BLACK);
+}
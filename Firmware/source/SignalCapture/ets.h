@@ -0,0 +1,15 @@
+#ifndef __ETS_H
+#define __ETS_H
+
+#include "mode_controlling.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+void ets_main_mode_changed(void);
+void ets_processing_handler(void);
+
+void ets_draw_menu(menu_draw_type_t draw_type);
+void ets_upper_button_pressed(void);
+
+#endif
+
@@ -0,0 +1,228 @@
+//Fixed-point FFT of real input, decimation in frequency
+//FFT_SIZE real samples are packed in pairs: x[2n] - real part,
+//x[2n+1] - imaginary part of the complex point "n". Complex FFT of
+//FFT_SIZE/2 points is made by one radix-2 and several radix-4 stages,
+//then split pass separates spectra of even and odd samples and combines them.
+//Data is Q15, real and imaginary parts are packed into one 32-bit word,
+//so butterflies are using Cortex-M4 dual 16-bit (SIMD) instructions.
+//Each stage is scaled, so result is (1/FFT_SIZE) * DFT and can't overflow.
+//Buffer must have FFT_SIZE words: input - first half, bins - second half.
+
+/* Includes ------------------------------------------------------------------*/
+#include "fft.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "math.h"
+#include "string.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define FFT_PI                          (3.14159265f)
+
+// Number of points of the complex FFT
+#define FFT_COMPLEX_SIZE                (FFT_SIZE / 2)
+
+// Radix-4 part: FFT of each half of the complex points
+#define FFT_QUARTER_SIZE                (FFT_COMPLEX_SIZE / 2)
+
+// log4(FFT_QUARTER_SIZE)
+#define FFT_QUARTER_STAGES              (4)
+
+// W^k = exp(-j*2*pi*k/FFT_SIZE), largest index is used by radix-4 stages:
+// 3 * (FFT_QUARTER_SIZE / 4 - 1) * 4
+#define FFT_TWIDDLES_CNT                (FFT_SIZE * 3 / 4)
+
+// Twiddle index step of FFT_COMPLEX_SIZE and FFT_QUARTER_SIZE transforms
+#define FFT_COMPLEX_STEP                (FFT_SIZE / FFT_COMPLEX_SIZE)
+#define FFT_QUARTER_STEP                (FFT_SIZE / FFT_QUARTER_SIZE)
+
+// Number of bits in radix-4 index
+#define FFT_INDEX_BITS                  (FFT_QUARTER_STAGES * 2)
+
+// Low bits of all base-4 digits of radix-4 index
+#define FFT_DIGIT_LOW_BITS              (0x55555555UL & (FFT_QUARTER_SIZE - 1))
+
+/* Private macro -------------------------------------------------------------*/
+// Swap real and imaginary parts
+#define FFT_SWAP(x)                     (((x) >> 16) | ((x) << 16))
+
+/* Private variables ---------------------------------------------------------*/
+// Tables are allocated from "mode_arena" by "fft_init"
+fft_complex_t* fft_twiddles = NULL;
+// Hann window, Q15, only first half - window is symmetric
+int16_t* fft_window = NULL;
+
+/* Private function prototypes -----------------------------------------------*/
+fft_complex_t fft_mult(fft_complex_t x, fft_complex_t w);
+void fft_radix2_stage(fft_complex_t* buffer);
+void fft_radix4(fft_complex_t* buffer);
+void fft_split(fft_complex_t* buffer);
+uint16_t fft_complex_index(uint16_t k);
+
+/* Private functions ---------------------------------------------------------*/
+
+// Must be called when mode that uses FFT is entered
+void fft_init(void)
+{
+  fft_twiddles = (fft_complex_t*)mode_arena_alloc(
+    FFT_TWIDDLES_CNT * sizeof(fft_complex_t));
+  fft_window = (int16_t*)mode_arena_alloc((FFT_SIZE / 2) * sizeof(int16_t));
+
+  for (uint16_t k = 0; k < FFT_TWIDDLES_CNT; k++)
+  {
+    float angle = 2.0f * FFT_PI * (float)k / (float)FFT_SIZE;
+    fft_twiddles[k] = FFT_PACK(
+      lrintf(cosf(angle) * 32767.0f), lrintf(-sinf(angle) * 32767.0f));
+  }
+
+  for (uint16_t i = 0; i < (FFT_SIZE / 2); i++)
+  {
+    float angle = 2.0f * FFT_PI * (float)i / (float)(FFT_SIZE - 1);
+    fft_window[i] = (int16_t)lrintf((0.5f - 0.5f * cosf(angle)) * 32767.0f);
+  }
+}
+
+// Multiply packed real samples (first half of the buffer) by window
+CCM_RAM_FUNC void fft_apply_window(fft_complex_t* buffer)
+{
+  for (uint16_t n = 0; n < (FFT_COMPLEX_SIZE / 2); n++)
+  {
+    //samples 2n, 2n+1 and symmetric FFT_SIZE-2-2n, FFT_SIZE-1-2n
+    fft_complex_t x = buffer[n];
+    buffer[n] = FFT_PACK((FFT_RE(x) * fft_window[2 * n]) >> 15,
+      (FFT_IM(x) * fft_window[2 * n + 1]) >> 15);
+    uint16_t m = FFT_COMPLEX_SIZE - 1 - n;
+    x = buffer[m];
+    buffer[m] = FFT_PACK((FFT_RE(x) * fft_window[2 * n + 1]) >> 15,
+      (FFT_IM(x) * fft_window[2 * n]) >> 15);
+  }
+}
+
+// FFT of FFT_SIZE real points, packed by pairs in the first half of the buffer
+// Bins 0 ... FFT_BINS_CNT - 1 are placed to the second half in natural order
+CCM_RAM_FUNC void fft_real(fft_complex_t* buffer)
+{
+  fft_radix2_stage(buffer);
+  fft_radix4(buffer);
+  fft_radix4(&buffer[FFT_QUARTER_SIZE]);
+  fft_split(buffer);
+}
+
+// x * w, both are Q15
+CCM_RAM_FUNC fft_complex_t fft_mult(fft_complex_t x, fft_complex_t w)
+{
+  int32_t re = (int32_t)__SMUSD(x, w);//xr*wr - xi*wi
+  int32_t im = (int32_t)__SMUADX(x, w);//xr*wi + xi*wr
+  return FFT_PACK(re >> 15, im >> 15);
+}
+
+// First stage of FFT_COMPLEX_SIZE transform, scaled by 1/2
+// First half gives even outputs, second half - odd outputs
+CCM_RAM_FUNC void fft_radix2_stage(fft_complex_t* buffer)
+{
+  for (uint16_t i = 0; i < FFT_QUARTER_SIZE; i++)
+  {
+    fft_complex_t a = buffer[i];
+    fft_complex_t b = buffer[i + FFT_QUARTER_SIZE];
+    buffer[i] = __SHADD16(a, b);
+    if (i == 0)
+      buffer[i + FFT_QUARTER_SIZE] = __SHSUB16(a, b);
+    else
+      buffer[i + FFT_QUARTER_SIZE] =
+        fft_mult(__SHSUB16(a, b), fft_twiddles[i * FFT_COMPLEX_STEP]);
+  }
+}
+
+// In-place FFT of FFT_QUARTER_SIZE points, each stage is scaled by 1/4
+// Output is in digit-reversed order
+CCM_RAM_FUNC void fft_radix4(fft_complex_t* buffer)
+{
+  uint16_t step = FFT_QUARTER_STEP;//twiddle index step
+
+  for (uint16_t n2 = FFT_QUARTER_SIZE; n2 > 1; n2 >>= 2)
+  {
+    uint16_t n1 = n2 >> 2;
+    for (uint16_t j = 0; j < n1; j++)
+    {
+      fft_complex_t w1 = fft_twiddles[j * step];
+      fft_complex_t w2 = fft_twiddles[2 * j * step];
+      fft_complex_t w3 = fft_twiddles[3 * j * step];
+
+      for (uint16_t i0 = j; i0 < FFT_QUARTER_SIZE; i0 += n2)
+      {
+        uint16_t i1 = i0 + n1;
+        uint16_t i2 = i1 + n1;
+        uint16_t i3 = i2 + n1;
+
+        //Halving add/sub - each stage is scaled by 1/4
+        fft_complex_t t0 = __SHADD16(buffer[i0], buffer[i2]);
+        fft_complex_t t1 = __SHSUB16(buffer[i0], buffer[i2]);
+        fft_complex_t t2 = __SHADD16(buffer[i1], buffer[i3]);
+        fft_complex_t t3 = __SHSUB16(buffer[i1], buffer[i3]);
+
+        buffer[i0] = __SHADD16(t0, t2);
+        if (j == 0)
+        {
+          //All twiddles are 1
+          buffer[i1] = __SHSAX(t1, t3);//t1 - j*t3
+          buffer[i2] = __SHSUB16(t0, t2);
+          buffer[i3] = __SHASX(t1, t3);//t1 + j*t3
+        }
+        else
+        {
+          //Sub-DFT of output "r" is placed to quarter "r"
+          buffer[i1] = fft_mult(__SHSAX(t1, t3), w1);
+          buffer[i2] = fft_mult(__SHSUB16(t0, t2), w2);
+          buffer[i3] = fft_mult(__SHASX(t1, t3), w3);
+        }
+      }
+    }
+    step <<= 2;
+  }
+}
+
+// Z - complex FFT of packed points, P(k) = Z(FFT_COMPLEX_SIZE - k)
+// Even samples spectrum: E = (Z + conj(P)) / 2, odd: O = -j * (Z - conj(P)) / 2
+// X(k) = (E + W^k * O) / 2 - one more halving keeps 1/FFT_SIZE scale
+CCM_RAM_FUNC void fft_split(fft_complex_t* buffer)
+{
+  fft_complex_t* bins = &buffer[FFT_COMPLEX_SIZE];
+  for (uint16_t k = 0; k < FFT_COMPLEX_SIZE; k++)
+  {
+    fft_complex_t z = buffer[fft_complex_index(k)];
+    fft_complex_t p =
+      buffer[fft_complex_index((FFT_COMPLEX_SIZE - k) & (FFT_COMPLEX_SIZE - 1))];
+    p = FFT_SWAP(p);
+    fft_complex_t e = __SHSAX(z, p);//(Z + conj(P)) / 2
+    fft_complex_t d = __SHASX(z, p);//(Z - conj(P)) / 2
+
+    //-j * W^k
+    fft_complex_t w = fft_twiddles[k];
+    fft_complex_t w_j = FFT_PACK(FFT_IM(w), -FFT_RE(w));
+    bins[k] = __SHADD16(e, fft_mult(d, w_j));
+  }
+}
+
+// Buffer index of the complex FFT output "k"
+// Even outputs are in the first half, odd - in the second one,
+// each half is in digit-reversed order
+CCM_RAM_FUNC uint16_t fft_complex_index(uint16_t k)
+{
+  //Reverse order of base-4 digits: reverse bits, then swap bits in each digit
+  uint32_t rev = __RBIT(k >> 1) >> (32 - FFT_INDEX_BITS);
+  rev = ((rev & FFT_DIGIT_LOW_BITS) << 1) | ((rev >> 1) & FFT_DIGIT_LOW_BITS);
+  return (uint16_t)(((k & 1) * FFT_QUARTER_SIZE) + rev);
+}
+
+// Return bin "k" (0 ... FFT_BINS_CNT - 1) of "fft_real" result
+fft_complex_t fft_get_bin(const fft_complex_t* buffer, uint16_t k)
+{
+  return buffer[FFT_COMPLEX_SIZE + k];
+}
+
+// Return re^2 + im^2 of the bin "k"
+uint32_t fft_get_power(const fft_complex_t* buffer, uint16_t k)
+{
+  fft_complex_t x = fft_get_bin(buffer, k);
+  return __SMUAD(x, x);
+}
@@ -0,0 +1,32 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FFT_H
+#define __FFT_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f30x.h"
+#include "config.h"
+
+/* Exported types ------------------------------------------------------------*/
+// Number of real input points
+// Complex FFT of FFT_SIZE/2 points is used, FFT_SIZE/8 must be power of 4
+#define FFT_SIZE                        (1024)
+
+// Number of output bins (0 ... FFT_SIZE/2 - 1), Nyquist bin is not calculated
+#define FFT_BINS_CNT                    (FFT_SIZE / 2)
+
+// Q15 complex value: real part - low halfword, imaginary part - high halfword
+typedef uint32_t fft_complex_t;
+
+#define FFT_PACK(re, im)        \
+  ((uint32_t)(uint16_t)(int16_t)(re) | ((uint32_t)(uint16_t)(int16_t)(im) << 16))
+#define FFT_RE(x)                       ((int16_t)((x) & 0xFFFF))
+#define FFT_IM(x)                       ((int16_t)((x) >> 16))
+
+/* Exported functions ------------------------------------------------------- */
+void fft_init(void);
+void fft_apply_window(fft_complex_t* buffer);
+void fft_real(fft_complex_t* buffer);
+fft_complex_t fft_get_bin(const fft_complex_t* buffer, uint16_t k);
+uint32_t fft_get_power(const fft_complex_t* buffer, uint16_t k);
+
+#endif /* __FFT_H */
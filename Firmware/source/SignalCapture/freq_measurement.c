@@ -4,6 +4,7 @@
 #include "mode_controlling.h"
 #include "adc_controlling.h"
 #include "data_processing.h"
+#include "acquisition.h"
 #include "display_functions.h"
 #include "comparator_handling.h"
 #include "stdio.h"
@@ -11,6 +12,7 @@
 #include "stm32f30x_it.h"
 #include "hardware.h"
 #include "math.h"
+#include "main.h"
 
 #include "freq_measurement.h"
 
@@ -49,25 +51,33 @@ uint32_t freq_measure_result_dwt_value = 0;
 
 extern menu_mode_t main_menu_mode;
 extern freq_meter_calib_state_t freq_meter_calib_state;
-extern volatile uint16_t adc_raw_buffer0[ADC_BUFFER_SIZE];
 
 /* Private function prototypes -----------------------------------------------*/
 void freq_meter_trigger_handling(void);
 void freq_measurement_start_measure(void);
+void freq_meter_calibration_job_cb(uint16_t* adc_buffer, uint16_t points);
 
 void FREQ_MEAS_TIM_IRQ_HANDLER(void);
 
+// Voltage capture for trigger level detection
+const acq_job_t freq_meter_calibration_job = 
+{
+  ACQ_JOB_FREQ_CALIBRATION, DATA_PROC_LOW_SAMPLE_RATE, MAIN_ADC_CAPTURED_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  freq_meter_calibration_job_cb, NULL
+};
 
 /* Private functions ---------------------------------------------------------*/
 
-void FREQ_MEAS_TIM_IRQ_HANDLER(void)
+CCM_RAM_FUNC void FREQ_MEAS_TIM_IRQ_HANDLER(void)
 {
-  if (TIM_GetITStatus(FREQ_MEAS_TIM_NAME, TIM_IT_Update) == SET)
+  if ((FREQ_MEAS_TIM_NAME->SR & TIM_IT_Update) && 
+      (FREQ_MEAS_TIM_NAME->DIER & TIM_IT_Update))
   {
     //timer is stopped  - one pulse mode
     uint32_t dwt_value = hardware_dwt_get();
-    TIM_ClearITPendingBit(FREQ_MEAS_TIM_NAME, TIM_IT_Update);
-    TIM_ITConfig(FREQ_MEAS_TIM_NAME, TIM_IT_Update, DISABLE);
+    FREQ_MEAS_TIM_NAME->SR = (uint16_t)~TIM_IT_Update;
+    FREQ_MEAS_TIM_NAME->DIER &= (uint16_t)~TIM_IT_Update;
     freq_measure_result_dwt_value = dwt_value - freq_measure_start_dwt_counter;
     freq_meas_result = FREQ_MEASURE_TIMER_FULL;
   }
@@ -189,9 +199,22 @@ void freq_measurement_main_mode_changed(void)
   {
     comparator_init(USE_NO_EVENTS_COMP);
     freq_comparator_threshold_v = FREQ_TRIGGER_DEFAULT_V;
+    freq_meter_calib_state = FREQ_METER_CALIB_IDLE;//capture jobs are dropped
   }
 }
 
+// Called by acquisition engine while trigger level is detected
+void freq_meter_calibration_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  acq_result_t result;
+  
+  result.job_id = ACQ_JOB_FREQ_CALIBRATION;
+  result.data = data_processing_extended(
+    &adc_buffer[FREQ_CALIB_START_OFFSET * 2], 
+    (points - FREQ_CALIB_START_OFFSET * 2));
+  acquisition_mailbox_post(&result);
+}
+
 // Conrolling process of trigger level detection
 void freq_meter_trigger_handling(void)
 {
@@ -214,7 +237,7 @@ void freq_meter_trigger_handling(void)
       if (TIMER_ELAPSED(calibration_timer))
       {
         freq_meter_calib_state = FREQ_METER_CALIB_CAPTURE;//start capture
-        data_processing_start_new_capture();
+        acquisition_submit(&freq_meter_calibration_job);
         freq_meas_calibration_counter = 0;
         comparator_min_voltage = 500.0f;
         comparator_max_voltage = 0.0f;
@@ -223,12 +246,11 @@ void freq_meter_trigger_handling(void)
     }
     else if (freq_meter_calib_state == FREQ_METER_CALIB_CAPTURE)//running voltage capture
     {
-      if (data_processing_state == PROCESSING_DATA_DONE)//voltage measured
+      acq_result_t result;
+      while (acquisition_mailbox_get(&result))//voltage measured
       {
         freq_meas_calibration_counter++;
-        adc_processed_data_t tmp_result = data_processing_extended(
-          (uint16_t*)&adc_raw_buffer0[FREQ_CALIB_START_OFFSET * 2], 
-          (ADC_BUFFER_SIZE / 2 - FREQ_CALIB_START_OFFSET * 2));
+        adc_processed_data_t tmp_result = result.data;
         
         if (tmp_result.min_voltage < comparator_min_voltage)
           comparator_min_voltage = tmp_result.min_voltage;
@@ -244,14 +266,12 @@ void freq_meter_trigger_handling(void)
           else
             freq_comparator_threshold_v = tmp_voltage;
           
+          acquisition_cancel(&freq_meter_calibration_job);
           freq_meter_calib_state = FREQ_METER_CALIB_DONE;
           menu_draw_frequency_meter_menu(MENU_MODE_FULL_REDRAW);
           START_TIMER(calibration_timer, FREQ_METER_DONE_WAIT_DELAY);
           return;
         }
-        
-        data_processing_start_new_capture();//start to measure voltage
-        return;
       }
     }
     else if (freq_meter_calib_state == FREQ_METER_CALIB_DONE)
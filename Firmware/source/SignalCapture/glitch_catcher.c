@@ -0,0 +1,201 @@
+//Glitch catcher - works in background in logic probe mode
+//COMP4 output is latched by GLITCH_TIM input capture at both edges, so
+//pulses that fall between ADC captures are still counted.
+//Pulse width is measured with timer clock resolution.
+
+/* Includes ------------------------------------------------------------------*/
+#include "glitch_catcher.h"
+#include "comparator_handling.h"
+#include "freq_measurement.h"
+#include "generator_timer.h"
+#include "mode_controlling.h"
+#include "main.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define GLITCH_TIM_PERIOD_TICKS         (0x10000UL)
+
+#define GLITCH_MAX_WIDTH_TICKS  \
+  ((uint32_t)((uint64_t)SystemCoreClock * GLITCH_MAX_WIDTH_US / 1000000))
+
+// Pulse that lasts longer is a new signal level
+#define GLITCH_MAX_WRAPS        (GLITCH_MAX_WIDTH_TICKS / GLITCH_TIM_PERIOD_TICKS + 1)
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+volatile uint32_t glitch_catcher_count = 0;
+volatile uint32_t glitch_catcher_min_width = 0xFFFFFFFF;//timer ticks
+
+// State of the pulse that is measured now, used only by interrupt
+uint8_t glitch_pulse_active = 0;
+uint16_t glitch_pulse_start = 0;
+uint16_t glitch_pulse_wraps = 0;
+uint8_t glitch_pulse_gen_restarts = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+void GLITCH_TIM_IRQ_HANDLER(void);
+void glitch_catcher_start(void);
+void glitch_catcher_stop(void);
+void glitch_catcher_edge(uint16_t capture, uint16_t status);
+void glitch_catcher_register(uint32_t width);
+
+/* Private functions ---------------------------------------------------------*/
+
+CCM_RAM_FUNC void GLITCH_TIM_IRQ_HANDLER(void)
+{
+  uint16_t status = GLITCH_TIM_NAME->SR;
+  uint16_t capture = 0;
+
+  if (status & TIM_IT_CC2)
+    capture = GLITCH_TIM_NAME->CCR2;//flag is cleared by reading
+
+  //Capture made before the counter overflow must be processed first
+  uint8_t capture_first = (status & TIM_IT_CC2) && (capture >= 0x8000);
+
+  if (capture_first)
+    glitch_catcher_edge(capture, status);
+
+  if (status & TIM_IT_Update)
+  {
+    GLITCH_TIM_NAME->SR = (uint16_t)~TIM_IT_Update;
+    if (glitch_pulse_active)
+    {
+      glitch_pulse_wraps++;
+      if (glitch_pulse_wraps > GLITCH_MAX_WRAPS)
+        glitch_pulse_active = 0;//long pulse - it is new signal level
+    }
+  }
+
+  if ((status & TIM_IT_CC2) && (capture_first == 0))
+    glitch_catcher_edge(capture, status);
+}
+
+// capture - timer value at the edge
+// status - timer SR value, read at interrupt entry
+CCM_RAM_FUNC void glitch_catcher_edge(uint16_t capture, uint16_t status)
+{
+  if (status & TIM_FLAG_CC2OF)
+  {
+    //Both edges are latched before interrupt - start time is lost
+    GLITCH_TIM_NAME->SR = (uint16_t)~TIM_FLAG_CC2OF;
+    glitch_pulse_active = 0;
+    glitch_catcher_register(GLITCH_WIDTH_UNKNOWN);
+    return;
+  }
+
+  if (glitch_pulse_active == 0)
+  {
+    glitch_pulse_start = capture;
+    glitch_pulse_wraps = 0;
+    glitch_pulse_gen_restarts = generator_timer_restarts;
+    glitch_pulse_active = 1;
+    return;
+  }
+
+  glitch_pulse_active = 0;
+
+  //Generator restart can make short pulse at the "Z-state" input
+  if (glitch_pulse_gen_restarts != generator_timer_restarts)
+    return;
+
+  uint32_t width =
+    (uint32_t)glitch_pulse_wraps * GLITCH_TIM_PERIOD_TICKS + capture - glitch_pulse_start;
+  if (width <= GLITCH_MAX_WIDTH_TICKS)
+    glitch_catcher_register(width);
+}
+
+// width - in timer ticks
+CCM_RAM_FUNC void glitch_catcher_register(uint32_t width)
+{
+  glitch_catcher_count++;
+  if (width < glitch_catcher_min_width)
+    glitch_catcher_min_width = width;
+}
+
+// This function must be called when "main_menu_mode" is changed
+// Must be called before "freq_measurement_main_mode_changed" - comparator
+// is reconfigured by frequency meter
+void glitch_catcher_main_mode_changed(void)
+{
+  glitch_catcher_stop();
+  glitch_catcher_reset();
+
+  if (main_menu_mode == MENU_MODE_LOGIC_PROBE)
+    glitch_catcher_start();
+}
+
+// Clear collected statistics
+void glitch_catcher_reset(void)
+{
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  glitch_catcher_count = 0;
+  glitch_catcher_min_width = 0xFFFFFFFF;
+  LEAVE_CRITICAL(int_state);
+}
+
+void glitch_catcher_start(void)
+{
+  TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+  TIM_ICInitTypeDef TIM_ICInitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  glitch_pulse_active = 0;
+
+  GLITCH_TIM_CLK_INIT_F(GLITCH_TIM_CLK, ENABLE);
+  TIM_DeInit(GLITCH_TIM_NAME);
+
+  TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+  TIM_TimeBaseStructure.TIM_Prescaler = 0;//max resolution
+  TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+  TIM_TimeBaseStructure.TIM_Period = GLITCH_TIM_PERIOD_TICKS - 1;
+  TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+  TIM_TimeBaseInit(GLITCH_TIM_NAME, &TIM_TimeBaseStructure);
+
+  TIM_ICStructInit(&TIM_ICInitStructure);
+  TIM_ICInitStructure.TIM_Channel = TIM_Channel_2;
+  TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_BothEdge;
+  TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+  TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+  TIM_ICInitStructure.TIM_ICFilter = 0;
+  TIM_ICInit(GLITCH_TIM_NAME, &TIM_ICInitStructure);
+
+  comparator_init(USE_GLITCH_CAPTURE_COMP);
+  comparator_set_threshold(FREQ_TRIGGER_DEFAULT_V);
+
+  TIM_ClearFlag(GLITCH_TIM_NAME, TIM_FLAG_Update | TIM_FLAG_CC2 | TIM_FLAG_CC2OF);
+  TIM_ITConfig(GLITCH_TIM_NAME, TIM_IT_Update | TIM_IT_CC2, ENABLE);
+
+  NVIC_InitStructure.NVIC_IRQChannel = GLITCH_TIM_IRQ;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;//lower than ADC DMA
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+
+  TIM_Cmd(GLITCH_TIM_NAME, ENABLE);
+}
+
+void glitch_catcher_stop(void)
+{
+  NVIC_DisableIRQ(GLITCH_TIM_IRQ);
+  TIM_Cmd(GLITCH_TIM_NAME, DISABLE);
+  TIM_ITConfig(GLITCH_TIM_NAME, TIM_IT_Update | TIM_IT_CC2, DISABLE);
+  GLITCH_TIM_CLK_INIT_F(GLITCH_TIM_CLK, DISABLE);
+}
+
+uint32_t glitch_catcher_get_count(void)
+{
+  return glitch_catcher_count;
+}
+
+// Return width of the shortest glitch, ns
+// GLITCH_WIDTH_UNKNOWN - glitch is shorter than interrupt latency
+uint32_t glitch_catcher_get_min_width_ns(void)
+{
+  uint32_t width = glitch_catcher_min_width;
+  if ((glitch_catcher_count == 0) || (width == GLITCH_WIDTH_UNKNOWN))
+    return GLITCH_WIDTH_UNKNOWN;
+  return (uint32_t)((uint64_t)width * 1000000000ULL / SystemCoreClock);
+}
@@ -0,0 +1,22 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __GLITCH_CATCHER_H
+#define __GLITCH_CATCHER_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f30x.h"
+#include "config.h"
+
+/* Exported types ------------------------------------------------------------*/
+// Longer pulses are normal signal changes, not glitches
+#define GLITCH_MAX_WIDTH_US             (1000)
+
+// Width value of the glitch that is shorter than timer interrupt latency
+#define GLITCH_WIDTH_UNKNOWN            (0)
+
+/* Exported functions ------------------------------------------------------- */
+void glitch_catcher_main_mode_changed(void);
+void glitch_catcher_reset(void);
+uint32_t glitch_catcher_get_count(void);
+uint32_t glitch_catcher_get_min_width_ns(void);
+
+#endif /* __GLITCH_CATCHER_H */
@@ -0,0 +1,422 @@
+//Voltage histogram mode with logic family detection
+//Every fused sample of every capture is added to the fixed-size histogram
+//by integer binning kernel. Histogram is halved when it is full, so it
+//follows the signal changes.
+//Two dominant levels (bimodal peaks) are found in the histogram, logic family
+//is selected by the high level. When the same family is detected several
+//times in a row, its input thresholds are used by the logic probe classifier.
+
+/* Includes ------------------------------------------------------------------*/
+#include "config.h"
+#include "mode_controlling.h"
+#include "adc_controlling.h"
+#include "data_processing.h"
+#include "acquisition.h"
+#include "display_functions.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "stdio.h"
+#include "string.h"
+
+#include "histogram.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  const char* name;
+  float nominal_v;//supply voltage, it is compared with high level
+  float low_v;//VIL
+  float high_v;//VIH
+} hist_logic_family_t;
+
+/* Private define ------------------------------------------------------------*/
+//One bin per display column
+#define HIST_BINS                       (DISP_WIDTH)
+
+//Voltage of the right side of the histogram
+#define HIST_MAX_VOLTAGE                (6.0f)
+
+//Histogram is halved when number of samples is bigger
+#define HIST_AGING_SAMPLES              (64UL * MAIN_ADC_CAPTURED_POINTS)
+
+//Second peak must be this far from the first one
+#define HIST_MIN_PEAK_DISTANCE          (HIST_BINS / 16)
+
+//Second peak must be bigger than 1/N of the first one
+#define HIST_MIN_PEAK_RATIO             (64)
+
+//High level must be within +-N% from family nominal voltage
+#define HIST_FAMILY_TOLERANCE           (0.25f)
+
+//Family is applied after this number of same detections
+#define HIST_STABLE_CNT                 (10)
+
+#define HIST_NO_FAMILY                  (0xFF)
+
+//Header is part with text
+#define HIST_HEADER_HEIGHT              (9)
+
+//One text line is placed below histogram
+#define HIST_Y_END                      (DISPLAY_HEIGHT - 10)
+
+#define HIST_ACTIVE_HEIGHT              (HIST_Y_END - HIST_HEADER_HEIGHT - 1)
+
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+//Sorted by nominal voltage
+const hist_logic_family_t hist_families[] =
+{
+  {"1.8V", 1.8f, 0.63f, 1.17f},
+  {"2.5V", 2.5f, 0.7f, 1.7f},
+  {"3.3V", 3.3f, 0.8f, 2.0f},
+  {"5V",   5.0f, 1.5f, 3.5f},
+};
+
+#define HIST_FAMILIES_CNT  (sizeof(hist_families) / sizeof(hist_logic_family_t))
+
+//Allocated from "mode_arena"
+uint32_t* hist_bins = NULL;
+
+uint32_t hist_total = 0;//samples in "hist_bins"
+
+//Fused value to bin: bin = (value * scale) >> 16
+uint32_t hist_bin_scale = 0;
+
+//Found levels, bins; level count is 0 if histogram is empty
+uint8_t hist_levels_cnt = 0;
+uint16_t hist_low_bin = 0;
+uint16_t hist_high_bin = 0;
+
+uint8_t hist_family = HIST_NO_FAMILY;
+uint8_t hist_candidate = HIST_NO_FAMILY;
+uint8_t hist_candidate_cnt = 0;
+uint8_t hist_applied = HIST_NO_FAMILY;//family used by logic probe
+
+/* Private function prototypes -----------------------------------------------*/
+void hist_job_cb(uint16_t* adc_buffer, uint16_t points);
+void hist_accumulate(const uint16_t* adc_buffer, uint16_t points);
+void hist_age(void);
+uint32_t hist_get_smoothed(uint16_t bin);
+void hist_find_levels(void);
+void hist_detect_family(void);
+float hist_bin_to_voltage(uint16_t bin);
+void hist_clear(void);
+void hist_draw_header(void);
+void hist_draw_bins(void);
+void hist_draw_levels(void);
+uint16_t hist_voltage_to_bin(float voltage);
+void hist_post_result(void);
+
+const acq_job_t hist_job =
+{
+  ACQ_JOB_HISTOGRAM, DATA_PROC_SAMPLE_RATE_200K, MAIN_ADC_CAPTURED_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  hist_job_cb, NULL
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+// This function must be called when "main_menu_mode" is changed
+void histogram_main_mode_changed(void)
+{
+  hist_bins = NULL;
+  if (main_menu_mode != MENU_MODE_HISTOGRAM)
+    return;
+
+  hist_bins = (uint32_t*)mode_arena_alloc(HIST_BINS * sizeof(uint32_t));
+  hist_bin_scale =
+    ((uint32_t)HIST_BINS << 16) / data_processing_volt_to_fused(HIST_MAX_VOLTAGE);
+  hist_clear();
+  acquisition_submit(&hist_job);
+}
+
+// Start collecting again
+void histogram_upper_button_pressed(void)
+{
+  hist_clear();
+  hist_post_result();
+}
+
+void hist_clear(void)
+{
+  memset(hist_bins, 0, HIST_BINS * sizeof(uint32_t));
+  hist_total = 0;
+  hist_levels_cnt = 0;
+  hist_family = HIST_NO_FAMILY;
+  hist_candidate = HIST_NO_FAMILY;
+  hist_candidate_cnt = 0;
+}
+
+//Called by acquisition engine
+void hist_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  hist_accumulate(adc_buffer, points);
+  hist_total += points;
+  if (hist_total > HIST_AGING_SAMPLES)
+    hist_age();
+
+  hist_find_levels();
+  hist_detect_family();
+  hist_post_result();
+}
+
+void hist_post_result(void)
+{
+  acq_result_t result;
+  result.job_id = ACQ_JOB_HISTOGRAM;
+  acquisition_mailbox_post(&result);
+}
+
+// Add fused samples to the bins, no division per sample
+CCM_RAM_FUNC void hist_accumulate(const uint16_t* adc_buffer, uint16_t points)
+{
+  uint32_t scale = hist_bin_scale;
+  uint32_t* bins = hist_bins;
+
+  for (uint16_t i = 0; i < points; i++)
+  {
+    uint32_t bin = ((uint32_t)adc_buffer[i * 2 + 1] * scale) >> 16;//fused sample
+    if (bin >= HIST_BINS)
+      bin = HIST_BINS - 1;
+    bins[bin]++;
+  }
+}
+
+// Old samples are weighted less than new ones
+void hist_age(void)
+{
+  hist_total = 0;
+  for (uint16_t i = 0; i < HIST_BINS; i++)
+  {
+    hist_bins[i] >>= 1;
+    hist_total += hist_bins[i];
+  }
+}
+
+// Bin smoothed by [1 2 1] window, single noisy bin is not a peak
+uint32_t hist_get_smoothed(uint16_t bin)
+{
+  uint32_t value = hist_bins[bin] * 2;
+  value += (bin > 0) ? hist_bins[bin - 1] : hist_bins[bin];
+  value += (bin < (HIST_BINS - 1)) ? hist_bins[bin + 1] : hist_bins[bin];
+  return value;
+}
+
+// First level is the highest peak. Second level is the bin with the
+// biggest "count * distance" from the first one - small far peak wins
+// over the slope of the first peak.
+void hist_find_levels(void)
+{
+  uint16_t first_bin = 0;
+  uint32_t first_value = 0;
+  for (uint16_t i = 0; i < HIST_BINS; i++)
+  {
+    uint32_t value = hist_get_smoothed(i);
+    if (value > first_value)
+    {
+      first_value = value;
+      first_bin = i;
+    }
+  }
+
+  hist_levels_cnt = 0;
+  if (first_value == 0)
+    return;
+
+  uint16_t second_bin = first_bin;
+  uint32_t second_weight = 0;
+  for (uint16_t i = 0; i < HIST_BINS; i++)
+  {
+    uint16_t distance = (i > first_bin) ? (i - first_bin) : (first_bin - i);
+    if (distance < HIST_MIN_PEAK_DISTANCE)
+      continue;
+
+    uint32_t value = hist_get_smoothed(i);
+    if ((value * HIST_MIN_PEAK_RATIO) < first_value)
+      continue;
+    if ((value * distance) > second_weight)
+    {
+      second_weight = value * distance;
+      second_bin = i;
+    }
+  }
+
+  if (second_weight == 0)
+  {
+    hist_levels_cnt = 1;
+    hist_low_bin = first_bin;
+    hist_high_bin = first_bin;
+    return;
+  }
+
+  hist_levels_cnt = 2;
+  hist_low_bin = (first_bin < second_bin) ? first_bin : second_bin;
+  hist_high_bin = (first_bin < second_bin) ? second_bin : first_bin;
+}
+
+// Family is selected by high level, nearest nominal voltage is used
+void hist_detect_family(void)
+{
+  uint8_t family = HIST_NO_FAMILY;
+
+  if (hist_levels_cnt == 2)
+  {
+    float high_v = hist_bin_to_voltage(hist_high_bin);
+    float best_diff = HIST_FAMILY_TOLERANCE;
+    for (uint8_t i = 0; i < HIST_FAMILIES_CNT; i++)
+    {
+      float diff = high_v / hist_families[i].nominal_v - 1.0f;
+      if (diff < 0.0f)
+        diff = -diff;
+      if (diff < best_diff)
+      {
+        best_diff = diff;
+        family = i;
+      }
+    }
+
+    //Low level must be a valid low of this family
+    if ((family != HIST_NO_FAMILY) &&
+        (hist_bin_to_voltage(hist_low_bin) >= hist_families[family].low_v))
+      family = HIST_NO_FAMILY;
+  }
+  hist_family = family;
+
+  if (family != hist_candidate)
+  {
+    hist_candidate = family;
+    hist_candidate_cnt = 0;
+  }
+  if (hist_candidate_cnt < HIST_STABLE_CNT)
+    hist_candidate_cnt++;
+
+  if ((family != HIST_NO_FAMILY) && (hist_candidate_cnt >= HIST_STABLE_CNT) &&
+      (family != hist_applied))
+  {
+    hist_applied = family;
+    data_processing_set_logic_thresholds(
+      hist_families[family].low_v, hist_families[family].high_v);
+  }
+}
+
+// Voltage of the bin center
+float hist_bin_to_voltage(uint16_t bin)
+{
+  return ((float)bin + 0.5f) * HIST_MAX_VOLTAGE / (float)HIST_BINS;
+}
+
+uint16_t hist_voltage_to_bin(float voltage)
+{
+  if (voltage <= 0.0f)
+    return 0;
+  uint16_t bin = (uint16_t)(voltage * (float)HIST_BINS / HIST_MAX_VOLTAGE);
+  if (bin >= HIST_BINS)
+    bin = HIST_BINS - 1;
+  return bin;
+}
+
+//*****************************************************************************
+
+void histogram_draw_menu(menu_draw_type_t draw_type)
+{
+  if (draw_type == MENU_MODE_FULL_REDRAW)
+  {
+    display_clear_framebuffer();
+    display_draw_string("HISTOGRAM", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_update();
+  }
+  else
+  {
+    acq_result_t result;
+
+    //Redraw only when capture is processed
+    if (acquisition_mailbox_get_last(&result))
+    {
+      display_clear_framebuffer();
+      hist_draw_header();
+      hist_draw_bins();
+      hist_draw_levels();
+      display_update();
+    }
+  }//PARTIAL_REDRAW
+}
+
+void hist_draw_header(void)
+{
+  char tmp_str[32];
+  float low_v;
+  float high_v;
+
+  if (hist_family != HIST_NO_FAMILY)
+  {
+    sprintf(tmp_str, "HIST %s LOGIC", hist_families[hist_family].name);
+    display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_GREEN);
+  }
+  else
+  {
+    display_draw_string("HIST ? LOGIC", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+  }
+
+  //Thresholds used by logic probe
+  data_processing_get_logic_thresholds(&low_v, &high_v);
+  sprintf(tmp_str, "%.2f/%.2f", low_v, high_v);
+  menu_shift_string_right(tmp_str, 9);
+  display_draw_string(tmp_str, 106, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+}
+
+// Bar height is proportional to the bin, the biggest bin is full height
+void hist_draw_bins(void)
+{
+  uint32_t max_value = 1;
+  for (uint16_t i = 0; i < HIST_BINS; i++)
+  {
+    if (hist_bins[i] > max_value)
+      max_value = hist_bins[i];
+  }
+
+  for (uint16_t x = 0; x < HIST_BINS; x++)
+  {
+    if (hist_bins[x] == 0)
+      continue;
+    uint16_t height = (uint16_t)((uint64_t)hist_bins[x] * HIST_ACTIVE_HEIGHT / max_value);
+    if (height == 0)
+      height = 1;//rare level is visible
+    display_draw_vertical_line(x, HIST_Y_END - height, HIST_Y_END - 1, COLOR_WHITE);
+  }
+  display_draw_line(HIST_Y_END, COLOR_BLUE);
+}
+
+// Found levels - green markers, logic probe thresholds - red markers
+void hist_draw_levels(void)
+{
+  char tmp_str[32];
+  float low_v;
+  float high_v;
+
+  data_processing_get_logic_thresholds(&low_v, &high_v);
+  display_set_pixel_color(hist_voltage_to_bin(low_v), HIST_Y_END, COLOR_RED);
+  display_set_pixel_color(hist_voltage_to_bin(high_v), HIST_Y_END, COLOR_RED);
+  display_draw_vertical_line(hist_voltage_to_bin(low_v),
+    HIST_HEADER_HEIGHT, HIST_HEADER_HEIGHT + 2, COLOR_RED);
+  display_draw_vertical_line(hist_voltage_to_bin(high_v),
+    HIST_HEADER_HEIGHT, HIST_HEADER_HEIGHT + 2, COLOR_RED);
+
+  if (hist_levels_cnt == 0)
+  {
+    display_draw_string("NO DATA", 0, HIST_Y_END + 2, FONT_SIZE_8, 0, COLOR_WHITE);
+    return;
+  }
+
+  display_draw_vertical_line(hist_low_bin,
+    HIST_HEADER_HEIGHT, HIST_HEADER_HEIGHT + 2, COLOR_GREEN);
+  display_draw_vertical_line(hist_high_bin,
+    HIST_HEADER_HEIGHT, HIST_HEADER_HEIGHT + 2, COLOR_GREEN);
+
+  if (hist_levels_cnt == 1)
+    sprintf(tmp_str, "LEVEL %.2fV", hist_bin_to_voltage(hist_low_bin));
+  else
+    sprintf(tmp_str, "LOW %.2fV HIGH %.2fV",
+      hist_bin_to_voltage(hist_low_bin), hist_bin_to_voltage(hist_high_bin));
+  display_draw_string(tmp_str, 0, HIST_Y_END + 2, FONT_SIZE_8, 0, COLOR_GREEN);
+}
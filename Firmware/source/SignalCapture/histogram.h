@@ -0,0 +1,13 @@
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include "mode_controlling.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+void histogram_main_mode_changed(void);
+
+void histogram_draw_menu(menu_draw_type_t draw_type);
+void histogram_upper_button_pressed(void);
+
+#endif
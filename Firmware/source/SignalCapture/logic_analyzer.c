@@ -0,0 +1,665 @@
+//Logic analyzer mode - digital level of the probe (COMP4_OUT pin) is sampled
+//by DMA from GPIO IDR, DMA request is made by LA_TIMER update event.
+//DMA is working in Circular mode with small staging buffer, its halves are
+//packed to 1 bit per sample into ring buffer by DMA interrupt.
+//Capture is stopped when post-trigger part of the ring is filled.
+//Bit "k" of the ring word is sample "k" of this word.
+
+/* Includes ------------------------------------------------------------------*/
+#include "config.h"
+#include "mode_controlling.h"
+#include "adc_controlling.h"
+#include "comparator_handling.h"
+#include "freq_measurement.h"
+#include "display_functions.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "stdio.h"
+#include "string.h"
+
+#include "logic_analyzer.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  LA_STATE_IDLE = 0,
+  LA_STATE_FILL,//pre-trigger part is not filled yet
+  LA_STATE_ARMED,
+  LA_STATE_TRIGGERED,
+  LA_STATE_DONE,
+  LA_STATE_OVERRUN,//staging buffer was overwritten before packing
+} la_state_t;
+
+// Item that is changed by upper button press, hold - next item
+typedef enum
+{
+  LA_CONTROL_ZOOM = 0,
+  LA_CONTROL_PAN,
+  LA_CONTROL_CURSOR_A,
+  LA_CONTROL_CURSOR_B,
+  LA_CONTROL_TRIGGER,
+  LA_CONTROL_RATE,
+  LA_CONTROL_RUN,
+  LA_CONTROL_COUNT,//LAST!
+} la_control_t;
+
+// Pulses that are fully placed between cursors
+typedef struct
+{
+  uint32_t edges_cnt;
+  uint32_t high_cnt;
+  uint32_t high_summ;//samples
+  uint32_t low_cnt;
+  uint32_t low_summ;//samples
+} la_pulse_stats_t;
+
+/* Private define ------------------------------------------------------------*/
+//Staging buffer, halfwords, each half is packed by one interrupt
+#define LA_DMA_BUFFER_SIZE              (256)
+#define LA_DMA_HALF_WORDS               (LA_DMA_BUFFER_SIZE / 2 / 32)
+
+//Probe level is this bit of COMP_OUT_GPIO->IDR
+#define LA_PIN_BIT                      (COMP_OUT_AF_SRC)
+
+//Part of the ring captured before trigger, %
+#define LA_PRE_TRIGGER_PERCENT          (10)
+
+#define LA_RATES_CNT                    (7)
+
+//Samples per column = 1 << zoom
+#define LA_MAX_ZOOM                     (10)
+#define LA_DEFAULT_ZOOM                 (2)
+
+//Trigger column after new capture
+#define LA_TRIGGER_COLUMN               (16)
+
+#define LA_HEADER_HEIGHT                (9)
+#define LA_TRACE_HIGH_Y                 (18)
+#define LA_TRACE_LOW_Y                  (38)
+#define LA_CURSOR_Y1                    (LA_HEADER_HEIGHT + 1)
+#define LA_CURSOR_Y2                    (LA_TRACE_LOW_Y + 4)
+#define LA_TEXT_Y                       (LA_CURSOR_Y2 + 3)
+
+#define LA_COLUMNS_CNT                  (DISP_WIDTH)
+
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+const uint32_t la_rates[LA_RATES_CNT] =
+{
+  2000000, 1000000, 500000, 200000, 100000, 50000, 10000
+};
+
+const char* const la_control_names[LA_CONTROL_COUNT] =
+{
+  "ZOOM ", "PAN  ", "CUR A", "CUR B", "TRIG ", "RATE ", "RUN  "
+};
+
+//Allocated from "mode_arena"
+uint16_t* la_dma_buffer = NULL;
+uint32_t* la_ring = NULL;
+uint32_t la_ring_words = 0;
+
+//Used by DMA interrupt
+volatile la_state_t la_state = LA_STATE_IDLE;
+uint32_t la_ring_pos = 0;//next word to write
+uint32_t la_words_total = 0;//packed words since capture start
+uint32_t la_pre_words = 0;
+uint32_t la_stop_words = 0;
+uint32_t la_last_bit = 0;//last sample of the previous word
+uint32_t la_trigger_invert = 0;//0xFFFFFFFF - falling edge trigger
+uint32_t la_trigger_bit = 0;//position inside trigger word
+
+uint8_t la_rate_idx = 1;
+float la_rate = 0.0f;//Hz, achieved
+
+//Valid in LA_STATE_DONE, sample indexes from the oldest sample
+uint32_t la_samples_cnt = 0;
+uint32_t la_ring_start = 0;//word of the oldest sample
+uint32_t la_trigger_pos = 0;
+uint32_t la_cursor_a = 0;
+uint32_t la_cursor_b = 0;
+
+uint32_t la_view_start = 0;
+uint8_t la_zoom = LA_DEFAULT_ZOOM;
+la_control_t la_control = LA_CONTROL_ZOOM;
+
+la_pulse_stats_t la_stats;
+
+//Set when waveform must be redrawn
+uint8_t la_redraw = 0;
+la_state_t la_drawn_state = LA_STATE_IDLE;
+
+/* Private function prototypes -----------------------------------------------*/
+void LA_DMA_IRQ_HANDLER(void);
+void la_pack(const uint16_t* samples);
+void la_init_hardware(void);
+void la_start(void);
+void la_capture_done(void);
+uint32_t la_get_word(uint32_t idx);
+uint8_t la_get_level(uint32_t pos);
+uint32_t la_next_edge(uint32_t pos);
+uint8_t la_range_state(uint32_t start, uint32_t end);
+void la_update_stats(void);
+void la_show_position(uint32_t pos);
+void la_draw_header(void);
+void la_draw_waveform(void);
+void la_draw_cursor(uint32_t pos, uint16_t color);
+void la_draw_stats(void);
+void la_format_time(char* str, uint32_t samples);
+void la_clear_active_zone(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+CCM_RAM_FUNC void LA_DMA_IRQ_HANDLER(void)
+{
+  uint32_t status = LA_DMA->ISR;
+
+  if ((status & LA_DMA_ISR_HT) && (status & LA_DMA_ISR_TC))
+  {
+    //Both halves are written - one of them is lost
+    logic_analyzer_stop();
+    la_state = LA_STATE_OVERRUN;
+    return;
+  }
+
+  if (status & LA_DMA_ISR_HT)
+  {
+    LA_DMA->IFCR = LA_DMA_ISR_HT;
+    la_pack(&la_dma_buffer[0]);
+  }
+  else if (status & LA_DMA_ISR_TC)
+  {
+    LA_DMA->IFCR = LA_DMA_ISR_TC;
+    la_pack(&la_dma_buffer[LA_DMA_BUFFER_SIZE / 2]);
+  }
+}
+
+// Pack half of the staging buffer to the ring and check trigger
+CCM_RAM_FUNC void la_pack(const uint16_t* samples)
+{
+  for (uint8_t w = 0; w < LA_DMA_HALF_WORDS; w++)
+  {
+    uint32_t bits = 0;
+    for (uint8_t k = 0; k < 32; k++)
+      bits = (bits >> 1) | ((uint32_t)(samples[k] & (1 << LA_PIN_BIT)) << (31 - LA_PIN_BIT));
+    samples += 32;
+
+    la_ring[la_ring_pos] = bits;
+    la_ring_pos++;
+    if (la_ring_pos >= la_ring_words)
+      la_ring_pos = 0;
+
+    if (la_state == LA_STATE_ARMED)
+    {
+      uint32_t level = bits ^ la_trigger_invert;
+      uint32_t prev_level = (level << 1) | ((la_last_bit ^ la_trigger_invert) & 1);
+      uint32_t edges = level & ~prev_level;
+      if (edges)
+      {
+        la_trigger_bit = __CLZ(__RBIT(edges));
+        la_stop_words = la_words_total + la_ring_words - la_pre_words;
+        la_state = LA_STATE_TRIGGERED;
+      }
+    }
+    la_last_bit = bits >> 31;
+    la_words_total++;
+
+    if (la_state == LA_STATE_FILL)
+    {
+      if (la_words_total >= la_pre_words)
+        la_state = LA_STATE_ARMED;
+    }
+    else if ((la_state == LA_STATE_TRIGGERED) && (la_words_total >= la_stop_words))
+    {
+      logic_analyzer_stop();
+      la_state = LA_STATE_DONE;
+      return;
+    }
+  }
+}
+
+// This function must be called when "main_menu_mode" is changed
+// Must be called after "freq_measurement_main_mode_changed" - same comparator
+// output pin is used
+void logic_analyzer_main_mode_changed(void)
+{
+  la_dma_buffer = NULL;
+  la_ring = NULL;
+  la_state = LA_STATE_IDLE;
+  if (main_menu_mode != MENU_MODE_LOGIC_ANALYZER)
+    return;
+
+  //Whole arena is used - ADC buffers are not allocated in this mode
+  la_dma_buffer = (uint16_t*)mode_arena_alloc(LA_DMA_BUFFER_SIZE * sizeof(uint16_t));
+  la_ring_words = mode_arena_get_free() / sizeof(uint32_t);
+  la_ring = (uint32_t*)mode_arena_alloc(la_ring_words * sizeof(uint32_t));
+  la_pre_words = la_ring_words * LA_PRE_TRIGGER_PERCENT / 100;
+  if (la_pre_words == 0)
+    la_pre_words = 1;
+
+  comparator_init(USE_NO_EVENTS_COMP);
+  comparator_set_threshold(FREQ_TRIGGER_DEFAULT_V);
+  la_init_hardware();
+  la_start();
+}
+
+void la_init_hardware(void)
+{
+  DMA_InitTypeDef DMA_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  LA_TIMER_CLK_INIT_F(LA_TIMER_CLK, ENABLE);
+  TIM_DeInit(LA_TIMER);
+  TIM_DMACmd(LA_TIMER, TIM_DMA_Update, ENABLE);
+
+  RCC_AHBPeriphClockCmd(LA_DMA_CLK, ENABLE);
+  DMA_DeInit(LA_DMA_CHANNEL);
+  DMA_StructInit(&DMA_InitStructure);
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&COMP_OUT_GPIO->IDR;
+  DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)la_dma_buffer;
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+  DMA_InitStructure.DMA_BufferSize = LA_DMA_BUFFER_SIZE;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+  DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+  DMA_Init(LA_DMA_CHANNEL, &DMA_InitStructure);
+
+  NVIC_InitStructure.NVIC_IRQChannel = LA_DMA_IRQ;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;//highest
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+}
+
+// Start new capture with current rate and trigger
+void la_start(void)
+{
+  logic_analyzer_stop();
+
+  //Same timer arithmetic as ADC trigger timer
+  adc_rate_plan_t plan = adc_plan_sample_rate(la_rates[la_rate_idx]);
+  la_rate = plan.rate;
+
+  la_ring_pos = 0;
+  la_words_total = 0;
+  la_last_bit = 0;
+  la_state = LA_STATE_FILL;
+  la_drawn_state = LA_STATE_IDLE;
+  la_redraw = 1;
+
+  LA_TIMER->PSC = plan.prescaler;
+  LA_TIMER->ARR = plan.period;
+  LA_TIMER->CNT = 0;
+  LA_TIMER->EGR = TIM_EGR_UG;//load prescaler
+  LA_TIMER->SR = 0;
+
+  LA_DMA->IFCR = LA_DMA_ISR_HT | LA_DMA_ISR_TC;
+  LA_DMA_CHANNEL->CNDTR = LA_DMA_BUFFER_SIZE;
+  DMA_ITConfig(LA_DMA_CHANNEL, DMA_IT_TC | DMA_IT_HT, ENABLE);
+  DMA_Cmd(LA_DMA_CHANNEL, ENABLE);
+  //Update event of UG bit is not making DMA request - it is disabled in CR1
+  TIM_Cmd(LA_TIMER, ENABLE);
+}
+
+// Can be called from interrupt
+CCM_RAM_FUNC void logic_analyzer_stop(void)
+{
+  LA_TIMER->CR1 &= ~TIM_CR1_CEN;
+  LA_DMA_CHANNEL->CCR &= ~DMA_CCR_EN;
+  LA_DMA->IFCR = LA_DMA_ISR_HT | LA_DMA_ISR_TC;
+}
+
+// Called from main loop when DMA interrupt has stopped the capture
+void la_capture_done(void)
+{
+  la_ring_start = la_ring_pos;
+  la_samples_cnt = la_ring_words * 32;
+  la_trigger_pos = la_pre_words * 32 + la_trigger_bit;
+
+  la_cursor_a = la_trigger_pos;
+  la_cursor_b = la_next_edge(la_trigger_pos);
+  if (la_cursor_b >= la_samples_cnt)
+    la_cursor_b = la_samples_cnt - 1;
+
+  la_zoom = LA_DEFAULT_ZOOM;
+  la_view_start = 0;
+  if (la_trigger_pos > (LA_TRIGGER_COLUMN << la_zoom))
+    la_view_start = la_trigger_pos - (LA_TRIGGER_COLUMN << la_zoom);
+  la_update_stats();
+}
+
+//idx - word index from the oldest word
+uint32_t la_get_word(uint32_t idx)
+{
+  idx += la_ring_start;
+  if (idx >= la_ring_words)
+    idx -= la_ring_words;
+  return la_ring[idx];
+}
+
+uint8_t la_get_level(uint32_t pos)
+{
+  return (uint8_t)((la_get_word(pos >> 5) >> (pos & 31)) & 1);
+}
+
+// Return position of the first sample after "pos" that differs from
+// the previous one, "la_samples_cnt" if there is no such sample
+uint32_t la_next_edge(uint32_t pos)
+{
+  pos++;
+  while (pos < la_samples_cnt)
+  {
+    uint32_t word_idx = pos >> 5;
+    uint32_t word = la_get_word(word_idx);
+    uint32_t prev_bit = (word_idx > 0) ? (la_get_word(word_idx - 1) >> 31) : (word & 1);
+    uint32_t changes = (word ^ ((word << 1) | prev_bit)) & (0xFFFFFFFFUL << (pos & 31));
+    if (changes)
+      return (word_idx << 5) + __CLZ(__RBIT(changes));
+    pos = (word_idx + 1) << 5;
+  }
+  return la_samples_cnt;
+}
+
+// Levels of samples from "start" to "end" (not included)
+// Return bit 0 - low sample is found, bit 1 - high sample is found
+uint8_t la_range_state(uint32_t start, uint32_t end)
+{
+  uint32_t any_high = 0;
+  uint32_t any_low = 0;
+
+  while ((start < end) && (!any_high || !any_low))
+  {
+    uint32_t word_idx = start >> 5;
+    uint32_t mask = 0xFFFFFFFFUL << (start & 31);
+    uint32_t next = (word_idx + 1) << 5;
+    if (end < next)
+    {
+      mask &= 0xFFFFFFFFUL >> (next - end);
+      next = end;
+    }
+    uint32_t word = la_get_word(word_idx);
+    any_high |= word & mask;
+    any_low |= ~word & mask;
+    start = next;
+  }
+  return (uint8_t)((any_low ? 1 : 0) | (any_high ? 2 : 0));
+}
+
+// Collect widths of the pulses that are fully placed between cursors
+void la_update_stats(void)
+{
+  uint32_t start = (la_cursor_a < la_cursor_b) ? la_cursor_a : la_cursor_b;
+  uint32_t end = (la_cursor_a < la_cursor_b) ? la_cursor_b : la_cursor_a;
+
+  memset(&la_stats, 0, sizeof(la_stats));
+  uint32_t edge = la_next_edge(start);
+  while (edge <= end)
+  {
+    uint32_t next_edge = la_next_edge(edge);
+    la_stats.edges_cnt++;
+    if (next_edge > end)
+      break;
+
+    if (la_get_level(edge))
+    {
+      la_stats.high_cnt++;
+      la_stats.high_summ += next_edge - edge;
+    }
+    else
+    {
+      la_stats.low_cnt++;
+      la_stats.low_summ += next_edge - edge;
+    }
+    edge = next_edge;
+  }
+}
+
+// Pan view if "pos" is not displayed
+void la_show_position(uint32_t pos)
+{
+  uint32_t window = (uint32_t)LA_COLUMNS_CNT << la_zoom;
+  if ((pos < la_view_start) || (pos >= (la_view_start + window)))
+    la_view_start = (pos > window / 4) ? (pos - window / 4) : 0;
+}
+
+void logic_analyzer_upper_button_pressed(void)
+{
+  uint32_t window = (uint32_t)LA_COLUMNS_CNT << la_zoom;
+
+  if ((la_control == LA_CONTROL_TRIGGER) || (la_control == LA_CONTROL_RATE) ||
+      (la_control == LA_CONTROL_RUN))
+  {
+    if (la_control == LA_CONTROL_TRIGGER)
+      la_trigger_invert = ~la_trigger_invert;
+    else if (la_control == LA_CONTROL_RATE)
+    {
+      la_rate_idx++;
+      if (la_rate_idx >= LA_RATES_CNT)
+        la_rate_idx = 0;
+    }
+    la_start();
+    return;
+  }
+
+  //Other items are working with captured data
+  if (la_state != LA_STATE_DONE)
+    return;
+
+  switch (la_control)
+  {
+    case LA_CONTROL_ZOOM:
+    {
+      //Zoom out around window center, wrap to max resolution
+      uint32_t center = la_view_start + window / 2;
+      la_zoom++;
+      if (la_zoom > LA_MAX_ZOOM)
+        la_zoom = 0;
+      window = (uint32_t)LA_COLUMNS_CNT << la_zoom;
+      la_view_start = (center > window / 2) ? (center - window / 2) : 0;
+    }
+    break;
+
+    case LA_CONTROL_PAN:
+      la_view_start += window / 2;
+      if (la_view_start >= la_samples_cnt)
+        la_view_start = 0;
+    break;
+
+    case LA_CONTROL_CURSOR_A:
+      la_cursor_a = la_next_edge(la_cursor_a);
+      if (la_cursor_a >= la_samples_cnt)
+        la_cursor_a = 0;
+      la_show_position(la_cursor_a);
+      la_update_stats();
+    break;
+
+    case LA_CONTROL_CURSOR_B:
+      la_cursor_b = la_next_edge(la_cursor_b);
+      if (la_cursor_b >= la_samples_cnt)
+        la_cursor_b = 0;
+      la_show_position(la_cursor_b);
+      la_update_stats();
+    break;
+
+    default: break;
+  }
+  la_redraw = 1;
+}
+
+void logic_analyzer_upper_button_hold(void)
+{
+  la_control++;
+  if (la_control >= LA_CONTROL_COUNT)
+    la_control = LA_CONTROL_ZOOM;
+  la_redraw = 1;
+}
+
+//*****************************************************************************
+
+void logic_analyzer_draw_menu(menu_draw_type_t draw_type)
+{
+  if (draw_type == MENU_MODE_FULL_REDRAW)
+  {
+    display_clear_framebuffer();
+    display_draw_string("LOGIC ANALYZER", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_update();
+    la_redraw = 1;
+  }
+  else
+  {
+    la_state_t state = la_state;
+
+    if ((state == LA_STATE_DONE) && (la_drawn_state != LA_STATE_DONE))
+      la_capture_done();
+
+    if ((la_redraw == 0) && (state == la_drawn_state) && (state != LA_STATE_TRIGGERED))
+      return;
+
+    if ((la_redraw) || (state != la_drawn_state))
+    {
+      la_clear_active_zone();
+      if (state == LA_STATE_DONE)
+      {
+        la_draw_waveform();
+        la_draw_stats();
+      }
+    }
+    la_redraw = 0;
+    la_drawn_state = state;
+    la_draw_header();
+    display_update();
+  }//PARTIAL_REDRAW
+}
+
+void la_draw_header(void)
+{
+  char tmp_str[32];
+  uint32_t rate = la_rates[la_rate_idx];
+
+  if (rate >= 1000000)
+    sprintf(tmp_str, "LA %luM %c  ", rate / 1000000, la_trigger_invert ? '\\' : '/');
+  else
+    sprintf(tmp_str, "LA %luk %c", rate / 1000, la_trigger_invert ? '\\' : '/');
+  display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+  display_draw_string((char*)la_control_names[la_control], 60, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+
+  switch (la_state)
+  {
+    case LA_STATE_FILL:
+      display_draw_string("FILL", 136, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+    break;
+
+    case LA_STATE_ARMED:
+      display_draw_string("WAIT", 136, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+    break;
+
+    case LA_STATE_TRIGGERED:
+    {
+      uint32_t post_words = la_ring_words - la_pre_words;
+      uint32_t left = la_stop_words - la_words_total;
+      sprintf(tmp_str, "%3lu%%", (post_words - left) * 100 / post_words);
+      display_draw_string(tmp_str, 136, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+    }
+    break;
+
+    case LA_STATE_OVERRUN:
+      display_draw_string(" OVR", 136, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    default:
+      display_draw_string("DONE", 136, 0, FONT_SIZE_8, 0, COLOR_GREEN);
+    break;
+  }
+}
+
+// Each column is a line between levels of its samples, last sample of
+// the previous column is included - edges are continuous
+void la_draw_waveform(void)
+{
+  for (uint16_t x = 0; x < LA_COLUMNS_CNT; x++)
+  {
+    uint32_t start = la_view_start + ((uint32_t)x << la_zoom);
+    if (start >= la_samples_cnt)
+      break;
+    uint32_t end = start + (1UL << la_zoom);
+    if (end > la_samples_cnt)
+      end = la_samples_cnt;
+    if (start > 0)
+      start--;
+
+    uint8_t state = la_range_state(start, end);
+    if (state == 3)
+      display_draw_vertical_line(x, LA_TRACE_HIGH_Y, LA_TRACE_LOW_Y, COLOR_WHITE);
+    else if (state == 2)
+      display_set_pixel_color(x, LA_TRACE_HIGH_Y, COLOR_WHITE);
+    else
+      display_set_pixel_color(x, LA_TRACE_LOW_Y, COLOR_WHITE);
+  }
+
+  la_draw_cursor(la_trigger_pos, COLOR_RED);
+  la_draw_cursor(la_cursor_a, COLOR_YELLOW);
+  la_draw_cursor(la_cursor_b, COLOR_GREEN);
+}
+
+// Dotted vertical line, not drawn if "pos" is out of the window
+void la_draw_cursor(uint32_t pos, uint16_t color)
+{
+  if (pos < la_view_start)
+    return;
+  uint32_t x = (pos - la_view_start) >> la_zoom;
+  if (x >= LA_COLUMNS_CNT)
+    return;
+
+  for (uint16_t y = LA_CURSOR_Y1; y <= LA_CURSOR_Y2; y += 2)
+    display_set_pixel_color((uint16_t)x, y, color);
+}
+
+// Time between cursors and pulses between them
+void la_draw_stats(void)
+{
+  char tmp_str[32];
+  char time_str[2][12];
+  uint32_t delta = (la_cursor_a < la_cursor_b) ?
+    (la_cursor_b - la_cursor_a) : (la_cursor_a - la_cursor_b);
+
+  la_format_time(time_str[0], delta);
+  la_format_time(time_str[1], (uint32_t)LA_COLUMNS_CNT << la_zoom);
+  sprintf(tmp_str, "dT %s W %s", time_str[0], time_str[1]);
+  display_draw_string(tmp_str, 0, LA_TEXT_Y, FONT_SIZE_8, 0, COLOR_WHITE);
+
+  strcpy(time_str[0], "-");
+  strcpy(time_str[1], "-");
+  if (la_stats.high_cnt)
+    la_format_time(time_str[0], la_stats.high_summ / la_stats.high_cnt);
+  if (la_stats.low_cnt)
+    la_format_time(time_str[1], la_stats.low_summ / la_stats.low_cnt);
+  sprintf(tmp_str, "H %s L %s", time_str[0], time_str[1]);
+  display_draw_string(tmp_str, 0, LA_TEXT_Y + 9, FONT_SIZE_8, 0, COLOR_GREEN);
+
+  sprintf(tmp_str, "EDGES %lu", la_stats.edges_cnt);
+  if ((la_stats.high_cnt) && (la_stats.low_cnt))
+  {
+    float high = (float)la_stats.high_summ / (float)la_stats.high_cnt;
+    float low = (float)la_stats.low_summ / (float)la_stats.low_cnt;
+    sprintf(&tmp_str[strlen(tmp_str)], " DUTY %lu%%",
+      (uint32_t)(high * 100.0f / (high + low) + 0.5f));
+  }
+  display_draw_string(tmp_str, 0, LA_TEXT_Y + 18, FONT_SIZE_8, 0, COLOR_GREEN);
+}
+
+void la_format_time(char* str, uint32_t samples)
+{
+  menu_print_time(str, (float)samples / la_rate);
+}
+
+void la_clear_active_zone(void)
+{
+  uint8_t y;
+  for (y = LA_HEADER_HEIGHT; y < DISPLAY_HEIGHT; y++)
+    display_draw_line(y, COLOR_BLACK);
+}
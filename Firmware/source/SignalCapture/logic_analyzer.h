@@ -0,0 +1,16 @@
+#ifndef __LOGIC_ANALYZER_H
+#define __LOGIC_ANALYZER_H
+
+#include "mode_controlling.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+void logic_analyzer_main_mode_changed(void);
+void logic_analyzer_stop(void);
+
+void logic_analyzer_draw_menu(menu_draw_type_t draw_type);
+void logic_analyzer_upper_button_pressed(void);
+void logic_analyzer_upper_button_hold(void);
+
+#endif
+
@@ -0,0 +1,430 @@
+//Persistence mode - intensity graded display of repetitive signals
+//Captures are started by comparator rising edge, like in averaging mode.
+//Every capture adds hits to the count map - 4-bit saturating counter per
+//display pixel. Counts decay by 3/4 every N captures, so old traces fade out.
+//Count is shown by the graded palette - rare paths are dim, frequent are bright.
+//First half of the capture is accumulated while second half is captured.
+
+/* Includes ------------------------------------------------------------------*/
+#include "config.h"
+#include "mode_controlling.h"
+#include "data_processing.h"
+#include "acquisition.h"
+#include "adc_controlling.h"
+#include "comparator_handling.h"
+#include "display_functions.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "stdio.h"
+#include "string.h"
+
+#include "persistence.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  PERS_STATUS_RUNNING = 0,
+  PERS_STATUS_NO_SIGNAL,
+  PERS_STATUS_NO_TRIGGER,
+} pers_status_t;
+
+/* Private define ------------------------------------------------------------*/
+//Two points per display column
+#define PERS_POINTS                     (320)
+#define PERS_COLUMNS_CNT                (DISP_WIDTH)
+#define PERS_POINTS_PER_COLUMN          (PERS_POINTS / PERS_COLUMNS_CNT)
+
+//Capture used to find comparator threshold and vertical scale
+#define PERS_LEVEL_POINTS               (256)
+
+#define PERS_DECAYS_CNT                 (4)
+#define PERS_RATES_CNT                  (5)
+
+//Smaller signal can't be used for trigger
+#define PERS_MIN_SWING_V                (0.05f)
+
+//Level search is restarted if trigger is not coming
+#define PERS_TRIGGER_TIMEOUT_MS         (200)
+
+//Header is part with text
+#define PERS_HEADER_HEIGHT              (9)
+
+//Count map rows, row 0 is the bottom one
+#define PERS_ROWS                       (DISPLAY_HEIGHT - PERS_HEADER_HEIGHT - 1)
+#define PERS_Y_END                      (PERS_HEADER_HEIGHT + PERS_ROWS)
+
+//Two 4-bit counters per byte, even row is in low nibble
+#define PERS_COLUMN_BYTES               (PERS_ROWS / 2)
+#define PERS_MAP_SIZE                   (PERS_COLUMNS_CNT * PERS_COLUMN_BYTES)
+
+#define PERS_COUNT_MAX                  (15)
+
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+//Number of captures between decay steps, 0 - infinite persistence
+const uint16_t pers_decay_periods[PERS_DECAYS_CNT] = {1, 4, 16, 0};
+const char* const pers_decay_names[PERS_DECAYS_CNT] = {"1", "4", "16", "INF"};
+uint8_t pers_decay_idx = 1;
+
+//ADC_ETS_TIMER is used, ADC timer prescaler must be 0 at these rates
+const uint32_t pers_rates[PERS_RATES_CNT] = {2000000, 1000000, 200000, 50000, 10000};
+uint8_t pers_rate_idx = 1;
+
+//Count to colour
+const uint8_t pers_palette[PERS_COUNT_MAX + 1] =
+{
+  COLOR_BLACK,
+  COLOR_GRADE_1, COLOR_GRADE_2, COLOR_GRADE_2, COLOR_GRADE_3,
+  COLOR_GRADE_3, COLOR_GRADE_4, COLOR_GRADE_4, COLOR_GRADE_5,
+  COLOR_GRADE_5, COLOR_GRADE_6, COLOR_GRADE_6, COLOR_GRADE_7,
+  COLOR_GRADE_7, COLOR_GRADE_8, COLOR_GRADE_8,
+};
+
+//Allocated from "mode_arena"
+uint8_t* pers_map = NULL;
+uint8_t* pers_decay_table = NULL;//decayed value of the map byte
+
+uint16_t pers_captures = 0;//captures since the last decay
+uint32_t pers_total_captures = 0;
+uint8_t pers_half_done = 0;//first half of the capture is accumulated
+uint8_t pers_decay_pending = 0;//map is decayed before the next capture is accumulated
+
+//Triggered captures are running
+uint8_t pers_running = 0;
+uint32_t pers_capture_time = 0;//ms_tick value
+
+pers_status_t pers_status = PERS_STATUS_RUNNING;
+
+//Vertical scale, set by level job: row = (value - base) * scale >> 16
+uint16_t pers_base_value = 0;
+uint16_t pers_span_value = 1;
+uint32_t pers_row_scale = 0;
+
+//Bottom and top voltage of the map
+float pers_min_voltage = 0.0f;
+float pers_max_voltage = 0.0f;
+
+/* Private function prototypes -----------------------------------------------*/
+void pers_level_job_cb(uint16_t* adc_buffer, uint16_t points);
+uint8_t pers_capture_job_partial_cb(uint16_t* adc_buffer, uint16_t points);
+void pers_capture_job_cb(uint16_t* adc_buffer, uint16_t points);
+void pers_accumulate(const uint16_t* adc_buffer, uint16_t x_start, uint16_t x_end);
+uint16_t pers_get_row(uint16_t value);
+void pers_decay(void);
+void pers_apply_decay(void);
+void pers_build_decay_table(void);
+void pers_restart(void);
+void pers_post_result(acq_job_id_t job_id);
+void pers_draw_header(void);
+void pers_draw_map(void);
+
+//"sample_rate" is changed by upper button hold
+acq_job_t pers_level_job =
+{
+  ACQ_JOB_PERSISTENCE_LEVEL, 0, PERS_LEVEL_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, 0, pers_level_job_cb, NULL
+};
+
+acq_job_t pers_capture_job =
+{
+  ACQ_JOB_PERSISTENCE, 0, PERS_POINTS,
+  ACQ_TRIGGER_COMPARATOR, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  pers_capture_job_cb, pers_capture_job_partial_cb
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+// This function must be called when "main_menu_mode" is changed
+// Must be called after "glitch_catcher_main_mode_changed" - same timer is used
+void persistence_main_mode_changed(void)
+{
+  pers_map = NULL;
+  pers_decay_table = NULL;
+  pers_running = 0;
+  if (main_menu_mode != MENU_MODE_PERSISTENCE)
+    return;
+
+  pers_map = (uint8_t*)mode_arena_alloc(PERS_MAP_SIZE);
+  pers_decay_table = (uint8_t*)mode_arena_alloc(256);
+  pers_build_decay_table();
+
+  comparator_init(USE_GLITCH_CAPTURE_COMP);
+  adc_ets_timer_init();
+  adc_set_ets_delay(0);
+
+  pers_restart();
+}
+
+// Clear count map and find trigger level again
+void pers_restart(void)
+{
+  acquisition_abort();
+  pers_running = 0;
+  pers_captures = 0;
+  pers_total_captures = 0;
+  pers_half_done = 0;
+  pers_decay_pending = 0;
+  memset(pers_map, 0, PERS_MAP_SIZE);
+
+  pers_level_job.sample_rate = pers_rates[pers_rate_idx];
+  pers_capture_job.sample_rate = pers_rates[pers_rate_idx];
+  acquisition_submit(&pers_level_job);
+}
+
+// Called from "data_processing_handler"
+// Search level again if trigger is not coming
+void persistence_processing_handler(void)
+{
+  if ((pers_running == 0) ||
+      ((ms_tick - pers_capture_time) < PERS_TRIGGER_TIMEOUT_MS))
+    return;
+
+  pers_status = PERS_STATUS_NO_TRIGGER;
+  pers_post_result(ACQ_JOB_PERSISTENCE);
+  pers_restart();
+}
+
+// Change persistence time
+void persistence_upper_button_pressed(void)
+{
+  pers_decay_idx++;
+  if (pers_decay_idx >= PERS_DECAYS_CNT)
+    pers_decay_idx = 0;
+  pers_captures = 0;
+  pers_post_result(ACQ_JOB_PERSISTENCE);
+}
+
+// Change sample rate
+void persistence_upper_button_hold(void)
+{
+  pers_rate_idx++;
+  if (pers_rate_idx >= PERS_RATES_CNT)
+    pers_rate_idx = 0;
+  pers_restart();
+  pers_post_result(ACQ_JOB_PERSISTENCE);
+}
+
+//Called by acquisition engine - set comparator threshold to the signal middle
+//Vertical scale covers signal range with 1/8 margin
+void pers_level_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  adc_processed_data_t data = data_processing_extended(adc_buffer, points);
+  float swing = data.max_voltage - data.min_voltage;
+
+  if (swing < PERS_MIN_SWING_V)
+  {
+    pers_status = PERS_STATUS_NO_SIGNAL;
+    pers_post_result(ACQ_JOB_PERSISTENCE_LEVEL);
+    acquisition_submit(&pers_level_job);
+    return;
+  }
+
+  pers_min_voltage = data.min_voltage - swing / 8.0f;
+  if (pers_min_voltage < 0.0f)
+    pers_min_voltage = 0.0f;
+  pers_max_voltage = data.max_voltage + swing / 8.0f;
+
+  pers_base_value = data_processing_volt_to_fused(pers_min_voltage);
+  pers_span_value = data_processing_volt_to_fused(pers_max_voltage) - pers_base_value;
+  if (pers_span_value == 0)
+    pers_span_value = 1;
+  pers_row_scale = ((uint32_t)(PERS_ROWS - 1) << 16) / pers_span_value;
+
+  comparator_set_threshold((data.max_voltage + data.min_voltage) / 2.0f);
+  pers_status = PERS_STATUS_RUNNING;
+  pers_capture_time = ms_tick;
+  pers_running = 1;
+  acquisition_submit(&pers_capture_job);
+}
+
+//Called by acquisition engine while second half is captured
+uint8_t pers_capture_job_partial_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  if (pers_running == 0)
+    return 1;//capture was aborted
+
+  pers_apply_decay();
+  pers_accumulate(adc_buffer, 0, points / PERS_POINTS_PER_COLUMN);
+  pers_half_done = 1;
+  return 0;//full capture is needed
+}
+
+//Called by acquisition engine - rest of the capture is accumulated
+void pers_capture_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  if (pers_running == 0)
+    return;//capture was aborted
+
+  //First half is not accumulated if main loop was late for it
+  uint16_t x_start = pers_half_done ? (points / 2 / PERS_POINTS_PER_COLUMN) : 0;
+  pers_apply_decay();
+  pers_accumulate(adc_buffer, x_start, PERS_COLUMNS_CNT);
+  pers_half_done = 0;
+  pers_total_captures++;
+  pers_capture_time = ms_tick;
+
+  //Decay is delayed to the next capture - this one must be displayed first
+  uint16_t decay_period = pers_decay_periods[pers_decay_idx];
+  pers_captures++;
+  if ((decay_period != 0) && (pers_captures >= decay_period))
+  {
+    pers_captures = 0;
+    pers_decay_pending = 1;
+  }
+  pers_post_result(ACQ_JOB_PERSISTENCE);
+}
+
+// Decay requested by the previous capture, called before accumulating
+void pers_apply_decay(void)
+{
+  if (pers_decay_pending == 0)
+    return;
+  pers_decay_pending = 0;
+  pers_decay();
+}
+
+// Add hits of the columns "x_start" - "x_end" to the count map
+// Column is hit from min to max of its points, last point of the
+// previous column is included - trace is continuous
+CCM_RAM_FUNC void pers_accumulate(const uint16_t* adc_buffer, uint16_t x_start, uint16_t x_end)
+{
+  for (uint16_t x = x_start; x < x_end; x++)
+  {
+    uint16_t start = x * PERS_POINTS_PER_COLUMN;
+    uint16_t i = (start > 0) ? (start - 1) : 0;
+    uint16_t min_value = adc_buffer[i * 2 + 1];
+    uint16_t max_value = min_value;
+    for (; i < (start + PERS_POINTS_PER_COLUMN); i++)
+    {
+      uint16_t value = adc_buffer[i * 2 + 1];//fused sample
+      if (value < min_value)
+        min_value = value;
+      if (value > max_value)
+        max_value = value;
+    }
+
+    uint8_t* column = &pers_map[x * PERS_COLUMN_BYTES];
+    uint16_t row_end = pers_get_row(max_value);
+    for (uint16_t row = pers_get_row(min_value); row <= row_end; row++)
+    {
+      uint8_t* cell = &column[row >> 1];
+      if (row & 1)
+      {
+        if ((*cell & 0xF0) != 0xF0)
+          *cell += 0x10;
+      }
+      else
+      {
+        if ((*cell & 0x0F) != 0x0F)
+          *cell += 0x01;
+      }
+    }
+  }
+}
+
+//Convert fused value to map row by integer scale
+CCM_RAM_FUNC uint16_t pers_get_row(uint16_t value)
+{
+  if (value <= pers_base_value)
+    return 0;
+  uint32_t diff = value - pers_base_value;
+  if (diff >= pers_span_value)
+    return PERS_ROWS - 1;
+  return (uint16_t)((diff * pers_row_scale) >> 16);
+}
+
+// Both counters of the byte are decayed by one table lookup
+CCM_RAM_FUNC void pers_decay(void)
+{
+  for (uint16_t i = 0; i < PERS_MAP_SIZE; i++)
+    pers_map[i] = pers_decay_table[pers_map[i]];
+}
+
+// Count is multiplied by 3/4, so single hit is cleared by first decay
+// Decay is done before the next capture is added, so each capture is displayed
+void pers_build_decay_table(void)
+{
+  for (uint16_t i = 0; i < 256; i++)
+  {
+    uint8_t low = ((i & 0x0F) * 3) / 4;
+    uint8_t high = ((i >> 4) * 3) / 4;
+    pers_decay_table[i] = (high << 4) | low;
+  }
+}
+
+void pers_post_result(acq_job_id_t job_id)
+{
+  acq_result_t result;
+  result.job_id = job_id;
+  acquisition_mailbox_post(&result);
+}
+
+//*****************************************************************************
+
+void persistence_draw_menu(menu_draw_type_t draw_type)
+{
+  if (draw_type == MENU_MODE_FULL_REDRAW)
+  {
+    display_clear_framebuffer();
+    display_draw_string("PERSISTENCE", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_draw_line(PERS_Y_END, COLOR_BLUE);
+    display_update();
+  }
+  else
+  {
+    acq_result_t result;
+
+    //Redraw only when capture is done
+    if (acquisition_mailbox_get_last(&result))
+    {
+      pers_draw_header();
+      pers_draw_map();
+      display_update();
+    }
+  }//PARTIAL_REDRAW
+}
+
+void pers_draw_header(void)
+{
+  char tmp_str[32];
+  uint32_t rate = pers_rates[pers_rate_idx];
+
+  if (rate >= 1000000)
+    sprintf(tmp_str, "PERS %-3s %luM  ", pers_decay_names[pers_decay_idx], rate / 1000000);
+  else
+    sprintf(tmp_str, "PERS %-3s %luk", pers_decay_names[pers_decay_idx], rate / 1000);
+  display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+
+  switch (pers_status)
+  {
+    case PERS_STATUS_NO_SIGNAL:
+      display_draw_string(" NO SIG", 118, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    case PERS_STATUS_NO_TRIGGER:
+      display_draw_string("NO TRIG", 118, 0, FONT_SIZE_8, 0, COLOR_RED);
+    break;
+
+    default:
+      sprintf(tmp_str, "%.2fV", pers_max_voltage);
+      menu_shift_string_right(tmp_str, 7);
+      display_draw_string(tmp_str, 118, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+    break;
+  }
+}
+
+// Count map is converted to colours, row 0 is the bottom line
+void pers_draw_map(void)
+{
+  for (uint16_t x = 0; x < PERS_COLUMNS_CNT; x++)
+  {
+    const uint8_t* column = &pers_map[x * PERS_COLUMN_BYTES];
+    uint16_t y = PERS_Y_END - 1;
+    for (uint16_t i = 0; i < PERS_COLUMN_BYTES; i++)
+    {
+      display_set_pixel_color(x, y--, pers_palette[column[i] & 0x0F]);
+      display_set_pixel_color(x, y--, pers_palette[column[i] >> 4]);
+    }
+  }
+}
@@ -0,0 +1,15 @@
+#ifndef __PERSISTENCE_H
+#define __PERSISTENCE_H
+
+#include "mode_controlling.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+void persistence_main_mode_changed(void);
+void persistence_processing_handler(void);
+
+void persistence_draw_menu(menu_draw_type_t draw_type);
+void persistence_upper_button_pressed(void);
+void persistence_upper_button_hold(void);
+
+#endif
@@ -0,0 +1,355 @@
+//Segmented acquisition mode - for bursts of short events
+//Capture buffer is split into segments, each segment is started by comparator
+//rising edge or by rising crossing of ADC1 analog watchdog level (selected by
+//lower button hold). Next segment is armed by ADC DMA interrupt, so dead time 
+//between segments is interrupt latency only - see "adc_next_segment".
+//Comparator starts sampling at the edge, watchdog trigger loses first
+//samples after the crossing (interrupt latency), but it doesn't need COMP4.
+//If trigger stops coming before all segments are captured, captured part
+//is processed. Segments are copied, so next capture is running while
+//they are browsed.
+
+/* Includes ------------------------------------------------------------------*/
+#include "config.h"
+#include "mode_controlling.h"
+#include "data_processing.h"
+#include "acquisition.h"
+#include "adc_controlling.h"
+#include "comparator_handling.h"
+#include "freq_measurement.h"
+#include "display_functions.h"
+#include "mode_arena.h"
+#include "main.h"
+#include "stdio.h"
+#include "string.h"
+
+#include "segmented.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+//ADC_ETS_TIMER is used, ADC timer prescaler must be 0 at this rate
+#define SEG_SAMPLE_RATE                 (1000000)
+
+#define SEG_COUNTS_CNT                  (3)
+
+//Burst is over if there is no new segment during this time
+#define SEG_END_TIMEOUT_MS              (300)
+
+//Header is part with text
+#define SEG_HEADER_HEIGHT               (9)
+
+//Two text lines are placed below waveform
+#define SEG_Y_END                       (DISPLAY_HEIGHT - 22)
+
+#define SEG_ACTIVE_HEIGHT               (SEG_Y_END - SEG_HEADER_HEIGHT - 1)
+
+#define SEG_COLUMNS_CNT                 (DISP_WIDTH)
+
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+const uint8_t seg_counts[SEG_COUNTS_CNT] = {8, 16, 32};
+uint8_t seg_count_idx = 1;
+
+//Allocated from "mode_arena"
+uint16_t* seg_buffer = NULL;//fused points of the captured segments
+adc_ac_data_t* seg_stats = NULL;
+
+uint32_t seg_times[ADC_MAX_SEGMENTS];//DWT value at the end of each segment
+uint8_t seg_captured = 0;//number of segments in "seg_buffer"
+uint16_t seg_points = 0;//points in each segment
+uint8_t seg_selected = 0;
+
+//Trigger of the segments: 0 - comparator, 1 - ADC analog watchdog
+uint8_t seg_awd_trigger = 0;
+
+//Range of all captured segments, fused points
+uint16_t seg_min_value = 0;
+uint16_t seg_max_value = 0;
+
+//Capture is running
+uint8_t seg_waiting = 0;
+uint8_t seg_last_done = 0;
+uint32_t seg_progress_time = 0;//ms_tick value
+
+//Set when segments must be redrawn
+uint8_t seg_redraw = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+void seg_capture_job_cb(uint16_t* adc_buffer, uint16_t points);
+void seg_start_capture(void);
+void seg_restart_capture(void);
+void seg_post_result(void);
+void seg_draw_header(void);
+void seg_draw_waveform(void);
+void seg_draw_stats(void);
+uint16_t seg_get_y(uint16_t value);
+void seg_clear_active_zone(void);
+
+//"segments" is changed by upper button hold, "trigger" - by lower button hold
+acq_job_t seg_capture_job =
+{
+  ACQ_JOB_SEGMENTED, SEG_SAMPLE_RATE, SEGMENTED_TOTAL_POINTS,
+  ACQ_TRIGGER_COMPARATOR, ACQ_PRIORITY_NORMAL, 0, seg_capture_job_cb, NULL, 0
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+// This function must be called when "main_menu_mode" is changed
+// Must be called after "glitch_catcher_main_mode_changed" - same timer is used
+void segmented_main_mode_changed(void)
+{
+  seg_buffer = NULL;
+  seg_stats = NULL;
+  seg_waiting = 0;
+  seg_captured = 0;
+  if (main_menu_mode != MENU_MODE_SEGMENTED)
+    return;
+
+  seg_buffer = (uint16_t*)mode_arena_alloc(SEGMENTED_TOTAL_POINTS * sizeof(uint16_t));
+  seg_stats = (adc_ac_data_t*)mode_arena_alloc(ADC_MAX_SEGMENTS * sizeof(adc_ac_data_t));
+
+  comparator_init(USE_GLITCH_CAPTURE_COMP);
+  comparator_set_threshold(FREQ_TRIGGER_DEFAULT_V);
+  adc_ets_timer_init();
+  adc_set_ets_delay(0);
+  adc_set_awd_level(data_processing_volt_to_points(FREQ_TRIGGER_DEFAULT_V));
+  seg_start_capture();
+}
+
+void seg_start_capture(void)
+{
+  seg_capture_job.segments = seg_counts[seg_count_idx];
+  seg_capture_job.trigger = seg_awd_trigger ? ACQ_TRIGGER_AWD : ACQ_TRIGGER_COMPARATOR;
+  seg_last_done = 0;
+  seg_progress_time = ms_tick;
+  seg_waiting = 1;
+  acquisition_submit(&seg_capture_job);
+}
+
+// Called from "data_processing_handler"
+// Show capture progress, finish capture when burst is over
+void segmented_processing_handler(void)
+{
+  if (seg_waiting == 0)
+    return;
+
+  uint8_t done = adc_get_segments_done();
+  if (done != seg_last_done)
+  {
+    seg_last_done = done;
+    seg_progress_time = ms_tick;
+    seg_post_result();
+  }
+  else if ((done > 0) && ((ms_tick - seg_progress_time) >= SEG_END_TIMEOUT_MS))
+  {
+    acquisition_finish();//processed by next "acquisition_handler" call
+  }
+}
+
+// Select next segment
+void segmented_upper_button_pressed(void)
+{
+  if (seg_captured == 0)
+    return;
+  seg_selected++;
+  if (seg_selected >= seg_captured)
+    seg_selected = 0;
+  seg_redraw = 1;
+}
+
+// Change number of segments, capture is restarted
+void segmented_upper_button_hold(void)
+{
+  seg_count_idx++;
+  if (seg_count_idx >= SEG_COUNTS_CNT)
+    seg_count_idx = 0;
+  seg_restart_capture();
+}
+
+// Switch trigger between comparator and ADC analog watchdog
+void segmented_lower_button_hold(void)
+{
+  seg_awd_trigger ^= 1;
+  seg_restart_capture();
+}
+
+// Captured segments are dropped
+void seg_restart_capture(void)
+{
+  acquisition_abort();
+  seg_captured = 0;
+  seg_selected = 0;
+  seg_redraw = 1;
+  seg_start_capture();
+}
+
+//Called by acquisition engine - copy captured segments and measure them
+void seg_capture_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  if (seg_waiting == 0)
+    return;//capture was aborted
+  seg_waiting = 0;
+
+  uint8_t done = adc_get_segments_done();
+  seg_points = points / seg_capture_job.segments;
+
+  seg_min_value = 0xFFFF;
+  seg_max_value = 0;
+  for (uint16_t i = 0; i < (uint16_t)(done * seg_points); i++)
+  {
+    uint16_t value = adc_buffer[i * 2 + 1];
+    seg_buffer[i] = value;
+    if (value < seg_min_value)
+      seg_min_value = value;
+    if (value > seg_max_value)
+      seg_max_value = value;
+  }
+
+  for (uint8_t seg = 0; seg < done; seg++)
+  {
+    seg_stats[seg] = data_processing_ac_measure(
+      &adc_buffer[(uint32_t)seg * seg_points * 2], seg_points);
+    seg_times[seg] = adc_get_segment_time(seg);
+  }
+
+  seg_captured = done;
+  if (seg_selected >= seg_captured)
+    seg_selected = 0;
+  seg_redraw = 1;
+  seg_post_result();
+  seg_start_capture();
+}
+
+void seg_post_result(void)
+{
+  acq_result_t result;
+  memset(&result, 0, sizeof(result));
+  result.job_id = ACQ_JOB_SEGMENTED;
+  acquisition_mailbox_post(&result);
+}
+
+//*****************************************************************************
+
+void segmented_draw_menu(menu_draw_type_t draw_type)
+{
+  if (draw_type == MENU_MODE_FULL_REDRAW)
+  {
+    display_clear_framebuffer();
+    display_draw_string("SEGMENTED", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_update();
+    seg_redraw = 1;
+  }
+  else
+  {
+    acq_result_t result;
+
+    //Redraw only when capture state is changed
+    if (acquisition_mailbox_get_last(&result) || seg_redraw)
+    {
+      seg_draw_header();
+      if (seg_redraw)
+      {
+        seg_redraw = 0;
+        seg_clear_active_zone();
+        if (seg_captured)
+        {
+          seg_draw_waveform();
+          seg_draw_stats();
+        }
+      }
+      display_update();
+    }
+  }//PARTIAL_REDRAW
+}
+
+void seg_draw_header(void)
+{
+  char tmp_str[32];
+
+  sprintf(tmp_str, "SEG %ux%u %s  ", seg_capture_job.segments,
+    SEGMENTED_TOTAL_POINTS / seg_capture_job.segments, seg_awd_trigger ? "AWD" : "CMP");
+  display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+
+  //Progress of the running capture
+  if (seg_last_done == 0)
+  {
+    display_draw_string("   WAIT", 118, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+  }
+  else
+  {
+    sprintf(tmp_str, "%u/%u", seg_last_done, seg_capture_job.segments);
+    menu_shift_string_right(tmp_str, 7);
+    display_draw_string(tmp_str, 118, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+  }
+}
+
+// Each column is a line from min to max of its points,
+// last point of the previous column is included - trace is continuous
+// Segment can be shorter than display - point is stretched to few columns
+void seg_draw_waveform(void)
+{
+  const uint16_t* values = &seg_buffer[(uint32_t)seg_selected * seg_points];
+
+  for (uint16_t x = 0; x < SEG_COLUMNS_CNT; x++)
+  {
+    uint16_t start = (uint32_t)x * seg_points / SEG_COLUMNS_CNT;
+    uint16_t end = (uint32_t)(x + 1) * seg_points / SEG_COLUMNS_CNT;
+    if (end <= start)
+      end = start + 1;
+
+    uint16_t i = (start > 0) ? (start - 1) : 0;
+    uint16_t min_value = values[i];
+    uint16_t max_value = values[i];
+    for (; i < end; i++)
+    {
+      if (values[i] < min_value)
+        min_value = values[i];
+      if (values[i] > max_value)
+        max_value = values[i];
+    }
+    display_draw_vertical_line(x, seg_get_y(max_value), seg_get_y(min_value), COLOR_WHITE);
+  }
+  display_draw_line(SEG_Y_END, COLOR_BLUE);
+}
+
+// Time from the previous trigger and voltages of the selected segment
+void seg_draw_stats(void)
+{
+  char tmp_str[32];
+  char time_str[12];
+  adc_ac_data_t* stats = &seg_stats[seg_selected];
+
+  strcpy(time_str, "-");
+  if (seg_selected > 0)
+  {
+    uint32_t ticks = seg_times[seg_selected] - seg_times[seg_selected - 1];
+    menu_print_time(time_str, (float)ticks / (float)SystemCoreClock);
+  }
+  sprintf(tmp_str, "#%u/%u dT %s", seg_selected + 1, seg_captured, time_str);
+  display_draw_string(tmp_str, 0, SEG_Y_END + 3, FONT_SIZE_8, 0, COLOR_GREEN);
+
+  sprintf(tmp_str, "VPP%4.2f AVG%4.2f RMS%4.2f", stats->vpp, stats->mean, stats->rms);
+  display_draw_string(tmp_str, 0, SEG_Y_END + 12, FONT_SIZE_8, 0, COLOR_GREEN);
+}
+
+//Convert fused value to y position (counted from upper line)
+uint16_t seg_get_y(uint16_t value)
+{
+  uint16_t swing = seg_max_value - seg_min_value;
+  if (swing == 0)
+    return SEG_Y_END - 1;
+
+  uint16_t pix_cnt =
+    (uint16_t)((uint32_t)(value - seg_min_value) * SEG_ACTIVE_HEIGHT / swing);
+  if (pix_cnt > SEG_ACTIVE_HEIGHT)
+    pix_cnt = SEG_ACTIVE_HEIGHT;
+  return (SEG_Y_END - 1 - pix_cnt);
+}
+
+void seg_clear_active_zone(void)
+{
+  uint8_t y;
+  for (y = SEG_HEADER_HEIGHT; y < DISPLAY_HEIGHT; y++)
+    display_draw_line(y, COLOR_BLACK);
+}
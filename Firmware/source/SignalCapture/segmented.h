@@ -0,0 +1,19 @@
+#ifndef __SEGMENTED_H
+#define __SEGMENTED_H
+
+#include "mode_controlling.h"
+
+/* Exported types ------------------------------------------------------------*/
+// Size of the capture buffer that is split into segments, points
+#define SEGMENTED_TOTAL_POINTS          (1280)
+
+void segmented_main_mode_changed(void);
+void segmented_processing_handler(void);
+
+void segmented_draw_menu(menu_draw_type_t draw_type);
+void segmented_upper_button_pressed(void);
+void segmented_upper_button_hold(void);
+void segmented_lower_button_hold(void);
+
+#endif
+
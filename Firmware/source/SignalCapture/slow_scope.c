@@ -1,12 +1,25 @@
+//History is a pyramid of levels - each level record is made of
+//SLOW_SCOPE_LEVEL_FACTOR records of the previous level.
+//Level 0 gets one record per capture. Each level keeps one screen of records,
+//so any zoom is drawn from its level in O(SLOW_SCOPE_POINT_CNT).
+//When recording is enabled, min/max/average of every SLOW_SCOPE_LOG_CAPTURES
+//captures are written to the flash log. Last view after zoom levels shows
+//the whole flash log, it is available after power cycle.
 
 /* Includes ------------------------------------------------------------------*/
 #include "config.h"
 #include "mode_controlling.h"
 #include "adc_controlling.h"
 #include "data_processing.h"
+#include "acquisition.h"
 #include "display_functions.h"
+#include "mode_arena.h"
+#include "flash_log.h"
+#include "power_controlling.h"
+#include "math.h"
 #include "stdio.h"
 #include "stdlib.h"
+#include "string.h"
 
 #include "slow_scope.h"
 
@@ -19,39 +32,105 @@
 //Header is part with capture text
 #define SLOW_SCOPE_HEADER_HEIGHT        (9)
 
-//For 1 sec period
+//For 1 sec period, in records
 #define SLOW_SCOPE_X_GRID_PERIOD        (10)
 
+//Display is redrawn if more records were added since the last draw
+#define SLOW_SCOPE_MAX_SCROLL           (8)
+
+//Record value to y position table, see "slow_scope_build_y_table"
+#define SLOW_SCOPE_Y_TABLE_SIZE         (512)
+
+//Maximum number of horizontal voltage grid lines
+#define SLOW_SCOPE_GRID_LINES_MAX       (8)
+
 //part of the display is closed by device case
 #define SLOW_SCOPE_Y_END                (DISPLAY_HEIGHT - 3)
 
 #define SLOW_SCOPE_ACTIVE_HEIGHT        (SLOW_SCOPE_Y_END - SLOW_SCOPE_HEADER_HEIGHT)
 
-//In pixels
-#define SLOW_SCOPE_X_GRID_PERIOD_1S     (8.7f)
+//In pixels - captures are running back-to-back, one point per capture
+#define SLOW_SCOPE_X_GRID_PERIOD_1S     \
+  ((float)DATA_PROC_LOW_SAMPLE_RATE / (float)MAIN_ADC_CAPTURED_POINTS)
+
+//Number of pyramid levels, last level keeps
+//SLOW_SCOPE_POINT_CNT * 4^5 captures = 4.5 hours
+#define SLOW_SCOPE_LEVELS_CNT           (6)
+#define SLOW_SCOPE_LEVEL_FACTOR         (4)
+
+//Voltage quantum of the history record, V
+#define SLOW_SCOPE_QUANT_V              (0.002f)
+
+//"end_type" field: end voltage - 14 bits, signal type - 2 bits
+#define SLOW_SCOPE_END_MASK             (0x3FFF)
+#define SLOW_SCOPE_TYPE_SHIFT           (14)
+
+#define SLOW_SCOPE_REC_END(rec)         ((rec).end_type & SLOW_SCOPE_END_MASK)
+#define SLOW_SCOPE_REC_TYPE(rec)        \
+  ((adc_signal_state_t)((rec).end_type >> SLOW_SCOPE_TYPE_SHIFT))
+
+//Flash log view is placed after zoom levels
+#define SLOW_SCOPE_LOG_VIEW             (SLOW_SCOPE_LEVELS_CNT)
+
+//One log record per 25.6 s - same as "4.3m" level record, log keeps ~13.5 hours
+#define SLOW_SCOPE_LOG_CAPTURES         (256)
+#define SLOW_SCOPE_LOG_PERIOD_S         \
+  ((float)SLOW_SCOPE_LOG_CAPTURES * MAIN_ADC_CAPTURED_POINTS / DATA_PROC_LOW_SAMPLE_RATE)
+
+/* Private typedef -----------------------------------------------------------*/
+//Quantized "adc_processed_data_t", voltages are in SLOW_SCOPE_QUANT_V units
+typedef struct
+{
+  uint16_t min_value;
+  uint16_t max_value;
+  uint16_t end_type;
+} slow_scope_record_t;
+
+typedef struct
+{
+  slow_scope_record_t* records;//circular buffer, SLOW_SCOPE_POINT_CNT records
+  uint16_t head;//newest record
+  uint16_t count;//number of valid records
+  uint32_t added;//number of records added to the level
+  slow_scope_record_t pending;//merge of the records of the previous level
+  uint8_t pending_cnt;
+} slow_scope_level_t;
 
 /* Private variables ---------------------------------------------------------*/
 extern menu_mode_t main_menu_mode;
-extern volatile cap_status_type adc_capture_status;
-extern volatile uint16_t adc_raw_buffer0[ADC_BUFFER_SIZE];
 extern volatile uint32_t ms_tick;
 
-slow_scope_data_processing_state_t slow_scope_state = ADC_SLOW_IDLE;
-
 adc_processed_data_t slow_scope_last_result;
 
-//Value in pixels
-//TODO - add automatic calculation
-float slow_scope_1s_period_pix = SLOW_SCOPE_X_GRID_PERIOD_1S;
+//Records are allocated from "mode_arena" in slow scope mode
+slow_scope_level_t slow_scope_levels[SLOW_SCOPE_LEVELS_CNT];
 
-//Circullar buffer
-adc_processed_data_t slow_scope_points[SLOW_SCOPE_POINT_CNT];
-uint16_t slow_scope_buf_pointer = 0;
+//Displayed level - timebase is 1s/div * 4^level, or SLOW_SCOPE_LOG_VIEW
+uint8_t slow_scope_zoom = 0;
+
+const char* const slow_scope_zoom_names[SLOW_SCOPE_LEVELS_CNT] =
+{
+  "1s", "4s", "16s", "64s", "4.3m", "17m"
+};
 
 //Maximum voltage at the scope
 float slow_scope_max_voltage = 4.0;
 //Voltage grid period
 float slow_scope_grid_v = 1.0;
+//Index in "slow_scope_grid_mode_items"
+uint8_t slow_scope_grid_item = 0xFF;
+
+//Allocated from "mode_arena", rebuilt when autoscale is changed
+uint8_t* slow_scope_y_table = NULL;
+uint8_t slow_scope_y_table_shift = 0;
+
+//Y positions of the voltage grid dots, rebuilt with Y table
+uint8_t slow_scope_grid_y[SLOW_SCOPE_GRID_LINES_MAX];
+uint8_t slow_scope_grid_y_cnt = 0;
+
+//Value of "added" of the displayed level at the last draw
+uint32_t slow_scope_drawn_added = 0;
+uint8_t slow_scope_full_redraw_flag = 1;
 
 //Array used for setting voltage grid 
 grid_mode_item_t slow_scope_grid_mode_items[] =
@@ -68,29 +147,70 @@ grid_mode_item_t slow_scope_grid_mode_items[] =
 //Capture enabled flag
 uint8_t slow_scope_capture_en_flag = 1;
 
+//Collected part of the flash log record, SLOW_SCOPE_QUANT_V units
+uint16_t slow_scope_log_min_value = 0;
+uint16_t slow_scope_log_max_value = 0;
+uint32_t slow_scope_log_avg_summ = 0;
+uint16_t slow_scope_log_cnt = 0;
+
 #define SLOW_SCOPE_GRID_ITEMS_CNT  (sizeof(slow_scope_grid_mode_items) / sizeof(grid_mode_item_t))
 
 /* Private function prototypes -----------------------------------------------*/
-void slow_scope_process_data(void);
+void slow_scope_job_cb(uint16_t* adc_buffer, uint16_t points);
+void slow_scope_process_data(uint16_t* adc_buffer, uint16_t points);
 void slow_scope_clear_active_zone(void);
 void slow_scope_draw_grid(void);
 void slow_scope_draw_voltage_grid(uint16_t x);
 uint16_t slow_scope_get_y_from_voltage(float voltage);
-void slow_scope_draw_signal(void);
-uint16_t slow_scope_draw_edges(uint16_t x, adc_processed_data_t point);
-void slow_scope_calcutate_grid_step(void);
+void slow_scope_draw_plot(void);
+void slow_scope_draw_header(void);
+void slow_scope_draw_signal(uint16_t x_start);
+void slow_scope_draw_column_grid(uint16_t x);
+uint16_t slow_scope_draw_edges(uint16_t x, uint16_t min_value, uint16_t max_value);
+uint16_t slow_scope_get_y(uint16_t value);
+void slow_scope_build_y_table(void);
+slow_scope_record_t slow_scope_quantize(adc_processed_data_t data);
+uint16_t slow_scope_volt_to_value(float voltage);
+uint16_t slow_scope_calc_average(uint16_t* adc_buffer, uint16_t points);
+void slow_scope_log_capture(slow_scope_record_t record, uint16_t avg_value);
+uint8_t slow_scope_get_column(uint16_t x, slow_scope_record_t* record);
+uint8_t slow_scope_get_log_column(uint16_t x, slow_scope_record_t* record);
+void slow_scope_add_record(uint8_t level, slow_scope_record_t record);
+void slow_scope_merge_record(slow_scope_level_t* level, slow_scope_record_t record);
+float slow_scope_get_voltage(uint16_t value);
+uint8_t slow_scope_calcutate_grid_step(void);
 void slow_scope_update_rate_measure(void);
 
+const acq_job_t slow_scope_job = 
+{
+  ACQ_JOB_SLOW_SCOPE, DATA_PROC_LOW_SAMPLE_RATE, MAIN_ADC_CAPTURED_POINTS,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS,
+  slow_scope_job_cb, NULL
+};
+
 /* Private functions ---------------------------------------------------------*/
 
 // This function must be called when "main_menu_mode" is changed
 // Switch capture mode
 void slow_scope_processing_main_mode_changed(void)
 {
-  slow_scope_state = ADC_SLOW_IDLE;
+  memset(slow_scope_levels, 0, sizeof(slow_scope_levels));
+  slow_scope_y_table = NULL;
+  slow_scope_grid_item = 0xFF;
+  slow_scope_drawn_added = 0;
+  slow_scope_full_redraw_flag = 1;
+  if ((main_menu_mode != MENU_MODE_SLOW_SCOPE) && flash_log_is_recording())
+    flash_log_stop();
+  
   if (main_menu_mode == MENU_MODE_SLOW_SCOPE)
   {
-    adc_set_sample_rate(DATA_PROC_LOW_SAMPLE_RATE);
+    slow_scope_y_table = (uint8_t*)mode_arena_alloc(SLOW_SCOPE_Y_TABLE_SIZE);
+    for (uint8_t i = 0; i < SLOW_SCOPE_LEVELS_CNT; i++)
+    {
+      slow_scope_levels[i].records = (slow_scope_record_t*)mode_arena_alloc(
+        SLOW_SCOPE_POINT_CNT * sizeof(slow_scope_record_t));
+    }
+    acquisition_submit(&slow_scope_job);
   }
 }
 
@@ -100,114 +220,333 @@ void slow_scope_upper_button_pressed(void)
   slow_scope_capture_en_flag^= 1;
 }
 
+// Switch to the next timebase, flash log view is the last one
+void slow_scope_upper_button_hold(void)
+{
+  slow_scope_zoom++;
+  if (slow_scope_zoom > SLOW_SCOPE_LOG_VIEW)
+    slow_scope_zoom = 0;
+  slow_scope_full_redraw_flag = 1;
+}
 
-//Called from "data_processing_handler" in "data_processing.c"
-void slow_scope_processing_handler(void)
+// Start or stop recording to the flash log
+void slow_scope_lower_button_hold(void)
 {
-  if (slow_scope_state == ADC_SLOW_IDLE)
+  if (flash_log_is_recording())
   {
-    adc_capture_start();
-    slow_scope_state = ADC_SLOW_CAPTURE_RUNNING;
+    flash_log_stop();
   }
-  else if (slow_scope_state == ADC_SLOW_CAPTURE_RUNNING)
+  else
   {
-    if (adc_capture_status == CAPTURE_DONE)
-    {
-      slow_scope_state = ADC_SLOW_PROCESSING_DATA;
-      data_processing_correct_raw_data(data_processing_get_adc_offset());
-      slow_scope_process_data();
-      slow_scope_update_rate_measure();
-      slow_scope_state = ADC_SLOW_PROCESSING_DATA_DONE;
-    }
+    slow_scope_log_cnt = 0;
+    flash_log_start();
   }
 }
 
 
+//Called by acquisition engine from "data_processing_handler"
+void slow_scope_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  acq_result_t result;
+  
+  slow_scope_process_data(adc_buffer, points);
+  slow_scope_update_rate_measure();
+  
+  //Device must not go to sleep while log is recorded
+  if (flash_log_is_recording())
+    power_controlling_event();
+  
+  result.job_id = ACQ_JOB_SLOW_SCOPE;
+  result.data = slow_scope_last_result;
+  acquisition_mailbox_post(&result);
+}
 
-void slow_scope_process_data(void)
+void slow_scope_process_data(uint16_t* adc_buffer, uint16_t points)
 {
   if (slow_scope_capture_en_flag == 0)
     return;
   
   //Analyse captured data and get single point result
   slow_scope_last_result = data_processing_extended(
-    (uint16_t*)&adc_raw_buffer0[SLOW_SCOPE_START_OFFSET * 2], 
-    (ADC_BUFFER_SIZE / 2 - SLOW_SCOPE_START_OFFSET * 2));
+    &adc_buffer[SLOW_SCOPE_START_OFFSET * 2], 
+    (points - SLOW_SCOPE_START_OFFSET * 2));
+  
+  slow_scope_record_t record = slow_scope_quantize(slow_scope_last_result);
+  slow_scope_add_record(0, record);
   
-  //Add data to FIFO
-  slow_scope_buf_pointer++;
-  if (slow_scope_buf_pointer >= SLOW_SCOPE_POINT_CNT)
+  if (flash_log_is_recording())
   {
-    slow_scope_buf_pointer = 0;
+    slow_scope_log_capture(record, slow_scope_calc_average(
+      &adc_buffer[SLOW_SCOPE_START_OFFSET * 2], 
+      (points - SLOW_SCOPE_START_OFFSET * 2)));
   }
-  slow_scope_points[slow_scope_buf_pointer] = slow_scope_last_result;
 }
 
-void slow_scope_draw_menu(menu_draw_type_t draw_type)
+slow_scope_record_t slow_scope_quantize(adc_processed_data_t data)
 {
-  static uint8_t new_data_pending = 0;
+  slow_scope_record_t record;
+  uint16_t end_value = slow_scope_volt_to_value(data.end_voltage);
+  if (end_value > SLOW_SCOPE_END_MASK)
+    end_value = SLOW_SCOPE_END_MASK;
+
+  record.min_value = slow_scope_volt_to_value(data.min_voltage);
+  record.max_value = slow_scope_volt_to_value(data.max_voltage);
+  record.end_type = end_value | 
+    ((uint16_t)data.signal_type << SLOW_SCOPE_TYPE_SHIFT);
+  return record;
+}
+
+// Convert voltage to SLOW_SCOPE_QUANT_V units
+uint16_t slow_scope_volt_to_value(float voltage)
+{
+  if (voltage < 0.0f)
+    return 0;
+  return (uint16_t)fminf(voltage / SLOW_SCOPE_QUANT_V + 0.5f, 65535.0f);
+}
+
+// Average of fused points in SLOW_SCOPE_QUANT_V units
+uint16_t slow_scope_calc_average(uint16_t* adc_buffer, uint16_t points)
+{
+  uint32_t summ = 0;
+  for (uint16_t i = 0; i < points; i++)
+    summ+= adc_buffer[i * 2 + 1];
   
+  if (points == 0)
+    return 0;
+  return slow_scope_volt_to_value(
+    data_processing_fused_to_voltage((uint16_t)(summ / points)));
+}
+
+// Collect captures to the flash log record
+void slow_scope_log_capture(slow_scope_record_t record, uint16_t avg_value)
+{
+  if (slow_scope_log_cnt == 0)
+  {
+    slow_scope_log_min_value = record.min_value;
+    slow_scope_log_max_value = record.max_value;
+    slow_scope_log_avg_summ = 0;
+  }
+  if (record.min_value < slow_scope_log_min_value)
+    slow_scope_log_min_value = record.min_value;
+  if (record.max_value > slow_scope_log_max_value)
+    slow_scope_log_max_value = record.max_value;
+  slow_scope_log_avg_summ+= avg_value;
+  slow_scope_log_cnt++;
+  
+  if (slow_scope_log_cnt >= SLOW_SCOPE_LOG_CAPTURES)
+  {
+    flash_log_append(slow_scope_log_min_value, slow_scope_log_max_value, 
+      (uint16_t)(slow_scope_log_avg_summ / slow_scope_log_cnt));
+    slow_scope_log_cnt = 0;
+  }
+}
+
+// Put record to the level, feed next level with it
+void slow_scope_add_record(uint8_t level, slow_scope_record_t record)
+{
+  slow_scope_level_t* dst = &slow_scope_levels[level];
+
+  dst->head++;
+  if (dst->head >= SLOW_SCOPE_POINT_CNT)
+    dst->head = 0;
+  dst->records[dst->head] = record;
+  dst->added++;
+  if (dst->count < SLOW_SCOPE_POINT_CNT)
+    dst->count++;
+
+  if ((level + 1) >= SLOW_SCOPE_LEVELS_CNT)
+    return;
+
+  slow_scope_level_t* next = &slow_scope_levels[level + 1];
+  slow_scope_merge_record(next, record);
+  if (next->pending_cnt >= SLOW_SCOPE_LEVEL_FACTOR)
+  {
+    next->pending_cnt = 0;
+    slow_scope_add_record(level + 1, next->pending);
+  }
+}
+
+// Add record to the pending record of the level
+// Merged record is stable only if all its records are stable at one level
+void slow_scope_merge_record(slow_scope_level_t* level, slow_scope_record_t record)
+{
+  slow_scope_record_t* pending = &level->pending;
+
+  if (level->pending_cnt == 0)
+  {
+    *pending = record;
+    level->pending_cnt = 1;
+    return;
+  }
+
+  adc_signal_state_t type = SLOW_SCOPE_REC_TYPE(*pending);
+  adc_signal_state_t new_type = SLOW_SCOPE_REC_TYPE(record);
+  if (record.min_value < pending->min_value)
+    pending->min_value = record.min_value;
+  if (record.max_value > pending->max_value)
+    pending->max_value = record.max_value;
+
+  float span = (float)(pending->max_value - pending->min_value) * SLOW_SCOPE_QUANT_V;
+  if ((type == ADC_SIGNAL_TYPE_STABLE) && (new_type == ADC_SIGNAL_TYPE_STABLE))
+  {
+    if (span >= DATA_PROC_STABLE_ANALYSE_THRESHOLD)
+      type = ADC_SIGNAL_TYPE_SINGLE;//level was changed between records
+  }
+  else if ((type == ADC_SIGNAL_TYPE_STABLE) && (new_type == ADC_SIGNAL_TYPE_SINGLE))
+  {
+    type = ADC_SIGNAL_TYPE_SINGLE;
+  }
+  else if ((type != ADC_SIGNAL_TYPE_SINGLE) || (new_type != ADC_SIGNAL_TYPE_STABLE))
+  {
+    type = ADC_SIGNAL_TYPE_MULTI;
+  }
+  //else - stable part after single edge
+
+  pending->end_type = SLOW_SCOPE_REC_END(record) | 
+    ((uint16_t)type << SLOW_SCOPE_TYPE_SHIFT);
+  level->pending_cnt++;
+}
+
+float slow_scope_get_voltage(uint16_t value)
+{
+  return (float)value * SLOW_SCOPE_QUANT_V;
+}
+
+void slow_scope_draw_menu(menu_draw_type_t draw_type)
+{
   if (draw_type == MENU_MODE_FULL_REDRAW)
   {
     display_clear_framebuffer();
     display_draw_string("SLOW SCOPE", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
     display_update();
+    slow_scope_full_redraw_flag = 1;
   }
   else
   {
-    if (slow_scope_state != ADC_SLOW_IDLE)
-    {
-      if (slow_scope_state == ADC_SLOW_PROCESSING_DATA_DONE)
-      {
-        slow_scope_state = ADC_SLOW_IDLE;
-        new_data_pending = 1;
-        return;
-      }
-    }
+    acq_result_t result;
     
-    if (new_data_pending == 1)
+    //Redraw only when new point is added
+    if (acquisition_mailbox_get_last(&result))
     {
-      if ((slow_scope_capture_en_flag == 0) && ((ms_tick % 1000) < 500))
-        display_draw_string("  STOPPED   ", 0, 0, FONT_SIZE_8, 0, COLOR_RED);
-      else
-        display_draw_string(" SLOW SCOPE", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
-      
-      char tmp_str[32];
-      memset(tmp_str, 0, sizeof(tmp_str));
-      
-      sprintf(tmp_str, "%dV / %dV",(int)slow_scope_grid_v, (int)slow_scope_max_voltage);
-      menu_shift_string_right(tmp_str, 9);
-      display_draw_string(tmp_str, 90, 0, FONT_SIZE_8, 0, COLOR_WHITE);
-      
-      slow_scope_clear_active_zone();
-      slow_scope_calcutate_grid_step();
-      slow_scope_draw_grid();
-      slow_scope_draw_signal();
-      
-      display_update();
-      new_data_pending = 0;
+      slow_scope_draw_plot();
     }
   }//PARTIAL_REDRAW
 }
 
-//Draw captured data from "slow_scope_points" FIFO
-void slow_scope_draw_signal(void)
+// Full redraw is needed when zoom or autoscale is changed.
+// Otherwise display is scrolled by the number of new records,
+// only new columns and header are sent to the display.
+void slow_scope_draw_plot(void)
+{
+  uint32_t new_cnt = 0;
+  if (slow_scope_zoom == SLOW_SCOPE_LOG_VIEW)
+    slow_scope_full_redraw_flag = 1;//log view is static
+  else
+    new_cnt = slow_scope_levels[slow_scope_zoom].added - slow_scope_drawn_added;
+  
+  if (slow_scope_calcutate_grid_step())
+    slow_scope_full_redraw_flag = 1;
+  
+  if (slow_scope_full_redraw_flag || (new_cnt > SLOW_SCOPE_MAX_SCROLL))
+  {
+    slow_scope_full_redraw_flag = 0;
+    slow_scope_clear_active_zone();
+    slow_scope_draw_header();
+    slow_scope_draw_grid();
+    slow_scope_draw_signal(0);
+    display_update();
+  }
+  else
+  {
+    if (new_cnt > 0)
+    {
+      uint16_t x_start = SLOW_SCOPE_POINT_CNT - new_cnt;
+      display_scroll_left(new_cnt);
+      for (uint16_t x = x_start; x < SLOW_SCOPE_POINT_CNT; x++)
+        slow_scope_draw_column_grid(x);
+      slow_scope_draw_signal(x_start);
+      display_update_rect(x_start, SLOW_SCOPE_HEADER_HEIGHT, 
+        new_cnt, DISPLAY_HEIGHT - SLOW_SCOPE_HEADER_HEIGHT);
+    }
+    
+    //Header is moved by scroll too
+    for (uint8_t y = 0; y < SLOW_SCOPE_HEADER_HEIGHT; y++)
+      display_draw_line(y, COLOR_BLACK);
+    slow_scope_draw_header();
+    display_update_rect(0, 0, DISPLAY_WIDTH, SLOW_SCOPE_HEADER_HEIGHT);
+  }
+  
+  if (slow_scope_zoom != SLOW_SCOPE_LOG_VIEW)
+    slow_scope_drawn_added = slow_scope_levels[slow_scope_zoom].added;
+}
+
+void slow_scope_draw_header(void)
 {
-  uint16_t prev_y = SLOW_SCOPE_Y_END;//in pixels
+  char tmp_str[32];
+  memset(tmp_str, 0, sizeof(tmp_str));
   
-  //read pointer of FIFO
-  int16_t tmp_pointer = slow_scope_buf_pointer + 1;
-  if (tmp_pointer >= SLOW_SCOPE_POINT_CNT)
-      tmp_pointer = 0;
+  if ((slow_scope_capture_en_flag == 0) && ((ms_tick % 1000) < 500))
+  {
+    display_draw_string("  STOPPED   ", 0, 0, FONT_SIZE_8, 0, COLOR_RED);
+  }
+  else if (slow_scope_zoom == SLOW_SCOPE_LOG_VIEW)
+  {
+    float hours = (float)flash_log_get_count() * SLOW_SCOPE_LOG_PERIOD_S / 3600.0f;
+    sprintf(tmp_str, " LOG %4.1fh ", hours);
+    display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+  }
+  else
+  {
+    sprintf(tmp_str, " SLOW %-5s", slow_scope_zoom_names[slow_scope_zoom]);
+    display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+  }
   
-  prev_y = slow_scope_get_y_from_voltage(slow_scope_points[tmp_pointer].max_voltage);
+  if (flash_log_is_recording())
+    display_draw_string("REC", 72, 0, FONT_SIZE_8, 0, COLOR_RED);
+  else
+    display_draw_string("   ", 72, 0, FONT_SIZE_8, 0, COLOR_RED);
   
-  for (int16_t x = 0; x < SLOW_SCOPE_POINT_CNT; x++)
+  sprintf(tmp_str, "%dV / %dV",(int)slow_scope_grid_v, (int)slow_scope_max_voltage);
+  menu_shift_string_right(tmp_str, 9);
+  display_draw_string(tmp_str, 90, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+}
+
+//Draw records of the displayed view from "x_start" column,
+//newest record is at the right side
+void slow_scope_draw_signal(uint16_t x_start)
+{
+  slow_scope_record_t record;
+  uint16_t prev_y = 0;
+  uint8_t prev_valid = 0;
+  
+  //Trace is continued from the previous column
+  if ((x_start > 0) && slow_scope_get_column(x_start - 1, &record))
+  {
+    if (SLOW_SCOPE_REC_TYPE(record) == ADC_SIGNAL_TYPE_STABLE)
+      prev_y = slow_scope_get_y((record.max_value + record.min_value) / 2);
+    else
+      prev_y = slow_scope_get_y(SLOW_SCOPE_REC_END(record));
+    prev_valid = 1;
+  }
+  
+  for (uint16_t x = x_start; x < SLOW_SCOPE_POINT_CNT; x++)
   {
-    if (slow_scope_points[tmp_pointer].signal_type == ADC_SIGNAL_TYPE_STABLE)
+    if (slow_scope_get_column(x, &record) == 0)
+    {
+      prev_valid = 0;//gap in the trace
+      continue;
+    }
+    
+    if (prev_valid == 0)
+    {
+      prev_y = slow_scope_get_y(record.max_value);
+      prev_valid = 1;
+    }
+    
+    if (SLOW_SCOPE_REC_TYPE(record) == ADC_SIGNAL_TYPE_STABLE)
     {
-      float tmp_voltage = (slow_scope_points[tmp_pointer].max_voltage + slow_scope_points[tmp_pointer].min_voltage) / 2.0f;//average
-      uint16_t point_y = slow_scope_get_y_from_voltage(tmp_voltage);
+      //average
+      uint16_t point_y = slow_scope_get_y((record.max_value + record.min_value) / 2);
       display_set_pixel_color(x, point_y, COLOR_WHITE);
       
       //Draw line connecting current point and previous point
@@ -217,36 +556,88 @@ void slow_scope_draw_signal(void)
       }
       prev_y = point_y;
     }
-    else if (slow_scope_points[tmp_pointer].signal_type == ADC_SIGNAL_TYPE_SINGLE)
+    else if (SLOW_SCOPE_REC_TYPE(record) == ADC_SIGNAL_TYPE_SINGLE)
     {
-      uint16_t max_y = slow_scope_get_y_from_voltage(
-        slow_scope_points[tmp_pointer].max_voltage); //y is smaller
-      uint16_t min_y = slow_scope_get_y_from_voltage(
-        slow_scope_points[tmp_pointer].min_voltage);//y is bigger
+      uint16_t max_y = slow_scope_get_y(record.max_value); //y is smaller
+      uint16_t min_y = slow_scope_get_y(record.min_value);//y is bigger
       display_draw_vertical_line(x, min_y, max_y, COLOR_WHITE);
       
-      prev_y = slow_scope_get_y_from_voltage(
-        slow_scope_points[tmp_pointer].end_voltage);
+      prev_y = slow_scope_get_y(SLOW_SCOPE_REC_END(record));
     }
     else
     {
-      slow_scope_draw_edges(x, slow_scope_points[tmp_pointer]);
-      prev_y = slow_scope_get_y_from_voltage(
-        slow_scope_points[tmp_pointer].end_voltage);
+      slow_scope_draw_edges(x, record.min_value, record.max_value);
+      prev_y = slow_scope_get_y(SLOW_SCOPE_REC_END(record));
     }
+  }
+}
+
+// Get record of the display column, return 0 if column is empty
+uint8_t slow_scope_get_column(uint16_t x, slow_scope_record_t* record)
+{
+  if (slow_scope_zoom == SLOW_SCOPE_LOG_VIEW)
+    return slow_scope_get_log_column(x, record);
+  
+  slow_scope_level_t* level = &slow_scope_levels[slow_scope_zoom];
+  uint16_t age = SLOW_SCOPE_POINT_CNT - 1 - x;//0 - newest record
+  if (age >= level->count)
+    return 0;
+  
+  int16_t pos = (int16_t)level->head - (int16_t)age;
+  if (pos < 0)
+    pos+= SLOW_SCOPE_POINT_CNT;
+  *record = level->records[pos];
+  return 1;
+}
 
-    tmp_pointer++;
-    if (tmp_pointer >= SLOW_SCOPE_POINT_CNT)
-      tmp_pointer = 0;
+// Whole flash log is fitted to the display, records are read directly from flash
+// Log record is a min/max band, its end voltage is the average voltage
+uint8_t slow_scope_get_log_column(uint16_t x, slow_scope_record_t* record)
+{
+  uint16_t log_cnt = flash_log_get_count();
+  uint16_t per_column = (log_cnt + SLOW_SCOPE_POINT_CNT - 1) / SLOW_SCOPE_POINT_CNT;
+  if (per_column == 0)
+    return 0;
+  
+  uint16_t first_idx = (SLOW_SCOPE_POINT_CNT - 1 - x) * per_column;//newest record
+  if (first_idx >= log_cnt)
+    return 0;
+  
+  slow_scope_level_t column;
+  column.pending_cnt = 0;
+  
+  //From older to newer - end value is taken from the newest record
+  for (int16_t i = (int16_t)per_column - 1; i >= 0; i--)
+  {
+    flash_log_record_t log_record;
+    if (flash_log_read(first_idx + i, &log_record) == 0)
+      continue;//torn or not written
+    
+    adc_signal_state_t type = ADC_SIGNAL_TYPE_STABLE;
+    if (slow_scope_get_voltage(log_record.max_value - log_record.min_value) >= 
+        DATA_PROC_STABLE_ANALYSE_THRESHOLD)
+      type = ADC_SIGNAL_TYPE_MULTI;
+    
+    slow_scope_record_t tmp_record;
+    tmp_record.min_value = log_record.min_value;
+    tmp_record.max_value = log_record.max_value;
+    tmp_record.end_type = (log_record.avg_value & SLOW_SCOPE_END_MASK) | 
+      ((uint16_t)type << SLOW_SCOPE_TYPE_SHIFT);
+    slow_scope_merge_record(&column, tmp_record);
   }
+  
+  if (column.pending_cnt == 0)
+    return 0;
+  *record = column.pending;
+  return 1;
 }
 
 // Draw dotted line at position X - mean several signal edges
 // Return minimum y
-uint16_t slow_scope_draw_edges(uint16_t x, adc_processed_data_t point)
+uint16_t slow_scope_draw_edges(uint16_t x, uint16_t min_value, uint16_t max_value)
 {
-  uint16_t max_y = slow_scope_get_y_from_voltage(point.max_voltage); //y is smaller
-  uint16_t min_y = slow_scope_get_y_from_voltage(point.min_voltage);//y is bigger
+  uint16_t max_y = slow_scope_get_y(max_value); //y is smaller
+  uint16_t min_y = slow_scope_get_y(min_value);//y is bigger
   
   for (uint16_t y = max_y; y <= min_y; y+= 2)
   {
@@ -259,18 +650,21 @@ uint16_t slow_scope_draw_edges(uint16_t x, adc_processed_data_t point)
 //-----------------------------------------------------------------------------
 
 //Calculate needed grid max voltage and step by analysing captured data
-void slow_scope_calcutate_grid_step(void)
+//Return 1 if grid is changed - Y table is rebuilt, full redraw is needed
+uint8_t slow_scope_calcutate_grid_step(void)
 {
-  float max_voltage = 0.0;
+  slow_scope_record_t record;
+  uint16_t max_value = 0;
   uint8_t grid_item = 0; 
-  //find max voltage in all points
-  for (uint16_t i = 0; i < SLOW_SCOPE_POINT_CNT; i++)
+  //find max voltage in all displayed records
+  for (uint16_t x = 0; x < SLOW_SCOPE_POINT_CNT; x++)
   {
-    if (slow_scope_points[i].max_voltage > max_voltage)
+    if (slow_scope_get_column(x, &record) && (record.max_value > max_value))
     {
-      max_voltage = slow_scope_points[i].max_voltage;
+      max_value = record.max_value;
     }
   }
+  float max_voltage = slow_scope_get_voltage(max_value);
   
   for (uint8_t i = 0; i < (SLOW_SCOPE_GRID_ITEMS_CNT - 1); i++)
   {
@@ -278,32 +672,44 @@ void slow_scope_calcutate_grid_step(void)
       grid_item = i + 1;
   }
   
+  if (grid_item == slow_scope_grid_item)
+    return 0;
+  
+  slow_scope_grid_item = grid_item;
   slow_scope_max_voltage = slow_scope_grid_mode_items[grid_item].max_voltage;
   slow_scope_grid_v =  slow_scope_grid_mode_items[grid_item].grid_step;
+  slow_scope_build_y_table();
+  return 1;
 }
 
 void slow_scope_draw_grid(void)
 {
   //Graw time grid - X
-  float x;
-  for (x = (SLOW_SCOPE_POINT_CNT - 1); x >= 0.0f; x = x - slow_scope_1s_period_pix)
+  for (uint16_t x = 0; x < SLOW_SCOPE_POINT_CNT; x++)
   {
-    slow_scope_draw_voltage_grid((int)x);
+    slow_scope_draw_column_grid(x);
   }
   
   display_draw_line(SLOW_SCOPE_Y_END, COLOR_BLUE);
 }
 
+// Time grid is bound to the records, so it is moved by scroll together with them
+void slow_scope_draw_column_grid(uint16_t x)
+{
+  uint32_t record_idx = SLOW_SCOPE_POINT_CNT - 1 - x;//from the right side
+  if (slow_scope_zoom != SLOW_SCOPE_LOG_VIEW)
+    record_idx = slow_scope_levels[slow_scope_zoom].added - record_idx;
+  
+  if ((record_idx % SLOW_SCOPE_X_GRID_PERIOD) == 0)
+    slow_scope_draw_voltage_grid(x);
+  display_set_pixel_color(x, SLOW_SCOPE_Y_END, COLOR_BLUE);
+}
+
 // Draw voltage grid - dots in Y line (vertical)
 void slow_scope_draw_voltage_grid(uint16_t x)
 {
-  float voltage_val = 0.0f;
-  while (voltage_val < slow_scope_max_voltage)
-  {
-    uint16_t y_pos = slow_scope_get_y_from_voltage(voltage_val);
-    display_set_pixel_color(x, y_pos, COLOR_YELLOW);
-    voltage_val+= slow_scope_grid_v;
-  }
+  for (uint8_t i = 0; i < slow_scope_grid_y_cnt; i++)
+    display_set_pixel_color(x, slow_scope_grid_y[i], COLOR_YELLOW);
 }
 
 //-----------------------------------------------------------------------------
@@ -320,6 +726,41 @@ uint16_t slow_scope_get_y_from_voltage(float voltage)
   return (SLOW_SCOPE_Y_END - pix_cnt);
 }
 
+//Convert record value to y position by the table
+uint16_t slow_scope_get_y(uint16_t value)
+{
+  uint16_t idx = value >> slow_scope_y_table_shift;
+  if (idx >= SLOW_SCOPE_Y_TABLE_SIZE)
+    idx = SLOW_SCOPE_Y_TABLE_SIZE - 1;
+  return slow_scope_y_table[idx];
+}
+
+//Table must cover "slow_scope_max_voltage", values above it are clamped
+void slow_scope_build_y_table(void)
+{
+  uint16_t max_value = slow_scope_volt_to_value(slow_scope_max_voltage);
+  slow_scope_y_table_shift = 0;
+  while ((max_value >> slow_scope_y_table_shift) >= SLOW_SCOPE_Y_TABLE_SIZE)
+    slow_scope_y_table_shift++;
+  
+  for (uint16_t i = 0; i < SLOW_SCOPE_Y_TABLE_SIZE; i++)
+  {
+    uint16_t value = (uint16_t)fminf((float)((uint32_t)i << slow_scope_y_table_shift), 65535.0f);
+    slow_scope_y_table[i] = 
+      (uint8_t)slow_scope_get_y_from_voltage(slow_scope_get_voltage(value));
+  }
+  
+  slow_scope_grid_y_cnt = 0;
+  float voltage_val = 0.0f;
+  while ((voltage_val < slow_scope_max_voltage) && 
+         (slow_scope_grid_y_cnt < SLOW_SCOPE_GRID_LINES_MAX))
+  {
+    slow_scope_grid_y[slow_scope_grid_y_cnt++] = 
+      (uint8_t)slow_scope_get_y_from_voltage(voltage_val);
+    voltage_val+= slow_scope_grid_v;
+  }
+}
+
 void slow_scope_clear_active_zone(void)
 {
   uint8_t y;
@@ -0,0 +1,450 @@
+//Spectrum analyzer mode
+//Fused samples of FFT_SIZE points are converted to Q15, windowed and passed to
+//real-input FFT, spectrum is placed to the second half of the capture buffer.
+//Display shows log magnitude of the first half of the spectrum,
+//dominant frequency and THD (by first harmonics of the dominant frequency).
+//In AUTO mode sample rate is chosen by auto-timebase from the edge-rate probe.
+
+/* Includes ------------------------------------------------------------------*/
+#include "config.h"
+#include "mode_controlling.h"
+#include "data_processing.h"
+#include "acquisition.h"
+#include "adc_controlling.h"
+#include "display_functions.h"
+#include "mode_arena.h"
+#include "hardware.h"
+#include "fft.h"
+#include "main.h"
+#include "stdio.h"
+#include "math.h"
+#include "string.h"
+
+#include "spectrum.h"
+
+/* Private define ------------------------------------------------------------*/
+//Header is part with text
+#define SPECTRUM_HEADER_HEIGHT          (9)
+
+//part of the display is closed by device case
+#define SPECTRUM_Y_END                  (DISPLAY_HEIGHT - 3)
+
+#define SPECTRUM_ACTIVE_HEIGHT          (SPECTRUM_Y_END - SPECTRUM_HEADER_HEIGHT)
+
+#define SPECTRUM_COLUMNS_CNT            (DISP_WIDTH)
+
+//Useful FFT bins - input is real
+#define SPECTRUM_BINS_CNT               (FFT_BINS_CNT)
+
+//Top of the display, dBV (RMS)
+#define SPECTRUM_TOP_DBV                (20.0f)
+
+//Bottom of the display is SPECTRUM_DB_RANGE below the top
+#define SPECTRUM_DB_RANGE               (90.0f)
+
+//Sine amplitude is halved by FFT and by Hann window
+#define SPECTRUM_FFT_GAIN               (0.25f)
+
+//Max left shift of the samples - small signals use more bits of Q15
+#define SPECTRUM_MAX_SHIFT              (4)
+
+#define SPECTRUM_DB_GRID                (20.0f)
+
+//Number of vertical grid lines
+#define SPECTRUM_FREQ_GRID_CNT          (10)
+
+//Lower bins are DC passed through the window
+#define SPECTRUM_MIN_PEAK_BIN           (3)
+
+//Peak must be higher than bottom of the display, dB
+#define SPECTRUM_MIN_PEAK_DB            (10.0f)
+
+//Harmonics 2..SPECTRUM_HARMONICS_CNT are used for THD
+#define SPECTRUM_HARMONICS_CNT          (5)
+
+//AUTO mode: number of signal periods in the capture
+#define SPECTRUM_AUTO_PERIODS           (16)
+
+//AUTO mode: lowest sample rate, Hz - capture time is limited
+#define SPECTRUM_AUTO_MIN_RATE          (100)
+
+/* Private variables ---------------------------------------------------------*/
+extern menu_mode_t main_menu_mode;
+
+//Selected by upper button
+uint8_t spectrum_rate_idx = 0;
+
+//Achieved rate of the last processed capture, Hz
+float spectrum_sample_rate = 0.0f;
+
+//Converts 10*log10(FFT power) to dBV, depends on samples shift
+float spectrum_dbv_offset = 0.0f;
+
+//Column heights in pixels, allocated from "mode_arena"
+uint8_t* spectrum_columns = NULL;
+
+//0 - no signal
+float spectrum_peak_freq = 0.0f;
+float spectrum_thd = 0.0f;//%
+uint8_t spectrum_peak_column = 0;
+uint8_t spectrum_harmonic_columns[SPECTRUM_HARMONICS_CNT - 1];
+uint8_t spectrum_harmonics_found = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+void spectrum_job_cb(uint16_t* adc_buffer, uint16_t points);
+void spectrum_load_samples(uint16_t* adc_buffer, fft_complex_t* fft_buffer);
+void spectrum_calc_columns(fft_complex_t* fft_buffer);
+void spectrum_find_peak(fft_complex_t* fft_buffer);
+uint32_t spectrum_get_peak_power(fft_complex_t* fft_buffer, uint16_t bin);
+uint8_t spectrum_bin_to_column(uint16_t bin);
+void spectrum_draw_header(void);
+void spectrum_draw_grid(void);
+void spectrum_draw_columns(void);
+void spectrum_clear_active_zone(void);
+const acq_job_t* spectrum_get_job(void);
+void spectrum_update_timebase(uint16_t* adc_buffer, uint16_t points);
+
+const acq_job_t spectrum_jobs[] =
+{
+  {ACQ_JOB_SPECTRUM, DATA_PROC_LOW_SAMPLE_RATE, FFT_SIZE,
+    ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS, spectrum_job_cb, NULL},
+  {ACQ_JOB_SPECTRUM, DATA_PROC_SAMPLE_RATE_200K, FFT_SIZE,
+    ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS, spectrum_job_cb, NULL},
+  {ACQ_JOB_SPECTRUM, DATA_PROC_SAMPLE_RATE_2M, FFT_SIZE,
+    ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS, spectrum_job_cb, NULL},
+};
+
+#define SPECTRUM_RATES_CNT  (sizeof(spectrum_jobs) / sizeof(acq_job_t))
+
+//Selected after fixed rates, sample rate is changed by "spectrum_update_timebase"
+#define SPECTRUM_AUTO_IDX   (SPECTRUM_RATES_CNT)
+
+acq_job_t spectrum_auto_job =
+{
+  ACQ_JOB_SPECTRUM, DATA_PROC_LOW_SAMPLE_RATE, FFT_SIZE,
+  ACQ_TRIGGER_NONE, ACQ_PRIORITY_NORMAL, ACQ_JOB_FLAG_CONTINUOUS, spectrum_job_cb, NULL
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+// This function must be called when "main_menu_mode" is changed
+// Capture buffers must be big enough for FFT_SIZE points
+void spectrum_main_mode_changed(void)
+{
+  spectrum_columns = NULL;
+  spectrum_peak_freq = 0.0f;
+  spectrum_harmonics_found = 0;
+  if (main_menu_mode == MENU_MODE_SPECTRUM)
+  {
+    spectrum_columns = (uint8_t*)mode_arena_alloc(SPECTRUM_COLUMNS_CNT);
+    memset(spectrum_columns, 0, SPECTRUM_COLUMNS_CNT);
+    fft_init();
+    acquisition_submit(spectrum_get_job());
+  }
+}
+
+const acq_job_t* spectrum_get_job(void)
+{
+  if (spectrum_rate_idx == SPECTRUM_AUTO_IDX)
+    return &spectrum_auto_job;
+  return &spectrum_jobs[spectrum_rate_idx];
+}
+
+// Switch sample rate
+void spectrum_upper_button_pressed(void)
+{
+  spectrum_rate_idx++;
+  if (spectrum_rate_idx > SPECTRUM_AUTO_IDX)
+    spectrum_rate_idx = 0;
+
+  //Capture of the old rate is dropped, mode buffers and FFT tables are kept
+  //Already captured buffers are processed with their own rate
+  acquisition_abort();
+  acquisition_submit(spectrum_get_job());
+}
+
+//Called by acquisition engine from "data_processing_handler"
+void spectrum_job_cb(uint16_t* adc_buffer, uint16_t points)
+{
+  acq_result_t result;
+
+  if (points != FFT_SIZE)
+    return;
+
+  spectrum_sample_rate = acquisition_get_sample_rate();
+  if (spectrum_rate_idx == SPECTRUM_AUTO_IDX)
+    spectrum_update_timebase(adc_buffer, points);
+
+  uint32_t start_ticks = hardware_dwt_get();
+  //ADC pairs are replaced by FFT data - buffer is not needed after processing
+  fft_complex_t* fft_buffer = (fft_complex_t*)adc_buffer;
+  spectrum_load_samples(adc_buffer, fft_buffer);
+  fft_apply_window(fft_buffer);
+  fft_real(fft_buffer);
+  hardware_profile_store(HARDWARE_PROFILE_FFT, start_ticks);
+
+  spectrum_calc_columns(fft_buffer);
+  spectrum_find_peak(fft_buffer);
+
+  result.job_id = ACQ_JOB_SPECTRUM;
+  acquisition_mailbox_post(&result);
+}
+
+// Choose sample rate of the next captures by number of periods in this one
+// Captures that are already running keep old rate - their rate is 
+// taken from "acquisition_get_sample_rate"
+void spectrum_update_timebase(uint16_t* adc_buffer, uint16_t points)
+{
+  uint16_t periods = data_processing_count_periods(adc_buffer, points);
+  uint32_t rate = adc_auto_timebase((uint32_t)lrintf(spectrum_sample_rate), 
+    points, periods, SPECTRUM_AUTO_PERIODS);
+  if (rate < SPECTRUM_AUTO_MIN_RATE)
+    rate = SPECTRUM_AUTO_MIN_RATE;
+  spectrum_auto_job.sample_rate = rate;//is read by engine when capture is started
+}
+
+// Convert fused samples to Q15 without DC
+// Samples are packed by pairs: "2n" - real part, "2n+1" - imaginary part of word "n"
+void spectrum_load_samples(uint16_t* adc_buffer, fft_complex_t* fft_buffer)
+{
+  uint32_t summ = 0;
+  uint16_t min_value = 0xFFFF;
+  uint16_t max_value = 0;
+  uint16_t i;
+
+  for (i = 0; i < FFT_SIZE; i++)
+  {
+    uint16_t value = adc_buffer[i * 2 + 1];
+    summ+= value;
+    if (value < min_value)
+      min_value = value;
+    if (value > max_value)
+      max_value = value;
+  }
+  int32_t average = (int32_t)(summ / FFT_SIZE);
+
+  //Biggest shift that keeps samples in 15 bits
+  int32_t deviation = max_value - average;
+  if ((average - min_value) > deviation)
+    deviation = average - min_value;
+  uint8_t shift = 0;
+  while ((shift < SPECTRUM_MAX_SHIFT) && ((deviation << (shift + 1)) < 32768))
+    shift++;
+
+  //ADC pairs "2i" and "2i+1" are read before word "i" is written
+  for (i = 0; i < (FFT_SIZE / 2); i++)
+  {
+    int32_t value_even = ((int32_t)adc_buffer[i * 4 + 1] - average) << shift;
+    int32_t value_odd = ((int32_t)adc_buffer[i * 4 + 3] - average) << shift;
+    fft_buffer[i] = FFT_PACK(__SSAT(value_even, 16), __SSAT(value_odd, 16));
+  }
+
+  //Sine peak in Q15 -> RMS in volts
+  float volts_per_q15 = data_processing_fused_to_voltage(1) / (float)(1 << shift);
+  spectrum_dbv_offset = 
+    20.0f * log10f(volts_per_q15 / SPECTRUM_FFT_GAIN / 1.41421356f);
+}
+
+// Convert FFT result to column heights, each column is max of its bins
+void spectrum_calc_columns(fft_complex_t* fft_buffer)
+{
+  uint16_t bin = 1;
+  for (uint16_t x = 0; x < SPECTRUM_COLUMNS_CNT; x++)
+  {
+    uint16_t end_bin = 1 +
+      (uint32_t)(x + 1) * (SPECTRUM_BINS_CNT - 1) / SPECTRUM_COLUMNS_CNT;
+    uint32_t max_power = 0;
+    for (; bin < end_bin; bin++)
+    {
+      uint32_t power = fft_get_power(fft_buffer, bin);
+      if (power > max_power)
+        max_power = power;
+    }
+
+    float level_db = 10.0f * log10f((float)max_power + 1.0f) + spectrum_dbv_offset - 
+      (SPECTRUM_TOP_DBV - SPECTRUM_DB_RANGE);
+    if (level_db < 0.0f)
+      level_db = 0.0f;
+    uint16_t height = (uint16_t)(level_db * SPECTRUM_ACTIVE_HEIGHT / SPECTRUM_DB_RANGE);
+    if (height > SPECTRUM_ACTIVE_HEIGHT)
+      height = SPECTRUM_ACTIVE_HEIGHT;
+    spectrum_columns[x] = (uint8_t)height;
+  }
+}
+
+// Find dominant frequency and its harmonics
+void spectrum_find_peak(fft_complex_t* fft_buffer)
+{
+  uint16_t peak_bin = SPECTRUM_MIN_PEAK_BIN;
+  uint32_t peak_power = 0;
+  for (uint16_t bin = SPECTRUM_MIN_PEAK_BIN; bin < (SPECTRUM_BINS_CNT - 1); bin++)
+  {
+    uint32_t power = fft_get_power(fft_buffer, bin);
+    if (power > peak_power)
+    {
+      peak_power = power;
+      peak_bin = bin;
+    }
+  }
+
+  spectrum_peak_freq = 0.0f;
+  spectrum_harmonics_found = 0;
+  float peak_dbv = 10.0f * log10f((float)peak_power + 1.0f) + spectrum_dbv_offset;
+  if (peak_dbv < (SPECTRUM_TOP_DBV - SPECTRUM_DB_RANGE + SPECTRUM_MIN_PEAK_DB))
+    return;//noise only
+
+  //Parabolic interpolation of the log power
+  float left = log10f((float)fft_get_power(fft_buffer, peak_bin - 1) + 1.0f);
+  float center = log10f((float)peak_power + 1.0f);
+  float right = log10f((float)fft_get_power(fft_buffer, peak_bin + 1) + 1.0f);
+  float divider = left - 2.0f * center + right;
+  float delta = 0.0f;
+  if (divider < 0.0f)
+    delta = 0.5f * (left - right) / divider;
+
+  float peak_pos = (float)peak_bin + delta;
+  spectrum_peak_freq = peak_pos * spectrum_sample_rate / (float)FFT_SIZE;
+  spectrum_peak_column = spectrum_bin_to_column(peak_bin);
+
+  //Window spreads each tone over 3 bins
+  float fundamental_power = (float)spectrum_get_peak_power(fft_buffer, peak_bin);
+  float harmonics_power = 0.0f;
+  for (uint8_t i = 2; i <= SPECTRUM_HARMONICS_CNT; i++)
+  {
+    uint16_t bin = (uint16_t)lrintf(peak_pos * (float)i);
+    if ((bin + 1) >= SPECTRUM_BINS_CNT)
+      break;
+    harmonics_power+= (float)spectrum_get_peak_power(fft_buffer, bin);
+    spectrum_harmonic_columns[spectrum_harmonics_found] = spectrum_bin_to_column(bin);
+    spectrum_harmonics_found++;
+  }
+  spectrum_thd = 100.0f * sqrtf(harmonics_power / fundamental_power);
+}
+
+// Return summ of the powers of "bin" and its neighbours
+uint32_t spectrum_get_peak_power(fft_complex_t* fft_buffer, uint16_t bin)
+{
+  return fft_get_power(fft_buffer, bin - 1) +
+    fft_get_power(fft_buffer, bin) + fft_get_power(fft_buffer, bin + 1);
+}
+
+uint8_t spectrum_bin_to_column(uint16_t bin)
+{
+  return (uint8_t)((uint32_t)(bin - 1) * SPECTRUM_COLUMNS_CNT / (SPECTRUM_BINS_CNT - 1));
+}
+
+//-----------------------------------------------------------------------------
+
+void spectrum_draw_menu(menu_draw_type_t draw_type)
+{
+  if (draw_type == MENU_MODE_FULL_REDRAW)
+  {
+    display_clear_framebuffer();
+    display_draw_string("SPECTRUM", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_update();
+  }
+  else
+  {
+    acq_result_t result;
+
+    //Redraw only when new spectrum is calculated
+    if (acquisition_mailbox_get_last(&result))
+    {
+      spectrum_draw_header();
+      spectrum_clear_active_zone();
+      spectrum_draw_grid();
+      spectrum_draw_columns();
+      display_update();
+    }
+  }//PARTIAL_REDRAW
+}
+
+void spectrum_draw_header(void)
+{
+  char tmp_str[32];
+  char rate_str[12];
+  uint32_t rate = (uint32_t)lrintf(spectrum_sample_rate);
+
+  if (rate < 1000)
+    sprintf(rate_str, "%luHz", rate);
+  else
+    sprintf(rate_str, "%luK", rate / 1000);
+  sprintf(tmp_str, "%s %-5s", 
+    (spectrum_rate_idx == SPECTRUM_AUTO_IDX) ? "AUT" : "FFT", rate_str);
+  display_draw_string(tmp_str, 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+
+  if (spectrum_peak_freq == 0.0f)
+  {
+    display_draw_string("  ---        ", 54, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+    return;
+  }
+
+  if (spectrum_peak_freq < 10000.0f)
+    sprintf(tmp_str, "%luHz", (uint32_t)lrintf(spectrum_peak_freq));
+  else
+    sprintf(tmp_str, "%lukHz", (uint32_t)lrintf(spectrum_peak_freq / 1000.0f));
+  menu_shift_string_right(tmp_str, 7);
+  display_draw_string(tmp_str, 54, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+
+  float thd = spectrum_thd;
+  if (thd > 99.0f)
+    thd = 99.0f;
+  if (spectrum_harmonics_found > 0)
+    sprintf(tmp_str, "THD%2lu%%", (uint32_t)lrintf(thd));
+  else
+    sprintf(tmp_str, "      ");
+  display_draw_string(tmp_str, 112, 0, FONT_SIZE_8, 0, COLOR_WHITE);
+}
+
+void spectrum_draw_grid(void)
+{
+  //Level grid - dotted horizontal lines
+  for (float level = SPECTRUM_DB_GRID; level < SPECTRUM_DB_RANGE; level+= SPECTRUM_DB_GRID)
+  {
+    uint16_t y = SPECTRUM_HEADER_HEIGHT +
+      (uint16_t)(level * SPECTRUM_ACTIVE_HEIGHT / SPECTRUM_DB_RANGE);
+    for (uint16_t x = 0; x < SPECTRUM_COLUMNS_CNT; x+= 4)
+      display_set_pixel_color(x, y, COLOR_GRAY);
+  }
+
+  //Frequency grid - 1/10 of the Nyquist frequency
+  for (uint8_t i = 1; i < SPECTRUM_FREQ_GRID_CNT; i++)
+  {
+    uint16_t x = i * SPECTRUM_COLUMNS_CNT / SPECTRUM_FREQ_GRID_CNT;
+    for (uint16_t y = SPECTRUM_HEADER_HEIGHT; y < SPECTRUM_Y_END; y+= 4)
+      display_set_pixel_color(x, y, COLOR_GRAY);
+  }
+
+  display_draw_line(SPECTRUM_Y_END, COLOR_BLUE);
+}
+
+void spectrum_draw_columns(void)
+{
+  for (uint16_t x = 0; x < SPECTRUM_COLUMNS_CNT; x++)
+  {
+    if (spectrum_columns[x] == 0)
+      continue;
+    uint8_t color = COLOR_GREEN;
+    if ((spectrum_peak_freq != 0.0f) && (x == spectrum_peak_column))
+      color = COLOR_RED;
+    display_draw_vertical_line(
+      x, SPECTRUM_Y_END - spectrum_columns[x], SPECTRUM_Y_END - 1, color);
+  }
+
+  //Harmonics markers - above the columns
+  for (uint8_t i = 0; i < spectrum_harmonics_found; i++)
+  {
+    uint8_t x = spectrum_harmonic_columns[i];
+    uint16_t y = SPECTRUM_Y_END - spectrum_columns[x];
+    if (y < (SPECTRUM_HEADER_HEIGHT + 3))
+      y = SPECTRUM_HEADER_HEIGHT + 3;
+    display_draw_vertical_line(x, y - 3, y - 1, COLOR_YELLOW);
+  }
+}
+
+void spectrum_clear_active_zone(void)
+{
+  uint8_t y;
+  for (y = SPECTRUM_HEADER_HEIGHT; y < DISPLAY_HEIGHT; y++)
+    display_draw_line(y, COLOR_BLACK);
+}
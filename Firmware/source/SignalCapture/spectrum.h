@@ -0,0 +1,14 @@
+#ifndef __SPECTRUM_H
+#define __SPECTRUM_H
+
+#include "mode_controlling.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+void spectrum_main_mode_changed(void);
+
+void spectrum_draw_menu(menu_draw_type_t draw_type);
+void spectrum_upper_button_pressed(void);
+
+#endif
+
@@ -6,6 +6,12 @@
 
 #define FW_VERSION_STRING       "FW VERSION: 1.0"
 
+// CCM RAM ********************************************************************
+// 1 - ISR's, capture processing kernels and display pixel pipeline are 
+// executed from CCM RAM (zero wait states), vector table is moved to CCM RAM
+// 0 - everything is executed from Flash
+#define USE_CCM_RAM_CODE        1
+
 // BUTTONS ********************************************************************
 
 // Lower button - wakeup
@@ -61,12 +67,18 @@
 
 #define ADC_TIMER_PERIOD        1000  //72M/12 = 6mhz
 
+// Internal trigger of ADC_TIMER connected to GENERATOR_TIMER TRGO (TIM3 -> TIM8 ITR3)
+#define ADC_TIMER_GENERATOR_ITR TIM_TS_ITR3
+
 // ADC ************************************************************************
 
 #define ADC_SAMPLING_TIME       ADC_SampleTime_1Cycles5
 //#define ADC_SAMPLING_TIME       ADC_SampleTime_181Cycles5
 
-#define ADC_TRIGGER_SOURCE      ADC_ExternalTrigConvEvent_7;//TIM8_TRGO
+// Number of ADC sampling times: ADC_SampleTime_1Cycles5 - ADC_SampleTime_601Cycles5
+#define ADC_SAMPLE_TIMES_CNT    8
+
+#define ADC_TRIGGER_SOURCE      ADC_ExternalTrigConvEvent_7 //TIM8_TRGO
 
 //Divided signal from probe -> ADC1
 
@@ -81,7 +93,14 @@
 
 
 #define ADC_OPAMP_NAME          OPAMP_Selection_OPAMP2
-#define ADC_OPAMP_GAIN          OPAMP_OPAMP_PGAGain_8
+#define ADC_OPAMP_GAIN          OPAMP_OPAMP_PGAGain_8//gain after power on
+#define ADC_OPAMP_GAIN_IDX      2//index of ADC_OPAMP_GAIN in auto-ranging gains
+
+// Auto-ranging PGA gains: x2, x4, x8, x16
+#define ADC_OPAMP_GAINS_CNT     4
+
+// OPAMP output settling time after PGA gain change, us
+#define ADC_OPAMP_SETTLING_US   5
 #define ADC_OPAMP_POS_INPUT     OPAMP_NonInvertingInput_IO4//PA7 for OPAMP2
 
 #define ADC_OPAMP_POS_PIN       GPIO_Pin_7
@@ -147,6 +166,33 @@
 #define FREQ_MEAS_TIM_ETR_AF_SRC        GPIO_PinSource12
 #define FREQ_MEAS_TIM_ETR_AFIO          GPIO_AF_11
 
+//Glitch catcher timer - COMP4_OUT is internally connected to TIM15_IC2
+#define GLITCH_TIM_NAME                 TIM15
+#define GLITCH_TIM_CLK_INIT_F           RCC_APB2PeriphClockCmd
+#define GLITCH_TIM_CLK                  RCC_APB2Periph_TIM15
+#define GLITCH_TIM_IRQ                  TIM1_BRK_TIM15_IRQn
+#define GLITCH_TIM_IRQ_HANDLER          TIM1_BRK_TIM15_IRQHandler
+#define GLITCH_COMP_OUTPUT              COMP_Output_TIM15IC2
+
+//Equivalent-time sampling: same timer is started by COMP4 (TI2FP2),
+//its TRGO triggers ADC1 and ADC2
+#define ADC_ETS_TIMER                   GLITCH_TIM_NAME
+#define ADC_ETS_TIMER_CLK_INIT_F        GLITCH_TIM_CLK_INIT_F
+#define ADC_ETS_TIMER_CLK               GLITCH_TIM_CLK
+#define ADC_ETS_TRIGGER_SOURCE          ADC_ExternalTrigConvEvent_14 //TIM15_TRGO
+
+//Logic analyzer: timer update event makes DMA read COMP_OUT_GPIO->IDR
+#define LA_TIMER                        TIM6
+#define LA_TIMER_CLK_INIT_F             RCC_APB1PeriphClockCmd
+#define LA_TIMER_CLK                    RCC_APB1Periph_TIM6
+#define LA_DMA                          DMA2
+#define LA_DMA_CLK                      RCC_AHBPeriph_DMA2
+#define LA_DMA_CHANNEL                  DMA2_Channel3 //TIM6_UP, no remap
+#define LA_DMA_IRQ                      DMA2_Channel3_IRQn
+#define LA_DMA_IRQ_HANDLER              DMA2_Channel3_IRQHandler
+#define LA_DMA_ISR_HT                   DMA_ISR_HTIF3
+#define LA_DMA_ISR_TC                   DMA_ISR_TCIF3
+
 // POWER CONTROLLING **********************************************************
 #define BATTERY_ADC_GPIO                GPIOB
 #define BATTERY_ADC_PIN                 GPIO_Pin_12 //BAT_VOLT
@@ -2,11 +2,15 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "generator_timer.h"
+#include "main.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+// Incremented at each restart - restart can make short pulse at the probe pin
+volatile uint8_t generator_timer_restarts = 0;
+
 /* Private function prototypes -----------------------------------------------*/
 
 
@@ -44,14 +48,22 @@ void generator_timer_init(void)
   
   TIM_CtrlPWMOutputs(GENERATOR_TIMER, ENABLE);
   
+  //TRGO is used to start ADC_TIMER at the same moment with generator
+  TIM_SelectOutputTrigger(GENERATOR_TIMER, TIM_TRGOSource_Enable);
+  TIM_SelectMasterSlaveMode(GENERATOR_TIMER, TIM_MasterSlaveMode_Enable);
+  
   TIM_Cmd(GENERATOR_TIMER, ENABLE);
 }
 
-void generator_timer_start(void)
+// Restart generator from the beginning of the high state
+// ADC_TIMER waiting for trigger is started too
+// Called from DMA interrupt - registers are accessed directly
+CCM_RAM_FUNC void generator_timer_start(void)
 {
-  TIM_Cmd(GENERATOR_TIMER, DISABLE);
-  GENERATOR_TIMER->CNT = 0;
-  TIM_Cmd(GENERATOR_TIMER, ENABLE);
+  GENERATOR_TIMER->CR1 &= (uint16_t)~TIM_CR1_CEN;
+  GENERATOR_TIMER->EGR = TIM_EventSource_Update;//reset counter and prescaler
+  GENERATOR_TIMER->CR1 |= TIM_CR1_CEN;//TRGO
+  generator_timer_restarts++;
 }
 
 
@@ -10,6 +10,8 @@
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
+extern volatile uint8_t generator_timer_restarts;
+
 void generator_timer_init(void);
 void generator_timer_activate_gpio(void);
 void generator_timer_deactivate_gpio(void);
@@ -1,13 +1,32 @@
 /* Includes ------------------------------------------------------------------*/
 #include "hardware.h"
+#include "main.h"
+#include "string.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+// 16 Cortex-M4 exceptions + STM32F303xC interrupts (last is FPU_IRQn)
+#define HARDWARE_VECTORS_CNT            (16 + FPU_IRQn + 1)
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+#if (USE_CCM_RAM_CODE)
+// Copy of the vector table, VTOR needs alignment to power of two of its size
+#pragma data_alignment=512
+CCM_RAM_NOINIT uint32_t hardware_ram_vectors[HARDWARE_VECTORS_CNT];
+#endif
+
+// Last measured execution time of routines, MCU ticks
+uint32_t hardware_profile_ticks[HARDWARE_PROFILE_ITEMS_CNT];
+
+// Minimal execution time since "hardware_profile_reset", MCU ticks, 0 - not measured
+// It doesn't include time of preempting interrupts, so builds can be compared by it
+uint32_t hardware_profile_min_ticks[HARDWARE_PROFILE_ITEMS_CNT];
+
 /* Private function prototypes -----------------------------------------------*/
 void hardware_init_rcc(void);
 void hardware_opamp_init(void);
+void hardware_relocate_vectors(void);
 
 void hardware_dwt_init(void);
 uint32_t hardware_dwt_get(void);
@@ -19,6 +38,7 @@ uint8_t hardware_dwt_comapre(int32_t tp);
 void hardware_init_all(void)
 {
   NVIC_PriorityGroupConfig(NVIC_PriorityGroup_0);
+  hardware_relocate_vectors();
   
   hardware_init_rcc();
   
@@ -28,6 +48,8 @@ void hardware_init_all(void)
   
   hardware_dwt_init();
   hardware_opamp_init();
+  
+  RCC_AHBPeriphClockCmd(RCC_AHBPeriph_CRC, ENABLE);//flash records CRC
 }
 
 //Initialize main clock system
@@ -38,6 +60,11 @@ void hardware_init_rcc(void)
   while (RCC_GetSYSCLKSource() != 0x00) {}
   RCC_DeInit();
 
+  //32 MHz needs one flash wait state (0 WS is allowed up to 24 MHz),
+  //"SystemInit" sets it only when HSE is started
+  FLASH_PrefetchBufferCmd(ENABLE);
+  FLASH_SetLatency(FLASH_Latency_1);
+  
   // PLL config 8 MHz / 2 * 8 = 32 MHz
   RCC_PLLConfig(RCC_PLLSource_HSI_Div2, RCC_PLLMul_8); 
   RCC_PLLCmd(ENABLE);
@@ -47,6 +74,19 @@ void hardware_init_rcc(void)
   SystemCoreClockUpdate();
 }
 
+//Move vector table to CCM RAM - no flash wait states at interrupt entry
+void hardware_relocate_vectors(void)
+{
+#if (USE_CCM_RAM_CODE)
+  uint32_t int_state;
+  ENTER_CRITICAL(int_state);
+  memcpy(hardware_ram_vectors, (void*)SCB->VTOR, sizeof(hardware_ram_vectors));
+  SCB->VTOR = (uint32_t)hardware_ram_vectors;
+  __DSB();
+  LEAVE_CRITICAL(int_state);
+#endif
+}
+
 //Init DWT counter
 void hardware_dwt_init(void)
 {
@@ -84,11 +124,39 @@ void hardware_opamp_init(void)
 
 // ***************************************************************************
 
-uint32_t hardware_dwt_get(void)
+CCM_RAM_FUNC uint32_t hardware_dwt_get(void)
 {
   return DWT->CYCCNT;
 }
 
+// Save execution time of the routine
+// start_ticks - DWT value at the routine start
+CCM_RAM_FUNC void hardware_profile_store(hardware_profile_item_t item, uint32_t start_ticks)
+{
+  uint32_t ticks = hardware_dwt_get() - start_ticks;
+  hardware_profile_ticks[item] = ticks;
+  if ((hardware_profile_min_ticks[item] == 0) || (ticks < hardware_profile_min_ticks[item]))
+    hardware_profile_min_ticks[item] = ticks;
+}
+
+// Return last execution time of the routine, MCU ticks
+uint32_t hardware_profile_get(hardware_profile_item_t item)
+{
+  return hardware_profile_ticks[item];
+}
+
+// Return minimal execution time of the routine, MCU ticks
+uint32_t hardware_profile_get_min(hardware_profile_item_t item)
+{
+  return hardware_profile_min_ticks[item];
+}
+
+// Start new measurement of minimal times
+void hardware_profile_reset(void)
+{
+  memset(hardware_profile_min_ticks, 0, sizeof(hardware_profile_min_ticks));
+}
+
 inline uint8_t hardware_dwt_comapre(int32_t tp)
 {
   return (((int32_t)hardware_dwt_get() - tp) < 0);
@@ -7,6 +7,21 @@
 #include "config.h"
 
 /* Exported types ------------------------------------------------------------*/
+// Routines which execution time is measured in MCU ticks
+typedef enum
+{
+  HARDWARE_PROFILE_ADC_DMA_IRQ = 0,
+  HARDWARE_PROFILE_CORRECT_RAW_DATA,
+  HARDWARE_PROFILE_LOGIC_PROBE_DATA,
+  HARDWARE_PROFILE_EXTENDED_DATA,
+  HARDWARE_PROFILE_FFT,
+  HARDWARE_PROFILE_AC_MEASURE,
+  HARDWARE_PROFILE_FUSE_SAMPLES,
+  HARDWARE_PROFILE_EDGE_MEASURE,
+  HARDWARE_PROFILE_SEND_FRAMEBUFFER,
+  HARDWARE_PROFILE_ITEMS_CNT,//LAST!
+} hardware_profile_item_t;
+
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
@@ -15,4 +30,9 @@ void dwt_delay_us(uint32_t us);
 
 uint32_t hardware_dwt_get(void);
 
+void hardware_profile_store(hardware_profile_item_t item, uint32_t start_ticks);
+uint32_t hardware_profile_get(hardware_profile_item_t item);
+uint32_t hardware_profile_get_min(hardware_profile_item_t item);
+void hardware_profile_reset(void);
+
 #endif /* __HARDWARE_H */
@@ -16,6 +16,7 @@
 #include "data_processing.h"
 #include "freq_measurement.h"
 #include "nvram.h"
+#include "flash_log.h"
 
 #include <stdio.h>
 
@@ -39,6 +40,7 @@ int main(void)
 {
   hardware_init_all();
   nvram_read_data();
+  flash_log_init();
   display_init();
   
   dac_init();
@@ -67,6 +69,7 @@ int main(void)
       power_controlling_handler();
       menu_redraw_display(MENU_MODE_PARTIAL_REDRAW);
       data_processing_handler();
+      flash_log_handler();
     }
   }
 }
@@ -4,6 +4,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f30x.h"
+#include "config.h"
 
 /* Exported types ------------------------------------------------------------*/
 extern volatile uint32_t ms_tick;
@@ -16,15 +17,26 @@ extern volatile uint32_t ms_tick;
 #if defined ( __ICCARM__ ) // IAR
     #define ENTER_CRITICAL(x)       x=__get_interrupt_state(); __disable_interrupt()
     #define LEAVE_CRITICAL(x)       __set_interrupt_state(x)
+    #define CCM_RAM_SECTION         _Pragma("location=\".ccmram\"")
+    #define CCM_RAM_NOINIT          _Pragma("location=\".ccmram_noinit\"")
 
 #elif defined (__CC_ARM) // KEIL
     #define ENTER_CRITICAL(x)       x=__disable_irq()
     #define LEAVE_CRITICAL(x)       if (!x) __enable_irq()
     #define NO_INIT                 __attribute__((zero_init))
+    #define CCM_RAM_SECTION         __attribute__((section(".ccmram")))
+    #define CCM_RAM_NOINIT          __attribute__((section(".ccmram_noinit"), zero_init))
 #else
   #error ERROR
 #endif
 
+// Place function to CCM RAM (see "USE_CCM_RAM_CODE" in config.h)
+#if (USE_CCM_RAM_CODE)
+    #define CCM_RAM_FUNC            CCM_RAM_SECTION
+#else
+    #define CCM_RAM_FUNC
+#endif
+
 /* Exported functions ------------------------------------------------------- */
 
 #endif /* __MAIN_H */
@@ -7,13 +7,27 @@
 #include "nvram.h"
 #include "stdio.h"
 #include "data_processing.h"
+#include "mode_arena.h"
+#include "hardware.h"
 
 #include "menu_selector.h"
 
 /* Private typedef -----------------------------------------------------------*/
+// Displayed state of the menu, screen is redrawn only when it is changed
+typedef struct
+{
+  uint8_t submenu_flag;
+  uint8_t selected;//cursor
+  uint8_t calib_state;
+  int32_t values[HARDWARE_PROFILE_ITEMS_CNT];//displayed values of the subitem
+} menu_selector_view_t;
+
 // Step of adc divider calibration in menu, Volts
 #define MENU_SELECTOR_ADC_CALIB_STEP            0.01f
 
+// Period of the battery measurement in INFO subitem, ms
+#define MENU_SELECTOR_BATTERY_MEAS_PERIOD_MS    500
+
 /* Private variables ---------------------------------------------------------*/
 
 menu_selector_item_t menu_selector_items[] = 
@@ -22,7 +36,8 @@ menu_selector_item_t menu_selector_items[] =
   {2, MENU_SUBITEM_INFO, "INFO"},
   {3, MENU_SUBITEM_CALIBRATE, "CALIBRATE ADC"},
   {4, MENU_SUBITEM_SET_OFF_TIME, "SET OFF TIME"},
-  {5, MENU_SUBITEM_RESET, "RESET"}, //reset in needed if device can't enter sleep
+  {5, MENU_SUBITEM_PROFILE, "PROFILE"},
+  {6, MENU_SUBITEM_RESET, "RESET"}, //reset in needed if device can't enter sleep
   {0, MENU_SUBITEM_NULL, ""}, //null item
 };
 
@@ -34,6 +49,12 @@ uint8_t menu_selector_submenu_flag = 0;
 //Data must be saved to nvram after exiting subitem
 uint8_t menu_selector_value_changed_flag = 0;
 
+menu_selector_view_t menu_selector_drawn_view;
+
+float menu_selector_battery_voltage = 0.0f;
+uint32_t menu_selector_battery_timestamp = 0;
+
+extern volatile uint32_t ms_tick;
 extern nvram_data_t nvram_data;
 extern adc_calibration_state_t data_processing_adc_calib_state;
 extern float data_processing_adc_calib_voltage;
@@ -50,7 +71,9 @@ void menu_selector_subitem_upper_button(void);
 void menu_selector_subitem_lower_button(void);
 void menu_selector_draw_set_off_time(void);
 void menu_selector_draw_adc_calib_menu(void);
+void menu_selector_draw_profile_menu(void);
 void menu_selector_subitem_adc_config_button_pressed(uint8_t is_upper);
+void menu_selector_get_view(menu_selector_view_t* view);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -94,6 +117,12 @@ void menu_selector_lower_button_hold(void)
 
 void menu_selector_draw(menu_draw_type_t draw_type)
 {
+  menu_selector_view_t view;
+  menu_selector_get_view(&view);
+  if ((menu_view_changed(&menu_selector_drawn_view, &view, sizeof(view)) == 0) && 
+      (draw_type == MENU_MODE_PARTIAL_REDRAW))
+    return;
+  
   display_clear_framebuffer();
   
   if (menu_selector_submenu_flag == 0)
@@ -114,6 +143,47 @@ uint8_t menu_selector_submenu_active(void)
   return menu_selector_submenu_flag;
 }
 
+void menu_selector_get_view(menu_selector_view_t* view)
+{
+  memset(view, 0, sizeof(menu_selector_view_t));
+  view->submenu_flag = menu_selector_submenu_flag;
+  view->selected = (uint8_t)menu_selector_selected;
+  if (menu_selector_submenu_flag == 0)
+    return;
+  
+  switch (menu_selector_selected)
+  {
+    case MENU_SUBITEM_INFO:
+      //Measurement is slow, it is not done at every redraw
+      if ((menu_selector_battery_timestamp == 0) || 
+          ((ms_tick - menu_selector_battery_timestamp) > MENU_SELECTOR_BATTERY_MEAS_PERIOD_MS))
+      {
+        menu_selector_battery_voltage = power_controlling_meas_battery_voltage();
+        menu_selector_battery_timestamp = ms_tick;
+      }
+      view->values[0] = (int32_t)(menu_selector_battery_voltage * 100.0f);
+      view->values[1] = mode_arena_get_used();
+      view->values[2] = mode_arena_get_high_water();
+      break;
+      
+    case MENU_SUBITEM_CALIBRATE:
+      view->calib_state = (uint8_t)data_processing_adc_calib_state;
+      view->values[0] = (int32_t)(data_processing_adc_calib_voltage * 100.0f);
+      break;
+      
+    case MENU_SUBITEM_SET_OFF_TIME:
+      view->values[0] = nvram_data.power_off_time;
+      break;
+      
+    case MENU_SUBITEM_PROFILE:
+      for (uint8_t i = 0; i < HARDWARE_PROFILE_ITEMS_CNT; i++)
+        view->values[i] = hardware_profile_get((hardware_profile_item_t)i);//new minimum is also new last value
+      break;
+      
+    default: break;
+  }
+}
+
 //Return 1 if adc calibration is running
 uint8_t menu_selector_adc_calib_running(void)
 {
@@ -127,7 +197,7 @@ uint8_t menu_selector_adc_calib_running(void)
 void menu_selector_draw_items(void)
 {
   uint8_t i = 0;
-  uint8_t y_pos = 10;//start in pixels
+  uint8_t y_pos = 9;//start in pixels
   
   display_draw_string("  SELECT MENU", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
   while (menu_selector_items[i].item_number > 0)
@@ -141,7 +211,7 @@ void menu_selector_draw_items(void)
     else
       display_draw_string(" ", 0, y_pos, FONT_SIZE_11, 0, COLOR_WHITE);
     
-    y_pos+= FONT_SIZE_11 + 1;
+    y_pos+= FONT_SIZE_11;
     i++;
   }
 }
@@ -166,8 +236,10 @@ void menu_selector_handle_button_hold_in_main_menu(void)
     //Enter to submenu
     menu_selector_submenu_flag = 1;
     menu_selector_value_changed_flag = 0;
+    menu_selector_battery_timestamp = 0;
     menu_selector_draw_subitems();
-    data_processing_adc_calib_state = ADC_CALIB_DISPLAY_MSG1;
+    data_processing_adc_calib_state = ADC_CALIB_DISPLAY_ZERO_MSG;
+    hardware_profile_reset();
   }
 }
 
@@ -189,6 +261,10 @@ void menu_selector_draw_subitems(void)
       menu_selector_draw_adc_calib_menu();
       break;
       
+    case MENU_SUBITEM_PROFILE:
+      menu_selector_draw_profile_menu();
+      break;
+      
     case MENU_SUBITEM_RESET:
       // Not good written
       NVIC_SystemReset();
@@ -259,6 +335,7 @@ void menu_selector_subitem_adc_config_button_pressed(uint8_t is_upper)
   
   float new_coef = data_processing_main_div + calib_step / current_adc_val;
   data_processing_main_div = new_coef;
+  data_processing_update_amp_div();
   //Calculate nvram correction coefficient
   nvram_data.div_a_coef = data_processing_main_div / ADC_MAIN_DIVIDER;
   menu_selector_value_changed_flag = 1;
@@ -272,6 +349,16 @@ void menu_selector_draw_adc_calib_menu(void)
   
   switch (data_processing_adc_calib_state)
   {
+    case ADC_CALIB_DISPLAY_ZERO_MSG:
+      display_draw_string(" TOUCH GROUND", 0, 13, FONT_SIZE_11, 0, COLOR_WHITE);
+      display_draw_string("  FOR 1 SEC", 0, 27, FONT_SIZE_11, 0, COLOR_WHITE);
+      break;
+      
+    case ADC_CALIB_MEASURE_ZERO:
+      display_draw_string("  MEASURING", 0, 13, FONT_SIZE_11, 0, COLOR_WHITE);
+      display_draw_string("    ZERO", 0, 27, FONT_SIZE_11, 0, COLOR_WHITE);
+      break;
+      
     case ADC_CALIB_DISPLAY_MSG1:
       display_draw_string("TOUCH EXTERNAL", 0, 13, FONT_SIZE_11, 0, COLOR_WHITE);
       display_draw_string("   VOLTAGE", 0, 27, FONT_SIZE_11, 0, COLOR_WHITE);
@@ -303,15 +390,55 @@ void menu_selector_draw_info_menu(void)
   display_draw_string(FW_VERSION_STRING, 0, 14, FONT_SIZE_11, 0, COLOR_WHITE);
   
   char tmp_str[32];
-  float bat_voltage = power_controlling_meas_battery_voltage();
-  sprintf(tmp_str, "BATT VOLT: %.02f V", bat_voltage);
+  sprintf(tmp_str, "BATT VOLT: %.02f V", menu_selector_battery_voltage);
   display_draw_string(tmp_str, 0, 30, FONT_SIZE_11, 0, COLOR_WHITE);
   
+  //Mode RAM usage: current / maximum / size
+  sprintf(tmp_str, "RAM: %lu/%lu/%lu", (unsigned long)mode_arena_get_used(), 
+          (unsigned long)mode_arena_get_high_water(), (unsigned long)MODE_ARENA_SIZE);
+  display_draw_string(tmp_str, 0, 46, FONT_SIZE_11, 0, COLOR_WHITE);
+  
   // display_draw_string(" by ILIASAM 2021", 0, 60, FONT_SIZE_11, 0, COLOR_WHITE);
 }
 
 //*****************************************************************************
 
+//Names of "hardware_profile_item_t" items, in the same order
+const char* const menu_selector_profile_names[] = 
+{
+  "DMA IRQ", "RAW CORR", "PROBE", "EXTENDED", "FFT", 
+  "AC MEAS", "FUSE", "EDGE MEAS", "LCD PUSH"
+};
+
+//Compilation fails if a profile item has no name
+typedef char menu_selector_profile_names_check[
+  ((sizeof(menu_selector_profile_names) / sizeof(menu_selector_profile_names[0])) == 
+   HARDWARE_PROFILE_ITEMS_CNT) ? 1 : -1];
+
+//Execution time of hot routines, MCU ticks: last and minimal since submenu entry
+//Compare minimal values with USE_CCM_RAM_CODE = 0 and 1 (see docs/ccm_profile.md)
+//Small font is used - all items must fit below the title
+void menu_selector_draw_profile_menu(void)
+{
+  char tmp_str[32];
+  
+  if (USE_CCM_RAM_CODE)
+    display_draw_string("CCM RAM     LAST    MIN", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+  else
+    display_draw_string("FLASH       LAST    MIN", 0, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+  
+  for (uint8_t i = 0; i < HARDWARE_PROFILE_ITEMS_CNT; i++)
+  {
+    sprintf(tmp_str, "%-9s %6u %6u", menu_selector_profile_names[i], 
+            (unsigned int)hardware_profile_get((hardware_profile_item_t)i),
+            (unsigned int)hardware_profile_get_min((hardware_profile_item_t)i));
+    display_draw_string(tmp_str, 0, FONT_SIZE_8 + i * FONT_SIZE_8, 
+                        FONT_SIZE_8, 0, COLOR_WHITE);
+  }
+}
+
+//*****************************************************************************
+
 void menu_selector_draw_set_off_time(void)
 {
   display_draw_string(" SET OFF TIME", 0, 10, FONT_SIZE_11, 0, COLOR_WHITE);
@@ -9,6 +9,7 @@ typedef enum
   MENU_SUBITEM_INFO,
   MENU_SUBITEM_CALIBRATE,
   MENU_SUBITEM_SET_OFF_TIME,
+  MENU_SUBITEM_PROFILE,
   MENU_SUBITEM_RESET,
   MENU_SUBITEM_NULL
 } menu_selector_enum;
@@ -0,0 +1,75 @@
+//RAM pool for buffers that are needed only by one menu mode
+//Buffers are allocated when mode is entered and all of them are released
+//at once when mode is changed (see "data_processing_main_mode_changed")
+
+/* Includes ------------------------------------------------------------------*/
+#include "mode_arena.h"
+#include "string.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+// All blocks are word aligned - DMA is working with 32-bit words
+#define MODE_ARENA_ALIGN_MASK           (sizeof(uint32_t) - 1)
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+uint32_t mode_arena_pool[MODE_ARENA_SIZE / sizeof(uint32_t)];
+
+// Offset of the first free byte, bytes
+uint32_t mode_arena_offset = 0;
+
+// Maximum offset reached since power on, bytes
+uint32_t mode_arena_high_water = 0;
+
+// Requested size of the allocation that didn't fit, bytes
+// Is kept for debugger - firmware is stopped after overflow
+volatile uint32_t mode_arena_overflow_size = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+// Release all blocks. DMA must be stopped before calling this!
+void mode_arena_reset(void)
+{
+  mode_arena_offset = 0;
+}
+
+// Get zero-filled block from the pool
+// size - in bytes
+void* mode_arena_alloc(uint32_t size)
+{
+  size = (size + MODE_ARENA_ALIGN_MASK) & ~MODE_ARENA_ALIGN_MASK;
+  if (size > (MODE_ARENA_SIZE - mode_arena_offset))
+  {
+    //Mode needs more memory than MODE_ARENA_SIZE:
+    //"mode_arena_offset" + "mode_arena_overflow_size" bytes
+    mode_arena_overflow_size = size;
+    while(1) {};
+  }
+
+  uint8_t* block = (uint8_t*)mode_arena_pool + mode_arena_offset;
+  mode_arena_offset += size;
+  if (mode_arena_offset > mode_arena_high_water)
+    mode_arena_high_water = mode_arena_offset;
+
+  memset(block, 0, size);
+  return block;
+}
+
+// Return number of bytes that can be still allocated
+uint32_t mode_arena_get_free(void)
+{
+  return MODE_ARENA_SIZE - mode_arena_offset;
+}
+
+// Return number of bytes allocated by current mode
+uint32_t mode_arena_get_used(void)
+{
+  return mode_arena_offset;
+}
+
+// Return maximum number of bytes that was used by any mode
+uint32_t mode_arena_get_high_water(void)
+{
+  return mode_arena_high_water;
+}
@@ -0,0 +1,22 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MODE_ARENA_H
+#define __MODE_ARENA_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f30x.h"
+#include "config.h"
+
+/* Exported types ------------------------------------------------------------*/
+// Size of the RAM pool shared by capture buffers and mode data, bytes
+#define MODE_ARENA_SIZE                 (14 * 1024)
+
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+void mode_arena_reset(void);
+void* mode_arena_alloc(uint32_t size);
+uint32_t mode_arena_get_free(void);
+uint32_t mode_arena_get_used(void);
+uint32_t mode_arena_get_high_water(void);
+
+#endif /* __MODE_ARENA_H */
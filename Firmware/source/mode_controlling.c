@@ -1,15 +1,54 @@
 /* Includes ------------------------------------------------------------------*/
 #include "mode_controlling.h"
 #include "display_functions.h"
+#include "display_layers.h"
 #include "data_processing.h"
+#include "acquisition.h"
 #include "comparator_handling.h"
 #include "freq_measurement.h"
+#include "glitch_catcher.h"
 #include "slow_scope.h"
+#include "spectrum.h"
+#include "ets.h"
+#include "logic_analyzer.h"
+#include "segmented.h"
+#include "average.h"
+#include "persistence.h"
+#include "histogram.h"
 #include "menu_selector.h"
 #include "string.h"
 #include "stdio.h"
 
 /* Private typedef -----------------------------------------------------------*/
+// View models - displayed values of the screens
+// Screen is redrawn only when its view model differs from the drawn one
+typedef struct
+{
+  char line1[24];
+  char line2[24];
+  uint8_t big_font;//line1 is printed by big font
+  uint32_t glitch_count;
+  uint32_t glitch_width_ns;
+} menu_probe_text_view_t;
+
+typedef struct
+{
+  char text[12];
+  uint8_t color;
+} menu_big_voltage_view_t;
+
+typedef struct
+{
+  char rms_line[24];
+  char vpp_line[24];
+} menu_voltmeter_text_view_t;
+
+typedef struct
+{
+  char frequency[24];
+  char level[24];
+} menu_freq_meter_view_t;
+
 /* Private define ------------------------------------------------------------*/
 
 /* Private macro -------------------------------------------------------------*/
@@ -19,13 +58,40 @@ menu_mode_t main_menu_mode = MENU_MODE_LOGIC_PROBE; // MENU_MODE_CHARGE;
 freq_meter_calib_state_t freq_meter_calib_state = FREQ_METER_CALIB_IDLE;
 
 #define VOLTAGE_BAR_HEIGHT      (6)
+#define VOLTAGE_BAR_START_Y     (51)
+
+//Dynamic rectangles of the logic probe mode
+#define LOGIC_PROBE_STATE_Y     (17)
+#define LOGIC_PROBE_TEXT_Y      (63)
+#define LOGIC_PROBE_TEXT_HEIGHT (DISPLAY_HEIGHT - LOGIC_PROBE_TEXT_Y)
+
+//Dynamic rectangles of the voltmeter mode
+#define VOLTMETER_BIG_X         (20)
+#define VOLTMETER_BIG_Y         (20)
+#define VOLTMETER_BIG_CHARS     (6)
+#define VOLTMETER_TEXT_X        (10)
+#define VOLTMETER_TEXT_Y        (58)
+#define VOLTMETER_TEXT_CHARS    (21)
+#define VOLTMETER_TEXT_HEIGHT   (18)
 
-#define MENU_LOW_LEVEL_VALUE_V      (1.0f)
-#define MENU_HIGH_LEVEL_VALUE_V     (2.0f)
 #define MENU_MAX_LEVEL_VALUE_V      (5.0f)
 
 uint8_t charge_status_flag = 3;
 
+extern volatile uint32_t ms_tick;
+
+//Time of the last partial redraw, ms
+uint32_t menu_redraw_timestamp = 0;
+
+//Drawn values of the dynamic layer, it is redrawn only when they are changed
+uint8_t menu_drawn_signal_state = 0xFF;//0xFF - not drawn
+uint16_t menu_drawn_bar_fill_x = 0xFFFF;
+menu_probe_text_view_t menu_drawn_probe_text;
+menu_big_voltage_view_t menu_drawn_big_voltage;
+menu_voltmeter_text_view_t menu_drawn_voltmeter_text;
+menu_freq_meter_view_t menu_drawn_freq_meter;
+uint8_t menu_drawn_charge_status = 0xFF;
+
 
 /* Private function prototypes -----------------------------------------------*/
 void menu_draw_logic_probe_menu(menu_draw_type_t draw_type);
@@ -36,7 +102,10 @@ void menu_print_current_frequency(char* str);
 void menu_baud_meter_menu(menu_draw_type_t draw_type);
 void menu_freq_meter_upper_button_pressed(void);
 void draw_not_supportd(void);//to delete
+void menu_draw_voltage_bar_frame(void);
 void menu_draw_voltage_bar(float meas_avr_voltage_v);
+void menu_draw_logic_probe_state(signal_state_t signal_state);
+void menu_draw_glitch_info(void);
 uint16_t menu_draw_get_bar_horiz_value_pix(float voltage_v);
 
 /* Private functions ---------------------------------------------------------*/
@@ -45,6 +114,17 @@ void menu_charge_status( uint8_t status) {
   charge_status_flag = status;
 }  
 
+// Compare view model with the drawn one, view becomes the drawn one
+// Return 1 if view is changed - screen must be redrawn
+// Unused bytes of the view must be cleared before the call
+uint8_t menu_view_changed(void* drawn_view, const void* view, uint16_t size)
+{
+  if (memcmp(drawn_view, view, size) == 0)
+    return 0;
+  memcpy(drawn_view, view, size);
+  return 1;
+}
+
 void menu_main_init(void)
 {
   data_processing_main_mode_changed();
@@ -72,6 +152,14 @@ void menu_lower_button_hold(void)
       menu_selector_lower_button_hold();
       break;
     
+    case MENU_MODE_SLOW_SCOPE:
+      slow_scope_lower_button_hold();
+      break;
+    
+    case MENU_MODE_SEGMENTED:
+      segmented_lower_button_hold();
+      break;
+    
     default: break;
   }
 }
@@ -88,6 +176,38 @@ void menu_upper_button_pressed(void)
       slow_scope_upper_button_pressed();
       break;
     
+    case MENU_MODE_SPECTRUM:
+      spectrum_upper_button_pressed();
+      break;
+    
+    case MENU_MODE_ETS:
+      ets_upper_button_pressed();
+      break;
+    
+    case MENU_MODE_LOGIC_ANALYZER:
+      logic_analyzer_upper_button_pressed();
+      break;
+    
+    case MENU_MODE_SEGMENTED:
+      segmented_upper_button_pressed();
+      break;
+    
+    case MENU_MODE_AVERAGE:
+      average_upper_button_pressed();
+      break;
+    
+    case MENU_MODE_PERSISTENCE:
+      persistence_upper_button_pressed();
+      break;
+    
+    case MENU_MODE_HISTOGRAM:
+      histogram_upper_button_pressed();
+      break;
+    
+    case MENU_MODE_LOGIC_PROBE:
+      glitch_catcher_reset();
+      break;
+    
     case MENU_SELECTOR:
       menu_selector_upper_button_pressed();
       break;
@@ -104,6 +224,26 @@ void menu_upper_button_hold(void)
       menu_selector_upper_button_hold();
       break;
     
+    case MENU_MODE_SLOW_SCOPE:
+      slow_scope_upper_button_hold();
+      break;
+    
+    case MENU_MODE_LOGIC_ANALYZER:
+      logic_analyzer_upper_button_hold();
+      break;
+    
+    case MENU_MODE_SEGMENTED:
+      segmented_upper_button_hold();
+      break;
+    
+    case MENU_MODE_AVERAGE:
+      average_upper_button_hold();
+      break;
+    
+    case MENU_MODE_PERSISTENCE:
+      persistence_upper_button_hold();
+      break;
+    
     default: break;
   }
 }
@@ -124,12 +264,26 @@ void menu_main_switch_to_next_mode(void)
 void menu_redraw_display(menu_draw_type_t draw_type)
 {
   if ( charge_status_flag < 3 ) {
-    main_menu_mode = MENU_MODE_CHARGE;
+    if ( main_menu_mode != MENU_MODE_CHARGE ) {
+      main_menu_mode = MENU_MODE_CHARGE;
+      data_processing_main_mode_changed();//release mode buffers
+      draw_type = MENU_MODE_FULL_REDRAW;
+    }
   } else if ( main_menu_mode == MENU_MODE_CHARGE ) {
    display_clear_framebuffer();
    main_menu_mode = MENU_MODE_LOGIC_PROBE;
+   data_processing_main_mode_changed();
+   draw_type = MENU_MODE_FULL_REDRAW;
   }
   
+  //Full redraw is done at once, partial redraw is limited by frame rate
+  if (draw_type == MENU_MODE_PARTIAL_REDRAW)
+  {
+    if ((ms_tick - menu_redraw_timestamp) < MENU_REDRAW_MIN_PERIOD_MS)
+      return;
+  }
+  menu_redraw_timestamp = ms_tick;
+  
   switch (main_menu_mode)
   {
     case MENU_MODE_LOGIC_PROBE:
@@ -148,6 +302,34 @@ void menu_redraw_display(menu_draw_type_t draw_type)
       slow_scope_draw_menu(draw_type);
     break;
     
+    case MENU_MODE_SPECTRUM:
+      spectrum_draw_menu(draw_type);
+    break;
+    
+    case MENU_MODE_ETS:
+      ets_draw_menu(draw_type);
+    break;
+    
+    case MENU_MODE_LOGIC_ANALYZER:
+      logic_analyzer_draw_menu(draw_type);
+    break;
+    
+    case MENU_MODE_SEGMENTED:
+      segmented_draw_menu(draw_type);
+    break;
+    
+    case MENU_MODE_AVERAGE:
+      average_draw_menu(draw_type);
+    break;
+    
+    case MENU_MODE_PERSISTENCE:
+      persistence_draw_menu(draw_type);
+    break;
+    
+    case MENU_MODE_HISTOGRAM:
+      histogram_draw_menu(draw_type);
+    break;
+    
     case MENU_SELECTOR:
       menu_selector_draw(draw_type);
     break;
@@ -170,110 +352,194 @@ void draw_not_supportd(void) //to delete
 }
 
 
+// Static layer: title, voltage bar frame and threshold markers
+// Dynamic layer: state text, bar fill and bottom text lines
 void menu_draw_logic_probe_menu(menu_draw_type_t draw_type)
 {
-  if (draw_type == MENU_MODE_FULL_REDRAW)
+  if ((draw_type == MENU_MODE_FULL_REDRAW) || (display_layers_background_valid() == 0))
   {
-    display_clear_framebuffer();
+    display_layers_begin_background();
     display_draw_string("LOGIC PROBE MODE", 30, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    menu_draw_voltage_bar_frame();
+    display_layers_store_background();
+    menu_drawn_signal_state = 0xFF;
+    menu_drawn_bar_fill_x = 0xFFFF;
+    memset(&menu_drawn_probe_text, 0, sizeof(menu_drawn_probe_text));
     display_update();
   }
   else //PARTIAL update
   {
-    if (data_processing_state == PROCESSING_DATA_DONE)
-    {
-      data_processing_start_new_capture();
-      return;
-    }
+    menu_probe_text_view_t view;
+    acq_result_t result;
     
-    char tmp_str[32];
-    if (data_processing_state != PROCESSING_IDLE)
+    //Redraw only when new capture is processed
+    if (acquisition_mailbox_get_last(&result))
     {
-      switch (logic_probe_signal_state)
-      {
-      case SIGNAL_TYPE_Z_STATE:
-        display_draw_string("Z STATE", 0, 17, FONT_SIZE_33, 0, COLOR_WHITE);
-        break;
-      case SIGNAL_TYPE_LOW_STATE:
-        display_draw_string("  LOW  ", 0, 17, FONT_SIZE_33, 0, COLOR_WHITE);
-        break;
-      case SIGNAL_TYPE_HIGH_STATE:
-        display_draw_string("  HIGH ", 0, 17, FONT_SIZE_33, 0, COLOR_WHITE);
-        break;
-      case SIGNAL_TYPE_PULSED_STATE:
-        display_draw_string(" PULSE ", 0, 17, FONT_SIZE_33, 0, COLOR_WHITE);
-        break;
-      case SIGNAL_TYPE_UNKNOWN_STATE:
-        display_draw_string("UNKNOWN", 0, 17, FONT_SIZE_33, 0, COLOR_WHITE);
-        break;
-      default: break;
-      }
+      if (result.signal_state != menu_drawn_signal_state)
+        menu_draw_logic_probe_state(result.signal_state);
       
       //Draw voltage when input voltage is stable
-      if ((logic_probe_signal_state == SIGNAL_TYPE_LOW_STATE) || 
-          (logic_probe_signal_state == SIGNAL_TYPE_HIGH_STATE) ||
-          (logic_probe_signal_state == SIGNAL_TYPE_UNKNOWN_STATE))
+      memset(&view, 0, sizeof(view));
+      if ((result.signal_state == SIGNAL_TYPE_LOW_STATE) || 
+          (result.signal_state == SIGNAL_TYPE_HIGH_STATE) ||
+          (result.signal_state == SIGNAL_TYPE_UNKNOWN_STATE))
       {
-        menu_print_big_voltage(tmp_str, voltmeter_voltage);
-        display_draw_string(tmp_str, 55, 63, FONT_SIZE_11, 0, COLOR_WHITE);
+        menu_print_big_voltage(view.line1, result.voltage);
+        view.big_font = 1;
       }
-      else
+      else if (result.signal_state == SIGNAL_TYPE_PULSED_STATE)
       {
-        display_draw_string("        ", 55, 63, FONT_SIZE_11, 0, COLOR_WHITE);
+        snprintf(view.line1, sizeof(view.line1), 
+          "AVG%5.2f RMS%5.2f", result.ac.mean, result.ac.rms);
+        snprintf(view.line2, sizeof(view.line2), 
+          "VPP%5.2f CF%4.1f", result.ac.vpp, result.ac.crest_factor);
       }
+      view.glitch_count = glitch_catcher_get_count();
+      view.glitch_width_ns = glitch_catcher_get_min_width_ns();
       
-      menu_draw_voltage_bar(voltmeter_voltage);
-
-      display_update();
+      if (menu_view_changed(&menu_drawn_probe_text, &view, sizeof(view)))
+      {
+        display_layers_restore_rect(
+          0, LOGIC_PROBE_TEXT_Y, DISPLAY_WIDTH, LOGIC_PROBE_TEXT_HEIGHT);
+        if (view.big_font)
+        {
+          display_draw_string(view.line1, 55, 63, FONT_SIZE_11, 0, COLOR_WHITE);
+        }
+        else
+        {
+          display_draw_string(view.line1, 55, 63, FONT_SIZE_8, 0, COLOR_WHITE);
+          display_draw_string(view.line2, 55, 72, FONT_SIZE_8, 0, COLOR_WHITE);
+        }
+        menu_draw_glitch_info();
+      }
       
+      menu_draw_voltage_bar(result.voltage);
+      display_layers_flush();
     }
   }
 }
 
+void menu_draw_logic_probe_state(signal_state_t signal_state)
+{
+  display_layers_restore_rect(0, LOGIC_PROBE_STATE_Y, DISPLAY_WIDTH, FONT_SIZE_33);
+  switch (signal_state)
+  {
+  case SIGNAL_TYPE_Z_STATE:
+    display_draw_string("Z STATE", 0, LOGIC_PROBE_STATE_Y, FONT_SIZE_33, 0, COLOR_WHITE);
+    break;
+  case SIGNAL_TYPE_LOW_STATE:
+    display_draw_string("  LOW  ", 0, LOGIC_PROBE_STATE_Y, FONT_SIZE_33, 0, COLOR_WHITE);
+    break;
+  case SIGNAL_TYPE_HIGH_STATE:
+    display_draw_string("  HIGH ", 0, LOGIC_PROBE_STATE_Y, FONT_SIZE_33, 0, COLOR_WHITE);
+    break;
+  case SIGNAL_TYPE_PULSED_STATE:
+    display_draw_string(" PULSE ", 0, LOGIC_PROBE_STATE_Y, FONT_SIZE_33, 0, COLOR_WHITE);
+    break;
+  case SIGNAL_TYPE_UNKNOWN_STATE:
+    display_draw_string("UNKNOWN", 0, LOGIC_PROBE_STATE_Y, FONT_SIZE_33, 0, COLOR_WHITE);
+    break;
+  default: break;
+  }
+  menu_drawn_signal_state = signal_state;
+}
+
+// Glitch catcher results - stay on screen until upper button is pressed
+// Text rectangle must be restored before the call
+void menu_draw_glitch_info(void)
+{
+  char tmp_str[16];
+  char width_str[8];
+  uint32_t count = glitch_catcher_get_count();
+  
+  if (count == 0)
+    return;
+  
+  if (count > 9999)
+    count = 9999;
+  sprintf(tmp_str, "GL:%-5lu", count);
+  display_draw_string(tmp_str, 0, 63, FONT_SIZE_8, 0, COLOR_RED);
+  
+  uint32_t width_ns = glitch_catcher_get_min_width_ns();
+  if (width_ns == GLITCH_WIDTH_UNKNOWN)
+    sprintf(width_str, "<1us");
+  else if (width_ns < 1000)
+    sprintf(width_str, "%luns", width_ns);
+  else
+    sprintf(width_str, "%luus", width_ns / 1000);
+  sprintf(tmp_str, "W:%-6s", width_str);
+  display_draw_string(tmp_str, 0, 72, FONT_SIZE_8, 0, COLOR_RED);
+}
+
+// Static part of the bar - outline and threshold markers
+void menu_draw_voltage_bar_frame(void)
+{
+  uint16_t start_y = VOLTAGE_BAR_START_Y;
+  float low_level_v;
+  float high_level_v;
+  
+  //Thresholds of the selected logic family
+  data_processing_get_logic_thresholds(&low_level_v, &high_level_v);
+  
+  display_draw_vertical_line(menu_draw_get_bar_horiz_value_pix(low_level_v), 
+    start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//low
+  
+  display_draw_vertical_line(menu_draw_get_bar_horiz_value_pix(high_level_v), 
+    start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//high
+  
+  display_draw_line(start_y, COLOR_WHITE);//upper line
+  display_draw_line(start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//lower line
+  display_draw_vertical_line(
+    0, start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//left
+  display_draw_vertical_line(
+    LCD_RIGHT_OFFSET, start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//right
+}
+
+// Bar fill is redrawn only when its length is changed
+// Threshold marker columns are kept from the static layer
 void menu_draw_voltage_bar(float meas_avr_voltage_v)
 {
-  uint16_t start_y = 51;
+  uint16_t start_y = VOLTAGE_BAR_START_Y + 1;
+  uint16_t fill_x = 0;//last filled column
+  
+  if (meas_avr_voltage_v >= MENU_MAX_LEVEL_VALUE_V)
+    fill_x = LCD_RIGHT_OFFSET - 1;
+  else if (meas_avr_voltage_v > 0.0f)
+    fill_x = menu_draw_get_bar_horiz_value_pix(meas_avr_voltage_v);
+  
+  if (fill_x == menu_drawn_bar_fill_x)
+    return;
+  menu_drawn_bar_fill_x = fill_x;
+  
+  float low_level_v;
+  float high_level_v;
+  data_processing_get_logic_thresholds(&low_level_v, &high_level_v);
   
   uint16_t low_x_offset_pix = 
-    menu_draw_get_bar_horiz_value_pix(MENU_LOW_LEVEL_VALUE_V);
+    menu_draw_get_bar_horiz_value_pix(low_level_v);
   uint16_t hight_x_offset_pix = 
-    menu_draw_get_bar_horiz_value_pix(MENU_HIGH_LEVEL_VALUE_V);
+    menu_draw_get_bar_horiz_value_pix(high_level_v);
   
+  display_layers_restore_rect(1, start_y, LCD_RIGHT_OFFSET - 1, VOLTAGE_BAR_HEIGHT - 1);
   
   uint8_t color = 0;
-  for (uint16_t x = 0; x < LCD_RIGHT_OFFSET; x++)
+  for (uint16_t x = 1; x <= fill_x; x++)
   {
-    if (x < low_x_offset_pix)
+    if ((x == low_x_offset_pix) || (x == hight_x_offset_pix))
+      continue;
+    
+    if ((x % 2) != 0)
+      color = COLOR_GRAY;
+    else if (x < low_x_offset_pix)
       color = COLOR_BLUE;
     else if (x < hight_x_offset_pix)
       color = COLOR_YELLOW;
     else
       color = COLOR_RED;
-    
-    if ((x % 2) != 0)
-      color = COLOR_GRAY;
-    
-    float horiz_volatge = (float)x * MENU_MAX_LEVEL_VALUE_V / (float)LCD_RIGHT_OFFSET;
-    if (horiz_volatge > meas_avr_voltage_v)
-      color = COLOR_BLACK;
       
     display_draw_vertical_line(
-        x, start_y, start_y + VOLTAGE_BAR_HEIGHT, color);//low
+        x, start_y, start_y + VOLTAGE_BAR_HEIGHT - 2, color);
   }
-  
-
-  display_draw_vertical_line(
-    low_x_offset_pix, start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//low
-  
-  display_draw_vertical_line(
-    hight_x_offset_pix, start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//low
-  
-  display_draw_line(start_y, COLOR_WHITE);//upper line
-  display_draw_line(start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//lower line
-  display_draw_vertical_line(
-    0, start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//left
-  display_draw_vertical_line(
-    LCD_RIGHT_OFFSET, start_y, start_y + VOLTAGE_BAR_HEIGHT, COLOR_WHITE);//right
 }
 
 //Return value in hoziz pixels
@@ -284,31 +550,56 @@ uint16_t menu_draw_get_bar_horiz_value_pix(float voltage_v)
 }
 
 //*****************************************************************************
+// Big voltage is redrawn only when its text is changed
 void menu_draw_voltmeter_menu(menu_draw_type_t draw_type)
 {
-  if (draw_type == MENU_MODE_FULL_REDRAW)
+  if ((draw_type == MENU_MODE_FULL_REDRAW) || (display_layers_background_valid() == 0))
   {
-    display_clear_framebuffer();
+    display_layers_begin_background();
     display_draw_string("VOLTMETER MODE", 40, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
+    display_layers_store_background();
+    memset(&menu_drawn_big_voltage, 0, sizeof(menu_drawn_big_voltage));
+    memset(&menu_drawn_voltmeter_text, 0, sizeof(menu_drawn_voltmeter_text));
     display_update();
   }
   else //PARTIAL update
   {
-    if (data_processing_state == PROCESSING_DATA_DONE)
-    {
-      data_processing_start_new_capture();
-      return;
-    }
+    acq_result_t result;
     
-    if (data_processing_state != PROCESSING_IDLE)
+    if (acquisition_mailbox_get_last(&result))
     {
-      char tmp_str[32];
-      menu_print_big_voltage(tmp_str, voltmeter_voltage);
-      if (voltmeter_voltage < 28)
-        display_draw_string(tmp_str, 20, 20, FONT_SIZE_33, 0, COLOR_WHITE);
-      else
-        display_draw_string(tmp_str, 20, 20, FONT_SIZE_33, 0, COLOR_RED);//Inaccurate
-      display_update();
+      menu_big_voltage_view_t big_view;
+      menu_voltmeter_text_view_t text_view;
+      
+      memset(&big_view, 0, sizeof(big_view));
+      menu_print_big_voltage(big_view.text, result.voltage);
+      big_view.color = COLOR_WHITE;
+      if (result.voltage >= 28)
+        big_view.color = COLOR_RED;//Inaccurate
+      
+      if (menu_view_changed(&menu_drawn_big_voltage, &big_view, sizeof(big_view)))
+      {
+        display_layers_restore_rect(VOLTMETER_BIG_X, VOLTMETER_BIG_Y, 
+          VOLTMETER_BIG_CHARS * FONT_SIZE_33_WIDTH, FONT_SIZE_33);
+        display_draw_string(big_view.text, 
+          VOLTMETER_BIG_X, VOLTMETER_BIG_Y, FONT_SIZE_33, 0, big_view.color);
+      }
+      
+      //AC parameters of the same capture
+      memset(&text_view, 0, sizeof(text_view));
+      snprintf(text_view.rms_line, sizeof(text_view.rms_line), 
+        "RMS%6.02fV  AC%6.02fV", result.ac.rms, result.ac.ac_rms);
+      snprintf(text_view.vpp_line, sizeof(text_view.vpp_line), 
+        "VPP%6.02fV  CF%6.02f ", result.ac.vpp, result.ac.crest_factor);
+      
+      if (menu_view_changed(&menu_drawn_voltmeter_text, &text_view, sizeof(text_view)))
+      {
+        display_layers_restore_rect(VOLTMETER_TEXT_X, VOLTMETER_TEXT_Y, 
+          VOLTMETER_TEXT_CHARS * FONT_SIZE_8_WIDTH, VOLTMETER_TEXT_HEIGHT);
+        display_draw_string(text_view.rms_line, VOLTMETER_TEXT_X, 58, FONT_SIZE_8, 0, COLOR_WHITE);
+        display_draw_string(text_view.vpp_line, VOLTMETER_TEXT_X, 68, FONT_SIZE_8, 0, COLOR_WHITE);
+      }
+      display_layers_flush();
     }
     
     //voltmeter_voltage
@@ -317,13 +608,19 @@ void menu_draw_voltmeter_menu(menu_draw_type_t draw_type)
 }
 
 //*****************************************************************************
+// View model is the charge status, screen is static between its changes
 void menu_draw_charge_menu(menu_draw_type_t draw_type)
 {
+  uint8_t status = (charge_status_flag == 1);
+  
+  if ((draw_type == MENU_MODE_PARTIAL_REDRAW) && (status == menu_drawn_charge_status))
+    return;
+  menu_drawn_charge_status = status;
 
   display_clear_framebuffer();
   display_draw_string("CHARGE BATTERY", 40, 0, FONT_SIZE_8, 0, COLOR_YELLOW);
 
-  if ( charge_status_flag == 1 ) {
+  if ( status ) {
     display_draw_string("100%", 35, 30, FONT_SIZE_33, 0, COLOR_GREEN);
     display_update();
   } else {
@@ -366,22 +663,28 @@ void menu_draw_frequency_meter_menu(menu_draw_type_t draw_type)
       display_draw_string("UNKNOWN", 0, 20, FONT_SIZE_33, 0, COLOR_WHITE);
     }
     
+    memset(&menu_drawn_freq_meter, 0, sizeof(menu_drawn_freq_meter));
     display_update();
   }
   else //PARTIAL update
   {
     if (freq_measurement_state == FREQ_MEASUREMENT_PROCESSING_DATA_DONE)
     {
-      char tmp_str[32];
+      menu_freq_meter_view_t view;
       if (freq_meter_calib_state == FREQ_METER_CALIB_IDLE)//normal working
       {
-        menu_print_current_frequency(tmp_str);
-        display_draw_string(tmp_str, 0, 20, FONT_SIZE_33, 0, COLOR_WHITE);
-        
-        sprintf(tmp_str, "LEVEL: %.02f V", freq_comparator_threshold_v);
-        display_draw_string(tmp_str, 30, 65, FONT_SIZE_11, 0, COLOR_WHITE);
+        memset(&view, 0, sizeof(view));
+        menu_print_current_frequency(view.frequency);
+        snprintf(view.level, sizeof(view.level), 
+          "LEVEL: %.02f V", freq_comparator_threshold_v);
         
-        display_update();
+        //Same frequency is not sent to the display again
+        if (menu_view_changed(&menu_drawn_freq_meter, &view, sizeof(view)))
+        {
+          display_draw_string(view.frequency, 0, 20, FONT_SIZE_33, 0, COLOR_WHITE);
+          display_draw_string(view.level, 30, 65, FONT_SIZE_11, 0, COLOR_WHITE);
+          display_update_rect(0, 20, DISPLAY_WIDTH, DISPLAY_HEIGHT - 20);
+        }
         
         freq_measurement_start_freq_capture();
       }
@@ -426,6 +729,19 @@ void menu_print_big_voltage(char* str, float voltage)
     sprintf(str, "%.01fV ", voltage);
 }
 
+// time - seconds, printed with units
+void menu_print_time(char* str, float time)
+{
+  if (time < 1e-6f)
+    sprintf(str, "%luns", (uint32_t)(time * 1e9f + 0.5f));
+  else if (time < 1e-3f)
+    sprintf(str, "%.2fus", time * 1e6f);
+  else if (time < 1.0f)
+    sprintf(str, "%.2fms", time * 1e3f);
+  else
+    sprintf(str, "%.2fs", time);
+}
+
 // Shift null-terminated string to right corner
 // max_size - max size of the string
 void menu_shift_string_right(char* str, uint8_t max_size)
@@ -14,6 +14,9 @@
 // Delay in ms after calibration is done
 #define FREQ_METER_DONE_WAIT_DELAY              (2000)
 
+// Minimum period of the partial redraw, ms - display frame rate cap
+#define MENU_REDRAW_MIN_PERIOD_MS               (40)
+
 typedef enum
 {
   MENU_MODE_FULL_REDRAW = 0,
@@ -26,6 +29,13 @@ typedef enum
   MENU_MODE_VOLTMETER,
   MENU_MODE_FREQUENCY_METER,
   MENU_MODE_SLOW_SCOPE,
+  MENU_MODE_SPECTRUM,
+  MENU_MODE_ETS,
+  MENU_MODE_LOGIC_ANALYZER,
+  MENU_MODE_SEGMENTED,
+  MENU_MODE_AVERAGE,
+  MENU_MODE_PERSISTENCE,
+  MENU_MODE_HISTOGRAM,
   MENU_SELECTOR,
   MENU_MODE_COUNT,//LAST!
   MENU_MODE_CHARGE,  
@@ -53,7 +63,9 @@ void menu_shift_string_right(char* str, uint8_t max_size);
 void menu_upper_button_hold(void);
 void menu_lower_button_hold(void);
 void menu_print_big_voltage(char* str, float voltage);
+void menu_print_time(char* str, float time);
 void menu_charge_status( uint8_t status);
+uint8_t menu_view_changed(void* drawn_view, const void* view, uint16_t size);
 
 #endif /* __MENU_CONTROLLING_H */
 
@@ -0,0 +1,283 @@
+//Append-only data log in the flash sectors below NVRAM sector.
+//Sectors are used as a ring, every sector starts with a header with sequence
+//number, so the written sector is found by scanning headers after power cycle.
+//Sector after the written one is erased ahead of time, so log never waits
+//for erase when it moves to the next sector.
+//Every record has CRC from hardware CRC unit - record that was torn
+//by power loss is skipped by "flash_log_read".
+//Records are collected to a batch, all flash programming and erasing
+//is done by "flash_log_handler" from the main loop.
+
+/* Includes ------------------------------------------------------------------*/
+#include "flash_log.h"
+#include "acquisition.h"
+#include "main.h"
+#include "string.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define FLASH_LOG_MAGIC                 (0x31474F4C)//"LOG1"
+
+#define FLASH_LOG_ERASED_WORD           (0xFFFFFFFF)
+
+// Records are written to flash when batch is full
+#define FLASH_LOG_BATCH_CNT             (4)
+
+// Max time of the sector erase, us
+#define FLASH_LOG_ERASE_TIME_US         (40000)
+
+// Number of 32-bit words covered by CRC
+#define FLASH_LOG_HEADER_CRC_WORDS      ((sizeof(flash_log_header_t) / 4) - 1)
+#define FLASH_LOG_RECORD_CRC_WORDS      ((sizeof(flash_log_record_t) / 4) - 1)
+
+/* Private macro -------------------------------------------------------------*/
+#define FLASH_LOG_SECTOR_ADDR(idx)      \
+  (FLASH_BASE + (uint32_t)(FLASH_LOG_FIRST_SECTOR + (idx)) * FLASH_SECTOR_SIZE)
+
+#define FLASH_LOG_RECORD_ADDR(idx, slot) (FLASH_LOG_SECTOR_ADDR(idx) + \
+  sizeof(flash_log_header_t) + (uint32_t)(slot) * sizeof(flash_log_record_t))
+
+/* Private variables ---------------------------------------------------------*/
+extern volatile uint32_t ms_tick;
+
+uint8_t flash_log_sector = 0;//written sector, index in the log
+uint16_t flash_log_write_idx = 0;//next free record slot of the written sector
+uint32_t flash_log_sequence = 0;//sequence of the written sector, 0 - log is empty
+uint8_t flash_log_full_sectors = 0;//number of full sectors before the written one
+
+//Sector after the written one must be erased
+uint8_t flash_log_erase_pending = 0;
+
+uint16_t flash_log_session = 0;
+uint32_t flash_log_start_time = 0;//ms_tick value
+uint8_t flash_log_recording = 0;
+
+flash_log_record_t flash_log_batch[FLASH_LOG_BATCH_CNT];
+uint8_t flash_log_batch_cnt = 0;
+uint8_t flash_log_flush_flag = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+uint8_t flash_log_check_header(uint8_t sector, flash_log_header_t* header);
+uint8_t flash_log_sector_is_erased(uint8_t sector);
+void flash_log_open_next_sector(void);
+void flash_log_write_batch(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+// Find written sector and free slot after power on
+void flash_log_init(void)
+{
+  flash_log_header_t header;
+
+  flash_log_sequence = 0;
+  for (uint8_t i = 0; i < FLASH_LOG_SECTORS_CNT; i++)
+  {
+    if (flash_log_check_header(i, &header) && (header.sequence > flash_log_sequence))
+    {
+      flash_log_sequence = header.sequence;
+      flash_log_sector = i;
+    }
+  }
+
+  if (flash_log_sequence == 0)
+  {
+    //Log is empty, first record opens sector 0
+    flash_log_sector = FLASH_LOG_SECTORS_CNT - 1;
+    flash_log_write_idx = FLASH_LOG_RECORDS_PER_SECTOR;
+    flash_log_full_sectors = 0;
+    return;
+  }
+
+  //Free slot is placed after the last programmed slot
+  flash_log_write_idx = 0;
+  for (uint16_t slot = 0; slot < FLASH_LOG_RECORDS_PER_SECTOR; slot++)
+  {
+    const uint32_t* words = (const uint32_t*)FLASH_LOG_RECORD_ADDR(flash_log_sector, slot);
+    for (uint8_t i = 0; i < (sizeof(flash_log_record_t) / 4); i++)
+    {
+      if (words[i] != FLASH_LOG_ERASED_WORD)
+      {
+        flash_log_write_idx = slot + 1;
+        break;
+      }
+    }
+  }
+
+  //Count previous sectors of the same ring pass
+  flash_log_full_sectors = 0;
+  while (flash_log_full_sectors < (FLASH_LOG_SECTORS_CNT - 2))
+  {
+    uint8_t sector = (flash_log_sector + FLASH_LOG_SECTORS_CNT -
+      flash_log_full_sectors - 1) % FLASH_LOG_SECTORS_CNT;
+    if ((flash_log_check_header(sector, &header) == 0) ||
+        (header.sequence != (flash_log_sequence - flash_log_full_sectors - 1)))
+      break;
+    flash_log_full_sectors++;
+  }
+
+  flash_log_record_t record;
+  if (flash_log_read(0, &record))
+    flash_log_session = record.session;
+
+  flash_log_erase_pending =
+    !flash_log_sector_is_erased((flash_log_sector + 1) % FLASH_LOG_SECTORS_CNT);
+}
+
+// Called from the main loop, does one flash operation per call
+// Sector erase stops flash access for tens of ms, it is done once per sector.
+// Interrupts are not masked during erase, and erase is started only when
+// it fits into the running capture - next capture is started without delay.
+void flash_log_handler(void)
+{
+  if (flash_log_erase_pending && acquisition_is_flash_free(FLASH_LOG_ERASE_TIME_US))
+  {
+    flash_log_erase_pending = 0;
+    flash_erase_sector_background(FLASH_LOG_FIRST_SECTOR +
+      (flash_log_sector + 1) % FLASH_LOG_SECTORS_CNT);
+    return;
+  }
+
+  if ((flash_log_batch_cnt >= FLASH_LOG_BATCH_CNT) ||
+      (flash_log_flush_flag && (flash_log_batch_cnt > 0)))
+  {
+    flash_log_write_batch();
+  }
+  flash_log_flush_flag = 0;
+}
+
+// Start new session, time of the records is counted from now
+void flash_log_start(void)
+{
+  flash_log_session++;
+  flash_log_start_time = ms_tick;
+  flash_log_batch_cnt = 0;
+  flash_log_recording = 1;
+}
+
+// Collected records are written by the next "flash_log_handler" call
+void flash_log_stop(void)
+{
+  flash_log_recording = 0;
+  flash_log_flush_flag = 1;
+}
+
+uint8_t flash_log_is_recording(void)
+{
+  return flash_log_recording;
+}
+
+void flash_log_append(uint16_t min_value, uint16_t max_value, uint16_t avg_value)
+{
+  if ((flash_log_recording == 0) || (flash_log_batch_cnt >= FLASH_LOG_BATCH_CNT))
+    return;//batch is not written yet - record is lost
+
+  flash_log_record_t* record = &flash_log_batch[flash_log_batch_cnt];
+  record->time_s = (ms_tick - flash_log_start_time) / 1000;
+  record->session = flash_log_session;
+  record->min_value = min_value;
+  record->max_value = max_value;
+  record->avg_value = avg_value;
+  record->crc = flash_calc_crc((uint32_t*)record, FLASH_LOG_RECORD_CRC_WORDS);
+  flash_log_batch_cnt++;
+}
+
+// Number of records in flash
+uint16_t flash_log_get_count(void)
+{
+  if (flash_log_sequence == 0)
+    return 0;
+  return flash_log_full_sectors * FLASH_LOG_RECORDS_PER_SECTOR + flash_log_write_idx;
+}
+
+// Read record from flash, idx 0 - newest record
+// Return 1 if record is valid
+uint8_t flash_log_read(uint16_t idx, flash_log_record_t* record)
+{
+  if (idx >= flash_log_get_count())
+    return 0;
+
+  uint8_t sector = flash_log_sector;
+  uint16_t slot;
+  if (idx < flash_log_write_idx)
+  {
+    slot = flash_log_write_idx - 1 - idx;
+  }
+  else
+  {
+    idx -= flash_log_write_idx;
+    sector = (sector + FLASH_LOG_SECTORS_CNT - 1 -
+      idx / FLASH_LOG_RECORDS_PER_SECTOR) % FLASH_LOG_SECTORS_CNT;
+    slot = FLASH_LOG_RECORDS_PER_SECTOR - 1 - idx % FLASH_LOG_RECORDS_PER_SECTOR;
+  }
+
+  flash_read(FLASH_LOG_RECORD_ADDR(sector, slot), (uint8_t*)record, sizeof(flash_log_record_t));
+  return (record->crc == flash_calc_crc((uint32_t*)record, FLASH_LOG_RECORD_CRC_WORDS));
+}
+
+//*****************************************************************************
+
+// Write collected records, sector is changed when it is full
+void flash_log_write_batch(void)
+{
+  uint8_t pos = 0;
+  while (pos < flash_log_batch_cnt)
+  {
+    if (flash_log_write_idx >= FLASH_LOG_RECORDS_PER_SECTOR)
+      flash_log_open_next_sector();
+
+    uint16_t cnt = FLASH_LOG_RECORDS_PER_SECTOR - flash_log_write_idx;
+    if (cnt > (flash_log_batch_cnt - pos))
+      cnt = flash_log_batch_cnt - pos;
+
+    flash_write(FLASH_LOG_RECORD_ADDR(flash_log_sector, flash_log_write_idx),
+      (uint8_t*)&flash_log_batch[pos], cnt * sizeof(flash_log_record_t));
+    flash_log_write_idx += cnt;
+    pos += cnt;
+  }
+  flash_log_batch_cnt = 0;
+}
+
+// Next sector is already erased by "flash_log_handler",
+// it is checked only for the case of power loss before erase or when
+// there was no capture window for the erase; interrupts are not masked here too
+void flash_log_open_next_sector(void)
+{
+  uint8_t next_sector = (flash_log_sector + 1) % FLASH_LOG_SECTORS_CNT;
+  if (flash_log_sector_is_erased(next_sector) == 0)
+    flash_erase_sector_background(FLASH_LOG_FIRST_SECTOR + next_sector);
+
+  if ((flash_log_sequence != 0) && (flash_log_full_sectors < (FLASH_LOG_SECTORS_CNT - 2)))
+    flash_log_full_sectors++;
+
+  flash_log_header_t header;
+  header.magic = FLASH_LOG_MAGIC;
+  header.sequence = flash_log_sequence + 1;
+  header.reserved = FLASH_LOG_ERASED_WORD;
+  header.crc = flash_calc_crc((uint32_t*)&header, FLASH_LOG_HEADER_CRC_WORDS);
+  flash_write(FLASH_LOG_SECTOR_ADDR(next_sector), (uint8_t*)&header, sizeof(header));
+
+  flash_log_sequence = header.sequence;
+  flash_log_sector = next_sector;
+  flash_log_write_idx = 0;
+  flash_log_erase_pending = 1;//oldest sector of the ring
+}
+
+// Return 1 if sector has valid header
+uint8_t flash_log_check_header(uint8_t sector, flash_log_header_t* header)
+{
+  flash_read(FLASH_LOG_SECTOR_ADDR(sector), (uint8_t*)header, sizeof(flash_log_header_t));
+  if (header->magic != FLASH_LOG_MAGIC)
+    return 0;
+  return (header->crc == flash_calc_crc((uint32_t*)header, FLASH_LOG_HEADER_CRC_WORDS));
+}
+
+uint8_t flash_log_sector_is_erased(uint8_t sector)
+{
+  const uint32_t* words = (const uint32_t*)FLASH_LOG_SECTOR_ADDR(sector);
+  for (uint16_t i = 0; i < (FLASH_SECTOR_SIZE / 4); i++)
+  {
+    if (words[i] != FLASH_LOG_ERASED_WORD)
+      return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,57 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FLASH_LOG_H
+#define __FLASH_LOG_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f30x.h"
+#include "config.h"
+#include "stm32f3_flash.h"
+#include "nvram.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;//incremented for every opened sector
+  uint32_t reserved;
+  uint32_t crc;
+} flash_log_header_t;
+
+// Values are stored in units of the writer
+// "crc" is calculated by hardware CRC unit from all other fields
+typedef struct
+{
+  uint32_t time_s;//seconds from session start
+  uint16_t session;//incremented by "flash_log_start"
+  uint16_t min_value;
+  uint16_t max_value;
+  uint16_t avg_value;
+  uint32_t crc;
+} flash_log_record_t;
+
+/* Exported constants --------------------------------------------------------*/
+// Log sectors are placed just below NVRAM sector, linker file must not use them
+#define FLASH_LOG_SECTORS_CNT           (16)
+#define FLASH_LOG_FIRST_SECTOR          (NVRAM_FLASH_SECTOR - FLASH_LOG_SECTORS_CNT)
+
+#define FLASH_LOG_RECORDS_PER_SECTOR    \
+  ((FLASH_SECTOR_SIZE - sizeof(flash_log_header_t)) / sizeof(flash_log_record_t))
+
+// One sector is kept erased ahead of the written one
+#define FLASH_LOG_MAX_RECORDS           \
+  ((FLASH_LOG_SECTORS_CNT - 1) * FLASH_LOG_RECORDS_PER_SECTOR)
+
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+void flash_log_init(void);
+void flash_log_handler(void);
+
+void flash_log_start(void);
+void flash_log_stop(void);
+uint8_t flash_log_is_recording(void);
+void flash_log_append(uint16_t min_value, uint16_t max_value, uint16_t avg_value);
+
+uint16_t flash_log_get_count(void);
+uint8_t flash_log_read(uint16_t idx, flash_log_record_t* record);
+
+#endif /* __FLASH_LOG_H */
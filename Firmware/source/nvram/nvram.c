@@ -1,22 +1,80 @@
+//Settings are stored as a log of records in two flash sectors.
+//Save appends records of the changed values only, so no erase is needed.
+//Last valid record of the key is its current value.
+//When the sector is full, latest records of all keys are copied to the other
+//sector (compaction) - this is the only place where a sector is erased.
+//Sector header is written after the copied records, so power loss during
+//compaction keeps the old sector active.
+//Erase doesn't mask interrupts and waits for a window in the running capture,
+//like the erase of "flash_log".
+
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f3_flash.h"
 #include "nvram.h"
+#include "acquisition.h"
 #include "main.h"
 #include "string.h"
 
 /* Private typedef -----------------------------------------------------------*/
 #define NVRAM_FLASH_OK_MASK     0xABCD
 
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;//sector with bigger sequence is the active one
+} nvram_sector_header_t;
+
+// Record: header, data aligned to 4 bytes, CRC of header and data
+typedef struct
+{
+  uint16_t key;
+  uint16_t size;//data size, bytes
+} nvram_record_header_t;
+
+// Layout of the settings before key/record store, used for migration
+typedef struct
+{
+  uint16_t flash_ok_flag;
+  float div_a_coef;
+  float div_b_coef;
+  uint16_t power_off_time;
+} nvram_legacy_data_t;
+
 /* Private define ------------------------------------------------------------*/
-//Number of the sector for storing data
-#define NVRAM_FLASH_SECTOR      (((128 * FLASH_BYTES_PER_KB) / FLASH_SECTOR_SIZE) - 2)
+#define NVRAM_MAGIC             (0x314D564E)//"NVM1"
+
+#define NVRAM_ERASED_KEY        (0xFFFF)
+
+// Sector erase time, us (same as for "flash_log")
+#define NVRAM_ERASE_TIME_US     (40000)
+
+// Max waiting of the capture window for the erase, ms
+// After it erase is done anyway - running capture is only delayed
+#define NVRAM_ERASE_WAIT_MS     (200)
 
 /* Private macro -------------------------------------------------------------*/
+#define NVRAM_SECTOR_ADDR(idx)  \
+  (FLASH_BASE + (uint32_t)(NVRAM_FLASH_SECTOR + (idx)) * FLASH_SECTOR_SIZE)
+
+#define NVRAM_ALIGN4(size)      (((size) + 3) & ~3)
+
+#define NVRAM_RECORD_SIZE(data_size)    (sizeof(nvram_record_header_t) + \
+  NVRAM_ALIGN4(data_size) + sizeof(uint32_t))
+
 /* Private variables ---------------------------------------------------------*/
 nvram_data_t nvram_data;
 
-/* Private function prototypes -----------------------------------------------*/
+uint8_t nvram_sector = 0;//active sector, 0 or 1
+uint32_t nvram_sequence = 0;//of the active sector, 0 - store is empty
+uint16_t nvram_free_offset = 0;//free space of the active sector
 
+//Address of the latest valid record of each key, 0 - no record
+uint32_t nvram_record_addr[NVRAM_KEY_COUNT];
+
+/* Private function prototypes -----------------------------------------------*/
+void nvram_mount(void);
+void nvram_compact(void);
+void nvram_read_legacy_data(void);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -25,24 +83,197 @@ void nvram_use_dafault_settings(void)
   nvram_data.div_a_coef = 1.0f;
   nvram_data.div_b_coef = 1.0f;
   nvram_data.power_off_time = 30;
-  nvram_data.flash_ok_flag = NVRAM_FLASH_OK_MASK;
+  for (uint8_t i = 0; i < ADC_OPAMP_GAINS_CNT; i++)
+    nvram_data.pga_gain_coef[i] = 1.0f;
+  
+  //Values measured before zero calibration was added:
+  //11 at 10 kHz (longest sampling time), 7 at higher rates
+  for (uint8_t i = 0; i < ADC_SAMPLE_TIMES_CNT; i++)
+    nvram_data.adc_zero_offsets[i] = 7;
+  nvram_data.adc_zero_offsets[ADC_SAMPLE_TIMES_CNT - 1] = 11;
 }
 
 void nvram_read_data(void)
 {
-  uint32_t address_src = FLASH_BASE + NVRAM_FLASH_SECTOR * FLASH_SECTOR_SIZE;
-  flash_read(address_src, (uint8_t*)&nvram_data, sizeof(nvram_data));
-  if (nvram_data.flash_ok_flag != NVRAM_FLASH_OK_MASK)
+  nvram_use_dafault_settings();
+  nvram_mount();
+  if (nvram_sequence == 0)
   {
-    nvram_use_dafault_settings();
+    nvram_read_legacy_data();
+    return;
   }
+
+  //Missing record - default value is kept
+  nvram_read_record(NVRAM_KEY_DIV_A_COEF, &nvram_data.div_a_coef, sizeof(float));
+  nvram_read_record(NVRAM_KEY_DIV_B_COEF, &nvram_data.div_b_coef, sizeof(float));
+  nvram_read_record(NVRAM_KEY_POWER_OFF_TIME,
+    &nvram_data.power_off_time, sizeof(uint16_t));
+  nvram_read_record(NVRAM_KEY_PGA_GAIN_COEF,
+    nvram_data.pga_gain_coef, sizeof(nvram_data.pga_gain_coef));
+  nvram_read_record(NVRAM_KEY_ADC_ZERO_OFFSETS,
+    nvram_data.adc_zero_offsets, sizeof(nvram_data.adc_zero_offsets));
 }
 
-// Save "nvram_data" to the Flash
+// Save "nvram_data" to the Flash, only changed values are written
 void nvram_save_current_settings(void)
 {
-  flash_erase_sector(NVRAM_FLASH_SECTOR);
-  uint32_t address_dst = FLASH_BASE + NVRAM_FLASH_SECTOR * FLASH_SECTOR_SIZE;
-  flash_write(address_dst, (uint8_t*)&nvram_data, sizeof(nvram_data));
+  nvram_write_record(NVRAM_KEY_DIV_A_COEF, &nvram_data.div_a_coef, sizeof(float));
+  nvram_write_record(NVRAM_KEY_DIV_B_COEF, &nvram_data.div_b_coef, sizeof(float));
+  nvram_write_record(NVRAM_KEY_POWER_OFF_TIME,
+    &nvram_data.power_off_time, sizeof(uint16_t));
+  nvram_write_record(NVRAM_KEY_PGA_GAIN_COEF,
+    nvram_data.pga_gain_coef, sizeof(nvram_data.pga_gain_coef));
+  nvram_write_record(NVRAM_KEY_ADC_ZERO_OFFSETS,
+    nvram_data.adc_zero_offsets, sizeof(nvram_data.adc_zero_offsets));
+}
+
+// Read latest value of the key
+// Return 0 if there is no record or its size is different
+uint8_t nvram_read_record(nvram_key_t key, void* data, uint16_t size)
+{
+  if ((key >= NVRAM_KEY_COUNT) || (nvram_record_addr[key] == 0))
+    return 0;
+
+  nvram_record_header_t* header = (nvram_record_header_t*)nvram_record_addr[key];
+  if (header->size != size)
+    return 0;
+
+  flash_read(nvram_record_addr[key] + sizeof(nvram_record_header_t), (uint8_t*)data, size);
+  return 1;
+}
+
+// Append new value of the key, nothing is written if value is not changed
+// Return 0 if value can't be written
+uint8_t nvram_write_record(nvram_key_t key, const void* data, uint16_t size)
+{
+  uint32_t buf[NVRAM_RECORD_SIZE(NVRAM_MAX_DATA_SIZE) / 4];
+
+  if ((key >= NVRAM_KEY_COUNT) || (size > NVRAM_MAX_DATA_SIZE))
+    return 0;
+
+  if (nvram_record_addr[key] != 0)
+  {
+    nvram_record_header_t* header = (nvram_record_header_t*)nvram_record_addr[key];
+    if ((header->size == size) && (memcmp(
+        (void*)(nvram_record_addr[key] + sizeof(nvram_record_header_t)), data, size) == 0))
+      return 1;
+  }
+
+  uint16_t record_size = NVRAM_RECORD_SIZE(size);
+  if ((nvram_sequence == 0) || ((nvram_free_offset + record_size) > FLASH_SECTOR_SIZE))
+  {
+    nvram_compact();
+    if ((nvram_free_offset + record_size) > FLASH_SECTOR_SIZE)
+      return 0;
+  }
+
+  memset(buf, 0, sizeof(buf));
+  nvram_record_header_t* header = (nvram_record_header_t*)buf;
+  header->key = key;
+  header->size = size;
+  memcpy(&buf[1], data, size);
+  uint16_t crc_words = (record_size / 4) - 1;
+  buf[crc_words] = flash_calc_crc(buf, crc_words);
+
+  uint32_t address_dst = NVRAM_SECTOR_ADDR(nvram_sector) + nvram_free_offset;
+  flash_write(address_dst, (uint8_t*)buf, record_size);
+  nvram_free_offset += record_size;
+  if (memcmp((void*)address_dst, buf, record_size) != 0)
+    return 0;//flash error, record is skipped by CRC check
+
+  nvram_record_addr[key] = address_dst;
+  return 1;
+}
+
+//*****************************************************************************
+
+// Find active sector and latest records of all keys
+void nvram_mount(void)
+{
+  memset(nvram_record_addr, 0, sizeof(nvram_record_addr));
+  nvram_sequence = 0;
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    nvram_sector_header_t* header = (nvram_sector_header_t*)NVRAM_SECTOR_ADDR(i);
+    if ((header->magic == NVRAM_MAGIC) && (header->sequence != 0xFFFFFFFF) &&
+        (header->sequence > nvram_sequence))
+    {
+      nvram_sequence = header->sequence;
+      nvram_sector = i;
+    }
+  }
+  if (nvram_sequence == 0)
+    return;
+
+  uint32_t sector_addr = NVRAM_SECTOR_ADDR(nvram_sector);
+  uint16_t offset = sizeof(nvram_sector_header_t);
+  while ((offset + NVRAM_RECORD_SIZE(0)) <= FLASH_SECTOR_SIZE)
+  {
+    nvram_record_header_t* header = (nvram_record_header_t*)(sector_addr + offset);
+    if (header->key == NVRAM_ERASED_KEY)
+      break;//free space
+
+    uint16_t record_size = NVRAM_RECORD_SIZE(header->size);
+    if ((header->size > NVRAM_MAX_DATA_SIZE) || ((offset + record_size) > FLASH_SECTOR_SIZE))
+    {
+      offset = FLASH_SECTOR_SIZE;//torn record - sector is compacted by next write
+      break;
+    }
+
+    uint16_t crc_words = (record_size / 4) - 1;
+    const uint32_t* words = (const uint32_t*)header;
+    if ((header->key < NVRAM_KEY_COUNT) &&
+        (words[crc_words] == flash_calc_crc(words, crc_words)))
+    {
+      nvram_record_addr[header->key] = (uint32_t)header;
+    }
+    offset += record_size;
+  }
+  nvram_free_offset = offset;
+}
+
+// Copy latest records to the other sector and make it active
+void nvram_compact(void)
+{
+  //Legacy settings are kept in sector 0 until store is created
+  uint8_t target = (nvram_sequence == 0) ? 1 : (nvram_sector ^ 1);
+  uint32_t target_addr = NVRAM_SECTOR_ADDR(target);
+  uint16_t offset = sizeof(nvram_sector_header_t);
+  uint32_t wait_timer;
+
+  START_TIMER(wait_timer, NVRAM_ERASE_WAIT_MS);
+  while ((acquisition_is_flash_free(NVRAM_ERASE_TIME_US) == 0) &&
+         (TIMER_ELAPSED(wait_timer) == 0)) {};
+  flash_erase_sector_background(NVRAM_FLASH_SECTOR + target);
+  for (uint8_t key = 0; key < NVRAM_KEY_COUNT; key++)
+  {
+    if (nvram_record_addr[key] == 0)
+      continue;
+
+    nvram_record_header_t* header = (nvram_record_header_t*)nvram_record_addr[key];
+    uint16_t record_size = NVRAM_RECORD_SIZE(header->size);
+    flash_write(target_addr + offset, (uint8_t*)nvram_record_addr[key], record_size);
+    nvram_record_addr[key] = target_addr + offset;
+    offset += record_size;
+  }
+
+  nvram_sector_header_t header = {NVRAM_MAGIC, nvram_sequence + 1};
+  flash_write(target_addr, (uint8_t*)&header, sizeof(header));
+
+  nvram_sector = target;
+  nvram_sequence++;
+  nvram_free_offset = offset;
 }
 
+// Settings saved by the old firmware, written to the store by next save
+void nvram_read_legacy_data(void)
+{
+  nvram_legacy_data_t legacy_data;
+  flash_read(NVRAM_SECTOR_ADDR(0), (uint8_t*)&legacy_data, sizeof(legacy_data));
+  if (legacy_data.flash_ok_flag != NVRAM_FLASH_OK_MASK)
+    return;
+
+  nvram_data.div_a_coef = legacy_data.div_a_coef;
+  nvram_data.div_b_coef = legacy_data.div_b_coef;
+  nvram_data.power_off_time = legacy_data.power_off_time;
+}
@@ -9,17 +9,38 @@
 /* Exported types ------------------------------------------------------------*/
 typedef struct
 {
-  uint16_t flash_ok_flag;
   float div_a_coef;
   float div_b_coef;
   uint16_t power_off_time;//seconds
+  float pga_gain_coef[ADC_OPAMP_GAINS_CNT];//real/nominal gain of OPAMP PGA
+  uint16_t adc_zero_offsets[ADC_SAMPLE_TIMES_CNT];//ADC1 points at 0V, per sampling time
 } nvram_data_t;
 
+// Keys of the stored records, new keys must be added before NVRAM_KEY_COUNT
+typedef enum
+{
+  NVRAM_KEY_DIV_A_COEF = 0,
+  NVRAM_KEY_DIV_B_COEF,
+  NVRAM_KEY_POWER_OFF_TIME,
+  NVRAM_KEY_PGA_GAIN_COEF,
+  NVRAM_KEY_ADC_ZERO_OFFSETS,
+  NVRAM_KEY_COUNT,//LAST!
+} nvram_key_t;
+
 /* Exported constants --------------------------------------------------------*/
+//Number of the first sector for storing data, two sectors are used
+#define NVRAM_FLASH_SECTOR      (((128 * FLASH_BYTES_PER_KB) / FLASH_SECTOR_SIZE) - 2)
+
+//Maximum size of the record data, bytes
+#define NVRAM_MAX_DATA_SIZE     (64)
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 void nvram_use_dafault_settings(void);
 void nvram_save_current_settings(void);
 void nvram_read_data(void);
 
+uint8_t nvram_read_record(nvram_key_t key, void* data, uint16_t size);
+uint8_t nvram_write_record(nvram_key_t key, const void* data, uint16_t size);
+
 #endif /* __NVRAM_H */
@@ -28,6 +28,23 @@ void flash_erase_sector(uint8_t sector_idx)
   FLASH_Lock();
 }
 
+// Erase without masking interrupts - capture ISRs are running during erase.
+// Waiting loop is executed from CCM RAM, so it is not stalled by Flash,
+// ISRs and vectors are in RAM too (see USE_CCM_RAM_CODE).
+CCM_RAM_FUNC void flash_erase_sector_background(uint8_t sector_idx)
+{
+  FLASH_Unlock();
+  FLASH->SR = FLASH_FLAG_ALL;
+  
+  FLASH->CR |= FLASH_CR_PER;
+  FLASH->AR = FLASH_BASE + FLASH_SECTOR_SIZE * sector_idx;
+  FLASH->CR |= FLASH_CR_STRT;
+  while (FLASH->SR & FLASH_SR_BSY) {};
+  FLASH->CR &= ~FLASH_CR_PER;
+  
+  FLASH_Lock();
+}
+
 
 //   ,    
 // address_dst -    
@@ -66,3 +83,13 @@ void flash_read(uint32_t src_addr, uint8_t *buf, uint16_t size)
 {
     memcpy((void *)buf, (void *)src_addr, size);
 }
+
+// CRC-32 (Ethernet polynomial) by hardware CRC unit, reset state of the unit is used
+// CRC unit clock is enabled by "hardware_init_all"
+uint32_t flash_calc_crc(const uint32_t* data, uint16_t words_cnt)
+{
+  CRC->CR = CRC_CR_RESET;
+  for (uint16_t i = 0; i < words_cnt; i++)
+    CRC->DR = data[i];
+  return CRC->DR;
+}
@@ -14,7 +14,9 @@
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 void flash_erase_sector(uint8_t sector_idx);
+void flash_erase_sector_background(uint8_t sector_idx);
 void flash_write(uint32_t address_dst, uint8_t *buf, uint16_t size);
 void flash_read(uint32_t src_addr, uint8_t *buf, uint16_t size);
+uint32_t flash_calc_crc(const uint32_t* data, uint16_t words_cnt);
 
 #endif /* __STM32F3_FLASH_H */
@@ -137,10 +137,11 @@ void PendSV_Handler(void)
 
 /**
   * @brief  This function handles SysTick Handler.
+  *         Located in CCM RAM - ticks are counted during Flash erase.
   * @param  None
   * @retval None
   */
-void SysTick_Handler(void)
+CCM_RAM_FUNC void SysTick_Handler(void)
 {
   ms_tick++;
 }
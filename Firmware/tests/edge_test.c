@@ -0,0 +1,206 @@
+//Host test of edge parameters measurement ("edge_measure.c")
+//Square waves with RC and underdamped second order edges are generated,
+//expected times and overshoot are found from the same continuous functions
+//in double precision.
+
+/* Includes ------------------------------------------------------------------*/
+#include "edge_measure.h"
+#include "hardware.h"
+#include <stdio.h>
+#include <math.h>
+
+/* Private define ------------------------------------------------------------*/
+#define EDGE_TEST_PI                    (3.14159265358979323846)
+
+#define EDGE_TEST_SAMPLE_RATE           (1e6)//Hz
+#define EDGE_TEST_POINTS                (2000)
+#define EDGE_TEST_HALF_PERIOD           (200)//samples
+#define EDGE_TEST_FIRST_EDGE            (20.3)//samples
+
+// Levels of the generated signal, fused points
+// Overshoot of the 2nd order edges must fit 0..65535
+#define EDGE_TEST_LOW                   (15000)
+#define EDGE_TEST_HIGH                  (45000)
+
+// Max error of rise/fall time, samples
+// Crossings are linearly interpolated, so fast edges are measured less precisely
+#define EDGE_TEST_TIME_TOLERANCE        (0.25)
+// Max error of overshoot, % of the swing
+#define EDGE_TEST_OVERSHOOT_TOLERANCE   (0.5)
+// Max error of settling time, samples: end of settling is the last sample
+// outside the band, expected value is found for continuous signal
+#define EDGE_TEST_SETTLING_TOLERANCE    (1.0)
+
+/* Private typedef -----------------------------------------------------------*/
+// Normalized step response: 0 before the edge, 1 after settling, t - samples
+typedef double (*edge_test_step_t)(double t);
+
+/* Private variables ---------------------------------------------------------*/
+// Parameters of the step responses, samples
+double edge_test_tau = 10.0;
+double edge_test_zeta = 0.5;
+double edge_test_wn = 0.2;//rad/sample
+
+// Stride 2 buffer has ADC1 values between fused samples
+uint16_t edge_test_buffer[EDGE_TEST_POINTS * 2];
+uint32_t edge_test_failed = 0;
+
+/* Private functions ---------------------------------------------------------*/
+
+// Stubs of "hardware.c"
+uint32_t hardware_dwt_get(void)
+{
+  return 0;
+}
+
+void hardware_profile_store(hardware_profile_item_t item, uint32_t start_ticks)
+{
+  (void)item;
+  (void)start_ticks;
+}
+
+double edge_test_rc_step(double t)
+{
+  if (t <= 0.0)
+    return 0.0;
+  return 1.0 - exp(-t / edge_test_tau);
+}
+
+double edge_test_second_order_step(double t)
+{
+  if (t <= 0.0)
+    return 0.0;
+  double wd = edge_test_wn * sqrt(1.0 - edge_test_zeta * edge_test_zeta);
+  double phi = acos(edge_test_zeta);
+  return 1.0 - exp(-edge_test_zeta * edge_test_wn * t) * sin(wd * t + phi) / sin(phi);
+}
+
+// First time when "step" crosses "level", samples
+double edge_test_cross_time(edge_test_step_t step, double level)
+{
+  double t = 0.0;
+  while (step(t + 0.5) < level)
+    t += 0.5;
+  double lo = t;
+  double hi = t + 0.5;
+  for (uint8_t i = 0; i < 60; i++)
+  {
+    double mid = (lo + hi) / 2.0;
+    if (step(mid) < level)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return (lo + hi) / 2.0;
+}
+
+// Rising edge at 0, falling edge at EDGE_TEST_HALF_PERIOD, and so on
+// Signal starts at settled low level
+void edge_test_generate(edge_test_step_t step, uint8_t stride)
+{
+  double swing = EDGE_TEST_HIGH - EDGE_TEST_LOW;
+  for (uint16_t i = 0; i < EDGE_TEST_POINTS; i++)
+  {
+    //first edge is between samples, so crossings are interpolated
+    double t = (double)i - EDGE_TEST_FIRST_EDGE;
+    double value = EDGE_TEST_LOW;
+    if (t > 0.0)
+    {
+      uint16_t half = (uint16_t)(t / EDGE_TEST_HALF_PERIOD);
+      double part = step(t - half * EDGE_TEST_HALF_PERIOD);
+      if (half & 1)
+        value = EDGE_TEST_HIGH - swing * part;
+      else
+        value = EDGE_TEST_LOW + swing * part;
+    }
+    edge_test_buffer[i * stride] = (uint16_t)lrint(value);
+    if (stride > 1)
+      edge_test_buffer[i * stride + 1] = 0xFFFF;//other channel must be ignored
+  }
+}
+
+void edge_test_check(const char* name, double value, double expected, double tolerance)
+{
+  uint8_t ok = (fabs(value - expected) <= tolerance);
+  printf("%-24s %10.3f expected %10.3f %s\n", name, value, expected, ok ? "" : "FAIL");
+  if (!ok)
+    edge_test_failed++;
+}
+
+// Measure generated waveform and compare with expected values
+void edge_test_run(const char* name, edge_test_step_t step, uint8_t stride)
+{
+  edge_test_generate(step, stride);
+  const uint16_t* samples = edge_test_buffer;
+  adc_edge_data_t result = edge_measure_process(samples, EDGE_TEST_POINTS, stride, 
+    EDGE_TEST_LOW, EDGE_TEST_HIGH, EDGE_TEST_SAMPLE_RATE);
+
+  //Thresholds are integer, as in "edge_measure_process"
+  double swing = EDGE_TEST_HIGH - EDGE_TEST_LOW;
+  double low = (double)((int32_t)swing / 10) / swing;
+  double middle = (double)((int32_t)swing / 2) / swing;
+  double rise = edge_test_cross_time(step, 1.0 - low) - edge_test_cross_time(step, low);
+
+  //Overshoot of the sampled response, settling time of the continuous one
+  double peak = 0.0;
+  double settled = 0.0;
+  double first_sample = ceil(EDGE_TEST_FIRST_EDGE) - EDGE_TEST_FIRST_EDGE;
+  for (uint16_t i = 0; i < EDGE_TEST_HALF_PERIOD; i++)
+  {
+    if (step(first_sample + i) > peak)
+      peak = step(first_sample + i);
+  }
+  for (double t = EDGE_TEST_HALF_PERIOD - 0.001; t > 0.0; t -= 0.001)
+  {
+    if (fabs(step(t) - 1.0) > (1.0 / 20.0))
+    {
+      settled = t;
+      break;
+    }
+  }
+  double settling = settled - edge_test_cross_time(step, middle);
+
+  //Edges that are finished in the capture (edge takes less than 1/4 of half period)
+  uint16_t rising_cnt = 0;
+  uint16_t falling_cnt = 0;
+  double edge = EDGE_TEST_FIRST_EDGE + EDGE_TEST_HALF_PERIOD / 4;
+  for (uint16_t n = 0; edge < EDGE_TEST_POINTS; n++, edge += EDGE_TEST_HALF_PERIOD)
+  {
+    if (n & 1)
+      falling_cnt++;
+    else
+      rising_cnt++;
+  }
+
+  double us = 1e6 / EDGE_TEST_SAMPLE_RATE;
+  printf("== %s\n", name);
+  edge_test_check("rising edges", result.rising_cnt, rising_cnt, 0.0);
+  edge_test_check("falling edges", result.falling_cnt, falling_cnt, 0.0);
+  edge_test_check("rise time, us", result.rise_time * 1e6, rise * us, 
+    EDGE_TEST_TIME_TOLERANCE * us);
+  edge_test_check("fall time, us", result.fall_time * 1e6, rise * us, 
+    EDGE_TEST_TIME_TOLERANCE * us);
+  edge_test_check("overshoot, %", result.overshoot, (peak - 1.0) * 100.0, 
+    EDGE_TEST_OVERSHOOT_TOLERANCE);
+  edge_test_check("settling time, us", result.settling_time * 1e6, settling * us, 
+    EDGE_TEST_SETTLING_TOLERANCE * us);
+}
+
+int main(void)
+{
+  edge_test_run("RC, tau 10", edge_test_rc_step, 1);
+  edge_test_tau = 3.0;
+  edge_test_run("RC, tau 3, pairs", edge_test_rc_step, 2);
+  edge_test_run("2nd order, zeta 0.5", edge_test_second_order_step, 1);
+  edge_test_zeta = 0.3;
+  edge_test_wn = 0.4;
+  edge_test_run("2nd order, zeta 0.3, pairs", edge_test_second_order_step, 2);
+
+  if (edge_test_failed)
+  {
+    printf("FAILED: %u checks\n", (unsigned)edge_test_failed);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
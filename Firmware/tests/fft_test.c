@@ -0,0 +1,136 @@
+//Host test of fixed-point FFT ("fft.c")
+//Results of "fft_apply_window" and "fft_real" are compared with
+//double precision Hann window and DFT of the same input.
+
+/* Includes ------------------------------------------------------------------*/
+#include "fft.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* Private define ------------------------------------------------------------*/
+#define FFT_TEST_PI                     (3.14159265358979323846)
+
+// Max error of window output, Q15 LSB:
+// window coefficient rounding (0.5), 32767 scale of the window (1), truncating shift (1)
+#define FFT_TEST_WINDOW_TOLERANCE       (2.5)
+
+// Max error of FFT output, Q15 LSB (FFT output is DFT / FFT_SIZE):
+// each stage (radix-2, radix-4, split) truncates halving add/sub and
+// twiddle products (about 2 LSB), errors of earlier stages are scaled
+// by 1/2 at each following stage
+#define FFT_TEST_FFT_TOLERANCE          (6.0)
+
+/* Private variables ---------------------------------------------------------*/
+fft_complex_t fft_test_buffer[FFT_SIZE];
+double fft_test_input[FFT_SIZE];
+uint32_t fft_test_failed = 0;
+
+/* Private functions ---------------------------------------------------------*/
+
+// Sample "i" of the packed buffer
+int16_t fft_test_get_sample(const fft_complex_t* buffer, uint16_t i)
+{
+  fft_complex_t x = buffer[i / 2];
+  return (i & 1) ? FFT_IM(x) : FFT_RE(x);
+}
+
+// Check result of "fft_apply_window"
+void fft_test_window(const char* name)
+{
+  double max_error = 0.0;
+  for (uint16_t i = 0; i < FFT_SIZE; i++)
+  {
+    uint16_t k = (i < (FFT_SIZE / 2)) ? i : (FFT_SIZE - 1 - i);//window is symmetric
+    double window = 0.5 - 0.5 * cos(2.0 * FFT_TEST_PI * k / (FFT_SIZE - 1));
+    double error = fabs(fft_test_get_sample(fft_test_buffer, i) - fft_test_input[i] * window);
+    if (error > max_error)
+      max_error = error;
+  }
+
+  printf("%-16s window max error %.2f LSB\n", name, max_error);
+  if (max_error > FFT_TEST_WINDOW_TOLERANCE)
+    fft_test_failed++;
+}
+
+// Check result of "fft_real", "windowed" - packed input of FFT
+void fft_test_transform(const char* name, const fft_complex_t* windowed)
+{
+  double max_error = 0.0;
+  for (uint16_t k = 0; k < FFT_BINS_CNT; k++)
+  {
+    double re = 0.0;
+    double im = 0.0;
+    for (uint16_t n = 0; n < FFT_SIZE; n++)
+    {
+      double angle = 2.0 * FFT_TEST_PI * (double)((uint32_t)k * n % FFT_SIZE) / FFT_SIZE;
+      double x = fft_test_get_sample(windowed, n);
+      re += x * cos(angle);
+      im -= x * sin(angle);
+    }
+    re /= FFT_SIZE;
+    im /= FFT_SIZE;
+
+    fft_complex_t result = fft_get_bin(fft_test_buffer, k);
+    double error = hypot(FFT_RE(result) - re, FFT_IM(result) - im);
+    if (error > max_error)
+      max_error = error;
+  }
+
+  printf("%-16s FFT max error %.2f LSB\n", name, max_error);
+  if (max_error > FFT_TEST_FFT_TOLERANCE)
+    fft_test_failed++;
+}
+
+// Run window and FFT on "fft_test_input"
+void fft_test_run(const char* name)
+{
+  static fft_complex_t windowed[FFT_SIZE / 2];
+
+  for (uint16_t i = 0; i < (FFT_SIZE / 2); i++)
+    fft_test_buffer[i] = 
+      FFT_PACK(lrint(fft_test_input[2 * i]), lrint(fft_test_input[2 * i + 1]));
+
+  fft_apply_window(fft_test_buffer);
+  fft_test_window(name);
+
+  for (uint16_t i = 0; i < (FFT_SIZE / 2); i++)
+    windowed[i] = fft_test_buffer[i];
+  fft_real(fft_test_buffer);
+  fft_test_transform(name, windowed);
+}
+
+int main(void)
+{
+  fft_init();
+
+  for (uint16_t i = 0; i < FFT_SIZE; i++)
+    fft_test_input[i] = 30000.0;
+  fft_test_run("dc");
+
+  for (uint16_t i = 0; i < FFT_SIZE; i++)
+    fft_test_input[i] = 32000.0 * sin(2.0 * FFT_TEST_PI * 50.0 * i / FFT_SIZE);
+  fft_test_run("tone bin 50");
+
+  for (uint16_t i = 0; i < FFT_SIZE; i++)
+    fft_test_input[i] = 16000.0 * sin(2.0 * FFT_TEST_PI * 123.4 * i / FFT_SIZE) + 
+      8000.0 * cos(2.0 * FFT_TEST_PI * 400.7 * i / FFT_SIZE);
+  fft_test_run("two tones");
+
+  for (uint16_t i = 0; i < FFT_SIZE; i++)
+    fft_test_input[i] = ((i / 20) & 1) ? 32767.0 : -32768.0;
+  fft_test_run("square");
+
+  srand(1);
+  for (uint16_t i = 0; i < FFT_SIZE; i++)
+    fft_test_input[i] = (double)(rand() % 65536 - 32768);
+  fft_test_run("noise");
+
+  if (fft_test_failed)
+  {
+    printf("FAILED: %u checks\n", (unsigned)fft_test_failed);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,22 @@
+/* Host replacement of main.h for unit tests ---------------------------------*/
+#ifndef __MAIN_H
+#define __MAIN_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f30x.h"
+#include "config.h"
+
+/* Exported types ------------------------------------------------------------*/
+extern volatile uint32_t ms_tick;
+
+/* Exported macro ------------------------------------------------------------*/
+#define START_TIMER(x, duration)  (x = (ms_tick + duration))
+#define TIMER_ELAPSED(x)  ((ms_tick > x) ? 1 : 0)
+
+#define ENTER_CRITICAL(x)       (void)(x = 0)
+#define LEAVE_CRITICAL(x)       (void)(x)
+
+// Code placement doesn't matter on host
+#define CCM_RAM_FUNC
+
+#endif /* __MAIN_H */
@@ -0,0 +1,65 @@
+/* Host replacement of the device header for unit tests ---------------------*/
+/* Only types and Cortex-M4 SIMD intrinsics used by the tested code are here  */
+#ifndef __STM32F30x_H
+#define __STM32F30x_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported functions ------------------------------------------------------- */
+// Signed halfwords of the packed value
+#define SHIM_LO(x)              ((int32_t)(int16_t)((x) & 0xFFFF))
+#define SHIM_HI(x)              ((int32_t)(int16_t)((x) >> 16))
+#define SHIM_PACK(lo, hi)       \
+  ((uint32_t)(uint16_t)(int16_t)(lo) | ((uint32_t)(uint16_t)(int16_t)(hi) << 16))
+
+// Halving add/sub: each result is shifted right by 1 (arithmetic)
+static inline uint32_t __SHADD16(uint32_t x, uint32_t y)
+{
+  return SHIM_PACK((SHIM_LO(x) + SHIM_LO(y)) >> 1, (SHIM_HI(x) + SHIM_HI(y)) >> 1);
+}
+
+static inline uint32_t __SHSUB16(uint32_t x, uint32_t y)
+{
+  return SHIM_PACK((SHIM_LO(x) - SHIM_LO(y)) >> 1, (SHIM_HI(x) - SHIM_HI(y)) >> 1);
+}
+
+// lo = x.lo - y.hi, hi = x.hi + y.lo
+static inline uint32_t __SHASX(uint32_t x, uint32_t y)
+{
+  return SHIM_PACK((SHIM_LO(x) - SHIM_HI(y)) >> 1, (SHIM_HI(x) + SHIM_LO(y)) >> 1);
+}
+
+// lo = x.lo + y.hi, hi = x.hi - y.lo
+static inline uint32_t __SHSAX(uint32_t x, uint32_t y)
+{
+  return SHIM_PACK((SHIM_LO(x) + SHIM_HI(y)) >> 1, (SHIM_HI(x) - SHIM_LO(y)) >> 1);
+}
+
+static inline uint32_t __SMUAD(uint32_t x, uint32_t y)
+{
+  return (uint32_t)(SHIM_LO(x) * SHIM_LO(y) + SHIM_HI(x) * SHIM_HI(y));
+}
+
+static inline uint32_t __SMUSD(uint32_t x, uint32_t y)
+{
+  return (uint32_t)(SHIM_LO(x) * SHIM_LO(y) - SHIM_HI(x) * SHIM_HI(y));
+}
+
+static inline uint32_t __SMUADX(uint32_t x, uint32_t y)
+{
+  return (uint32_t)(SHIM_LO(x) * SHIM_HI(y) + SHIM_HI(x) * SHIM_LO(y));
+}
+
+static inline uint32_t __RBIT(uint32_t value)
+{
+  uint32_t result = 0;
+  for (uint8_t i = 0; i < 32; i++)
+  {
+    result = (result << 1) | (value & 1);
+    value >>= 1;
+  }
+  return result;
+}
+
+#endif /* __STM32F30x_H */